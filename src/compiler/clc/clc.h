@@ -214,6 +214,10 @@ const nir_shader *clc_libclc_get_clc_shader(struct clc_libclc *lib);
 
 void clc_libclc_serialize(struct clc_libclc *lib, void **serialized, size_t *size);
 void clc_libclc_free_serialized(void *serialized);
+/* The function impls of a deserialized library are read when the first
+ * kernel calling them is compiled, so the shader returned by
+ * clc_libclc_get_clc_shader() only has impls for the functions used so far.
+ */
 struct clc_libclc *clc_libclc_deserialize(const void *serialized, size_t size);
 
 /* Forward declare */
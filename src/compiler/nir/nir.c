@@ -205,6 +205,7 @@ nir_shader_create(void *mem_ctx,
 #ifndef NDEBUG
    nir_process_debug_variable();
 #endif
+   nir_pass_profile_init();
 
    exec_list_make_empty(&shader->variables);
 
@@ -573,6 +574,7 @@ nir_function_impl_create_bare(nir_shader *shader)
    impl->num_blocks = 0;
    impl->valid_metadata = nir_metadata_none;
    impl->structured = true;
+   impl->num_instr_changes = 0;
 
    /* create start & end blocks */
    nir_block *start_block = nir_block_create(shader);
@@ -608,15 +610,11 @@ nir_block_create(nir_shader *shader)
    block->successors[0] = block->successors[1] = NULL;
    block->predecessors = _mesa_pointer_set_create(block);
    block->imm_dom = NULL;
-   /* XXX maybe it would be worth it to defer allocation?  This
-    * way it doesn't get allocated for shader refs that never run
-    * nir_calc_dominance?  For example, state-tracker creates an
-    * initial IR, clones that, runs appropriate lowering pass, passes
-    * to driver which does common lowering/opt, and then stores ref
-    * which is later used to do state specific lowering and futher
-    * opt.  Do any of the references not need dominance metadata?
+   /* The dominance frontier is allocated by nir_calc_dominance, so blocks
+    * that never need dominance (deserialized libraries, shaders that are
+    * only cloned or cached) don't pay for the set.
     */
-   block->dom_frontier = _mesa_pointer_set_create(block);
+   block->dom_frontier = NULL;
 
    exec_list_make_empty(&block->instr_list);
 
@@ -1078,6 +1076,7 @@ add_use_cb(nir_src *src, void *state)
 
    nir_src_set_parent_instr(src, instr);
    list_addtail(&src->use_link, &src->ssa->uses);
+   nir_instr_mark_changed(src->ssa->parent_instr);
 
    return true;
 }
@@ -1104,6 +1103,7 @@ add_defs_uses(nir_instr *instr)
 {
    nir_foreach_src(instr, add_use_cb, instr);
    nir_foreach_def(instr, add_ssa_def_cb, instr);
+   nir_instr_mark_changed(instr);
 }
 
 void
@@ -1198,8 +1198,10 @@ remove_use_cb(nir_src *src, void *state)
 {
    (void)state;
 
-   if (src_is_valid(src))
+   if (src_is_valid(src)) {
       list_del(&src->use_link);
+      nir_instr_mark_changed(src->ssa->parent_instr);
+   }
 
    return true;
 }
@@ -1514,8 +1516,10 @@ nir_src_get_block(nir_src *src)
 static void
 src_remove_all_uses(nir_src *src)
 {
-   if (src && src_is_valid(src))
+   if (src && src_is_valid(src)) {
       list_del(&src->use_link);
+      nir_instr_mark_changed(src->ssa->parent_instr);
+   }
 }
 
 static void
@@ -1529,12 +1533,14 @@ src_add_all_uses(nir_src *src, nir_instr *parent_instr, nir_if *parent_if)
 
    if (parent_instr) {
       nir_src_set_parent_instr(src, parent_instr);
+      nir_instr_mark_changed(parent_instr);
    } else {
       assert(parent_if);
       nir_src_set_parent_if(src, parent_if);
    }
 
    list_addtail(&src->use_link, &src->ssa->uses);
+   nir_instr_mark_changed(src->ssa->parent_instr);
 }
 
 void
@@ -1549,6 +1555,7 @@ nir_instr_clear_src(nir_instr *instr, nir_src *src)
 {
    src_remove_all_uses(src);
    *src = NIR_SRC_INIT;
+   nir_instr_mark_changed(instr);
 }
 
 void
@@ -42,6 +42,7 @@
 #include "util/macros.h"
 #include "util/ralloc.h"
 #include "util/set.h"
+#include "util/u_atomic.h"
 #include "util/u_math.h"
 #include "nir_defines.h"
 #include "nir_shader_compiler_options.h"
@@ -943,6 +944,12 @@ typedef struct nir_instr {
     */
    bool has_debug_info;
 
+   /* Consumers of nir_metadata_instr_changes which haven't looked at this
+    * instruction since it last changed, one bit per entry of
+    * nir_function_impl::instr_changes.
+    */
+   uint8_t changed;
+
    /** generic instruction index. */
    uint32_t index;
 } nir_instr;
@@ -2979,7 +2986,9 @@ typedef struct nir_block {
    unsigned num_dom_children;
    nir_block **dom_children;
 
-   /* Set of nir_blocks on the dominance frontier of this block */
+   /* Set of nir_blocks on the dominance frontier of this block, NULL until
+    * dominance is first computed for the block.
+    */
    struct set *dom_frontier;
 
    /*
@@ -3357,6 +3366,28 @@ typedef enum {
     */
    nir_metadata_divergence = 0x40,
 
+   /** Indicates that nir_instr::changed is valid.
+    *
+    * nir_instr_insert(), nir_instr_remove(), nir_src_rewrite() and the
+    * nir_def_rewrite_uses() family mark the instructions whose sources or
+    * uses they change, as well as the instructions they insert.  Peephole
+    * passes such as nir_algebraic_impl() use that to only revisit those
+    * instructions and their users.  It can't be computed through
+    * nir_metadata_require(); consumers set it after looking at every
+    * instruction.
+    *
+    * A pass can preserve this metadata type if it only changes the shader
+    * through those helpers, or calls nir_instr_mark_changed() on each
+    * instruction it modifies in place.  Most passes shouldn't preserve it,
+    * and it isn't part of nir_metadata_all.
+    *
+    * Search helpers and range analysis also read shader_info, for example
+    * workgroup_size, tess.tcs_vertices_out and the float controls mode.
+    * Changing those doesn't touch any instruction, so code which does has
+    * to drop this metadata type by hand.
+    */
+   nir_metadata_instr_changes = 0x80,
+
    /** All control flow metadata
     *
     * This includes all metadata preserved by a pass that preserves control flow
@@ -3371,10 +3402,12 @@ typedef enum {
 
    /** All metadata
     *
-    * This includes all nir_metadata flags except not_properly_reset.  Passes
-    * which do not change the shader in any way should use this.
+    * This includes all nir_metadata flags except not_properly_reset and
+    * instr_changes.  Passes which do not change the shader in any way should
+    * use this.
     */
-   nir_metadata_all = ~nir_metadata_not_properly_reset,
+   nir_metadata_all = ~(nir_metadata_not_properly_reset |
+                        nir_metadata_instr_changes),
 } nir_metadata;
 MESA_DEFINE_CPP_ENUM_BITFIELD_OPERATORS(nir_metadata)
 
@@ -3414,6 +3447,18 @@ typedef struct nir_function_impl {
    nir_metadata valid_metadata;
    nir_variable_mode loop_analysis_indirect_mask;
    bool loop_analysis_force_unroll_sampler_indirect;
+
+   /** Consumers of nir_instr::changed, see nir_metadata_instr_changes.
+    *
+    * Consumer i owns bit i of nir_instr::changed.
+    */
+   struct {
+      const void *key;
+      /* Copy of the consumer's parameters, allocated on the impl. */
+      void *data;
+      unsigned data_size;
+   } instr_changes[8];
+   unsigned num_instr_changes;
 } nir_function_impl;
 
 #define nir_foreach_function_temp_variable(var, impl) \
@@ -3923,6 +3968,18 @@ void nir_shader_preserve_all_metadata(nir_shader *shader);
 /** dirties all metadata and fills it with obviously wrong information */
 void nir_metadata_invalidate(nir_shader *shader);
 
+/**
+ * Returns the bit of nir_instr::changed owned by the consumer identified by
+ * key and its parameters, registering it if needed.  If *all is set, the
+ * bit can't be trusted and the consumer has to look at every instruction.
+ * Either way, it clears the bit on the instructions it looks at.
+ */
+uint8_t nir_metadata_instr_changes_bit(nir_function_impl *impl,
+                                       const void *key, const void *data,
+                                       unsigned data_size, bool *all);
+/** Forgets all consumers of nir_metadata_instr_changes. */
+void nir_metadata_clear_instr_changes(nir_function_impl *impl);
+
 /**
  * Indicate progress on an implementation, preserving only the specified
  * metadata. The supplied progress is returned to improve ergonomics.
@@ -4299,11 +4356,26 @@ bool nir_srcs_equal(nir_src src1, nir_src src2);
 bool nir_instrs_equal(const nir_instr *instr1, const nir_instr *instr2);
 nir_block *nir_src_get_block(nir_src *src);
 
+/** Marks an instruction as changed for nir_metadata_instr_changes.
+ *
+ * Passes which preserve nir_metadata_instr_changes have to call this after
+ * modifying an instruction in place, for example its opcode or swizzles.
+ */
+static inline void
+nir_instr_mark_changed(nir_instr *instr)
+{
+   instr->changed = 0xff;
+}
+
 static inline void
 nir_src_rewrite(nir_src *src, nir_def *new_ssa)
 {
    assert(src->ssa);
    assert(nir_src_is_if(src) ? (nir_src_parent_if(src) != NULL) : (nir_src_parent_instr(src) != NULL));
+   if (!nir_src_is_if(src))
+      nir_instr_mark_changed(nir_src_parent_instr(src));
+   nir_instr_mark_changed(src->ssa->parent_instr);
+   nir_instr_mark_changed(new_ssa->parent_instr);
    list_del(&src->use_link);
    src->ssa = new_ssa;
    list_addtail(&src->use_link, &new_ssa->uses);
@@ -4625,6 +4697,53 @@ should_print_nir(UNUSED nir_shader *shader)
 }
 #endif /* NDEBUG */
 
+/** Per-pass profiling
+ *
+ * When enabled, through NIR_PASS_PROFILE=<file> or
+ * nir_pass_profile_start(), every NIR_PASS records its wall time, the
+ * instruction count before and after, the shader's memory use (debug
+ * builds only) and whether it made progress.  Passes also show up as
+ * Perfetto slices when tracing.
+ */
+typedef struct {
+   bool active;
+   int64_t start_ns;
+   unsigned instr_count;
+   size_t mem_size;
+} nir_pass_profile_sample;
+
+extern bool nir_pass_profile_enabled;
+
+void nir_pass_profile_init(void);
+void nir_pass_profile_start(void);
+void nir_pass_profile_stop(void);
+void nir_pass_profile_reset(void);
+void nir_pass_profile_dump_json(FILE *fp);
+
+void nir_pass_profile_begin_impl(nir_pass_profile_sample *sample,
+                                 nir_shader *shader, const char *pass);
+void nir_pass_profile_end_impl(nir_pass_profile_sample *sample,
+                               nir_shader *shader, const char *pass,
+                               int progress);
+
+static inline void
+nir_pass_profile_begin(nir_pass_profile_sample *sample, nir_shader *shader,
+                       const char *pass)
+{
+   sample->active = unlikely(p_atomic_read(&nir_pass_profile_enabled));
+   if (sample->active)
+      nir_pass_profile_begin_impl(sample, shader, pass);
+}
+
+/* progress is -1 when the pass doesn't report it */
+static inline void
+nir_pass_profile_end(nir_pass_profile_sample *sample, nir_shader *shader,
+                     const char *pass, int progress)
+{
+   if (sample->active)
+      nir_pass_profile_end_impl(sample, shader, pass, progress);
+}
+
 #define _PASS(pass, nir, do_pass)                                       \
    do {                                                                 \
       if (should_skip_nir(#pass)) {                                     \
@@ -4652,7 +4771,11 @@ should_print_nir(UNUSED nir_shader *shader)
    nir_metadata_set_validation_flag(nir);                                                   \
    if (should_print_nir(nir))                                                               \
       printf("%s\n", #pass);                                                                \
-   if (pass(nir, ##__VA_ARGS__)) {                                                          \
+   nir_pass_profile_sample _nir_profile;                                                    \
+   nir_pass_profile_begin(&_nir_profile, nir, #pass);                                       \
+   bool _nir_progress = pass(nir, ##__VA_ARGS__);                                           \
+   nir_pass_profile_end(&_nir_profile, nir, #pass, _nir_progress);                          \
+   if (_nir_progress) {                                                                     \
       nir_validate_shader(nir, "after " #pass " in " __FILE__ ":" NIR_STRINGIZE(__LINE__)); \
       UNUSED bool _;                                                                        \
       progress = true;                                                                      \
@@ -4671,7 +4794,10 @@ should_print_nir(UNUSED nir_shader *shader)
 #define NIR_PASS_V(nir, pass, ...) _PASS(pass, nir, {        \
    if (should_print_nir(nir))                                \
       printf("%s\n", #pass);                                 \
+   nir_pass_profile_sample _nir_profile;                     \
+   nir_pass_profile_begin(&_nir_profile, nir, #pass);        \
    pass(nir, ##__VA_ARGS__);                                 \
+   nir_pass_profile_end(&_nir_profile, nir, #pass, -1);      \
    nir_validate_shader(nir, "after " #pass " in " __FILE__); \
    if (should_print_nir(nir))                                \
       nir_print_shader(nir, stdout);                         \
@@ -4722,6 +4848,94 @@ do {                                                                 \
 #define NIR_LOOP_PASS_NOT_IDEMPOTENT(progress, skip, nir, pass, ...) \
    _NIR_LOOP_PASS(progress, false, skip, nir, pass, ##__VA_ARGS__)
 
+/** Kinds of change a pass can make, for NIR_SCHED_PASS */
+typedef enum {
+   /** Instructions were added or their sources rewritten */
+   nir_opt_changes_instrs = BITFIELD_BIT(0),
+   /** Instructions lost uses and may now be dead or used once */
+   nir_opt_changes_dead   = BITFIELD_BIT(1),
+   /** Control flow or phis changed */
+   nir_opt_changes_cf     = BITFIELD_BIT(2),
+   /** Variables or derefs changed */
+   nir_opt_changes_vars   = BITFIELD_BIT(3),
+
+   nir_opt_changes_all    = BITFIELD_MASK(4),
+} nir_opt_changes;
+
+#define NIR_OPT_SCHEDULE_MAX_PASSES 64
+
+typedef struct {
+   const void *pass_site[NIR_OPT_SCHEDULE_MAX_PASSES];
+   uint32_t pass_epoch[NIR_OPT_SCHEDULE_MAX_PASSES];
+   uint32_t change_epoch[4];
+   uint32_t epoch;
+   unsigned num_passes;
+   bool progress;
+
+   /* Statistics */
+   unsigned iterations;
+   unsigned skipped;
+} nir_opt_schedule;
+
+void nir_opt_schedule_init(nir_opt_schedule *sched);
+bool nir_opt_schedule_iterate(nir_opt_schedule *sched);
+bool nir_opt_schedule_begin_pass(nir_opt_schedule *sched, const void *site,
+                                 uint32_t enabled_by, unsigned *slot);
+void nir_opt_schedule_end_pass(nir_opt_schedule *sched, unsigned slot,
+                               uint32_t changes, bool progress,
+                               bool idempotent);
+
+#define _NIR_SCHED_PASS(progress, sched, idempotent, enabled_by, changes, \
+                        nir, pass, ...)                                   \
+do {                                                                      \
+   static char _nir_sched_site;                                           \
+   unsigned _nir_sched_slot;                                              \
+   if (nir_opt_schedule_begin_pass(sched, &_nir_sched_site, enabled_by,   \
+                                   &_nir_sched_slot)) {                   \
+      bool _nir_sched_progress = false;                                   \
+      NIR_PASS(_nir_sched_progress, nir, pass, ##__VA_ARGS__);            \
+      nir_opt_schedule_end_pass(sched, _nir_sched_slot, changes,          \
+                                _nir_sched_progress, idempotent);         \
+      progress |= _nir_sched_progress;                                    \
+   }                                                                      \
+} while (0)
+
+/* Optimization loop where a pass is only rerun when a change it depends
+ * on happened since it last ran, instead of whenever any pass made
+ * progress.
+ *
+ * Each pass declares the kinds of change that can give it something to do
+ * ("enabled_by") and the ones it makes when it progresses ("changes").
+ * Passes are told apart by call site, so they may be called conditionally.
+ * Declaring too little in either mask loses optimizations, never
+ * correctness; nir_opt_changes_all is always safe.
+ *
+ * Example:
+ * nir_opt_schedule sched;
+ * nir_opt_schedule_init(&sched);
+ * while (nir_opt_schedule_iterate(&sched)) {
+ *    NIR_SCHED_PASS(progress, &sched, nir_opt_changes_dead,
+ *                   nir_opt_changes_dead | nir_opt_changes_cf,
+ *                   nir, nir_opt_dce);
+ *    NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, &sched,
+ *                   nir_opt_changes_instrs | nir_opt_changes_dead,
+ *                   nir_opt_changes_instrs | nir_opt_changes_dead,
+ *                   nir, nir_opt_algebraic);
+ *    ...
+ * }
+ */
+#define NIR_SCHED_PASS(progress, sched, enabled_by, changes, nir, pass, ...) \
+   _NIR_SCHED_PASS(progress, sched, true, enabled_by, changes, nir, pass,    \
+                   ##__VA_ARGS__)
+
+/* Like NIR_SCHED_PASS, but use this for passes which may make further
+ * progress when repeated.
+ */
+#define NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, sched, enabled_by, changes, \
+                                      nir, pass, ...)                       \
+   _NIR_SCHED_PASS(progress, sched, false, enabled_by, changes, nir, pass,  \
+                   ##__VA_ARGS__)
+
 #define NIR_SKIP(name) should_skip_nir(#name)
 
 /** An instruction filtering callback with writemask
@@ -5951,8 +6165,20 @@ void nir_loop_analyze_impl(nir_function_impl *impl,
                            nir_variable_mode indirect_mask,
                            bool force_unroll_sampler_indirect);
 
-/* This requires both nir_metadata_live_defs and nir_metadata_instr_index. */
-bool nir_defs_interfere(nir_def *a, nir_def *b);
+/** Scratch space for liveness queries, see nir_live_query_init() */
+typedef struct nir_live_query {
+   BITSET_WORD *live_in;
+   nir_block **blocks;
+} nir_live_query;
+
+void nir_live_query_init(nir_live_query *query, nir_function_impl *impl,
+                         void *mem_ctx);
+
+/* These require nir_metadata_block_index, nir_metadata_dominance and
+ * nir_metadata_instr_index.
+ */
+bool nir_def_is_live_at(nir_live_query *query, nir_def *def, nir_instr *instr);
+bool nir_defs_interfere(nir_live_query *query, nir_def *a, nir_def *b);
 
 bool nir_repair_ssa_impl(nir_function_impl *impl);
 bool nir_repair_ssa(nir_shader *shader);
@@ -46,7 +46,10 @@ init_block(nir_block *block, nir_function_impl *impl)
    block->dom_pre_index = UINT32_MAX;
    block->dom_post_index = 0;
 
-   _mesa_set_clear(block->dom_frontier, NULL);
+   if (block->dom_frontier)
+      _mesa_set_clear(block->dom_frontier, NULL);
+   else
+      block->dom_frontier = _mesa_pointer_set_create(block);
 
    return true;
 }
@@ -300,9 +303,11 @@ nir_dump_dom_frontier_impl(nir_function_impl *impl, FILE *fp)
 {
    nir_foreach_block_unstructured(block, impl) {
       fprintf(fp, "DF(%u) = {", block->index);
-      set_foreach(block->dom_frontier, entry) {
-         nir_block *df = (nir_block *)entry->key;
-         fprintf(fp, "%u, ", df->index);
+      if (block->dom_frontier) {
+         set_foreach(block->dom_frontier, entry) {
+            nir_block *df = (nir_block *)entry->key;
+            fprintf(fp, "%u, ", df->index);
+         }
       }
       fprintf(fp, "}\n");
    }
@@ -38,6 +38,7 @@ struct from_ssa_state {
    struct exec_list dead_instrs;
    bool phi_webs_only;
    struct hash_table *merge_node_table;
+   nir_live_query live_query;
    nir_instr *instr;
    bool consider_divergence;
    bool progress;
@@ -105,8 +106,8 @@ ssa_def_dominates(nir_def *a, nir_def *b)
  * is represented by a combination of a hash table and the "def" parameter
  * in the merge_node structure.  The merge_set stores a linked list of
  * merge_nodes, ordered by a pre-order DFS walk of the dominance tree.  (Since
- * the liveness analysis pass indexes the SSA values in dominance order for
- * us, this is an easy thing to keep up.)  It is assumed that no pair of the
+ * instructions are indexed in that order for us, this is an easy thing to
+ * keep up.)  It is assumed that no pair of the
  * nodes in a given set interfere.  Merging two sets or checking for
  * interference can be done in a single linear-time merge-sort walk of the
  * two lists of nodes.
@@ -171,7 +172,8 @@ get_merge_node(nir_def *def, struct from_ssa_state *state)
 }
 
 static bool
-merge_nodes_interfere(merge_node *a, merge_node *b)
+merge_nodes_interfere(merge_node *a, merge_node *b,
+                      struct from_ssa_state *state)
 {
    /* There's no need to check for interference within the same set,
     * because we assume, that sets themselves are already
@@ -180,13 +182,13 @@ merge_nodes_interfere(merge_node *a, merge_node *b)
    if (a->set == b->set)
       return false;
 
-   return nir_defs_interfere(a->def, b->def);
+   return nir_defs_interfere(&state->live_query, a->def, b->def);
 }
 
 /* Merges b into a
  *
  * This algorithm uses def_after to ensure that the sets always stay in the
- * same order as the pre-order DFS done by the liveness algorithm.
+ * same order as a pre-order DFS of the dominance tree.
  */
 static merge_set *
 merge_merge_sets(merge_set *a, merge_set *b)
@@ -223,7 +225,7 @@ merge_merge_sets(merge_set *a, merge_set *b)
  * Boissinot et al.
  */
 static bool
-merge_sets_interfere(merge_set *a, merge_set *b)
+merge_sets_interfere(merge_set *a, merge_set *b, struct from_ssa_state *state)
 {
    /* List of all the nodes which dominate the current node, in dominance
     * order.
@@ -237,7 +239,7 @@ merge_sets_interfere(merge_set *a, merge_set *b)
           !exec_node_is_tail_sentinel(bn)) {
 
       /* We walk the union of the two sets in the same order as the pre-order
-       * DFS done by liveness analysis.
+       * DFS of the dominance tree.
        */
       merge_node *current;
       if (exec_node_is_tail_sentinel(an)) {
@@ -288,7 +290,7 @@ merge_sets_interfere(merge_set *a, merge_set *b)
        * This is what allows us to do a interference check of the union of the
        * two sets with a single linear-time walk.
        */
-      if (dom_idx >= 0 && merge_nodes_interfere(current, dom[dom_idx]))
+      if (dom_idx >= 0 && merge_nodes_interfere(current, dom[dom_idx], state))
          return true;
 
       dom[++dom_idx] = current;
@@ -490,7 +492,7 @@ aggressive_coalesce_parallel_copy(nir_parallel_copy_instr *pcopy,
       if (dest_node->set->divergent != src_node->set->divergent)
          continue;
 
-      if (!merge_sets_interfere(src_node->set, dest_node->set))
+      if (!merge_sets_interfere(src_node->set, dest_node->set, state))
          merge_merge_sets(src_node->set, dest_node->set);
    }
 }
@@ -1053,12 +1055,13 @@ nir_convert_from_ssa_impl(nir_function_impl *impl,
       isolate_phi_nodes_block(shader, block, &state);
    }
 
-   /* Mark metadata as dirty before we ask for liveness analysis */
+   /* Mark metadata as dirty before we ask for interference queries */
    nir_progress(true, impl, nir_metadata_control_flow);
 
    nir_metadata_require(impl, nir_metadata_instr_index |
-                                 nir_metadata_live_defs |
+                                 nir_metadata_block_index |
                                  nir_metadata_dominance);
+   nir_live_query_init(&state.live_query, impl, state.dead_ctx);
 
    nir_foreach_block(block, impl) {
       coalesce_phi_nodes_block(block, &state);
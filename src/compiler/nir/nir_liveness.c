@@ -249,61 +249,124 @@ nir_get_live_defs(nir_cursor cursor, void *mem_ctx)
    return live;
 }
 
-static bool
-src_does_not_use_def(nir_src *src, void *def)
+/* Returns the block at the end of which a use is, or NULL if it is at its
+ * instruction.  Phi sources are used at the end of their predecessor and if
+ * conditions at the end of the block preceding the if.
+ */
+static nir_block *
+use_end_block(nir_src *src)
 {
-   return src->ssa != (nir_def *)def;
+   if (nir_src_is_if(src)) {
+      nir_cf_node *prev = nir_cf_node_prev(&nir_src_parent_if(src)->cf_node);
+      return nir_cf_node_as_block(prev);
+   }
+
+   if (nir_src_parent_instr(src)->type == nir_instr_type_phi)
+      return exec_node_data(nir_phi_src, src, src)->pred;
+
+   return NULL;
 }
 
-static bool
-search_for_use_after_instr(nir_instr *start, nir_def *def)
+/* Allocates the scratch space nir_def_is_live_at() needs for impl, so that
+ * passes asking many questions don't allocate for each of them.
+ */
+void
+nir_live_query_init(nir_live_query *query, nir_function_impl *impl,
+                    void *mem_ctx)
 {
-   /* Only look for a use strictly after the given instruction */
-   struct exec_node *node = start->node.next;
-   while (!exec_node_is_tail_sentinel(node)) {
-      nir_instr *instr = exec_node_data(nir_instr, node, node);
-      if (!nir_foreach_src(instr, src_does_not_use_def, def))
-         return true;
-      node = node->next;
-   }
+   query->live_in = rzalloc_array(mem_ctx, BITSET_WORD,
+                                  BITSET_WORDS(impl->num_blocks));
+   query->blocks = ralloc_array(mem_ctx, nir_block *, impl->num_blocks);
+}
 
-   /* If uses are considered to be in the block immediately preceding the if
-    * so we need to also check the following if condition, if any.
-    */
-   nir_if *following_if = nir_block_get_following_if(start->block);
-   if (following_if && following_if->condition.ssa == def)
+/* Records that def is live at the end of block.  Returns true if that is
+ * the block of the query.
+ */
+static bool
+live_query_mark_live_out(nir_live_query *query, unsigned *num_blocks,
+                         nir_block *def_block, nir_block *block,
+                         nir_block *query_block)
+{
+   if (block == query_block)
       return true;
 
+   /* Live at the end of any other block means live at its start too. */
+   if (block != def_block && !BITSET_TEST(query->live_in, block->index)) {
+      BITSET_SET(query->live_in, block->index);
+      query->blocks[(*num_blocks)++] = block;
+   }
+
    return false;
 }
 
-/* Returns true if def is live at instr assuming that def comes before
- * instr in a pre DFS search of the dominance tree.
+/* Returns true if def is live right after instr, ie. if one of its uses
+ * can be reached from there without going through the definition again.
+ *
+ * Rather than looking the answer up in per-block live sets, this walks the
+ * uses of def and, only if that isn't conclusive, walks backwards from them
+ * through the CFG, up to the block defining def.  This only visits the
+ * blocks def is live in.
+ *
+ * def must dominate instr.  This requires nir_metadata_block_index,
+ * nir_metadata_dominance and nir_metadata_instr_index, and a query
+ * initialized with nir_live_query_init() for the impl.
  */
-static bool
-nir_def_is_live_at(nir_def *def, nir_instr *instr)
+bool
+nir_def_is_live_at(nir_live_query *query, nir_def *def, nir_instr *instr)
 {
-   if (BITSET_TEST(instr->block->live_out, def->index)) {
-      /* Since def dominates instr, if def is in the liveout of the block,
-       * it's live at instr
-       */
-      return true;
-   } else {
-      if (BITSET_TEST(instr->block->live_in, def->index) ||
-          def->parent_instr->block == instr->block) {
-         /* In this case it is either live coming into instr's block or it
-          * is defined in the same block.  In this case, we simply need to
-          * see if it is used after instr.
-          */
-         return search_for_use_after_instr(instr, def);
+   nir_block *def_block = def->parent_instr->block;
+   nir_block *block = instr->block;
+   unsigned num_blocks = 0;
+   bool live = false;
+
+   assert(nir_block_dominates(def_block, block));
+
+   nir_foreach_use_including_if(src, def) {
+      nir_block *end_block = use_end_block(src);
+      nir_block *use_block =
+         end_block ? end_block : nir_src_parent_instr(src)->block;
+
+      if (use_block == block &&
+          (end_block || nir_src_parent_instr(src)->index > instr->index))
+         return true;
+   }
+
+   nir_foreach_use_including_if(src, def) {
+      nir_block *end_block = use_end_block(src);
+      if (end_block) {
+         live_query_mark_live_out(query, &num_blocks, def_block, end_block,
+                                  block);
       } else {
-         return false;
+         nir_block *use_block = nir_src_parent_instr(src)->block;
+         if (use_block != def_block &&
+             !BITSET_TEST(query->live_in, use_block->index)) {
+            BITSET_SET(query->live_in, use_block->index);
+            query->blocks[num_blocks++] = use_block;
+         }
+      }
+   }
+
+   /* Every block stays in the list, so that its bit can be cleared again
+    * afterwards.
+    */
+   for (unsigned i = 0; i < num_blocks && !live; i++) {
+      set_foreach(query->blocks[i]->predecessors, entry) {
+         if (live_query_mark_live_out(query, &num_blocks, def_block,
+                                      (nir_block *)entry->key, block)) {
+            live = true;
+            break;
+         }
       }
    }
+
+   for (unsigned i = 0; i < num_blocks; i++)
+      BITSET_CLEAR(query->live_in, query->blocks[i]->index);
+
+   return live;
 }
 
 bool
-nir_defs_interfere(nir_def *a, nir_def *b)
+nir_defs_interfere(nir_live_query *query, nir_def *a, nir_def *b)
 {
    if (a->parent_instr == b->parent_instr) {
       /* Two variables defined at the same time interfere assuming at
@@ -315,8 +378,8 @@ nir_defs_interfere(nir_def *a, nir_def *b)
       /* If either variable is an ssa_undef, then there's no interference */
       return false;
    } else if (a->parent_instr->index < b->parent_instr->index) {
-      return nir_def_is_live_at(a, b->parent_instr);
+      return nir_def_is_live_at(query, a, b->parent_instr);
    } else {
-      return nir_def_is_live_at(b, a->parent_instr);
+      return nir_def_is_live_at(query, b, a->parent_instr);
    }
 }
@@ -63,7 +63,49 @@ nir_metadata_require(nir_function_impl *impl, nir_metadata required, ...)
 
 #undef NEEDS_UPDATE
 
-   impl->valid_metadata |= required;
+   /* Only the consumers of nir_instr::changed can set this. */
+   impl->valid_metadata |= required & ~nir_metadata_instr_changes;
+}
+
+void
+nir_metadata_clear_instr_changes(nir_function_impl *impl)
+{
+   for (unsigned i = 0; i < impl->num_instr_changes; i++)
+      ralloc_free(impl->instr_changes[i].data);
+   impl->num_instr_changes = 0;
+}
+
+uint8_t
+nir_metadata_instr_changes_bit(nir_function_impl *impl, const void *key,
+                               const void *data, unsigned data_size,
+                               bool *all)
+{
+   if (!(impl->valid_metadata & nir_metadata_instr_changes)) {
+      nir_metadata_clear_instr_changes(impl);
+      impl->valid_metadata |= nir_metadata_instr_changes;
+   }
+
+   for (unsigned i = 0; i < impl->num_instr_changes; i++) {
+      if (impl->instr_changes[i].key == key &&
+          impl->instr_changes[i].data_size == data_size &&
+          memcmp(impl->instr_changes[i].data, data, data_size) == 0) {
+         *all = false;
+         return 1u << i;
+      }
+   }
+
+   /* Once all slots are taken, the last one goes to whoever asks next.  Its
+    * new owner starts with a full walk, so the stale bits don't matter.
+    */
+   if (impl->num_instr_changes == ARRAY_SIZE(impl->instr_changes))
+      ralloc_free(impl->instr_changes[--impl->num_instr_changes].data);
+
+   unsigned i = impl->num_instr_changes++;
+   impl->instr_changes[i].key = key;
+   impl->instr_changes[i].data = ralloc_memdup(impl, data, data_size);
+   impl->instr_changes[i].data_size = data_size;
+   *all = true;
+   return 1u << i;
 }
 
 bool
@@ -71,7 +113,7 @@ nir_progress(bool progress, nir_function_impl *impl, nir_metadata preserved)
 {
    /* If we do not make progress, we preserve all metadata. */
    if (!progress)
-      preserved = nir_metadata_all;
+      preserved = nir_metadata_all | nir_metadata_instr_changes;
 
    /* If we discard valid liveness information, immediately free the
     * liveness information for each block. For large shaders, it can
@@ -120,7 +162,8 @@ nir_metadata_invalidate(nir_shader *shader)
          block->dom_children = NULL;
          block->num_dom_children = 1;
          block->dom_pre_index = block->dom_post_index = 0;
-         _mesa_set_clear(block->dom_frontier, NULL);
+         if (block->dom_frontier)
+            _mesa_set_clear(block->dom_frontier, NULL);
 
          if (block->cf_node.parent->type == nir_cf_node_loop &&
              nir_cf_node_is_first(&block->cf_node)) {
@@ -157,7 +157,8 @@ nir_copy_prop_impl(nir_function_impl *impl)
       }
    }
 
-   return nir_progress(progress, impl, nir_metadata_control_flow);
+   return nir_progress(progress, impl,
+                       nir_metadata_control_flow | nir_metadata_instr_changes);
 }
 
 bool
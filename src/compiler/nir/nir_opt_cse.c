@@ -53,7 +53,8 @@ nir_opt_cse_impl(nir_function_impl *impl)
       }
    }
 
-   nir_progress(progress, impl, nir_metadata_control_flow);
+   nir_progress(progress, impl,
+                nir_metadata_control_flow | nir_metadata_instr_changes);
 
    nir_instr_set_destroy(instr_set);
    return progress;
@@ -237,7 +237,8 @@ nir_opt_dce_impl(nir_function_impl *impl)
 
    nir_instr_free_list(&dead_instrs);
 
-   return nir_progress(progress, impl, nir_metadata_control_flow);
+   return nir_progress(progress, impl,
+                       nir_metadata_control_flow | nir_metadata_instr_changes);
 }
 
 bool
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Bookkeeping for NIR_SCHED_PASS, see nir.h.
+ *
+ * Time is counted in epochs, one per pass that makes progress.  Each kind
+ * of change remembers the epoch it last happened in and each pass the
+ * epoch it last started in, so a pass has to run again exactly when one
+ * of the changes it depends on happened after it last started.
+ */
+
+#include "nir.h"
+
+void
+nir_opt_schedule_init(nir_opt_schedule *sched)
+{
+   memset(sched, 0, sizeof(*sched));
+   sched->progress = true;
+}
+
+bool
+nir_opt_schedule_iterate(nir_opt_schedule *sched)
+{
+   if (!sched->progress)
+      return false;
+
+   sched->progress = false;
+   sched->iterations++;
+   return true;
+}
+
+bool
+nir_opt_schedule_begin_pass(nir_opt_schedule *sched, const void *site,
+                            uint32_t enabled_by, unsigned *slot)
+{
+   unsigned i;
+   for (i = 0; i < sched->num_passes; i++) {
+      if (sched->pass_site[i] == site)
+         break;
+   }
+
+   if (i == sched->num_passes) {
+      /* Passes past the table size are simply always run. */
+      if (i == NIR_OPT_SCHEDULE_MAX_PASSES) {
+         *slot = i;
+         return true;
+      }
+
+      sched->pass_site[i] = site;
+      sched->num_passes++;
+      *slot = i;
+      return true;
+   }
+
+   *slot = i;
+
+   u_foreach_bit(change, enabled_by) {
+      if (sched->change_epoch[change] > sched->pass_epoch[i])
+         return true;
+   }
+
+   sched->skipped++;
+   return false;
+}
+
+void
+nir_opt_schedule_end_pass(nir_opt_schedule *sched, unsigned slot,
+                          uint32_t changes, bool progress,
+                          bool idempotent)
+{
+   if (slot < NIR_OPT_SCHEDULE_MAX_PASSES)
+      sched->pass_epoch[slot] = sched->epoch;
+
+   if (!progress)
+      return;
+
+   sched->epoch++;
+   sched->progress = true;
+
+   u_foreach_bit(change, changes)
+      sched->change_epoch[change] = sched->epoch;
+
+   /* Don't let a pass re-trigger itself if running it twice in a row is
+    * pointless.
+    */
+   if (idempotent && slot < NIR_OPT_SCHEDULE_MAX_PASSES)
+      sched->pass_epoch[slot] = sched->epoch;
+}
@@ -0,0 +1,337 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Records what every NIR_PASS costs, to find the passes that dominate
+ * compile time and the optimization loop iterations that do nothing.
+ *
+ * Records are appended to a global list under a lock and only summarized
+ * when dumped, so the overhead per pass is two timestamps, two instruction
+ * walks and the append.  The dump is JSON:
+ *
+ *    {
+ *       "shaders": [{ "stage": "FS", "name": ..., "blake3": ...,
+ *                     "passes": [{ "pass": ..., "ns": ..., "instrs_before": ...,
+ *                                  "instrs_after": ..., "progress": ...,
+ *                                  "mem_before": ..., "mem_after": ... }] }],
+ *       "summary": [{ "pass": ..., "calls": ..., "progress": ..., "ns": ... }]
+ *    }
+ *
+ * Shaders are told apart by their address, stage and source hash, so a
+ * shader reallocated at the address of a freed one with the same source
+ * is merged with it.  Memory is only reported in debug builds, since
+ * release builds of ralloc don't track sizes.
+ */
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include "util/hash_table.h"
+#include "util/os_time.h"
+#include "util/perf/cpu_trace.h"
+#include "util/simple_mtx.h"
+#include "util/u_atomic.h"
+#include "util/u_call_once.h"
+#include "util/u_debug.h"
+#include "util/u_dynarray.h"
+#include "nir.h"
+
+bool nir_pass_profile_enabled = false;
+
+struct pass_record {
+   const void *shader;
+   gl_shader_stage stage;
+   blake3_hash blake3;
+   const char *shader_name;
+
+   const char *pass;
+   int64_t ns;
+   unsigned instrs_before;
+   unsigned instrs_after;
+   size_t mem_before;
+   size_t mem_after;
+   int progress;
+};
+
+static simple_mtx_t profile_lock = SIMPLE_MTX_INITIALIZER;
+static struct util_dynarray profile_records;
+static void *profile_mem_ctx;
+static const char *profile_file;
+
+static unsigned
+count_instrs(nir_shader *shader)
+{
+   unsigned count = 0;
+
+   nir_foreach_function_impl(impl, shader) {
+      nir_foreach_block(block, impl)
+         count += exec_list_length(&block->instr_list);
+   }
+
+   return count;
+}
+
+static size_t
+shader_mem_size(UNUSED nir_shader *shader)
+{
+#ifndef NDEBUG
+   return ralloc_total_size(shader);
+#else
+   return 0;
+#endif
+}
+
+void
+nir_pass_profile_begin_impl(nir_pass_profile_sample *sample,
+                            nir_shader *shader, const char *pass)
+{
+   _MESA_TRACE_BEGIN(pass);
+
+   sample->instr_count = count_instrs(shader);
+   sample->mem_size = shader_mem_size(shader);
+   sample->start_ns = os_time_get_nano();
+}
+
+void
+nir_pass_profile_end_impl(nir_pass_profile_sample *sample,
+                          nir_shader *shader, const char *pass,
+                          int progress)
+{
+   const int64_t ns = os_time_get_nano() - sample->start_ns;
+
+   _MESA_TRACE_END();
+
+   struct pass_record record = {
+      .shader = shader,
+      .stage = shader->info.stage,
+      .pass = pass,
+      .ns = ns,
+      .instrs_before = sample->instr_count,
+      .instrs_after = count_instrs(shader),
+      .mem_before = sample->mem_size,
+      .mem_after = shader_mem_size(shader),
+      .progress = progress,
+   };
+   memcpy(record.blake3, shader->info.source_blake3, sizeof(record.blake3));
+
+   _MESA_TRACE_SET_COUNTER("nir instructions", record.instrs_after);
+
+   simple_mtx_lock(&profile_lock);
+   if (!profile_mem_ctx) {
+      profile_mem_ctx = ralloc_context(NULL);
+      util_dynarray_init(&profile_records, profile_mem_ctx);
+   }
+   /* The shader may be gone by the time we dump. */
+   if (shader->info.name)
+      record.shader_name = ralloc_strdup(profile_mem_ctx, shader->info.name);
+   util_dynarray_append(&profile_records, struct pass_record, record);
+   simple_mtx_unlock(&profile_lock);
+}
+
+static void
+profile_dump_at_exit(void)
+{
+   FILE *fp = fopen(profile_file, "w");
+   if (!fp) {
+      fprintf(stderr, "NIR_PASS_PROFILE: can't open %s\n", profile_file);
+      return;
+   }
+
+   nir_pass_profile_dump_json(fp);
+   fclose(fp);
+}
+
+static void
+nir_pass_profile_init_once(void)
+{
+   profile_file = debug_get_option("NIR_PASS_PROFILE", NULL);
+   if (profile_file) {
+      p_atomic_set(&nir_pass_profile_enabled, true);
+      atexit(profile_dump_at_exit);
+   }
+}
+
+void
+nir_pass_profile_init(void)
+{
+   static util_once_flag flag = UTIL_ONCE_FLAG_INIT;
+   util_call_once(&flag, nir_pass_profile_init_once);
+}
+
+void
+nir_pass_profile_start(void)
+{
+   p_atomic_set(&nir_pass_profile_enabled, true);
+}
+
+void
+nir_pass_profile_stop(void)
+{
+   p_atomic_set(&nir_pass_profile_enabled, false);
+}
+
+void
+nir_pass_profile_reset(void)
+{
+   simple_mtx_lock(&profile_lock);
+   ralloc_free(profile_mem_ctx);
+   profile_mem_ctx = NULL;
+   memset(&profile_records, 0, sizeof(profile_records));
+   simple_mtx_unlock(&profile_lock);
+}
+
+static uint32_t
+shader_key_hash(const void *key)
+{
+   const struct pass_record *r = key;
+   uint32_t hash = _mesa_hash_pointer(r->shader);
+   hash = _mesa_hash_data_with_seed(r->blake3, sizeof(r->blake3), hash);
+   return _mesa_hash_data_with_seed(&r->stage, sizeof(r->stage), hash);
+}
+
+static bool
+shader_key_equal(const void *a, const void *b)
+{
+   const struct pass_record *ra = a, *rb = b;
+   return ra->shader == rb->shader && ra->stage == rb->stage &&
+          !memcmp(ra->blake3, rb->blake3, sizeof(ra->blake3));
+}
+
+struct pass_summary {
+   const char *pass;
+   unsigned calls;
+   unsigned progress;
+   int64_t ns;
+};
+
+static void
+print_json_string(FILE *fp, const char *str)
+{
+   fputc('"', fp);
+   for (const char *c = str; c && *c; c++) {
+      if (*c == '"' || *c == '\\')
+         fprintf(fp, "\\%c", *c);
+      else if ((unsigned char)*c < 0x20)
+         fprintf(fp, "\\u%04x", *c);
+      else
+         fputc(*c, fp);
+   }
+   fputc('"', fp);
+}
+
+static void
+print_record(FILE *fp, const struct pass_record *r)
+{
+   fprintf(fp, "{ \"pass\": ");
+   print_json_string(fp, r->pass);
+   fprintf(fp, ", \"ns\": %" PRId64 ", \"instrs_before\": %u, "
+               "\"instrs_after\": %u, \"progress\": %s",
+           r->ns, r->instrs_before, r->instrs_after,
+           r->progress < 0 ? "null" : r->progress ? "true" : "false");
+#ifndef NDEBUG
+   fprintf(fp, ", \"mem_before\": %zu, \"mem_after\": %zu",
+           r->mem_before, r->mem_after);
+#endif
+   fprintf(fp, " }");
+}
+
+void
+nir_pass_profile_dump_json(FILE *fp)
+{
+   void *mem_ctx = ralloc_context(NULL);
+
+   simple_mtx_lock(&profile_lock);
+
+   const unsigned count =
+      profile_mem_ctx ? util_dynarray_num_elements(&profile_records,
+                                                   struct pass_record) : 0;
+   const struct pass_record *records =
+      profile_mem_ctx ? profile_records.data : NULL;
+
+   /* Group the records by shader, in order of first appearance. */
+   struct hash_table *shaders =
+      _mesa_hash_table_create(mem_ctx, shader_key_hash, shader_key_equal);
+   struct util_dynarray groups;
+   util_dynarray_init(&groups, mem_ctx);
+   unsigned *next = ralloc_array(mem_ctx, unsigned, MAX2(count, 1));
+   unsigned *last = ralloc_array(mem_ctx, unsigned, MAX2(count, 1));
+
+   struct hash_table *passes = _mesa_hash_table_create(
+      mem_ctx, _mesa_hash_string, _mesa_key_string_equal);
+   struct util_dynarray summaries;
+   util_dynarray_init(&summaries, mem_ctx);
+
+   for (unsigned i = 0; i < count; i++) {
+      const struct pass_record *r = &records[i];
+      next[i] = UINT_MAX;
+
+      struct hash_entry *entry = _mesa_hash_table_search(shaders, r);
+      if (entry) {
+         unsigned group = (uintptr_t)entry->data;
+         next[last[group]] = i;
+         last[group] = i;
+      } else {
+         unsigned group = util_dynarray_num_elements(&groups, unsigned);
+         util_dynarray_append(&groups, unsigned, i);
+         last[group] = i;
+         _mesa_hash_table_insert(shaders, r, (void *)(uintptr_t)group);
+      }
+
+      entry = _mesa_hash_table_search(passes, r->pass);
+      unsigned s;
+      if (entry) {
+         s = (uintptr_t)entry->data;
+      } else {
+         s = util_dynarray_num_elements(&summaries, struct pass_summary);
+         util_dynarray_append(&summaries, struct pass_summary,
+                              (struct pass_summary){ .pass = r->pass });
+         _mesa_hash_table_insert(passes, r->pass, (void *)(uintptr_t)s);
+      }
+
+      struct pass_summary *summary =
+         util_dynarray_element(&summaries, struct pass_summary, s);
+      summary->calls++;
+      summary->progress += r->progress > 0;
+      summary->ns += r->ns;
+   }
+
+   fprintf(fp, "{\n  \"shaders\": [");
+   bool first_group = true;
+   util_dynarray_foreach(&groups, unsigned, head) {
+      const struct pass_record *r = &records[*head];
+
+      fprintf(fp, "%s\n    { \"stage\": ", first_group ? "" : ",");
+      print_json_string(fp, _mesa_shader_stage_to_abbrev(r->stage));
+      fprintf(fp, ", \"name\": ");
+      print_json_string(fp, r->shader_name);
+
+      char blake3[BLAKE3_HEX_LEN];
+      _mesa_blake3_format(blake3, r->blake3);
+      fprintf(fp, ", \"blake3\": \"%s\",\n      \"passes\": [", blake3);
+
+      for (unsigned i = *head; i != UINT_MAX; i = next[i]) {
+         fprintf(fp, "%s\n        ", i == *head ? "" : ",");
+         print_record(fp, &records[i]);
+      }
+      fprintf(fp, "\n      ] }");
+      first_group = false;
+   }
+
+   fprintf(fp, "\n  ],\n  \"summary\": [");
+   bool first_summary = true;
+   util_dynarray_foreach(&summaries, struct pass_summary, summary) {
+      fprintf(fp, "%s\n    { \"pass\": ", first_summary ? "" : ",");
+      print_json_string(fp, summary->pass);
+      fprintf(fp, ", \"calls\": %u, \"progress\": %u, \"ns\": %" PRId64 " }",
+              summary->calls, summary->progress, summary->ns);
+      first_summary = false;
+   }
+   fprintf(fp, "\n  ]\n}\n");
+
+   simple_mtx_unlock(&profile_lock);
+
+   ralloc_free(mem_ctx);
+}
@@ -884,6 +884,29 @@ nir_algebraic_instr(nir_builder *build, nir_instr *instr,
    return false;
 }
 
+/* Marks the users of the instructions in the worklist, and their users in
+ * turn.  Range analysis looks through any number of instructions, so all of
+ * them may match now.
+ */
+static void
+mark_changed_users(nir_instr_worklist *worklist)
+{
+   nir_instr *instr;
+   while ((instr = nir_instr_worklist_pop_head(worklist))) {
+      nir_def *def = nir_instr_def(instr);
+      if (!def)
+         continue;
+
+      nir_foreach_use(use, def) {
+         nir_instr *user = nir_src_parent_instr(use);
+         if (!user->pass_flags) {
+            user->pass_flags = 1;
+            nir_instr_worklist_push_tail(worklist, user);
+         }
+      }
+   }
+}
+
 bool
 nir_algebraic_impl(nir_function_impl *impl,
                    const bool *condition_flags,
@@ -903,6 +926,15 @@ nir_algebraic_impl(nir_function_impl *impl,
    }
    memset(states.data, 0, states.size);
 
+   /* Only instructions which changed since the last run of this pass, and
+    * their users, can match anything new.
+    */
+   bool all;
+   const uint8_t changed_bit =
+      nir_metadata_instr_changes_bit(impl, table, condition_flags,
+                                     table->num_conditions * sizeof(bool),
+                                     &all);
+
    struct hash_table *range_ht = _mesa_pointer_hash_table_create(NULL);
 
    nir_instr_worklist *worklist = nir_instr_worklist_create();
@@ -911,18 +943,25 @@ nir_algebraic_impl(nir_function_impl *impl,
    nir_foreach_block(block, impl) {
       nir_foreach_instr(instr, block) {
          nir_algebraic_automaton(instr, &states, table->pass_op_table);
+
+         instr->pass_flags = all || (instr->changed & changed_bit);
+         instr->changed &= ~changed_bit;
+         if (instr->pass_flags && !all)
+            nir_instr_worklist_push_tail(worklist, instr);
       }
    }
 
+   mark_changed_users(worklist);
+
    /* Put our instrs in the worklist such that we're popping the last instr
     * first.  This will encourage us to match the biggest source patterns when
     * possible.
     */
    nir_foreach_block_reverse(block, impl) {
       nir_foreach_instr_reverse(instr, block) {
-         instr->pass_flags = 0;
-         if (instr->type == nir_instr_type_alu)
+         if (instr->pass_flags && instr->type == nir_instr_type_alu)
             nir_instr_worklist_push_tail(worklist, instr);
+         instr->pass_flags = 0;
       }
    }
 
@@ -949,5 +988,6 @@ nir_algebraic_impl(nir_function_impl *impl,
    ralloc_free(range_ht);
    util_dynarray_fini(&states);
 
-   return nir_progress(progress, impl, nir_metadata_control_flow);
+   return nir_progress(progress, impl,
+                       nir_metadata_control_flow | nir_metadata_instr_changes);
 }
@@ -91,8 +91,20 @@ typedef struct {
    struct nir_variable_data last_var_data;
 
    struct hash_table *strings;
+
+   /* For nir_lazy_shader, the function impls that haven't been read yet
+    * and the functions whose impls need to be read next.
+    */
+   struct hash_table *pending_impls;
+   struct util_dynarray wanted_impls;
 } read_ctx;
 
+typedef struct {
+   const void *data;
+   uint32_t size;
+   uint32_t first_idx;
+} read_pending_impl;
+
 static void
 write_add_object(write_ctx *ctx, const void *obj)
 {
@@ -1593,6 +1605,9 @@ read_call(read_ctx *ctx)
    nir_function *callee = read_object(ctx);
    nir_call_instr *call = nir_call_instr_create(ctx->nir, callee);
 
+   if (ctx->pending_impls)
+      util_dynarray_append(&ctx->wanted_impls, nir_function *, callee);
+
    for (unsigned i = 0; i < call->num_params; i++)
       read_src(ctx, &call->params[i]);
 
@@ -1925,6 +1940,13 @@ read_cf_list(read_ctx *ctx, struct exec_list *cf_list)
 static void
 write_function_impl(write_ctx *ctx, const nir_function_impl *fi)
 {
+   /* Don't carry types over from other impls, so that each can be read on
+    * its own.
+    */
+   ctx->last_type = NULL;
+   ctx->last_interface_type = NULL;
+   memset(&ctx->last_var_data, 0, sizeof(ctx->last_var_data));
+
    blob_write_uint8(ctx->blob, fi->structured);
    blob_write_uint8(ctx->blob, !!fi->preamble);
 
@@ -1942,11 +1964,18 @@ read_function_impl(read_ctx *ctx)
 {
    nir_function_impl *fi = nir_function_impl_create_bare(ctx->nir);
 
+   ctx->last_type = NULL;
+   ctx->last_interface_type = NULL;
+   memset(&ctx->last_var_data, 0, sizeof(ctx->last_var_data));
+
    fi->structured = blob_read_uint8(ctx->blob);
    bool preamble = blob_read_uint8(ctx->blob);
 
-   if (preamble)
+   if (preamble) {
       fi->preamble = read_object(ctx);
+      if (ctx->pending_impls)
+         util_dynarray_append(&ctx->wanted_impls, nir_function *, fi->preamble);
+   }
 
    read_var_list(ctx, &fi->locals);
 
@@ -2186,8 +2215,16 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
       write_function(&ctx, fxn);
    }
 
+   /* Prefix impls with their size and first object index, so that readers
+    * can skip them.
+    */
    nir_foreach_function_impl(impl, nir) {
+      size_t size_offset = blob_reserve_uint32(blob);
+      blob_write_uint32(blob, ctx.next_idx);
+
+      size_t start = blob->size;
       write_function_impl(&ctx, impl);
+      blob_overwrite_uint32(blob, size_offset, blob->size - start);
    }
 
    blob_write_uint32(blob, nir->constant_data_size);
@@ -2205,16 +2242,47 @@ nir_serialize(struct blob *blob, const nir_shader *nir, bool strip)
    util_dynarray_fini(&ctx.phi_fixups);
 }
 
-nir_shader *
-nir_deserialize(void *mem_ctx,
-                const struct nir_shader_compiler_options *options,
-                struct blob_reader *blob)
+static void
+read_wanted_impls(read_ctx *ctx)
 {
-   read_ctx ctx = { 0 };
-   ctx.blob = blob;
-   list_inithead(&ctx.phi_srcs);
-   ctx.idx_table_len = blob_read_uint32(blob);
-   ctx.idx_table = calloc(ctx.idx_table_len, sizeof(uintptr_t));
+   struct blob_reader *blob = ctx->blob;
+
+   while (util_dynarray_num_elements(&ctx->wanted_impls, nir_function *)) {
+      nir_function *fxn =
+         util_dynarray_pop(&ctx->wanted_impls, nir_function *);
+
+      struct hash_entry *entry =
+         _mesa_hash_table_search(ctx->pending_impls, fxn);
+      if (!entry)
+         continue;
+
+      const read_pending_impl *pending = entry->data;
+      _mesa_hash_table_remove(ctx->pending_impls, entry);
+
+      struct blob_reader impl_blob;
+      blob_reader_init(&impl_blob, pending->data, pending->size);
+      ctx->blob = &impl_blob;
+      ctx->next_idx = pending->first_idx;
+
+      nir_function_set_impl(fxn, read_function_impl(ctx));
+      assert(impl_blob.current == impl_blob.end && !impl_blob.overrun);
+   }
+
+   ctx->blob = blob;
+}
+
+/* Reads a whole shader.  If ctx->pending_impls is set, function impls are
+ * only located and left for read_wanted_impls().
+ */
+static void
+read_shader(read_ctx *ctx, void *mem_ctx,
+            const struct nir_shader_compiler_options *options)
+{
+   struct blob_reader *blob = ctx->blob;
+
+   list_inithead(&ctx->phi_srcs);
+   ctx->idx_table_len = blob_read_uint32(blob);
+   ctx->idx_table = calloc(ctx->idx_table_len, sizeof(uintptr_t));
 
    enum nir_serialize_shader_flags flags = blob_read_uint32(blob);
    char *name = (flags & NIR_SERIALIZE_SHADER_NAME) ? blob_read_string(blob) : NULL;
@@ -2223,48 +2291,85 @@ nir_deserialize(void *mem_ctx,
    struct shader_info info;
    blob_copy_bytes(blob, (uint8_t *)&info, sizeof(info));
 
-   ctx.nir = nir_shader_create(mem_ctx, info.stage, options, NULL);
+   ctx->nir = nir_shader_create(mem_ctx, info.stage, options, NULL);
 
-   ctx.nir->has_debug_info = !!(flags & NIR_SERIALIZE_DEBUG_INFO);
-   if (ctx.nir->has_debug_info)
-      ctx.strings = _mesa_hash_table_create(NULL, _mesa_hash_string, _mesa_key_string_equal);
+   ctx->nir->has_debug_info = !!(flags & NIR_SERIALIZE_DEBUG_INFO);
+   if (ctx->nir->has_debug_info)
+      ctx->strings = _mesa_hash_table_create(NULL, _mesa_hash_string, _mesa_key_string_equal);
 
-   info.name = name ? ralloc_strdup(ctx.nir, name) : NULL;
-   info.label = label ? ralloc_strdup(ctx.nir, label) : NULL;
+   info.name = name ? ralloc_strdup(ctx->nir, name) : NULL;
+   info.label = label ? ralloc_strdup(ctx->nir, label) : NULL;
 
-   ctx.nir->info = info;
+   ctx->nir->info = info;
 
-   read_var_list(&ctx, &ctx.nir->variables);
+   read_var_list(ctx, &ctx->nir->variables);
 
-   ctx.nir->num_inputs = blob_read_uint32(blob);
-   ctx.nir->num_uniforms = blob_read_uint32(blob);
-   ctx.nir->num_outputs = blob_read_uint32(blob);
-   ctx.nir->scratch_size = blob_read_uint32(blob);
+   ctx->nir->num_inputs = blob_read_uint32(blob);
+   ctx->nir->num_uniforms = blob_read_uint32(blob);
+   ctx->nir->num_outputs = blob_read_uint32(blob);
+   ctx->nir->scratch_size = blob_read_uint32(blob);
 
    unsigned num_functions = blob_read_uint32(blob);
    for (unsigned i = 0; i < num_functions; i++)
-      read_function(&ctx);
+      read_function(ctx);
 
-   nir_foreach_function(fxn, ctx.nir) {
-      if (fxn->impl == NIR_SERIALIZE_FUNC_HAS_IMPL)
-         nir_function_set_impl(fxn, read_function_impl(&ctx));
+   /* All pending impls are allocated at once. */
+   read_pending_impl *pending = NULL;
+   if (ctx->pending_impls && num_functions) {
+      pending = ralloc_array(ctx->pending_impls, read_pending_impl,
+                             num_functions);
    }
 
-   ctx.nir->constant_data_size = blob_read_uint32(blob);
-   if (ctx.nir->constant_data_size > 0) {
-      ctx.nir->constant_data =
-         ralloc_size(ctx.nir, ctx.nir->constant_data_size);
-      blob_copy_bytes(blob, ctx.nir->constant_data,
-                      ctx.nir->constant_data_size);
+   nir_foreach_function(fxn, ctx->nir) {
+      if (fxn->impl != NIR_SERIALIZE_FUNC_HAS_IMPL)
+         continue;
+
+      uint32_t size = blob_read_uint32(blob);
+      ASSERTED uint32_t first_idx = blob_read_uint32(blob);
+
+      if (!ctx->pending_impls) {
+         assert(ctx->next_idx == first_idx);
+         nir_function_set_impl(fxn, read_function_impl(ctx));
+         continue;
+      }
+
+      /* Only remember where the impl is.  The data stays in the caller's
+       * buffer until the impl is wanted.
+       */
+      pending->data = blob_read_bytes(blob, size);
+      pending->size = size;
+      pending->first_idx = first_idx;
+
+      fxn->impl = NULL;
+      _mesa_hash_table_insert(ctx->pending_impls, fxn, pending++);
    }
 
-   ctx.nir->xfb_info = read_xfb_info(&ctx);
+   ctx->nir->constant_data_size = blob_read_uint32(blob);
+   if (ctx->nir->constant_data_size > 0) {
+      ctx->nir->constant_data =
+         ralloc_size(ctx->nir, ctx->nir->constant_data_size);
+      blob_copy_bytes(blob, ctx->nir->constant_data,
+                      ctx->nir->constant_data_size);
+   }
+
+   ctx->nir->xfb_info = read_xfb_info(ctx);
 
-   if (ctx.nir->info.uses_printf) {
-      ctx.nir->printf_info =
-         u_printf_deserialize_info(ctx.nir, blob,
-                                   &ctx.nir->printf_info_count);
+   if (ctx->nir->info.uses_printf) {
+      ctx->nir->printf_info =
+         u_printf_deserialize_info(ctx->nir, blob,
+                                   &ctx->nir->printf_info_count);
    }
+}
+
+nir_shader *
+nir_deserialize(void *mem_ctx,
+                const struct nir_shader_compiler_options *options,
+                struct blob_reader *blob)
+{
+   read_ctx ctx = { 0 };
+   ctx.blob = blob;
+
+   read_shader(&ctx, mem_ctx, options);
 
    free(ctx.idx_table);
    _mesa_hash_table_destroy(ctx.strings, NULL);
@@ -2274,6 +2379,92 @@ nir_deserialize(void *mem_ctx,
    return ctx.nir;
 }
 
+struct nir_lazy_shader {
+   read_ctx ctx;
+};
+
+static void
+lazy_shader_destroy(void *ptr)
+{
+   nir_lazy_shader *lazy = ptr;
+
+   free(lazy->ctx.idx_table);
+   _mesa_hash_table_destroy(lazy->ctx.strings, NULL);
+}
+
+/**
+ * Deserializes a shader without any of its function impls, which are then
+ * read on demand by nir_lazy_shader_load_functions().  This is much cheaper
+ * than nir_deserialize() for libraries of which only a few functions end up
+ * being used.
+ *
+ * The impls aren't copied, so \p data has to outlive the returned object.
+ * Returns NULL if the data is truncated.
+ */
+nir_lazy_shader *
+nir_deserialize_lazy(void *mem_ctx,
+                     const struct nir_shader_compiler_options *options,
+                     const void *data, size_t size)
+{
+   nir_lazy_shader *lazy = rzalloc(mem_ctx, nir_lazy_shader);
+   ralloc_set_destructor(lazy, lazy_shader_destroy);
+
+   struct blob_reader blob;
+   blob_reader_init(&blob, data, size);
+
+   lazy->ctx.blob = &blob;
+   lazy->ctx.pending_impls = _mesa_pointer_hash_table_create(lazy);
+   util_dynarray_init(&lazy->ctx.wanted_impls, lazy);
+
+   read_shader(&lazy->ctx, lazy, options);
+   lazy->ctx.blob = NULL;
+
+   if (blob.overrun) {
+      ralloc_free(lazy);
+      return NULL;
+   }
+
+   nir_validate_shader(lazy->ctx.nir, "after deserialize");
+
+   return lazy;
+}
+
+/** Returns the shader, which is owned by the nir_lazy_shader. */
+nir_shader *
+nir_lazy_shader_get_shader(const nir_lazy_shader *lazy)
+{
+   return lazy->ctx.nir;
+}
+
+/**
+ * Reads the impls of the functions for which \p filter returns true, and of
+ * the functions they call.  Impls which were read earlier are kept.
+ *
+ * This modifies the shader, so callers sharing it between threads have to
+ * serialize calls and must not walk functions they haven't loaded.
+ */
+void
+nir_lazy_shader_load_functions(nir_lazy_shader *lazy,
+                               bool (*filter)(const nir_function *fxn,
+                                              void *data),
+                               void *data)
+{
+   read_ctx *ctx = &lazy->ctx;
+
+   hash_table_foreach(ctx->pending_impls, entry) {
+      nir_function *fxn = (nir_function *)entry->key;
+      if (filter(fxn, data))
+         util_dynarray_append(&ctx->wanted_impls, nir_function *, fxn);
+   }
+
+   if (!util_dynarray_num_elements(&ctx->wanted_impls, nir_function *))
+      return;
+
+   read_wanted_impls(ctx);
+
+   nir_validate_shader(ctx->nir, "after loading functions");
+}
+
 nir_function *
 nir_deserialize_function(void *mem_ctx,
                          const struct nir_shader_compiler_options *options,
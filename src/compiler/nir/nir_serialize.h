@@ -37,6 +37,22 @@ nir_shader *nir_deserialize(void *mem_ctx,
                             const struct nir_shader_compiler_options *options,
                             struct blob_reader *blob);
 
+typedef struct nir_lazy_shader nir_lazy_shader;
+
+nir_lazy_shader *
+nir_deserialize_lazy(void *mem_ctx,
+                     const struct nir_shader_compiler_options *options,
+                     const void *data, size_t size);
+
+nir_shader *
+nir_lazy_shader_get_shader(const nir_lazy_shader *lazy);
+
+void
+nir_lazy_shader_load_functions(nir_lazy_shader *lazy,
+                               bool (*filter)(const nir_function *fxn,
+                                              void *data),
+                               void *data);
+
 void
 nir_serialize_function(struct blob *blob, const nir_function *fxn);
 
@@ -132,6 +132,7 @@ sweep_impl(nir_shader *nir, nir_function_impl *impl)
 
    /* Wipe out all the metadata, if any. */
    nir_progress(true, impl, nir_metadata_none);
+   nir_metadata_clear_instr_changes(impl);
 }
 
 static void
@@ -1699,7 +1699,7 @@ validate_dominance(nir_function_impl *impl, validate_state *state)
       md->dom_frontier = block->dom_frontier;
 
       block->dom_children = NULL;
-      block->dom_frontier = _mesa_pointer_set_create(block);
+      block->dom_frontier = NULL;
    }
 
    /* Call metadata passes and compare it against the preserved metadata and call SSA dominance
@@ -1725,10 +1725,17 @@ validate_dominance(nir_function_impl *impl, validate_state *state)
                                            block->num_dom_children * sizeof(md->dom_children[0])));
          }
 
-         validate_assert(state, block->dom_frontier->entries == md->dom_frontier->entries);
-         set_foreach(block->dom_frontier, entry) {
-            validate_assert(state, _mesa_set_search_pre_hashed(md->dom_frontier,
-                                                               entry->hash, entry->key));
+         /* The end block isn't visited by nir_calc_dominance, so it may not
+          * have a dominance frontier set.
+          */
+         unsigned num_frontier = block->dom_frontier ? block->dom_frontier->entries : 0;
+         unsigned md_num_frontier = md->dom_frontier ? md->dom_frontier->entries : 0;
+         validate_assert(state, num_frontier == md_num_frontier);
+         if (num_frontier && num_frontier == md_num_frontier) {
+            set_foreach(block->dom_frontier, entry) {
+               validate_assert(state, _mesa_set_search_pre_hashed(md->dom_frontier,
+                                                                  entry->hash, entry->key));
+            }
          }
       }
       state->block = NULL;
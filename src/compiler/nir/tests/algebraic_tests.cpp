@@ -271,4 +271,56 @@ TEST_F(nir_opt_idiv_const_test, irem)
    }
 }
 
+TEST_F(nir_opt_algebraic_test, revisit_changed_users)
+{
+   nir_def *res_deref = &nir_build_deref_var(b, res_var)->def;
+   nir_def *x = nir_load_local_invocation_index(b);
+   nir_def *t = nir_iabs(b, x);
+
+   nir_build_store_deref(b, res_deref, nir_ineg(b, t), 0x1);
+   EXPECT_FALSE(nir_opt_algebraic(b->shader));
+   EXPECT_TRUE(b->impl->valid_metadata & nir_metadata_instr_changes);
+
+   /* Changes which aren't reported aren't seen. */
+   nir_instr_as_alu(t->parent_instr)->op = nir_op_ineg;
+   EXPECT_FALSE(nir_opt_algebraic(b->shader));
+
+   /* Once they are, users of the changed instruction are revisited too. */
+   nir_instr_mark_changed(t->parent_instr);
+   EXPECT_TRUE(nir_opt_algebraic(b->shader));
+}
+
+TEST_F(nir_opt_algebraic_test, revisit_rewritten_srcs)
+{
+   nir_def *res_deref = &nir_build_deref_var(b, res_var)->def;
+   nir_def *x = nir_load_local_invocation_index(b);
+   nir_def *y = nir_load_subgroup_invocation(b);
+   nir_def *zero = nir_imm_int(b, 0);
+
+   nir_build_store_deref(b, res_deref, nir_iadd(b, x, y), 0x1);
+   EXPECT_FALSE(nir_opt_algebraic(b->shader));
+
+   nir_def_rewrite_uses(y, zero);
+   EXPECT_TRUE(nir_opt_algebraic(b->shader));
+   EXPECT_FALSE(nir_opt_algebraic(b->shader));
+}
+
+TEST_F(nir_opt_algebraic_test, revisit_all_after_invalidation)
+{
+   nir_def *res_deref = &nir_build_deref_var(b, res_var)->def;
+   nir_def *x = nir_load_local_invocation_index(b);
+   nir_def *t = nir_iabs(b, x);
+
+   nir_build_store_deref(b, res_deref, nir_ineg(b, t), 0x1);
+   EXPECT_FALSE(nir_opt_algebraic(b->shader));
+
+   /* A pass which doesn't preserve the metadata makes the next run look at
+    * everything.
+    */
+   nir_instr_as_alu(t->parent_instr)->op = nir_op_ineg;
+   nir_progress(true, b->impl, nir_metadata_control_flow);
+   EXPECT_FALSE(b->impl->valid_metadata & nir_metadata_instr_changes);
+   EXPECT_TRUE(nir_opt_algebraic(b->shader));
+}
+
 }
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "nir_test.h"
+
+class nir_liveness_test : public nir_test {
+protected:
+   nir_liveness_test()
+      : nir_test::nir_test("nir_liveness_test")
+   {
+   }
+};
+
+/* Checks nir_def_is_live_at() against the live sets from
+ * nir_metadata_live_defs for every def and every instruction it dominates.
+ */
+static void
+check_against_live_defs(nir_function_impl *impl)
+{
+   nir_metadata_require(impl, nir_metadata_block_index |
+                                 nir_metadata_dominance |
+                                 nir_metadata_instr_index |
+                                 nir_metadata_live_defs);
+
+   void *mem_ctx = ralloc_context(NULL);
+   nir_live_query query;
+   nir_live_query_init(&query, impl, mem_ctx);
+
+   nir_foreach_block(def_block, impl) {
+      nir_foreach_instr(def_instr, def_block) {
+         nir_def *def = nir_instr_def(def_instr);
+         if (!def)
+            continue;
+
+         nir_foreach_block(block, impl) {
+            if (!nir_block_dominates(def_block, block))
+               continue;
+
+            nir_if *following_if = nir_block_get_following_if(block);
+
+            nir_foreach_instr(instr, block) {
+               if (instr->type == nir_instr_type_phi ||
+                   (block == def_block && instr->index < def_instr->index))
+                  continue;
+
+               const BITSET_WORD *live =
+                  nir_get_live_defs(nir_after_instr(instr), mem_ctx);
+               bool expected = BITSET_TEST(live, def->index) ||
+                               (following_if &&
+                                following_if->condition.ssa == def);
+
+               EXPECT_EQ(nir_def_is_live_at(&query, def, instr), expected)
+                  << "ssa_" << def->index << " after instruction "
+                  << instr->index;
+            }
+         }
+      }
+   }
+
+   ralloc_free(mem_ctx);
+}
+
+TEST_F(nir_liveness_test, loop)
+{
+   nir_variable *var =
+      nir_local_variable_create(b->impl, glsl_uint_type(), "var");
+
+   nir_def *x = nir_load_local_invocation_index(b);
+   nir_def *y = nir_iadd_imm(b, x, 1);
+   nir_store_var(b, var, x, 1);
+
+   nir_def *t, *mul;
+   nir_push_loop(b);
+   {
+      t = nir_iadd(b, nir_load_var(b, var), y);
+      nir_push_if(b, nir_ult_imm(b, t, 100));
+      {
+         mul = nir_imul(b, t, x);
+         nir_store_var(b, var, mul, 1);
+      }
+      nir_push_else(b, NULL);
+      {
+         nir_jump(b, nir_jump_break);
+      }
+      nir_pop_if(b, NULL);
+   }
+   nir_pop_loop(b, NULL);
+
+   nir_store_global(b, nir_imm_int64(b, 0), 4, nir_load_var(b, var), 1);
+   nir_intrinsic_instr *store =
+      nir_instr_as_intrinsic(nir_block_last_instr(nir_impl_last_block(b->impl)));
+
+   NIR_PASS(_, b->shader, nir_lower_vars_to_ssa);
+   nir_metadata_require(b->impl, nir_metadata_block_index |
+                                    nir_metadata_dominance |
+                                    nir_metadata_instr_index);
+   nir_live_query query;
+   nir_live_query_init(&query, b->impl, b->shader);
+
+   /* Used earlier in the loop, so live again on the next iteration. */
+   EXPECT_TRUE(nir_def_is_live_at(&query, y, t->parent_instr));
+   EXPECT_TRUE(nir_def_is_live_at(&query, x, mul->parent_instr));
+   /* Not used after the loop. */
+   EXPECT_FALSE(nir_def_is_live_at(&query, x, &store->instr));
+   EXPECT_FALSE(nir_def_is_live_at(&query, t, &store->instr));
+
+   check_against_live_defs(b->impl);
+}
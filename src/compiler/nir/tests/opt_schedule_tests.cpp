@@ -0,0 +1,91 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "nir_test.h"
+
+class nir_opt_schedule_test : public nir_test {
+protected:
+   nir_opt_schedule_test()
+      : nir_test::nir_test("nir_opt_schedule_test")
+   {
+      nir_opt_schedule_init(&sched);
+   }
+
+   nir_opt_schedule sched;
+};
+
+/* Fake passes counting their runs and making progress a given number of
+ * times.
+ */
+struct fake_pass {
+   unsigned runs;
+   unsigned progress_runs;
+};
+
+static bool
+fake_pass(nir_shader *shader, struct fake_pass *pass)
+{
+   bool progress = pass->runs++ < pass->progress_runs;
+   return nir_progress(progress, nir_shader_get_entrypoint(shader),
+                       nir_metadata_control_flow);
+}
+
+TEST_F(nir_opt_schedule_test, skip_unaffected)
+{
+   struct fake_pass pass_a = { .progress_runs = 1 }, pass_b = { 0 };
+   bool progress = false;
+
+   while (nir_opt_schedule_iterate(&sched)) {
+      NIR_SCHED_PASS(progress, &sched, nir_opt_changes_instrs,
+                     nir_opt_changes_dead, b->shader, fake_pass, &pass_a);
+      NIR_SCHED_PASS(progress, &sched, nir_opt_changes_dead,
+                     nir_opt_changes_all, b->shader, fake_pass, &pass_b);
+   }
+
+   /* The dead code pass_a left behind was seen by the first run of pass_b. */
+   EXPECT_TRUE(progress);
+   EXPECT_EQ(pass_a.runs, 1u);
+   EXPECT_EQ(pass_b.runs, 1u);
+   EXPECT_EQ(sched.iterations, 2u);
+   EXPECT_EQ(sched.skipped, 2u);
+}
+
+TEST_F(nir_opt_schedule_test, rerun_enabled)
+{
+   struct fake_pass pass_a = { .progress_runs = 1 }, pass_b = { 0 };
+   bool progress = false;
+
+   while (nir_opt_schedule_iterate(&sched)) {
+      NIR_SCHED_PASS(progress, &sched, nir_opt_changes_dead,
+                     nir_opt_changes_all, b->shader, fake_pass, &pass_b);
+      NIR_SCHED_PASS(progress, &sched, nir_opt_changes_instrs,
+                     nir_opt_changes_dead, b->shader, fake_pass, &pass_a);
+   }
+
+   EXPECT_EQ(pass_a.runs, 1u);
+   EXPECT_EQ(pass_b.runs, 2u);
+   EXPECT_EQ(sched.iterations, 2u);
+}
+
+TEST_F(nir_opt_schedule_test, idempotent)
+{
+   struct fake_pass pass_a = { .progress_runs = 3 }, pass_b = { .progress_runs = 3 };
+   bool progress = false;
+
+   while (nir_opt_schedule_iterate(&sched)) {
+      NIR_SCHED_PASS(progress, &sched, nir_opt_changes_instrs,
+                     nir_opt_changes_instrs, b->shader, fake_pass, &pass_a);
+   }
+   EXPECT_EQ(pass_a.runs, 1u);
+
+   nir_opt_schedule_init(&sched);
+   while (nir_opt_schedule_iterate(&sched)) {
+      NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, &sched, nir_opt_changes_instrs,
+                                    nir_opt_changes_instrs, b->shader,
+                                    fake_pass, &pass_b);
+   }
+   EXPECT_EQ(pass_b.runs, 4u);
+}
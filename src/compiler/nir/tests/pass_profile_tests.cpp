@@ -0,0 +1,74 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "util/memstream.h"
+#include "nir_test.h"
+
+class nir_pass_profile_test : public nir_test {
+protected:
+   nir_pass_profile_test()
+      : nir_test::nir_test("nir_pass_profile_test")
+   {
+      nir_pass_profile_reset();
+      nir_pass_profile_start();
+   }
+
+   ~nir_pass_profile_test()
+   {
+      nir_pass_profile_stop();
+      nir_pass_profile_reset();
+   }
+
+   std::string dump()
+   {
+      char *result = NULL;
+      size_t result_size = 0;
+      struct u_memstream mem;
+      if (!u_memstream_open(&mem, &result, &result_size))
+         return "";
+
+      nir_pass_profile_dump_json(u_memstream_get(&mem));
+      u_memstream_close(&mem);
+
+      std::string str(result, result_size);
+      free(result);
+      return str;
+   }
+};
+
+TEST_F(nir_pass_profile_test, records_progress)
+{
+   nir_iadd(b, nir_imm_int(b, 1), nir_imm_int(b, 2));
+
+   bool progress = false;
+   NIR_PASS(progress, b->shader, nir_opt_dce);
+   ASSERT_TRUE(progress);
+
+   progress = false;
+   NIR_PASS(progress, b->shader, nir_opt_dce);
+   ASSERT_FALSE(progress);
+
+   std::string json = dump();
+   EXPECT_NE(json.find("\"stage\": \"CS\""), std::string::npos);
+   EXPECT_NE(json.find("\"instrs_before\": 3, \"instrs_after\": 0, \"progress\": true"),
+             std::string::npos);
+   EXPECT_NE(json.find("\"instrs_before\": 0, \"instrs_after\": 0, \"progress\": false"),
+             std::string::npos);
+   EXPECT_NE(json.find("{ \"pass\": \"nir_opt_dce\", \"calls\": 2, \"progress\": 1,"),
+             std::string::npos);
+}
+
+TEST_F(nir_pass_profile_test, stop)
+{
+   nir_iadd(b, nir_imm_int(b, 1), nir_imm_int(b, 2));
+   nir_pass_profile_stop();
+
+   bool progress = false;
+   NIR_PASS(progress, b->shader, nir_opt_dce);
+   ASSERT_TRUE(progress);
+
+   EXPECT_EQ(dump().find("nir_opt_dce"), std::string::npos);
+}
@@ -26,6 +26,7 @@
 #include "nir.h"
 #include "nir_builder.h"
 #include "nir_serialize.h"
+#include "util/os_time.h"
 
 namespace {
 
@@ -100,6 +101,28 @@ nir_serialize_test::ASSERT_SWIZZLE_EQ(nir_alu_instr *a, nir_alu_instr *b, unsign
 
 class nir_serialize_all_test : public nir_serialize_test {};
 class nir_serialize_all_but_one_test : public nir_serialize_test {};
+class nir_serialize_lazy_test : public nir_serialize_test {};
+
+static bool
+is_entrypoint(const nir_function *fxn, void *data)
+{
+   return fxn->is_entrypoint;
+}
+
+static bool
+has_name(const nir_function *fxn, void *data)
+{
+   return !strcmp(fxn->name, (const char *)data);
+}
+
+static unsigned
+count_impls(nir_shader *nir)
+{
+   unsigned count = 0;
+   nir_foreach_function_impl(impl, nir)
+      count++;
+   return count;
+}
 
 } // namespace
 
@@ -195,3 +218,93 @@ TEST_P(nir_serialize_all_but_one_test, single_channel)
 
    ASSERT_SWIZZLE_EQ(vec_alu, vec_alu_dup, 1, 0);
 }
+
+TEST_F(nir_serialize_lazy_test, only_reachable)
+{
+   nir_function *called = nir_function_create(b->shader, "called");
+   nir_function *unused = nir_function_create(b->shader, "unused");
+
+   nir_function_impl *called_impl = nir_function_impl_create(called);
+   nir_builder cb = nir_builder_at(nir_after_impl(called_impl));
+   nir_undef(&cb, 1, 32);
+
+   nir_function_impl *unused_impl = nir_function_impl_create(unused);
+   nir_builder ub = nir_builder_at(nir_after_impl(unused_impl));
+   nir_undef(&ub, 1, 32);
+
+   nir_build_call(b, called, 0, NULL);
+   nir_def *fmax = nir_fmax(b, nir_imm_float(b, 1.0), nir_imm_float(b, 2.0));
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b->shader, false);
+
+   nir_lazy_shader *lazy =
+      nir_deserialize_lazy(b->shader, &options, blob.data, blob.size);
+   ASSERT_NE(lazy, nullptr);
+   dup = nir_lazy_shader_get_shader(lazy);
+
+   ASSERT_EQ(exec_list_length(&dup->functions), 3u);
+   ASSERT_EQ(count_impls(dup), 0u);
+
+   /* Functions called by the wanted ones are read as well. */
+   nir_lazy_shader_load_functions(lazy, is_entrypoint, NULL);
+   ASSERT_EQ(count_impls(dup), 2u);
+   ASSERT_EQ(nir_shader_get_function_for_name(dup, "unused")->impl, nullptr);
+
+   nir_alu_instr *fmax_dup = get_last_alu(dup);
+   ASSERT_EQ(fmax_dup->op, nir_instr_as_alu(fmax->parent_instr)->op);
+
+   nir_lazy_shader_load_functions(lazy, has_name, (void *)"unused");
+   ASSERT_EQ(count_impls(dup), 3u);
+
+   blob_finish(&blob);
+}
+
+/* Compares reading a library of functions in full with reading a single
+ * function from it.  Run it with --gtest_also_run_disabled_tests.
+ */
+TEST_F(nir_serialize_lazy_test, DISABLED_benchmark)
+{
+   const unsigned num_functions = 2000, num_alus = 64, rounds = 20;
+
+   for (unsigned i = 0; i < num_functions; i++) {
+      char name[16];
+      snprintf(name, sizeof(name), "f%u", i);
+      nir_function *fxn = nir_function_create(b->shader, name);
+      nir_function_impl *impl = nir_function_impl_create(fxn);
+      nir_builder fb = nir_builder_at(nir_after_impl(impl));
+
+      nir_def *x = nir_load_local_invocation_index(&fb);
+      for (unsigned j = 0; j < num_alus; j++)
+         x = nir_iadd_imm(&fb, nir_imul(&fb, x, x), j);
+      nir_store_global(&fb, nir_imm_int64(&fb, 0), 4, x, 0x1);
+   }
+
+   struct blob blob;
+   blob_init(&blob);
+   nir_serialize(&blob, b->shader, false);
+
+   int64_t full = 0, lazy = 0;
+   for (unsigned r = 0; r < rounds; r++) {
+      int64_t start = os_time_get_nano();
+      struct blob_reader reader;
+      blob_reader_init(&reader, blob.data, blob.size);
+      ralloc_free(nir_deserialize(NULL, &options, &reader));
+      full += os_time_get_nano() - start;
+
+      start = os_time_get_nano();
+      nir_lazy_shader *l = nir_deserialize_lazy(NULL, &options,
+                                                blob.data, blob.size);
+      nir_lazy_shader_load_functions(l, has_name, (void *)"f7");
+      ralloc_free(l);
+      lazy += os_time_get_nano() - start;
+   }
+
+   double mb = blob.size * (double)rounds / (1024 * 1024);
+   printf("%u functions, %.2f MB: full %.1f MB/s, one function %.1f MB/s\n",
+          num_functions, blob.size / (1024.0 * 1024.0),
+          mb / (full / 1e9), mb / (lazy / 1e9));
+
+   blob_finish(&blob);
+}
@@ -6799,6 +6799,7 @@ vtn_create_builder(const uint32_t *words, size_t word_count,
    b->line = -1;
    b->col = -1;
    list_inithead(&b->functions);
+   util_dynarray_init(&b->functions_to_emit, b);
    b->entry_point_stage = stage;
    b->entry_point_name = entry_point_name;
 
@@ -7144,22 +7145,41 @@ spirv_to_nir(const uint32_t *words, size_t word_count,
 
    vtn_build_cfg(b, words, word_end);
 
-   if (!options->create_library) {
+   if (options->create_library) {
+      vtn_foreach_function(func, &b->functions) {
+         _mesa_hash_table_clear(b->strings, NULL);
+         vtn_function_emit(b, func, vtn_handle_body_instruction);
+      }
+   } else {
       assert(b->entry_point->value_type == vtn_value_type_function);
       b->entry_point->func->referenced = true;
-   }
+      util_dynarray_append(&b->functions_to_emit, struct vtn_function *,
+                           b->entry_point->func);
+
+      /* Only emit the functions reachable from the entry point, as they are
+       * found by vtn_handle_function_call().
+       */
+      while (util_dynarray_num_elements(&b->functions_to_emit,
+                                        struct vtn_function *)) {
+         struct vtn_function *func =
+            util_dynarray_pop(&b->functions_to_emit, struct vtn_function *);
 
-   bool progress;
-   do {
-      progress = false;
+         /* Imported functions have no body. */
+         if (func->start_block == NULL || func->emitted)
+            continue;
+
+         _mesa_hash_table_clear(b->strings, NULL);
+         vtn_function_emit(b, func, vtn_handle_body_instruction);
+      }
+
+      /* The other functions were only declared by the prepass and nothing
+       * calls them, drop them rather than have later passes walk them.
+       */
       vtn_foreach_function(func, &b->functions) {
-         if ((options->create_library || func->referenced) && !func->emitted) {
-            _mesa_hash_table_clear(b->strings, NULL);
-            vtn_function_emit(b, func, vtn_handle_body_instruction);
-            progress = true;
-         }
+         if (!func->emitted)
+            exec_node_remove(&func->nir_func->node);
       }
-   } while (progress);
+   }
 
    if (!options->create_library) {
       vtn_assert(b->entry_point->value_type == vtn_value_type_function);
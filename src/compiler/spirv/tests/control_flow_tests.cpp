@@ -240,4 +240,56 @@ OpFunctionEnd
    };
    get_nir(ARRAY_SIZE(words), words, MESA_SHADER_COMPUTE);
    ASSERT_TRUE(shader);
-}
\ No newline at end of file
+}
+
+TEST_F(ControlFlow, UncalledFunction)
+{
+   /*
+               OpCapability Shader
+               OpMemoryModel Logical GLSL450
+               OpEntryPoint GLCompute %main "main"
+               OpExecutionMode %main LocalSize 1 1 1
+               OpName %main "main"
+               OpName %used "used"
+               OpName %unused "unused"
+       %void = OpTypeVoid
+          %2 = OpTypeFunction %void
+     %unused = OpFunction %void None %2
+          %6 = OpLabel
+               OpReturn
+               OpFunctionEnd
+       %used = OpFunction %void None %2
+          %7 = OpLabel
+               OpReturn
+               OpFunctionEnd
+       %main = OpFunction %void None %2
+          %8 = OpLabel
+          %9 = OpFunctionCall %void %used
+               OpReturn
+               OpFunctionEnd
+    */
+   static const uint32_t words[] = {
+      0x07230203, 0x00010000, 0x00000000, 0x0000000a, 0x00000000, 0x00020011,
+      0x00000001, 0x0003000e, 0x00000000, 0x00000001, 0x0005000f, 0x00000005,
+      0x00000003, 0x6e69616d, 0x00000000, 0x00060010, 0x00000003, 0x00000011,
+      0x00000001, 0x00000001, 0x00000001, 0x00040005, 0x00000003, 0x6e69616d,
+      0x00000000, 0x00040005, 0x00000004, 0x64657375, 0x00000000, 0x00040005,
+      0x00000005, 0x73756e75, 0x00006465, 0x00020013, 0x00000001, 0x00030021,
+      0x00000002, 0x00000001, 0x00050036, 0x00000001, 0x00000005, 0x00000000,
+      0x00000002, 0x000200f8, 0x00000006, 0x000100fd, 0x00010038, 0x00050036,
+      0x00000001, 0x00000004, 0x00000000, 0x00000002, 0x000200f8, 0x00000007,
+      0x000100fd, 0x00010038, 0x00050036, 0x00000001, 0x00000003, 0x00000000,
+      0x00000002, 0x000200f8, 0x00000008, 0x00040039, 0x00000001, 0x00000009,
+      0x00000004, 0x000100fd, 0x00010038,
+   };
+   get_nir(ARRAY_SIZE(words), words, MESA_SHADER_COMPUTE);
+   ASSERT_TRUE(shader);
+
+   /* Only the functions reachable from the entry point are translated. */
+   bool found_used = false;
+   nir_foreach_function(func, shader) {
+      ASSERT_STRNE(func->name, "unused");
+      found_used |= !strcmp(func->name, "used");
+   }
+   EXPECT_TRUE(found_used);
+}
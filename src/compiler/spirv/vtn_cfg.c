@@ -201,7 +201,11 @@ vtn_handle_function_call(struct vtn_builder *b, SpvOp opcode,
    struct vtn_function *vtn_callee =
       vtn_value(b, w[3], vtn_value_type_function)->func;
 
-   vtn_callee->referenced = true;
+   if (!vtn_callee->referenced) {
+      vtn_callee->referenced = true;
+      util_dynarray_append(&b->functions_to_emit, struct vtn_function *,
+                           vtn_callee);
+   }
 
    nir_call_instr *call = nir_call_instr_create(b->nb.shader,
                                                 vtn_callee->nir_func);
@@ -534,11 +538,6 @@ vtn_build_cfg(struct vtn_builder *b, const uint32_t *words, const uint32_t *end)
 {
    vtn_foreach_instruction(b, words, end,
                            vtn_cfg_handle_prepass_instruction);
-
-   if (b->shader->info.stage == MESA_SHADER_KERNEL)
-      return;
-
-   vtn_build_structured_cfg(b, words, end);
 }
 
 bool
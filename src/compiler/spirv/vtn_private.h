@@ -254,8 +254,7 @@ void vtn_emit_cf_func_structured(struct vtn_builder *b, struct vtn_function *fun
 bool vtn_handle_phis_first_pass(struct vtn_builder *b, SpvOp opcode,
                                 const uint32_t *w, unsigned count);
 void vtn_emit_ret_store(struct vtn_builder *b, const struct vtn_block *block);
-void vtn_build_structured_cfg(struct vtn_builder *b, const uint32_t *words,
-                              const uint32_t *end);
+void vtn_build_structured_cfg(struct vtn_builder *b, struct vtn_function *func);
 
 const uint32_t *
 vtn_foreach_instruction(struct vtn_builder *b, const uint32_t *start,
@@ -692,6 +691,9 @@ struct vtn_builder {
    struct vtn_function *func;
    struct list_head functions;
 
+   /* Functions found to be called but not emitted yet. */
+   struct util_dynarray functions_to_emit;
+
    struct hash_table *strings;
 
    /* Current function parameter index */
@@ -220,6 +220,8 @@ draw_destroy(struct draw_context *draw)
    draw_prim_assembler_destroy(draw->ia);
    draw_pipeline_destroy(draw);
    draw_pt_destroy(draw);
+   if (util_queue_is_initialized(&draw->pt.vs_queue))
+      util_queue_destroy(&draw->pt.vs_queue);
    draw_vs_destroy(draw);
    draw_gs_destroy(draw);
 #if DRAW_LLVM_AVAILABLE
@@ -1114,6 +1116,38 @@ draw_set_images(struct draw_context *draw,
 }
 
 
+/**
+ * Tell which of the sampler views and images set last are of textures the
+ * driver laid out in the tiles of sparse resources, without them being
+ * sparse.
+ */
+void
+draw_set_tiled_textures(struct draw_context *draw,
+                        enum pipe_shader_type shader_stage,
+                        const bool *sampler_views,
+                        unsigned num_sampler_views,
+                        const bool *images,
+                        unsigned num_images)
+{
+   assert(shader_stage < DRAW_MAX_SHADER_STAGE);
+   assert(num_sampler_views <= PIPE_MAX_SHADER_SAMPLER_VIEWS);
+   assert(num_images <= PIPE_MAX_SHADER_IMAGES);
+
+   draw_do_flush(draw, DRAW_FLUSH_STATE_CHANGE);
+
+   memset(draw->tiled_sampler_views[shader_stage], 0,
+          sizeof(draw->tiled_sampler_views[shader_stage]));
+   memset(draw->tiled_images[shader_stage], 0,
+          sizeof(draw->tiled_images[shader_stage]));
+   if (num_sampler_views)
+      memcpy(draw->tiled_sampler_views[shader_stage], sampler_views,
+             num_sampler_views * sizeof(bool));
+   if (num_images)
+      memcpy(draw->tiled_images[shader_stage], images,
+             num_images * sizeof(bool));
+}
+
+
 void
 draw_set_mapped_texture(struct draw_context *draw,
                         enum pipe_shader_type shader_stage,
@@ -1292,3 +1326,17 @@ draw_set_constant_buffer_stride(struct draw_context *draw, unsigned num_bytes)
 {
    draw->constant_buffer_stride = num_bytes;
 }
+
+
+/**
+ * Let the llvm middle end run the vertex shader of large draws on up to
+ * 'num_threads' worker threads, in addition to the calling thread.
+ * Primitives are still assembled, clipped and emitted in order on the
+ * calling thread.  The threads are only started by the first draw big
+ * enough to use them.
+ */
+void
+draw_set_vs_threads(struct draw_context *draw, unsigned num_threads)
+{
+   draw->pt.vs_threads = MIN2(num_threads, DRAW_MAX_VS_THREADS);
+}
@@ -149,6 +149,8 @@ void draw_set_zs_format(struct draw_context *draw, enum pipe_format format);
 /* for TGSI constants are 4 * sizeof(float), but for NIR they need to be sizeof(float); */
 void draw_set_constant_buffer_stride(struct draw_context *draw, unsigned num_bytes);
 
+void draw_set_vs_threads(struct draw_context *draw, unsigned num_threads);
+
 bool
 draw_install_aaline_stage(struct draw_context *draw, struct pipe_context *pipe);
 
@@ -221,6 +223,14 @@ draw_set_images(struct draw_context *draw,
                 struct pipe_image_view *images,
                 unsigned num);
 
+void
+draw_set_tiled_textures(struct draw_context *draw,
+                        enum pipe_shader_type shader_stage,
+                        const bool *sampler_views,
+                        unsigned num_sampler_views,
+                        const bool *images,
+                        unsigned num_images);
+
 void
 draw_set_mapped_texture(struct draw_context *draw,
                         enum pipe_shader_type shader_stage,
@@ -2023,6 +2023,32 @@ draw_llvm_generate(struct draw_llvm *llvm, struct draw_llvm_variant *variant)
 }
 
 
+static void
+draw_llvm_static_texture_state(const struct draw_context *draw,
+                               enum pipe_shader_type stage, unsigned i,
+                               struct lp_static_texture_state *state)
+{
+   const struct pipe_sampler_view *view = draw->sampler_views[stage][i];
+
+   lp_sampler_static_texture_state(state, view);
+   if (view && draw->tiled_sampler_views[stage][i])
+      lp_sampler_static_texture_state_tiled(state, view);
+}
+
+
+static void
+draw_llvm_static_texture_state_image(const struct draw_context *draw,
+                                     enum pipe_shader_type stage, unsigned i,
+                                     struct lp_static_texture_state *state)
+{
+   const struct pipe_image_view *view = draw->images[stage][i];
+
+   lp_sampler_static_texture_state_image(state, view);
+   if (view && view->resource && draw->tiled_images[stage][i])
+      lp_sampler_static_texture_state_image_tiled(state, view);
+}
+
+
 struct draw_llvm_variant_key *
 draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
 {
@@ -2098,16 +2124,16 @@ draw_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[PIPE_SHADER_VERTEX][i]);
    }
    for (unsigned i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[PIPE_SHADER_VERTEX][i]);
+      draw_llvm_static_texture_state(llvm->draw, PIPE_SHADER_VERTEX, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_llvm_variant_key_images(key);
    memset(draw_image, 0,
           key->nr_images * sizeof *draw_image);
    for (unsigned i = 0; i < key->nr_images; i++) {
-      lp_sampler_static_texture_state_image(&draw_image[i].image_state,
-                                            llvm->draw->images[PIPE_SHADER_VERTEX][i]);
+      draw_llvm_static_texture_state_image(llvm->draw, PIPE_SHADER_VERTEX, i,
+                                           &draw_image[i].image_state);
    }
    return key;
 }
@@ -2626,16 +2652,16 @@ draw_gs_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[PIPE_SHADER_GEOMETRY][i]);
    }
    for (unsigned i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[PIPE_SHADER_GEOMETRY][i]);
+      draw_llvm_static_texture_state(llvm->draw, PIPE_SHADER_GEOMETRY, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_gs_llvm_variant_key_images(key);
    memset(draw_image, 0,
           key->nr_images * sizeof *draw_image);
    for (unsigned i = 0; i < key->nr_images; i++) {
-      lp_sampler_static_texture_state_image(&draw_image[i].image_state,
-                                            llvm->draw->images[PIPE_SHADER_GEOMETRY][i]);
+      draw_llvm_static_texture_state_image(llvm->draw, PIPE_SHADER_GEOMETRY, i,
+                                           &draw_image[i].image_state);
    }
    return key;
 }
@@ -3298,16 +3324,16 @@ draw_tcs_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[PIPE_SHADER_TESS_CTRL][i]);
    }
    for (i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[PIPE_SHADER_TESS_CTRL][i]);
+      draw_llvm_static_texture_state(llvm->draw, PIPE_SHADER_TESS_CTRL, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_tcs_llvm_variant_key_images(key);
    memset(draw_image, 0,
           key->nr_images * sizeof *draw_image);
    for (i = 0; i < key->nr_images; i++) {
-      lp_sampler_static_texture_state_image(&draw_image[i].image_state,
-                                            llvm->draw->images[PIPE_SHADER_TESS_CTRL][i]);
+      draw_llvm_static_texture_state_image(llvm->draw, PIPE_SHADER_TESS_CTRL, i,
+                                           &draw_image[i].image_state);
    }
    return key;
 }
@@ -3846,16 +3872,16 @@ draw_tes_llvm_make_variant_key(struct draw_llvm *llvm, char *store)
                                       llvm->draw->samplers[PIPE_SHADER_TESS_EVAL][i]);
    }
    for (unsigned i = 0 ; i < key->nr_sampler_views; i++) {
-      lp_sampler_static_texture_state(&draw_sampler[i].texture_state,
-                                      llvm->draw->sampler_views[PIPE_SHADER_TESS_EVAL][i]);
+      draw_llvm_static_texture_state(llvm->draw, PIPE_SHADER_TESS_EVAL, i,
+                                     &draw_sampler[i].texture_state);
    }
 
    draw_image = draw_tes_llvm_variant_key_images(key);
    memset(draw_image, 0,
           key->nr_images * sizeof *draw_image);
    for (unsigned i = 0; i < key->nr_images; i++) {
-      lp_sampler_static_texture_state_image(&draw_image[i].image_state,
-                                            llvm->draw->images[PIPE_SHADER_TESS_EVAL][i]);
+      draw_llvm_static_texture_state_image(llvm->draw, PIPE_SHADER_TESS_EVAL, i,
+                                           &draw_image[i].image_state);
    }
    return key;
 }
@@ -44,6 +44,7 @@
 #include "pipe/p_state.h"
 #include "pipe/p_defines.h"
 #include "pipe/p_shader_tokens.h"
+#include "util/u_queue.h"
 
 #include "draw_vertex_header.h"
 
@@ -57,6 +58,11 @@ struct gallivm_state;
  */
 #define DRAW_MAX_SHADER_STAGE (PIPE_SHADER_GEOMETRY + 1)
 
+/**
+ * Max number of worker threads shading the vertices of large draws.
+ */
+#define DRAW_MAX_VS_THREADS 8
+
 /**
  * The largest possible index of a vertex that can be fetched.
  */
@@ -214,6 +220,10 @@ struct draw_context
       bool test_fse;         /* enable FSE even though its not correct (eg for softpipe) */
       bool no_fse;           /* disable FSE even when it is correct */
 
+      /** workers for the vertex shader, see draw_set_vs_threads() */
+      struct util_queue vs_queue;
+      unsigned vs_threads;
+
       /* user-space vertex data, buffers */
       struct {
          /** vertex element/index buffer (ex: glDrawElements) */
@@ -385,6 +395,12 @@ struct draw_context
    struct pipe_image_view *images[DRAW_MAX_SHADER_STAGE][PIPE_MAX_SHADER_IMAGES];
    unsigned num_images[DRAW_MAX_SHADER_STAGE];
 
+   /** Views of textures the driver laid out in the tiles of sparse
+    * resources without them being sparse.
+    */
+   bool tiled_sampler_views[DRAW_MAX_SHADER_STAGE][PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   bool tiled_images[DRAW_MAX_SHADER_STAGE][PIPE_MAX_SHADER_IMAGES];
+
    struct pipe_query_data_pipeline_statistics statistics;
    bool collect_statistics;
    bool collect_primgen;
@@ -489,6 +489,114 @@ emit(struct pt_emit *emit,
 }
 
 
+/* Below this many vertices per thread, handing chunks of a draw to the
+ * vs threads costs more than it saves.  Also keeps chunks a multiple of
+ * the widest vector the shader is run at.
+ */
+#define LLVM_VS_CHUNK_SIZE 512
+
+
+struct llvm_vs_chunk {
+   struct util_queue_fence fence;
+   struct llvm_middle_end *fpme;
+   struct vertex_header *verts;
+   unsigned count;
+   unsigned start;
+   unsigned vertex_id_offset;
+   const unsigned *elts;
+   bool clipped;
+};
+
+
+static void
+llvm_vs_chunk_run(void *data, void *gdata, int thread_index)
+{
+   struct llvm_vs_chunk *chunk = data;
+   struct llvm_middle_end *fpme = chunk->fpme;
+   struct draw_context *draw = fpme->draw;
+
+   chunk->clipped =
+      fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
+                                      &fpme->llvm->jit_resources[PIPE_SHADER_VERTEX],
+                                      chunk->verts,
+                                      draw->pt.user.vbuffer,
+                                      chunk->count,
+                                      chunk->start,
+                                      fpme->vertex_size,
+                                      draw->pt.vertex_buffer,
+                                      draw->instance_id,
+                                      chunk->vertex_id_offset,
+                                      draw->start_instance,
+                                      chunk->elts,
+                                      draw->pt.user.drawid,
+                                      draw->pt.user.viewid);
+}
+
+
+/**
+ * Run the fetch/vertex shader/clip test function over the vertices,
+ * split into chunks shaded in parallel on the vs threads if there are
+ * enough of them.  Each chunk writes its own range of 'verts', so the
+ * result is the same as with a single call.
+ */
+static bool
+llvm_middle_end_shade(struct llvm_middle_end *fpme,
+                      struct vertex_header *verts,
+                      unsigned count,
+                      unsigned start,
+                      unsigned vertex_id_offset,
+                      const unsigned *elts)
+{
+   struct draw_context *draw = fpme->draw;
+   struct llvm_vs_chunk chunks[DRAW_MAX_VS_THREADS + 1];
+   unsigned num_chunks = MIN2(count / LLVM_VS_CHUNK_SIZE,
+                              draw->pt.vs_threads + 1);
+
+   if (num_chunks > 1 && !util_queue_is_initialized(&draw->pt.vs_queue) &&
+       !util_queue_init(&draw->pt.vs_queue, "drawvs", DRAW_MAX_VS_THREADS,
+                        draw->pt.vs_threads, UTIL_QUEUE_INIT_RESIZE_IF_FULL,
+                        NULL))
+      num_chunks = 1;
+
+   const unsigned chunk_size = num_chunks > 1 ?
+      align(DIV_ROUND_UP(count, num_chunks), LLVM_VS_CHUNK_SIZE) : count;
+   num_chunks = DIV_ROUND_UP(count, chunk_size);
+
+   for (unsigned i = 0; i < num_chunks; i++) {
+      struct llvm_vs_chunk *chunk = &chunks[i];
+      const unsigned first = i * chunk_size;
+
+      chunk->fpme = fpme;
+      chunk->verts = (struct vertex_header *)
+         ((char *)verts + first * fpme->vertex_size);
+      chunk->count = MIN2(chunk_size, count - first);
+      /* Indexed fetches use 'start' as the max index instead. */
+      chunk->start = elts ? start : start + first;
+      chunk->vertex_id_offset = vertex_id_offset;
+      chunk->elts = elts ? elts + first : NULL;
+      chunk->clipped = false;
+
+      /* The calling thread does the first chunk itself. */
+      if (i > 0) {
+         util_queue_fence_init(&chunk->fence);
+         util_queue_add_job(&draw->pt.vs_queue, chunk, &chunk->fence,
+                            llvm_vs_chunk_run, NULL, 0);
+      }
+   }
+
+   llvm_vs_chunk_run(&chunks[0], NULL, 0);
+   bool clipped = chunks[0].clipped;
+
+   for (unsigned i = 1; i < num_chunks; i++) {
+      util_queue_fence_wait(&chunks[i].fence);
+      util_queue_fence_destroy(&chunks[i].fence);
+      clipped |= chunks[i].clipped;
+   }
+
+   return clipped;
+}
+
+
 static void
 llvm_pipeline_generic(struct draw_pt_middle_end *middle,
                       const struct draw_fetch_info *fetch_info,
@@ -553,20 +661,9 @@ llvm_pipeline_generic(struct draw_pt_middle_end *middle,
          elts = fetch_info->elts;
       }
       /* Run vertex fetch shader */
-      clipped = fpme->current_variant->jit_func(&fpme->llvm->vs_jit_context,
-                                                &fpme->llvm->jit_resources[PIPE_SHADER_VERTEX],
-                                                llvm_vert_info.verts,
-                                                draw->pt.user.vbuffer,
-                                                fetch_info->count,
-                                                start,
-                                                fpme->vertex_size,
-                                                draw->pt.vertex_buffer,
-                                                draw->instance_id,
-                                                vertex_id_offset,
-                                                draw->start_instance,
-                                                elts,
-                                                draw->pt.user.drawid,
-                                                draw->pt.user.viewid);
+      clipped = llvm_middle_end_shade(fpme, llvm_vert_info.verts,
+                                      fetch_info->count, start,
+                                      vertex_id_offset, elts);
 
       /* Finished with fetch and vs */
       fetch_info = NULL;
@@ -234,16 +234,23 @@ public:
       llvm::cantFail(JD->define(std::move(munit)));
    }
 
+   /* The first lookup in a JITDylib compiles its module, with the object
+    * cache of that module.  The cache is a property of the shared
+    * compiler, so it is only set for the duration of the lookup.
+    */
    static void *lookup_in_jd(
          const char *func_name,
-         LLVMOrcJITDylibRef jd) {
+         LLVMOrcJITDylibRef jd,
+         llvm::ObjectCache *objcache) {
       using llvm::orc::JITDylib;
       using llvm::JITEvaluatedSymbol;
       using llvm::orc::ExecutorAddr;
       JITDylib* JD = ::unwrap(jd);
       LPJit* jit = get_instance();
       jit->lookup_mutex.lock();
+      set_object_cache(objcache);
       auto func = ExitOnErr(jit->lljit->lookup(*JD, func_name));
+      set_object_cache(NULL);
       jit->lookup_mutex.unlock();
 #if LLVM_VERSION_MAJOR >= 15
       return func.toPtr<void *>();
@@ -304,9 +311,16 @@ void lpjit_exit()
    delete LPJit::jit;
 }
 
+/* Marks modules whose machine code comes from the object cache. */
+#define LP_CACHED_MODULE_MD "lp.cached"
+
 LLVMErrorRef module_transform(void *Ctx, LLVMModuleRef mod) {
    struct lp_passmgr *mgr;
 
+   /* The compile layer will not look at the IR, don't optimize it. */
+   if (LLVMGetNamedMetadataNumOperands(mod, LP_CACHED_MODULE_MD))
+      return LLVMErrorSuccess;
+
    lp_passmgr_create(mod, &mgr);
 
    lp_passmgr_run(mgr, mod,
@@ -624,7 +638,6 @@ gallivm_free_ir(struct gallivm_state *gallivm)
    gallivm->_ts_context=NULL;
    gallivm->cache=NULL;
    LPJit::deregister_gallivm_state(gallivm);
-   LPJit::set_object_cache(NULL);
 }
 
 void
@@ -646,6 +659,12 @@ gallivm_compile_module(struct gallivm_state *gallivm)
 
    lp_build_coro_add_malloc_hooks(gallivm);
 
+   if (gallivm->cache && gallivm->cache->data_size) {
+      LLVMValueRef md = LLVMMetadataAsValue(gallivm->context,
+         LLVMMDNodeInContext2(gallivm->context, NULL, 0));
+      LLVMAddNamedMetadataOperand(gallivm->module, LP_CACHED_MODULE_MD, md);
+   }
+
    LPJit::add_ir_module_to_jd(gallivm->_ts_context, gallivm->module,
       gallivm->_per_module_jd);
    /* ownership of module is now transferred into orc jit,
@@ -659,8 +678,6 @@ gallivm_compile_module(struct gallivm_state *gallivm)
          LPObjectCacheORC *objcache = new LPObjectCacheORC(gallivm->cache);
          gallivm->cache->jit_obj_cache = (void *)objcache;
       }
-      auto *objcache = (LPObjectCacheORC *)gallivm->cache->jit_obj_cache;
-      LPJit::set_object_cache(objcache);
    }
    /* defer compilation till first lookup by gallivm_jit_function */
 }
@@ -669,8 +686,11 @@ func_pointer
 gallivm_jit_function(struct gallivm_state *gallivm,
                      LLVMValueRef func, const char *func_name)
 {
+   LPObjectCacheORC *objcache = gallivm->cache ?
+      (LPObjectCacheORC *)gallivm->cache->jit_obj_cache : NULL;
+
    return pointer_to_func(
-      LPJit::lookup_in_jd(func_name, gallivm->_per_module_jd));
+      LPJit::lookup_in_jd(func_name, gallivm->_per_module_jd, objcache));
 }
 
 void
@@ -129,9 +129,8 @@ lp_sampler_static_texture_state(struct lp_static_texture_state *state,
    state->pot_height = util_is_power_of_two_or_zero(texture->height0);
    state->pot_depth = util_is_power_of_two_or_zero(texture->depth0);
    state->level_zero_only = !view->u.tex.last_level;
-   state->tiled = !!(texture->flags & PIPE_RESOURCE_FLAG_SPARSE);
-   if (state->tiled)
-      state->tiled_samples = texture->nr_samples;
+   if (texture->flags & PIPE_RESOURCE_FLAG_SPARSE)
+      lp_sampler_static_texture_state_tiled(state, view);
 
    /*
     * the layer / element / level parameters are all either dynamic
@@ -173,12 +172,8 @@ lp_sampler_static_texture_state_image(struct lp_static_texture_state *state,
    state->pot_height = util_is_power_of_two_or_zero(resource->height0);
    state->pot_depth = util_is_power_of_two_or_zero(resource->depth0);
    state->level_zero_only = view->u.tex.level == 0;
-   state->tiled = !!(resource->flags & PIPE_RESOURCE_FLAG_SPARSE);
-   if (state->tiled) {
-      state->tiled_samples = resource->nr_samples;
-      if (view->u.tex.is_2d_view_of_3d)
-         state->target = PIPE_TEXTURE_2D;
-   }
+   if (resource->flags & PIPE_RESOURCE_FLAG_SPARSE)
+      lp_sampler_static_texture_state_image_tiled(state, view);
 
    /*
     * the layer / element / level parameters are all either dynamic
@@ -187,6 +182,35 @@ lp_sampler_static_texture_state_image(struct lp_static_texture_state *state,
 }
 
 
+/**
+ * Mark the texture of an initialized texture state as laid out in the
+ * 64KiB tiles of sparse resources, see lp_build_tiled_sample_offset().
+ * Sparse textures always are, drivers may lay out other textures that way
+ * too.
+ */
+void
+lp_sampler_static_texture_state_tiled(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view)
+{
+   state->tiled = true;
+   state->tiled_samples = view->texture->nr_samples;
+}
+
+
+/**
+ * Same as lp_sampler_static_texture_state_tiled(), for image views.
+ */
+void
+lp_sampler_static_texture_state_image_tiled(struct lp_static_texture_state *state,
+                                            const struct pipe_image_view *view)
+{
+   state->tiled = true;
+   state->tiled_samples = view->resource->nr_samples;
+   if (view->u.tex.is_2d_view_of_3d)
+      state->target = PIPE_TEXTURE_2D;
+}
+
+
 /**
  * Initialize lp_sampler_static_sampler_state object with the gallium sampler
  * state (this contains the parts which are considered static).
@@ -2261,6 +2285,7 @@ lp_build_tiled_sample_offset(struct lp_build_context *bld,
    case PIPE_TEXTURE_CUBE:
    case PIPE_TEXTURE_RECT:
    case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_CUBE_ARRAY:
       res_dimensions = 2;
       break;
    case PIPE_TEXTURE_3D:
@@ -2276,6 +2301,7 @@ lp_build_tiled_sample_offset(struct lp_build_context *bld,
    case PIPE_TEXTURE_CUBE:
    case PIPE_TEXTURE_RECT:
    case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_CUBE_ARRAY:
       dimensions = 2;
       break;
    case PIPE_TEXTURE_3D:
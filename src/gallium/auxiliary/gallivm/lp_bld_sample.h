@@ -657,6 +657,14 @@ void
 lp_sampler_static_texture_state_image(struct lp_static_texture_state *state,
                                       const struct pipe_image_view *view);
 
+void
+lp_sampler_static_texture_state_tiled(struct lp_static_texture_state *state,
+                                      const struct pipe_sampler_view *view);
+
+void
+lp_sampler_static_texture_state_image_tiled(struct lp_static_texture_state *state,
+                                            const struct pipe_image_view *view);
+
 void
 lp_build_lod_selector(struct lp_build_sample_context *bld,
                       bool is_lodq,
@@ -61,6 +61,9 @@ llvmpipe_destroy(struct pipe_context *pipe)
    mtx_unlock(&lp_screen->ctx_mutex);
    lp_print_counters();
 
+   if (util_queue_is_initialized(&llvmpipe->fs_compile_queue))
+      util_queue_destroy(&llvmpipe->fs_compile_queue);
+
    if (llvmpipe->csctx) {
       lp_csctx_destroy(llvmpipe->csctx);
    }
@@ -272,6 +275,13 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    if (!llvmpipe->context.ref)
       goto fail;
 
+   /* Failing to start the thread just means compiling synchronously. */
+   if (lp_screen->async_compile) {
+      util_queue_init(&llvmpipe->fs_compile_queue, "lpfs", 32, 1,
+                      UTIL_QUEUE_INIT_RESIZE_IF_FULL |
+                      UTIL_QUEUE_INIT_USE_MINIMUM_PRIORITY, NULL);
+   }
+
    /*
     * Create drawing context and plug our rendering stage into it.
     */
@@ -288,6 +298,8 @@ llvmpipe_create_context(struct pipe_screen *screen, void *priv,
    draw_set_constant_buffer_stride(llvmpipe->draw,
                                    lp_get_constant_buffer_stride(screen));
 
+   draw_set_vs_threads(llvmpipe->draw, lp_screen->num_vs_threads);
+
    /* FIXME: devise alternative to draw_texture_samplers */
 
    llvmpipe->setup = lp_setup_create(&llvmpipe->pipe, llvmpipe->draw);
@@ -35,6 +35,7 @@
 
 #include "draw/draw_vertex.h"
 #include "util/u_blitter.h"
+#include "util/u_queue.h"
 
 #include "lp_tex_sample.h"
 #include "lp_jit.h"
@@ -192,6 +193,9 @@ struct llvmpipe_context {
    /** The LLVMContext to use for LLVM related work */
    lp_context_ref context;
 
+   /** Background compilation of fragment shader variants */
+   struct util_queue fs_compile_queue;
+
    int max_global_buffers;
    struct pipe_resource **global_buffers;
 
@@ -31,6 +31,7 @@
 #include "util/u_thread.h"
 #include "util/u_memory.h"
 #include "lp_cs_tpool.h"
+#include "lp_thread.h"
 
 static int
 lp_cs_tpool_worker(void *data)
@@ -101,6 +102,7 @@ lp_cs_tpool_create(unsigned num_threads)
          num_threads = i;  /* previous thread is max */
          break;
       }
+      lp_thread_pin(pool->threads[i], i, num_threads);
    }
    pool->num_threads = num_threads;
    return pool;
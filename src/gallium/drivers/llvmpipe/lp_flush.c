@@ -120,24 +120,41 @@ llvmpipe_flush_resource(struct pipe_context *pipe,
                         bool do_not_block,
                         const char *reason)
 {
-   unsigned referenced = 0;
+   unsigned referenced = 0, referenced_elsewhere = 0;
+   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct llvmpipe_screen *lp_screen = llvmpipe_screen(pipe->screen);
+   const unsigned conflicts = read_only ?
+      LP_REFERENCED_FOR_WRITE :
+      LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
 
    mtx_lock(&lp_screen->ctx_mutex);
    list_for_each_entry(struct llvmpipe_context, ctx, &lp_screen->ctx_list, list) {
-      referenced |=
+      unsigned ref =
          llvmpipe_is_resource_referenced((struct pipe_context *)ctx,
                                          resource, level);
+      referenced |= ref;
+      if (ctx != llvmpipe)
+         referenced_elsewhere |= ref;
    }
    mtx_unlock(&lp_screen->ctx_mutex);
 
-   if ((referenced & LP_REFERENCED_FOR_WRITE) ||
-       ((referenced & LP_REFERENCED_FOR_READ) && !read_only)) {
+   if (referenced & conflicts) {
 
       if (cpu_access)
          if (do_not_block)
             return false;
 
+      /*
+       * If only scenes of this context which are already queued use the
+       * resource, waiting for them is enough and the scene being built
+       * doesn't need to be flushed.
+       */
+      if (!(referenced_elsewhere & conflicts)) {
+         draw_flush(llvmpipe->draw);
+         if (lp_setup_wait_resource(llvmpipe->setup, resource, conflicts))
+            return true;
+      }
+
       /*
        * Flush and wait.
        * Finish so VS can use FS results.
@@ -430,7 +430,7 @@ lp_jit_texture_from_pipe(struct lp_jit_texture *jit, const struct pipe_sampler_v
                 */
                jit->depth = view->u.tex.last_layer - view->u.tex.first_layer + 1;
                for (unsigned j = first_level; j <= last_level; j++) {
-                  if (is_2d_view_of_3d && (res->flags & PIPE_RESOURCE_FLAG_SPARSE)) {
+                  if (is_2d_view_of_3d && llvmpipe_resource_is_tiled(res)) {
                      jit->mip_offsets[j] = llvmpipe_get_texel_offset(
                         view->texture, j, 0, 0, view->u.tex.first_layer);
                   } else {
@@ -584,7 +584,7 @@ lp_jit_image_from_pipe(struct lp_jit_image *jit, const struct pipe_image_view *v
             jit->depth = view->u.tex.last_layer - view->u.tex.first_layer + 1;
 
             if (res->target == PIPE_TEXTURE_3D && view->u.tex.first_layer != 0 &&
-                (res->flags & PIPE_RESOURCE_FLAG_SPARSE)) {
+                llvmpipe_resource_is_tiled(res)) {
                mip_offset = llvmpipe_get_texel_offset(
                   res, view->u.tex.level, 0, 0, view->u.tex.first_layer);
             } else {
@@ -66,7 +66,13 @@
 
 #define LP_MAX_SAMPLES 4
 
-#define LP_MAX_THREADS 32
+#define LP_MAX_THREADS 256
+
+/**
+ * Max number of L3 cache domains the worker threads are grouped by,
+ * see lp_thread.h.
+ */
+#define LP_MAX_THREAD_GROUPS 32
 
 
 /**
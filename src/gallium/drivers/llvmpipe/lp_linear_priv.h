@@ -73,6 +73,7 @@ is_nearest_sampler(const struct lp_sampler_static_state *sampler)
 {
    return
       sampler->texture_state.target == PIPE_TEXTURE_2D &&
+      !sampler->texture_state.tiled &&
       sampler->sampler_state.min_img_filter == PIPE_TEX_FILTER_NEAREST &&
       sampler->sampler_state.mag_img_filter == PIPE_TEX_FILTER_NEAREST &&
       (sampler->texture_state.level_zero_only ||
@@ -91,6 +92,7 @@ is_linear_sampler(const struct lp_sampler_static_state *sampler)
 {
    return
       sampler->texture_state.target == PIPE_TEXTURE_2D &&
+      !sampler->texture_state.tiled &&
       sampler->sampler_state.min_img_filter == PIPE_TEX_FILTER_LINEAR &&
       sampler->sampler_state.mag_img_filter == PIPE_TEX_FILTER_LINEAR &&
       (sampler->texture_state.level_zero_only ||
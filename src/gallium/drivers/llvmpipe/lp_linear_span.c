@@ -0,0 +1,211 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include "util/detect.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "util/u_sse.h"
+
+#include "lp_linear_span.h"
+
+#if LP_LINEAR_SPAN_AVX
+#include <immintrin.h>
+#endif
+
+
+/* Functions using wider vectors than the build baseline are only
+ * called after checking the CPU caps.
+ */
+#if DETECT_CC_GCC
+#define LP_TARGET(t) __attribute__((target(t)))
+#else
+#define LP_TARGET(t)
+#endif
+
+
+void
+lp_linear_blend_premul_span_c(uint32_t *dst, const uint32_t *src,
+                              unsigned width)
+{
+   for (unsigned i = 0; i < width; i++) {
+      const uint32_t s = src[i];
+      const uint32_t d = dst[i];
+      const unsigned a = s >> 24;
+      uint32_t res = 0;
+
+      /* Same rounding as util_sse2_blend_premul_4() */
+      for (unsigned c = 0; c < 32; c += 8) {
+         const unsigned sc = (s >> c) & 0xff;
+         const unsigned dc = (d >> c) & 0xff;
+         const unsigned rc = sc + dc - ((dc * a) >> 8);
+         res |= MIN2(rc, 0xff) << c;
+      }
+
+      dst[i] = res;
+   }
+}
+
+
+#if DETECT_ARCH_SSE
+
+void
+lp_linear_blend_premul_span_sse2(uint32_t *dst, const uint32_t *src,
+                                 unsigned width)
+{
+   unsigned i;
+
+   for (i = 0; i + 3 < width; i += 4) {
+      const __m128i s = _mm_loadu_si128((const __m128i *)&src[i]);
+      const __m128i d = _mm_loadu_si128((const __m128i *)&dst[i]);
+      _mm_storeu_si128((__m128i *)&dst[i], util_sse2_blend_premul_4(s, d));
+   }
+
+   if (i < width)
+      lp_linear_blend_premul_span_c(dst + i, src + i, width - i);
+}
+
+#endif /* DETECT_ARCH_SSE */
+
+
+#if LP_LINEAR_SPAN_AVX
+
+/* See util_sse2_premul_blend_epi16(): s + d - ((d * a) >> 8) on pixels
+ * unpacked to 16 bits per channel.
+ */
+static inline LP_TARGET("avx2") __m256i
+blend_premul_epi16_avx2(__m256i s, __m256i d)
+{
+   __m256i a = _mm256_shufflelo_epi16(s, 0xff);
+   a = _mm256_shufflehi_epi16(a, 0xff);
+
+   const __m256i da = _mm256_srli_epi16(_mm256_mullo_epi16(d, a), 8);
+   return _mm256_add_epi16(s, _mm256_sub_epi16(d, da));
+}
+
+
+LP_TARGET("avx2") void
+lp_linear_blend_premul_span_avx2(uint32_t *dst, const uint32_t *src,
+                                 unsigned width)
+{
+   const __m256i zero = _mm256_setzero_si256();
+   unsigned i;
+
+   for (i = 0; i + 7 < width; i += 8) {
+      const __m256i s = _mm256_loadu_si256((const __m256i *)&src[i]);
+      const __m256i d = _mm256_loadu_si256((const __m256i *)&dst[i]);
+
+      /* Unpacking and packing both work within 128 bit lanes, so the
+       * pixels end up back in place.
+       */
+      const __m256i lo =
+         blend_premul_epi16_avx2(_mm256_unpacklo_epi8(s, zero),
+                                 _mm256_unpacklo_epi8(d, zero));
+      const __m256i hi =
+         blend_premul_epi16_avx2(_mm256_unpackhi_epi8(s, zero),
+                                 _mm256_unpackhi_epi8(d, zero));
+
+      _mm256_storeu_si256((__m256i *)&dst[i], _mm256_packus_epi16(lo, hi));
+   }
+
+   if (i < width)
+      lp_linear_blend_premul_span_c(dst + i, src + i, width - i);
+}
+
+
+static inline LP_TARGET("avx512f,avx512bw") __m512i
+blend_premul_epi16_avx512(__m512i s, __m512i d)
+{
+   __m512i a = _mm512_shufflelo_epi16(s, 0xff);
+   a = _mm512_shufflehi_epi16(a, 0xff);
+
+   const __m512i da = _mm512_srli_epi16(_mm512_mullo_epi16(d, a), 8);
+   return _mm512_add_epi16(s, _mm512_sub_epi16(d, da));
+}
+
+
+LP_TARGET("avx512f,avx512bw") void
+lp_linear_blend_premul_span_avx512(uint32_t *dst, const uint32_t *src,
+                                   unsigned width)
+{
+   const __m512i zero = _mm512_setzero_si512();
+
+   /* The tail goes through masked loads and stores rather than a scalar
+    * loop.
+    */
+   for (unsigned i = 0; i < width; i += 16) {
+      const __mmask16 mask = width - i >= 16 ?
+         0xffff : (__mmask16)((1u << (width - i)) - 1);
+      const __m512i s = _mm512_maskz_loadu_epi32(mask, &src[i]);
+      const __m512i d = _mm512_maskz_loadu_epi32(mask, &dst[i]);
+
+      const __m512i lo =
+         blend_premul_epi16_avx512(_mm512_unpacklo_epi8(s, zero),
+                                   _mm512_unpacklo_epi8(d, zero));
+      const __m512i hi =
+         blend_premul_epi16_avx512(_mm512_unpackhi_epi8(s, zero),
+                                   _mm512_unpackhi_epi8(d, zero));
+
+      _mm512_mask_storeu_epi32(&dst[i], mask, _mm512_packus_epi16(lo, hi));
+   }
+}
+
+#endif /* LP_LINEAR_SPAN_AVX */
+
+
+/**
+ * Pick the widest premultiplied blend implementation the CPU supports.
+ */
+lp_linear_blend_span_func
+lp_linear_get_blend_premul_span(void)
+{
+   UNUSED const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+#if LP_LINEAR_SPAN_AVX
+   if (caps->has_avx512f && caps->has_avx512bw)
+      return lp_linear_blend_premul_span_avx512;
+   if (caps->has_avx2)
+      return lp_linear_blend_premul_span_avx2;
+#endif
+#if DETECT_ARCH_SSE
+   if (caps->has_sse2)
+      return lp_linear_blend_premul_span_sse2;
+#endif
+#if LP_LINEAR_SPAN_NEON
+   /* NEON is part of the arm64 baseline. */
+   if (DETECT_ARCH_AARCH64 || caps->has_neon)
+      return lp_linear_blend_premul_span_neon;
+#endif
+
+   return lp_linear_blend_premul_span_c;
+}
+
+
+void
+lp_linear_rgb1_span(uint32_t *dst, const uint32_t *src, unsigned width)
+{
+   /* Simple enough for the compiler to vectorize on any target. */
+   for (unsigned i = 0; i < width; i++)
+      dst[i] = src[i] | 0xff000000;
+}
+
+
+void
+lp_linear_fetch_nearest_span(uint32_t *dst, const uint32_t *src_row,
+                             int acc, int step, unsigned width)
+{
+   /* Unscaled rows, the common case for compositors, are plain copies. */
+   if (step == 256) {
+      memcpy(dst, &src_row[acc >> 8], width * sizeof *dst);
+      return;
+   }
+
+   for (unsigned i = 0; i < width; i++) {
+      dst[i] = src_row[acc >> 8];
+      acc += step;
+   }
+}
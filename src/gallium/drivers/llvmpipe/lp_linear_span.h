@@ -0,0 +1,91 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Span kernels of the linear rasterizer fastpaths (lp_state_fs_linear.c).
+ *
+ * A span is a row of at most TILE_SIZE packed 8bpc pixels.  Kernels with
+ * several implementations are picked at runtime from the CPU caps, the
+ * plain C version being the reference the others must match exactly.
+ */
+
+#ifndef LP_LINEAR_SPAN_H
+#define LP_LINEAR_SPAN_H
+
+#include <stdint.h>
+
+#include "util/detect.h"
+
+
+#if (DETECT_ARCH_X86 || DETECT_ARCH_X86_64) && \
+    (DETECT_CC_GCC || DETECT_CC_MSVC)
+#define LP_LINEAR_SPAN_AVX 1
+#else
+#define LP_LINEAR_SPAN_AVX 0
+#endif
+
+#if (DETECT_ARCH_AARCH64 || DETECT_ARCH_ARM) && !defined(__SOFTFP__)
+#define LP_LINEAR_SPAN_NEON 1
+#else
+#define LP_LINEAR_SPAN_NEON 0
+#endif
+
+
+/**
+ * Blend 'width' pixels of 'src' onto 'dst' with add/one/inv_src_alpha,
+ * ie. premultiplied alpha.  'src' is 16 byte aligned, 'dst' needn't be.
+ */
+typedef void
+(*lp_linear_blend_span_func)(uint32_t *dst, const uint32_t *src,
+                             unsigned width);
+
+void
+lp_linear_blend_premul_span_c(uint32_t *dst, const uint32_t *src,
+                              unsigned width);
+
+#if DETECT_ARCH_SSE
+void
+lp_linear_blend_premul_span_sse2(uint32_t *dst, const uint32_t *src,
+                                 unsigned width);
+#endif
+
+#if LP_LINEAR_SPAN_AVX
+void
+lp_linear_blend_premul_span_avx2(uint32_t *dst, const uint32_t *src,
+                                 unsigned width);
+
+void
+lp_linear_blend_premul_span_avx512(uint32_t *dst, const uint32_t *src,
+                                   unsigned width);
+#endif
+
+#if LP_LINEAR_SPAN_NEON
+void
+lp_linear_blend_premul_span_neon(uint32_t *dst, const uint32_t *src,
+                                 unsigned width);
+#endif
+
+lp_linear_blend_span_func
+lp_linear_get_blend_premul_span(void);
+
+
+/**
+ * Force the alpha channel of 'width' pixels to one.
+ */
+void
+lp_linear_rgb1_span(uint32_t *dst, const uint32_t *src, unsigned width);
+
+
+/**
+ * Nearest filtered fetch of 'width' texels of a row, starting at texel
+ * 'acc' and stepping by 'step', both in 24.8 fixed point.
+ */
+void
+lp_linear_fetch_nearest_span(uint32_t *dst, const uint32_t *src_row,
+                             int acc, int step, unsigned width);
+
+
+#endif /* LP_LINEAR_SPAN_H */
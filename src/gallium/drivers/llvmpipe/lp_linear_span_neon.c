@@ -0,0 +1,59 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+
+#include "util/detect.h"
+
+#include "lp_linear_span.h"
+
+#if LP_LINEAR_SPAN_NEON
+
+/* armhf builds default to vfp, not neon, and refuse to compile neon
+ * intrinsics unless told otherwise.  The caller checks the CPU caps.
+ */
+#if DETECT_ARCH_ARM
+#pragma GCC target ("fpu=neon")
+#endif
+
+#include <arm_neon.h>
+
+
+void
+lp_linear_blend_premul_span_neon(uint32_t *dst, const uint32_t *src,
+                                 unsigned width)
+{
+   /* De-interleaving loads put each channel of 16 pixels in its own
+    * register, so the alpha needs no shuffling.
+    */
+   while (width >= 16) {
+      const uint8x16x4_t s = vld4q_u8((const uint8_t *)src);
+      uint8x16x4_t d = vld4q_u8((const uint8_t *)dst);
+      const uint8x16_t a = s.val[3];
+
+      for (unsigned c = 0; c < 4; c++) {
+         /* s + d - ((d * a) >> 8), see util_sse2_premul_blend_epi16() */
+         const uint16x8_t lo = vmull_u8(vget_low_u8(d.val[c]),
+                                        vget_low_u8(a));
+         const uint16x8_t hi = vmull_u8(vget_high_u8(d.val[c]),
+                                        vget_high_u8(a));
+         const uint8x16_t da = vcombine_u8(vshrn_n_u16(lo, 8),
+                                           vshrn_n_u16(hi, 8));
+
+         d.val[c] = vqaddq_u8(s.val[c], vsubq_u8(d.val[c], da));
+      }
+
+      vst4q_u8((uint8_t *)dst, d);
+
+      width -= 16;
+      dst += 16;
+      src += 16;
+   }
+
+   if (width)
+      lp_linear_blend_premul_span_c(dst, src, width);
+}
+
+#endif /* LP_LINEAR_SPAN_NEON */
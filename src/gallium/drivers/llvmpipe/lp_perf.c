@@ -114,13 +114,24 @@ lp_print_counters(void)
       debug_printf("llvmpipe:   nr_rect_part_4x4:           %9u (%3.0f%% of %u)\n", lp_count.nr_rect_partially_covered_4, p2, total_4);
 
 
+      debug_printf("llvmpipe: nr_hiz_culled_16x16:          %9u\n", lp_count.nr_hiz_culled_16);
+      debug_printf("llvmpipe: nr_hiz_culled_4x4:            %9u\n", lp_count.nr_hiz_culled_4);
+
       debug_printf("llvmpipe: nr_color_tile_clear:          %9u\n", lp_count.nr_color_tile_clear);
       debug_printf("llvmpipe: nr_color_tile_load:           %9u\n", lp_count.nr_color_tile_load);
       debug_printf("llvmpipe: nr_color_tile_store:          %9u\n", lp_count.nr_color_tile_store);
 
       debug_printf("llvmpipe: nr_llvm_compiles:             %u\n", lp_count.nr_llvm_compiles);
+      debug_printf("llvmpipe: nr_llvm_cache_hits:           %u\n", lp_count.nr_llvm_cache_hits);
+      debug_printf("llvmpipe: nr_fs_async_hits:             %u\n", lp_count.nr_fs_async_hits);
+      debug_printf("llvmpipe: nr_fs_async_waits:            %u\n", lp_count.nr_fs_async_waits);
       debug_printf("llvmpipe: total LLVM compile time:      %.2f sec\n", lp_count.llvm_compile_time / 1000000.0);
       debug_printf("llvmpipe: average LLVM compile time:    %.2f sec\n", lp_count.llvm_compile_time / 1000000.0 / lp_count.nr_llvm_compiles);
 
+      for (unsigned i = 0; i < LP_MAX_THREADS; i++) {
+         if (lp_count.rast_idle_time[i])
+            debug_printf("llvmpipe: rast thread %2u idle time:     %.3f sec\n", i, lp_count.rast_idle_time[i] / 1000000.0);
+      }
+
    }
 }
@@ -34,6 +34,7 @@
 #define LP_PERF_H
 
 #include "util/compiler.h"
+#include "lp_limits.h"
 
 /**
  * Various counters
@@ -62,12 +63,20 @@ struct lp_counters
    unsigned nr_rect_fully_covered_4;
    unsigned nr_rect_partially_covered_4;
    unsigned nr_non_empty_4;
+   unsigned nr_hiz_culled_16;
+   unsigned nr_hiz_culled_4;
    unsigned nr_llvm_compiles;
+   unsigned nr_llvm_cache_hits;  /**< modules loaded from the disk cache */
+   unsigned nr_fs_async_hits;    /**< fs variants ready from the background */
+   unsigned nr_fs_async_waits;   /**< draws waiting for a background fs */
    int64_t llvm_compile_time;  /**< total, in microseconds */
 
    unsigned nr_color_tile_clear;
    unsigned nr_color_tile_load;
    unsigned nr_color_tile_store;
+
+   /** time each rasterizer thread spent waiting on its peers, in usecs */
+   int64_t rast_idle_time[LP_MAX_THREADS];
 };
 
 
@@ -76,10 +85,12 @@ extern struct lp_counters lp_count;
 
 /** Increment the named counter (only for debug builds) */
 #if MESA_DEBUG && !THREAD_SANITIZER
+#define LP_COUNTERS 1
 #define LP_COUNT(counter) lp_count.counter++
 #define LP_COUNT_ADD(counter, incr)  lp_count.counter += (incr)
 #define LP_COUNT_GET(counter) (lp_count.counter)
 #else
+#define LP_COUNTERS 0
 #define LP_COUNT(counter) do {} while (0)
 #define LP_COUNT_ADD(counter, incr) (void)(incr)
 #define LP_COUNT_GET(counter) 0
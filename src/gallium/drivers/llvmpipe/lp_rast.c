@@ -49,6 +49,7 @@
 #include "lp_scene.h"
 #include "lp_screen.h"
 #include "lp_tex_sample.h"
+#include "lp_thread.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -78,7 +79,7 @@ lp_rast_begin(struct lp_rasterizer *rast,
    LP_DBG(DEBUG_RAST, "%s\n", __func__);
 
    lp_scene_begin_rasterization(scene);
-   lp_scene_bin_iter_begin(scene);
+   lp_scene_bin_iter_begin(scene, rast->num_groups);
 }
 
 
@@ -126,6 +127,12 @@ lp_rast_tile_begin(struct lp_rasterizer_task *task,
                          scene->zsbuf.stride * task->y +
                          scene->zsbuf.format_bytes * task->x;
    }
+
+   if (task->hiz_enabled) {
+      for (unsigned i = 0; i < ARRAY_SIZE(task->hiz_zmax); i++)
+         for (unsigned j = 0; j < ARRAY_SIZE(task->hiz_zmax[0]); j++)
+            task->hiz_zmax[i][j] = INFINITY;
+   }
 }
 
 
@@ -202,6 +209,21 @@ lp_rast_clear_zstencil(struct lp_rasterizer_task *task,
     * Clear the area of the depth/depth buffer matching this tile.
     */
 
+   if (task->hiz_enabled) {
+      const enum pipe_format format = scene->fb.zsbuf->format;
+      const uint64_t depth_mask = util_pack64_mask_z(format, 0xffffffff);
+      float zmax = INFINITY;
+
+      if ((clear_mask64 & depth_mask) == depth_mask)
+         util_format_unpack_z_float(format, &zmax, &clear_value64, 1);
+
+      if (clear_mask64 & depth_mask) {
+         for (unsigned i = 0; i < ARRAY_SIZE(task->hiz_zmax); i++)
+            for (unsigned j = 0; j < ARRAY_SIZE(task->hiz_zmax[0]); j++)
+               task->hiz_zmax[i][j] = zmax;
+      }
+   }
+
    if (scene->fb.zsbuf) {
       for (unsigned s = 0; s < scene->zsbuf.nr_samples; s++) {
          uint8_t *dst_layer =
@@ -318,65 +340,79 @@ lp_rast_shade_tile(struct lp_rasterizer_task *task,
    const struct lp_fragment_shader_variant *variant = state->variant;
 
    unsigned view_index = inputs->view_index;
-   /* render the whole 64x64 tile in 4x4 chunks */
-   for (unsigned y = 0; y < task->height; y += 4){
-      for (unsigned x = 0; x < task->width; x += 4) {
-         /* color buffer */
-         uint8_t *color[PIPE_MAX_COLOR_BUFS];
-         unsigned stride[PIPE_MAX_COLOR_BUFS];
-         unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
-         for (unsigned i = 0; i < scene->fb.nr_cbufs; i++){
-            if (scene->fb.cbufs[i]) {
-               stride[i] = scene->cbufs[i].stride;
-               sample_stride[i] = scene->cbufs[i].sample_stride;
-               color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
-                                          tile_y + y,
-                                          inputs->layer, view_index);
-            } else {
-               stride[i] = 0;
-               sample_stride[i] = 0;
-               color[i] = NULL;
-            }
-         }
-
-         /* depth buffer */
-         uint8_t *depth = NULL;
-         unsigned depth_stride = 0;
-         unsigned depth_sample_stride = 0;
-         if (scene->zsbuf.map) {
-            depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
-                                           tile_y + y,
-                                           inputs->layer, view_index);
-            depth_stride = scene->zsbuf.stride;
-            depth_sample_stride = scene->zsbuf.sample_stride;
+   /* render the whole 64x64 tile in 16x16 blocks of 4x4 chunks */
+   for (unsigned by = 0; by < task->height; by += 16) {
+      for (unsigned bx = 0; bx < task->width; bx += 16) {
+         if (lp_rast_hiz_cull(task, inputs, tile_x + bx, tile_y + by, 16)) {
+            LP_COUNT(nr_hiz_culled_16);
+            continue;
          }
+         lp_rast_hiz_invalidate(task, tile_x + bx, tile_y + by);
+
+         const unsigned y_end = MIN2(by + 16, task->height);
+         const unsigned x_end = MIN2(bx + 16, task->width);
+         for (unsigned y = by; y < y_end; y += 4) {
+            for (unsigned x = bx; x < x_end; x += 4) {
+               /* color buffer */
+               uint8_t *color[PIPE_MAX_COLOR_BUFS];
+               unsigned stride[PIPE_MAX_COLOR_BUFS];
+               unsigned sample_stride[PIPE_MAX_COLOR_BUFS];
+               for (unsigned i = 0; i < scene->fb.nr_cbufs; i++){
+                  if (scene->fb.cbufs[i]) {
+                     stride[i] = scene->cbufs[i].stride;
+                     sample_stride[i] = scene->cbufs[i].sample_stride;
+                     color[i] = lp_rast_get_color_block_pointer(task, i, tile_x + x,
+                                                tile_y + y,
+                                                inputs->layer, view_index);
+                  } else {
+                     stride[i] = 0;
+                     sample_stride[i] = 0;
+                     color[i] = NULL;
+                  }
+               }
 
-         uint64_t mask = 0;
-         for (unsigned i = 0; i < scene->fb_max_samples; i++)
-            mask |= (uint64_t)(0xffff) << (16 * i);
+               /* depth buffer */
+               uint8_t *depth = NULL;
+               unsigned depth_stride = 0;
+               unsigned depth_sample_stride = 0;
+               if (scene->zsbuf.map) {
+                  depth = lp_rast_get_depth_block_pointer(task, tile_x + x,
+                                                 tile_y + y,
+                                                 inputs->layer, view_index);
+                  depth_stride = scene->zsbuf.stride;
+                  depth_sample_stride = scene->zsbuf.sample_stride;
+               }
 
-         /* Propagate non-interpolated raster state. */
-         task->thread_data.raster_state.viewport_index = inputs->viewport_index;
-         task->thread_data.raster_state.view_index = inputs->view_index;
+               uint64_t mask = 0;
+               for (unsigned i = 0; i < scene->fb_max_samples; i++)
+                  mask |= (uint64_t)(0xffff) << (16 * i);
+
+               /* Propagate non-interpolated raster state. */
+               task->thread_data.raster_state.viewport_index = inputs->viewport_index;
+               task->thread_data.raster_state.view_index = inputs->view_index;
+
+               /* run shader on 4x4 block */
+               BEGIN_JIT_CALL(state, task);
+               variant->jit_function[RAST_WHOLE](&state->jit_context,
+                                                 &state->jit_resources,
+                                                  tile_x + x, tile_y + y,
+                                                  inputs->frontfacing,
+                                                  GET_A0(inputs),
+                                                  GET_DADX(inputs),
+                                                  GET_DADY(inputs),
+                                                  color,
+                                                  depth,
+                                                  mask,
+                                                  &task->thread_data,
+                                                  stride,
+                                                  depth_stride,
+                                                  sample_stride,
+                                                  depth_sample_stride);
+               END_JIT_CALL();
+            }
+         }
 
-         /* run shader on 4x4 block */
-         BEGIN_JIT_CALL(state, task);
-         variant->jit_function[RAST_WHOLE](&state->jit_context,
-                                           &state->jit_resources,
-                                            tile_x + x, tile_y + y,
-                                            inputs->frontfacing,
-                                            GET_A0(inputs),
-                                            GET_DADX(inputs),
-                                            GET_DADY(inputs),
-                                            color,
-                                            depth,
-                                            mask,
-                                            &task->thread_data,
-                                            stride,
-                                            depth_stride,
-                                            sample_stride,
-                                            depth_sample_stride);
-         END_JIT_CALL();
+         lp_rast_hiz_update(task, inputs, tile_x + bx, tile_y + by);
       }
    }
 }
@@ -464,6 +500,12 @@ lp_rast_shade_quads_mask_sample(struct lp_rasterizer_task *task,
     * allocated 4x4 blocks hence need to filter them out here.
     */
    if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+      if (lp_rast_hiz_cull(task, inputs, x, y, 4)) {
+         LP_COUNT(nr_hiz_culled_4);
+         return;
+      }
+      lp_rast_hiz_invalidate(task, x, y);
+
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
@@ -1046,6 +1088,23 @@ rasterize_scene(struct lp_rasterizer_task *task,
 {
    task->scene = scene;
 
+   /* Coarse depth culling, for single sampled depth buffers only. */
+   task->hiz_enabled = false;
+   if (scene->fb.zsbuf && scene->zsbuf.nr_samples == 1 &&
+       !(LP_PERF & PERF_NO_HIZ)) {
+      const struct util_format_description *desc =
+         util_format_description(scene->fb.zsbuf->format);
+
+      if (util_format_has_depth(desc)) {
+         const struct util_format_channel_description *chan =
+            &desc->channel[desc->swizzle[0]];
+
+         task->hiz_enabled = true;
+         task->hiz_quantum = chan->type == UTIL_FORMAT_TYPE_FLOAT ? 0.0f :
+            (float)(1.0 / (double)u_uintN_max(chan->size));
+      }
+   }
+
    /* Clear the cache tags. This should not always be necessary but
     * simpler for now.
     */
@@ -1064,7 +1123,7 @@ rasterize_scene(struct lp_rasterizer_task *task,
       int i, j;
 
       assert(scene);
-      while ((bin = lp_scene_bin_iter_next(scene, &i, &j))) {
+      while ((bin = lp_scene_bin_iter_next(scene, task->group, &i, &j))) {
          if (!is_empty_bin(bin))
             rasterize_bin(task, bin, i, j);
       }
@@ -1195,7 +1254,14 @@ thread_function(void *init_data)
       /* Wait for all threads to get here so that threads[1+] don't
        * get a null rast->curr_scene pointer.
        */
+#if LP_COUNTERS
+      int64_t idle_start = os_time_get();
+#endif
       util_barrier_wait(&rast->barrier);
+#if LP_COUNTERS
+      LP_COUNT_ADD(rast_idle_time[task->thread_index],
+                   os_time_get() - idle_start);
+#endif
 
       /* do work */
       if (debug)
@@ -1204,7 +1270,14 @@ thread_function(void *init_data)
       rasterize_scene(task, rast->curr_scene);
 
       /* wait for all threads to finish with this scene */
+#if LP_COUNTERS
+      idle_start = os_time_get();
+#endif
       util_barrier_wait(&rast->barrier);
+#if LP_COUNTERS
+      LP_COUNT_ADD(rast_idle_time[task->thread_index],
+                   os_time_get() - idle_start);
+#endif
 
       /* XXX: shouldn't be necessary:
        */
@@ -1245,6 +1318,7 @@ create_rast_threads(struct lp_rasterizer *rast)
          rast->num_threads = i; /* previous thread is max */
          break;
       }
+      lp_thread_pin(rast->threads[i], i, rast->num_threads);
    }
 }
 
@@ -1271,6 +1345,7 @@ lp_rast_create(unsigned num_threads)
       struct lp_rasterizer_task *task = &rast->tasks[i];
       task->rast = rast;
       task->thread_index = i;
+      task->group = lp_thread_group(i, num_threads);
       task->thread_data.cache =
          align_malloc(sizeof(struct lp_build_format_cache), 16);
       if (!task->thread_data.cache) {
@@ -1279,6 +1354,7 @@ lp_rast_create(unsigned num_threads)
    }
 
    rast->num_threads = num_threads;
+   rast->num_groups = lp_thread_num_groups(num_threads);
 
    rast->no_rast = debug_get_bool_option("LP_NO_RAST", false);
 
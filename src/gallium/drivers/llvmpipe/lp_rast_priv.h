@@ -37,6 +37,7 @@
 #include "lp_state.h"
 #include "lp_texture.h"
 #include "lp_limits.h"
+#include "lp_perf.h"
 
 
 #define TILE_VECTOR_HEIGHT 4
@@ -97,9 +98,20 @@ struct lp_rasterizer_task
    /** "my" index */
    unsigned thread_index;
 
+   /** thread group (L3 cache domain) of this thread, see lp_thread.h */
+   unsigned group;
+
    /** Non-interpolated passthru state and occlude counter for visible pixels */
    struct lp_jit_thread_data thread_data;
 
+   /**
+    * Coarse depth of the current tile: an upper bound of the depth values
+    * of each 16x16 block of layer 0, INFINITY when unknown.
+    */
+   float hiz_zmax[TILE_SIZE / 16][TILE_SIZE / 16];
+   bool hiz_enabled;
+   float hiz_quantum;   /**< one unorm depth step, zero for float depth */
+
    util_semaphore work_ready;
    util_semaphore work_done;
 #ifdef _WIN32
@@ -128,6 +140,7 @@ struct lp_rasterizer
    struct lp_rasterizer_task tasks[LP_MAX_THREADS];
 
    unsigned num_threads;
+   unsigned num_groups;
    thrd_t threads[LP_MAX_THREADS];
 
    /** For synchronizing the rasterization threads */
@@ -218,6 +231,97 @@ lp_rast_get_depth_block_pointer(struct lp_rasterizer_task *task,
 }
 
 
+/**
+ * Conservative depth range of a primitive over the size x size block at
+ * x, y (window coords), covering both the unorm conversion and the
+ * rounding of the interpolation in the fragment shader.
+ */
+static inline void
+lp_rast_hiz_block_range(const struct lp_rasterizer_task *task,
+                        const struct lp_rast_shader_inputs *inputs,
+                        unsigned x, unsigned y, unsigned size,
+                        float *zmin, float *zmax)
+{
+   const float (*a0)[4] = (const float (*)[4])GET_A0(inputs);
+   const float dzdx = GET_DADX(inputs)[0][2];
+   const float dzdy = GET_DADY(inputs)[0][2];
+
+   /* The X component of a0 holds the polygon offset, see lp_state_setup.c */
+   const float zc = a0[0][2] + a0[0][0] + dzdx * x + dzdy * y;
+   const float ex = dzdx * size;
+   const float ey = dzdy * size;
+   const float eps = (fabsf(zc) + fabsf(ex) + fabsf(ey)) * (8.0f * FLT_EPSILON) +
+                     task->hiz_quantum;
+
+   *zmin = zc + MIN2(ex, 0.0f) + MIN2(ey, 0.0f) - eps;
+   *zmax = zc + MAX2(ex, 0.0f) + MAX2(ey, 0.0f) + eps;
+}
+
+
+/**
+ * Whether the depth test fails for every fragment of the primitive in the
+ * block at x, y, which must lie within a single 16x16 block of the tile.
+ * NaN depth never culls.
+ */
+static inline bool
+lp_rast_hiz_cull(const struct lp_rasterizer_task *task,
+                 const struct lp_rast_shader_inputs *inputs,
+                 unsigned x, unsigned y, unsigned size)
+{
+   if (!task->hiz_enabled || !task->state->variant->hiz_cull ||
+       inputs->layer || inputs->view_index)
+      return false;
+
+   float zmin, zmax;
+   lp_rast_hiz_block_range(task, inputs, x, y, size, &zmin, &zmax);
+
+   /* Clamped depth values never exceed one. */
+   if (zmin > 1.0f)
+      zmin = 1.0f;
+
+   return zmin > task->hiz_zmax[(y % TILE_SIZE) / 16][(x % TILE_SIZE) / 16];
+}
+
+
+/**
+ * Tighten the coarse depth of the 16x16 block at x, y after the primitive
+ * covered all of it.
+ */
+static inline void
+lp_rast_hiz_update(struct lp_rasterizer_task *task,
+                   const struct lp_rast_shader_inputs *inputs,
+                   unsigned x, unsigned y)
+{
+   if (!task->hiz_enabled || !task->state->variant->hiz_update ||
+       inputs->layer || inputs->view_index)
+      return;
+
+   float zmin, zmax;
+   lp_rast_hiz_block_range(task, inputs, x, y, 16, &zmin, &zmax);
+
+   /* Stored depth values are at least zero. */
+   if (zmax < 0.0f)
+      zmax = 0.0f;
+
+   float *cell = &task->hiz_zmax[(y % TILE_SIZE) / 16][(x % TILE_SIZE) / 16];
+   if (zmax < *cell)
+      *cell = zmax;
+}
+
+
+/**
+ * Forget the coarse depth of the 16x16 block containing x, y if the
+ * current state may increase the depth values there.
+ */
+static inline void
+lp_rast_hiz_invalidate(struct lp_rasterizer_task *task,
+                       unsigned x, unsigned y)
+{
+   if (task->hiz_enabled && task->state->variant->hiz_invalidate)
+      task->hiz_zmax[(y % TILE_SIZE) / 16][(x % TILE_SIZE) / 16] = INFINITY;
+}
+
+
 /**
  * Shade all pixels in a 4x4 block.  The fragment code omits the
  * triangle in/out tests.
@@ -268,6 +372,12 @@ lp_rast_shade_quads_all(struct lp_rasterizer_task *task,
     * allocated 4x4 blocks hence need to filter them out here.
     */
    if ((x % TILE_SIZE) < task->width && (y % TILE_SIZE) < task->height) {
+      if (lp_rast_hiz_cull(task, inputs, x, y, 4)) {
+         LP_COUNT(nr_hiz_culled_4);
+         return;
+      }
+      lp_rast_hiz_invalidate(task, x, y);
+
       /* Propagate non-interpolated raster state. */
       task->thread_data.raster_state.viewport_index = inputs->viewport_index;
       task->thread_data.raster_state.view_index = inputs->view_index;
@@ -25,6 +25,7 @@
  *
  **************************************************************************/
 
+#include "util/u_atomic.h"
 #include "util/u_framebuffer.h"
 #include "util/u_math.h"
 #include "util/u_memory.h"
@@ -103,6 +104,7 @@ lp_scene_destroy(struct lp_scene *scene)
    lp_scene_end_rasterization(scene);
    mtx_destroy(&scene->mutex);
    free(scene->tiles);
+   free(scene->bin_order);
    assert(scene->data.head == &scene->data.first);
    slab_free_st(&scene->setup->scene_slab, scene);
 }
@@ -147,6 +149,7 @@ lp_scene_bin_reset(struct lp_scene *scene, unsigned x, unsigned y)
    struct cmd_bin *bin = lp_scene_get_bin(scene, x, y);
 
    bin->last_state = NULL;
+   bin->num_cmds = 0;
    bin->head = bin->tail;
    if (bin->tail) {
       bin->tail->next = NULL;
@@ -550,60 +553,98 @@ lp_scene_is_resource_referenced(const struct lp_scene *scene,
 }
 
 
-/** advance curr_x,y to the next bin */
-static bool
-next_bin(struct lp_scene *scene)
+static int
+compare_bin_order(const void *a, const void *b)
 {
-   scene->curr_x++;
-   if (scene->curr_x >= scene->tiles_x) {
-      scene->curr_x = 0;
-      scene->curr_y++;
-   }
-   if (scene->curr_y >= scene->tiles_y) {
-      /* no more bins */
-      return false;
-   }
-   return true;
+   const uint64_t ka = *(const uint64_t *)a;
+   const uint64_t kb = *(const uint64_t *)b;
+   return ka < kb ? -1 : ka > kb ? 1 : 0;
 }
 
 
+/**
+ * Prepare the list of bins to hand out to the rasterizer threads.
+ * Called once per scene by one thread, before the other threads start
+ * pulling bins.
+ *
+ * Empty bins are dropped.  The framebuffer is cut in num_groups bands of
+ * tile rows, one per thread group (see lp_thread.h), so that threads
+ * sharing an L3 cache mostly touch the same part of the framebuffer.
+ * Within a band, bins are ordered by the number of commands binned into
+ * them so that the most expensive tiles start first and the cheap ones
+ * fill in the gaps at the end of the scene.  Bins of equal cost keep
+ * their raster order.
+ */
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene)
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_groups)
 {
-   scene->curr_x = scene->curr_y = -1;
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+   unsigned n = 0;
+
+   assert(num_groups >= 1 && num_groups <= LP_MAX_THREAD_GROUPS);
+
+   for (unsigned i = 0; i < num_bins; i++) {
+      const struct cmd_bin *bin = &scene->tiles[i];
+      if (bin->head) {
+         const uint64_t group = (i / scene->tiles_x) * num_groups /
+                                scene->tiles_y;
+         const uint64_t cost = MIN2(bin->num_cmds, 0xffffff);
+         scene->bin_order[n++] = group << 56 | (~cost & 0xffffff) << 32 | i;
+      }
+   }
+
+   /* Bins are collected in raster order, so the groups' runs are already
+    * in place and sorting only reorders bins within a run.
+    */
+   if (!(LP_PERF & PERF_NO_BIN_SORT))
+      qsort(scene->bin_order, n, sizeof(scene->bin_order[0]),
+            compare_bin_order);
+
+   unsigned i = 0;
+   for (unsigned g = 0; g < num_groups; g++) {
+      while (i < n && (scene->bin_order[i] >> 56) == g)
+         i++;
+      scene->bin_group_end[g] = i;
+      scene->bin_group_next[g] = g ? scene->bin_group_end[g - 1] : 0;
+   }
+   scene->num_bin_groups = num_groups;
 }
 
 
 /**
  * Return pointer to next bin to be rendered.
- * The lp_scene::curr_x and ::curr_y fields will be advanced.
  * Multiple rendering threads will call this function to get a chunk
- * of work (a bin) to work on.
+ * of work (a bin) to work on.  A thread takes bins from its own group's
+ * run first and then helps out the other groups.  Bins are handed out
+ * with a single atomic increment, so no lock is taken here.
  */
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene , int *x, int *y)
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned group,
+                       int *x, int *y)
 {
-   struct cmd_bin *bin = NULL;
+   const unsigned num_groups = scene->num_bin_groups;
 
-   mtx_lock(&scene->mutex);
+   for (unsigned k = 0; k < num_groups; k++) {
+      const unsigned g = (group + k) % num_groups;
 
-   if (scene->curr_x < 0) {
-      /* first bin */
-      scene->curr_x = 0;
-      scene->curr_y = 0;
-   } else if (!next_bin(scene)) {
-      /* no more bins left */
-      goto end;
-   }
+      /* Don't push the cursor of an exhausted run any further. */
+      if ((unsigned)p_atomic_read(&scene->bin_group_next[g]) >=
+          scene->bin_group_end[g])
+         continue;
 
-   bin = lp_scene_get_bin(scene, scene->curr_x, scene->curr_y);
-   *x = scene->curr_x;
-   *y = scene->curr_y;
+      const unsigned i = p_atomic_inc_return(&scene->bin_group_next[g]) - 1;
+      if (i >= scene->bin_group_end[g])
+         continue;
 
-end:
-   /*printf("return bin %p at %d, %d\n", (void *) bin, *bin_x, *bin_y);*/
-   mtx_unlock(&scene->mutex);
-   return bin;
+      const unsigned idx = (uint32_t)scene->bin_order[i];
+      *x = idx % scene->tiles_x;
+      *y = idx / scene->tiles_x;
+
+      return &scene->tiles[idx];
+   }
+
+   /* no more bins left */
+   return NULL;
 }
 
 
@@ -627,6 +668,14 @@ lp_scene_begin_binning(struct lp_scene *scene,
       if (!scene->tiles)
          return;
       memset(scene->tiles, 0, sizeof(struct cmd_bin) * num_required_tiles);
+
+      free(scene->bin_order);
+      scene->bin_order = malloc(num_required_tiles * sizeof(uint64_t));
+      if (!scene->bin_order) {
+         free(scene->tiles);
+         scene->tiles = NULL;
+         return;
+      }
       scene->num_alloced_tiles = num_required_tiles;
    }
 
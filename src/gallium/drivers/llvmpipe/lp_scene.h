@@ -98,6 +98,7 @@ struct cmd_bin {
    const struct lp_rast_state *last_state;  /* most recent state set in bin */
    struct cmd_block *head;
    struct cmd_block *tail;
+   unsigned num_cmds;  /**< commands binned so far, used as a cost estimate */
 };
 
 
@@ -197,8 +198,20 @@ struct lp_scene {
     */
    unsigned tiles_x, tiles_y;
 
-   int curr_x, curr_y;  /**< for iterating over bins */
-   mtx_t mutex;
+   /**
+    * Non-empty bins in the order they are handed out to the rasterizer
+    * threads.  The bins are split in one run per thread group, each
+    * covering a band of tile rows, and each run is sorted most expensive
+    * first.  Entries pack the group and the inverted bin cost in the high
+    * 32 bits and the bin index in the low 32 bits.
+    */
+   uint64_t *bin_order;
+   unsigned num_bin_groups;
+   unsigned bin_group_end[LP_MAX_THREAD_GROUPS];
+   /** next entry of each group's run, advanced atomically */
+   int bin_group_next[LP_MAX_THREAD_GROUPS];
+
+   mtx_t mutex;  /**< protects the resource and shader reference lists */
 
    unsigned num_alloced_tiles;
    struct cmd_bin *tiles;
@@ -344,6 +357,8 @@ lp_scene_bin_command(struct lp_scene *scene,
       tail->count++;
    }
 
+   bin->num_cmds++;
+
    return true;
 }
 
@@ -398,10 +413,11 @@ lp_scene_get_num_bins(const struct lp_scene *scene)
 
 
 void
-lp_scene_bin_iter_begin(struct lp_scene *scene);
+lp_scene_bin_iter_begin(struct lp_scene *scene, unsigned num_groups);
 
 struct cmd_bin *
-lp_scene_bin_iter_next(struct lp_scene *scene, int *x, int *y);
+lp_scene_bin_iter_next(struct lp_scene *scene, unsigned group,
+                       int *x, int *y);
 
 
 
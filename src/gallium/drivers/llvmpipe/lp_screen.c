@@ -50,6 +50,7 @@
 #include "lp_screen.h"
 #include "lp_context.h"
 #include "lp_debug.h"
+#include "lp_perf.h"
 #include "lp_public.h"
 #include "lp_limits.h"
 #include "lp_rast.h"
@@ -101,6 +102,9 @@ static const struct debug_named_value lp_perf_flags[] = {
    { "no_alphatest",   PERF_NO_ALPHATEST, NULL },
    { "no_rast_linear", PERF_NO_RAST_LINEAR, NULL },
    { "no_shade",       PERF_NO_SHADE, NULL },
+   { "no_bin_sort",    PERF_NO_BIN_SORT, NULL },
+   { "thread_pin",     PERF_THREAD_PIN, NULL },
+   { "no_hiz",         PERF_NO_HIZ, NULL },
    DEBUG_NAMED_VALUE_END
 };
 
@@ -769,6 +773,7 @@ llvmpipe_destroy_screen(struct pipe_screen *_screen)
 #endif
    mtx_destroy(&screen->rast_mutex);
    mtx_destroy(&screen->cs_mutex);
+   mtx_destroy(&screen->cs_variant_mutex);
    FREE(screen);
 }
 
@@ -888,6 +893,7 @@ lp_disk_cache_find_shader(struct llvmpipe_screen *screen,
       cache->data_size = 0;
       return;
    }
+   LP_COUNT(nr_llvm_cache_hits);
    cache->data_size = binary_size;
    cache->data = buffer;
 }
@@ -998,6 +1004,12 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    screen->num_threads = debug_get_num_option("LP_NUM_THREADS",
                                               screen->num_threads);
    screen->num_threads = MIN2(screen->num_threads, LP_MAX_THREADS);
+   screen->num_vs_threads = debug_get_num_option("LP_VS_THREADS", 0);
+   screen->parallel_binning = debug_get_bool_option("LP_PARALLEL_BINNING",
+                                                    false);
+   screen->tiled_textures = debug_get_bool_option("LP_TILED_TEXTURES",
+                                                  false);
+   screen->async_compile = debug_get_bool_option("LP_ASYNC_COMPILE", false);
 
 #if defined(HAVE_LIBDRM) && defined(HAVE_LINUX_UDMABUF_H)
    screen->udmabuf_fd = open("/dev/udmabuf", O_RDWR);
@@ -1023,6 +1035,7 @@ llvmpipe_create_screen(struct sw_winsys *winsys)
    list_inithead(&screen->ctx_list);
    (void) mtx_init(&screen->ctx_mutex, mtx_plain);
    (void) mtx_init(&screen->cs_mutex, mtx_plain);
+   (void) mtx_init(&screen->cs_variant_mutex, mtx_plain);
    (void) mtx_init(&screen->rast_mutex, mtx_plain);
 
    (void) mtx_init(&screen->late_mutex, mtx_plain);
@@ -53,6 +53,18 @@ struct llvmpipe_screen
 
    unsigned num_threads;
 
+   /* Worker threads for the vertex shader of large draws */
+   unsigned num_vs_threads;
+
+   /* Bin large triangle batches on the compute thread pool */
+   bool parallel_binning;
+
+   /* Lay out sampler-only textures in 64KiB tiles */
+   bool tiled_textures;
+
+   /* Speculatively compile fragment shader variants in the background */
+   bool async_compile;
+
    /* Increments whenever textures are modified.  Contexts can track this.
     */
    unsigned timestamp;
@@ -63,6 +75,11 @@ struct llvmpipe_screen
    struct lp_cs_tpool *cs_tpool;
    mtx_t cs_mutex;
 
+   /* Protects the compute, task and mesh shader variant lists.  A shader's
+    * variants can be created and looked up on several contexts at once.
+    */
+   mtx_t cs_variant_mutex;
+
    bool allow_cl;
 
    mtx_t late_mutex;
@@ -325,6 +325,8 @@ set_scene_state(struct lp_setup_context *setup,
 {
    const unsigned old_state = setup->state;
 
+   lp_setup_flush_tri_batch(setup);
+
    if (old_state == new_state)
       return true;
 
@@ -548,6 +550,8 @@ lp_setup_clear(struct lp_setup_context *setup,
     * clears again (we still clear tiles twice if a clear command succeeded
     * partially for one buffer).
     */
+   lp_setup_flush_tri_batch(setup);
+
    if (flags & PIPE_CLEAR_DEPTHSTENCIL) {
       unsigned flagszs = flags & PIPE_CLEAR_DEPTHSTENCIL;
       if (!lp_setup_try_clear_zs(setup, depth, stencil, flagszs)) {
@@ -580,6 +584,8 @@ lp_setup_bind_rasterizer(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_tri_batch(setup);
+
    setup->ccw_is_frontface = rast->front_ccw;
    setup->cullmode = rast->cull_face;
    setup->triangle = first_triangle;
@@ -622,6 +628,8 @@ lp_setup_set_fs_variant(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s %p\n", __func__, variant);
 
+   lp_setup_flush_tri_batch(setup);
+
    setup->fs.current.variant = variant;
    setup->dirty |= LP_SETUP_NEW_FS;
 }
@@ -778,6 +786,7 @@ lp_setup_set_rasterizer_discard(struct lp_setup_context *setup,
                                 bool rasterizer_discard)
 {
    if (setup->rasterizer_discard != rasterizer_discard) {
+      lp_setup_flush_tri_batch(setup);
       setup->rasterizer_discard = rasterizer_discard;
       setup->line = first_line;
       setup->point = first_point;
@@ -879,6 +888,8 @@ lp_setup_set_fragment_sampler_views(struct lp_setup_context *setup,
 {
    LP_DBG(DEBUG_SETUP, "%s\n", __func__);
 
+   lp_setup_flush_tri_batch(setup);
+
    assert(num <= PIPE_MAX_SHADER_SAMPLER_VIEWS);
 
    const unsigned max_tex_num = MAX2(num, setup->fs.current_tex_num);
@@ -941,14 +952,19 @@ lp_setup_set_fragment_sampler_state(struct lp_setup_context *setup,
 
 
 /**
- * Is the given texture referenced by any scene?
- * Note: we have to check all scenes including any scenes currently
- * being rendered and the current scene being built.
+ * Is the given texture referenced by the scene being built?
+ * The framebuffer only counts once something (even just a clear) has
+ * been recorded for it.
  */
-unsigned
-lp_setup_is_resource_referenced(const struct lp_setup_context *setup,
-                                const struct pipe_resource *texture)
+static unsigned
+lp_setup_is_resource_binned(const struct lp_setup_context *setup,
+                            const struct pipe_resource *texture)
 {
+   struct lp_scene *scene = setup->scene;
+
+   if (setup->state == SETUP_FLUSHED || !scene)
+      return LP_UNREFERENCED;
+
    /* check the render targets */
    for (unsigned i = 0; i < setup->fb.nr_cbufs; i++) {
       if (setup->fb.cbufs[i] && setup->fb.cbufs[i]->texture == texture)
@@ -958,13 +974,64 @@ lp_setup_is_resource_referenced(const struct lp_setup_context *setup,
       return LP_REFERENCED_FOR_READ | LP_REFERENCED_FOR_WRITE;
    }
 
+   mtx_lock(&scene->mutex);
+   unsigned ref = lp_scene_is_resource_referenced(scene, texture);
+   mtx_unlock(&scene->mutex);
+
+   return ref;
+}
+
+
+/**
+ * Is the given texture referenced by a scene queued for rasterization?
+ * Scenes the rasterizer is done with still hold their references until
+ * they get reused, but they don't count.  If 'fence' is not NULL, it gets
+ * a reference to the fence of a scene that does reference the texture.
+ */
+static unsigned
+lp_setup_is_resource_queued(struct lp_scene *scene,
+                            const struct pipe_resource *texture,
+                            struct lp_fence **fence)
+{
+   unsigned ref = LP_UNREFERENCED;
+
+   /* The rasterizer drops the fence under the scene mutex when it is done
+    * with the scene, so take a reference to wait on before unlocking.
+    */
+   mtx_lock(&scene->mutex);
+   if (scene->fence && lp_fence_issued(scene->fence) &&
+       !lp_fence_signalled(scene->fence)) {
+      ref = lp_scene_is_resource_referenced(scene, texture);
+      if (ref && fence)
+         lp_fence_reference(fence, scene->fence);
+   }
+   mtx_unlock(&scene->mutex);
+
+   return ref;
+}
+
+
+/**
+ * Is the given texture referenced by any scene?
+ * Note: we have to check all scenes including any scenes currently
+ * being rendered and the current scene being built.
+ */
+unsigned
+lp_setup_is_resource_referenced(const struct lp_setup_context *setup,
+                                const struct pipe_resource *texture)
+{
+   unsigned ref = lp_setup_is_resource_binned(setup, texture);
+   if (ref)
+      return ref;
+
    /* check resources referenced by active scenes */
    for (unsigned i = 0; i < setup->num_active_scenes; i++) {
       struct lp_scene *scene = setup->scenes[i];
 
-      mtx_lock(&scene->mutex);
-      unsigned ref = lp_scene_is_resource_referenced(scene, texture);
-      mtx_unlock(&scene->mutex);
+      if (scene == setup->scene)
+         continue;
+
+      ref = lp_setup_is_resource_queued(scene, texture, NULL);
       if (ref)
          return ref;
    }
@@ -973,6 +1040,44 @@ lp_setup_is_resource_referenced(const struct lp_setup_context *setup,
 }
 
 
+/**
+ * Wait for the queued scenes whose use of the given texture conflicts
+ * with 'usage' (a mask of LP_REFERENCED_FOR_READ/WRITE bits), leaving
+ * the scene being built alone so that binning can carry on.
+ *
+ * Returns false, without waiting, if the scene being built has such a
+ * use too; the caller has to flush it then.
+ */
+bool
+lp_setup_wait_resource(struct lp_setup_context *setup,
+                       const struct pipe_resource *texture,
+                       unsigned usage)
+{
+   if (lp_setup_is_resource_binned(setup, texture) & usage)
+      return false;
+
+   /* Scenes are rasterized in order, so this waits no longer than for
+    * the last of them.
+    */
+   for (unsigned i = 0; i < setup->num_active_scenes; i++) {
+      struct lp_scene *scene = setup->scenes[i];
+
+      if (scene == setup->scene)
+         continue;
+
+      struct lp_fence *fence = NULL;
+
+      if (lp_setup_is_resource_queued(scene, texture, &fence) & usage) {
+         LP_DBG(DEBUG_SETUP, "%s: waiting for scene %u\n", __func__, i);
+         lp_fence_wait(fence);
+      }
+      lp_fence_reference(&fence, NULL);
+   }
+
+   return true;
+}
+
+
 /**
  * Called by vbuf code when we're about to draw something.
  *
@@ -1214,6 +1319,7 @@ lp_setup_update_state(struct lp_setup_context *setup,
       }
 
       if (lp->setup->dirty) {
+         lp_setup_flush_tri_batch(setup);
          llvmpipe_update_setup(lp);
       }
 
@@ -1279,6 +1385,7 @@ void
 lp_setup_destroy(struct lp_setup_context *setup)
 {
    lp_setup_reset(setup);
+   lp_setup_destroy_tri_batch(setup);
 
    util_unreference_framebuffer_state(&setup->fb);
 
@@ -1367,6 +1474,8 @@ lp_setup_create(struct pipe_context *pipe,
    setup->line     = first_line;
    setup->point    = first_point;
 
+   lp_setup_init_tri_batch(setup);
+
    setup->dirty = ~0;
 
    /* Initialize empty default fb correctly, so the rect is empty */
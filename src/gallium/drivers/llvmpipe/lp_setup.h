@@ -63,6 +63,9 @@ void
 lp_setup_flush(struct lp_setup_context *setup,
                const char *reason);
 
+void
+lp_setup_flush_tri_batch(struct lp_setup_context *setup);
+
 void
 lp_setup_bind_framebuffer(struct lp_setup_context *setup,
                           const struct pipe_framebuffer_state *fb);
@@ -130,6 +133,11 @@ unsigned
 lp_setup_is_resource_referenced(const struct lp_setup_context *setup,
                                 const struct pipe_resource *texture);
 
+bool
+lp_setup_wait_resource(struct lp_setup_context *setup,
+                       const struct pipe_resource *texture,
+                       unsigned usage);
+
 void
 lp_setup_set_sample_mask(struct lp_setup_context *setup,
                          uint32_t sample_mask);
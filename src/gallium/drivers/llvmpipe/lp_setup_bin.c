@@ -0,0 +1,445 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Deferred, multi-threaded triangle binning (LP_PARALLEL_BINNING).
+ *
+ * Instead of binning each triangle as the draw module hands it over,
+ * triangles are recorded (with a copy of their vertices) until something
+ * changes the setup state or needs the scene.  A large batch is then cut
+ * into contiguous chunks which are binned concurrently on the cs thread
+ * pool, each worker into a private shadow scene.  The per-tile command
+ * lists of the shadow scenes are finally spliced onto the real bins in
+ * chunk order, so every tile sees its commands in submission order.
+ *
+ * The invariant that makes this work is that a pending batch is always
+ * binned before the live setup state changes, see the callers of
+ * lp_setup_flush_tri_batch().
+ */
+
+#include "util/u_memory.h"
+#include "util/u_math.h"
+#include "lp_setup_context.h"
+#include "lp_context.h"
+#include "lp_cs_tpool.h"
+#include "lp_screen.h"
+#include "lp_debug.h"
+
+
+/** Bin a batch as soon as it gets this large */
+#define LP_TRI_BATCH_MAX_TRIS   (64 * 1024)
+#define LP_TRI_BATCH_MAX_VERTS  (16 * 1024 * 1024)
+
+/** Batches smaller than this are binned on the calling thread */
+#define LP_TRI_BATCH_MIN_PARALLEL_TRIS 4096
+
+/** Don't bother splitting a batch in chunks smaller than this */
+#define LP_TRI_BATCH_MIN_CHUNK_TRIS 1024
+
+
+struct lp_setup_bin_worker
+{
+   /** private copy of the setup state, binning into 'scene' */
+   struct lp_setup_context setup;
+
+   /** shadow scene holding only this worker's bins and data blocks */
+   struct lp_scene scene;
+   unsigned num_alloced_tiles;
+   unsigned initial_scene_size;
+
+   unsigned first_tri;
+   unsigned num_tris;
+   unsigned num_binned;    /**< triangles fully binned before any failure */
+
+   unsigned fpstate;       /**< floating point state of the calling thread */
+};
+
+
+void
+lp_setup_init_tri_batch(struct lp_setup_context *setup)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+   struct lp_setup_tri_batch *batch = &setup->tri_batch;
+
+   memset(batch, 0, sizeof *batch);
+   batch->enabled = screen->parallel_binning &&
+                    screen->num_threads > 1 &&
+                    screen->cs_tpool;
+   batch->vbuf_offset = ~0u;
+}
+
+
+void
+lp_setup_destroy_tri_batch(struct lp_setup_context *setup)
+{
+   struct lp_setup_tri_batch *batch = &setup->tri_batch;
+
+   for (unsigned i = 0; i < batch->num_workers; i++)
+      free(batch->workers[i].scene.tiles);
+
+   align_free(batch->workers);
+   align_free(batch->verts);
+   FREE(batch->tris);
+   memset(batch, 0, sizeof *batch);
+}
+
+
+/**
+ * Bin a triangle right away, when it can't be recorded.  The triangles
+ * already recorded are binned first to keep the primitive order.
+ */
+static void
+bin_triangle_unbatched(struct lp_setup_context *setup,
+                       const float (*v0)[4],
+                       const float (*v1)[4],
+                       const float (*v2)[4])
+{
+   lp_setup_flush_tri_batch(setup);
+   setup->tri_batch.triangle(setup, v0, v1, v2);
+}
+
+
+/**
+ * Record a triangle for deferred binning.  Installed as setup->triangle
+ * by lp_setup_tri_batch_install().
+ */
+static void
+batch_triangle(struct lp_setup_context *setup,
+               const float (*v0)[4],
+               const float (*v1)[4],
+               const float (*v2)[4])
+{
+   struct lp_setup_tri_batch *batch = &setup->tri_batch;
+   const uint8_t *vbuf = setup->vertex_buffer;
+
+   if (batch->num_tris >= LP_TRI_BATCH_MAX_TRIS ||
+       batch->verts_used >= LP_TRI_BATCH_MAX_VERTS)
+      lp_setup_flush_tri_batch(setup);
+
+   /* The draw module reuses the vertex buffer, so keep a copy of it the
+    * first time one of its triangles gets recorded.
+    */
+   if (batch->vbuf_offset == ~0u) {
+      const unsigned size = setup->nr_vertices * setup->vertex_size;
+
+      if (batch->num_tris == 0)
+         batch->verts_used = 0;
+
+      if (batch->verts_used + size > batch->verts_size) {
+         unsigned new_size = MAX2(batch->verts_size * 2,
+                                  batch->verts_used + size);
+         uint8_t *verts = align_realloc(batch->verts, batch->verts_size,
+                                        new_size, 16);
+         if (!verts) {
+            bin_triangle_unbatched(setup, v0, v1, v2);
+            return;
+         }
+         batch->verts = verts;
+         batch->verts_size = new_size;
+      }
+
+      memcpy(batch->verts + batch->verts_used, vbuf, size);
+      batch->vbuf_offset = batch->verts_used;
+      batch->verts_used += align(size, 16);
+   }
+
+   if (batch->num_tris == batch->tris_size) {
+      unsigned new_size = MAX2(batch->tris_size * 2, 1024);
+      uint32_t (*tris)[3] = REALLOC(batch->tris,
+                                    batch->tris_size * sizeof(*tris),
+                                    new_size * sizeof(*tris));
+      if (!tris) {
+         bin_triangle_unbatched(setup, v0, v1, v2);
+         return;
+      }
+      batch->tris = tris;
+      batch->tris_size = new_size;
+   }
+
+   uint32_t *tri = batch->tris[batch->num_tris++];
+   tri[0] = batch->vbuf_offset + ((const uint8_t *)v0 - vbuf);
+   tri[1] = batch->vbuf_offset + ((const uint8_t *)v1 - vbuf);
+   tri[2] = batch->vbuf_offset + ((const uint8_t *)v2 - vbuf);
+}
+
+
+/**
+ * Called at the end of lp_setup_choose_triangle(): route triangles to
+ * the batch and remember the real triangle function for binning.
+ */
+void
+lp_setup_tri_batch_install(struct lp_setup_context *setup)
+{
+   struct lp_setup_tri_batch *batch = &setup->tri_batch;
+
+   if (!batch->enabled)
+      return;
+
+   assert(batch->num_tris == 0);
+   batch->triangle = setup->triangle;
+   setup->triangle = batch_triangle;
+}
+
+
+static inline const float (*
+batch_vert(const struct lp_setup_tri_batch *batch, uint32_t offset))[4]
+{
+   return (const float (*)[4])(batch->verts + offset);
+}
+
+
+static void
+bin_worker_fn(void *data, int iter, struct lp_cs_local_mem *lmem)
+{
+   struct lp_setup_context *setup = data;
+   struct lp_setup_tri_batch *batch = &setup->tri_batch;
+   struct lp_setup_bin_worker *w = &batch->workers[iter];
+   unsigned fpstate = util_fpstate_get();
+
+   /* Bin with the same rounding/denorm behaviour as the serial path. */
+   util_fpstate_set(w->fpstate);
+
+   for (unsigned i = 0; i < w->num_tris; i++) {
+      const uint32_t *tri = batch->tris[w->first_tri + i];
+
+      batch->triangle(&w->setup,
+                      batch_vert(batch, tri[0]),
+                      batch_vert(batch, tri[1]),
+                      batch_vert(batch, tri[2]));
+
+      if (w->setup.bin_worker_failed)
+         break;
+      w->num_binned++;
+   }
+
+   util_fpstate_set(fpstate);
+}
+
+
+/**
+ * Prepare a worker's setup copy and shadow scene for binning a chunk.
+ */
+static bool
+bin_worker_begin(struct lp_setup_context *setup,
+                 struct lp_setup_bin_worker *w,
+                 unsigned budget)
+{
+   struct lp_scene *scene = setup->scene;
+   struct lp_scene *shadow = &w->scene;
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+
+   if (w->num_alloced_tiles < num_bins) {
+      free(shadow->tiles);
+      shadow->tiles = malloc(num_bins * sizeof(struct cmd_bin));
+      if (!shadow->tiles) {
+         w->num_alloced_tiles = 0;
+         return false;
+      }
+      w->num_alloced_tiles = num_bins;
+   }
+   memset(shadow->tiles, 0, num_bins * sizeof(struct cmd_bin));
+
+   /* Only the fields looked at while binning triangles. */
+   shadow->pipe = scene->pipe;
+   shadow->setup = &w->setup;
+   shadow->fb = scene->fb;
+   shadow->fb_max_layer = scene->fb_max_layer;
+   shadow->fb_max_samples = scene->fb_max_samples;
+   memcpy(shadow->fixed_sample_pos, scene->fixed_sample_pos,
+          sizeof(scene->fixed_sample_pos));
+   shadow->had_queries = scene->had_queries;
+   shadow->permit_linear_rasterizer = scene->permit_linear_rasterizer;
+   shadow->tiles_x = scene->tiles_x;
+   shadow->tiles_y = scene->tiles_y;
+   shadow->alloc_failed = false;
+
+   /* The embedded first block is never handed over to the real scene,
+    * mark it full so that all allocations go to malloc'ed blocks.
+    */
+   shadow->data.first.used = DATA_BLOCK_SIZE;
+   shadow->data.first.next = NULL;
+   shadow->data.head = &shadow->data.first;
+   shadow->scene_size = LP_SCENE_MAX_SIZE - budget;
+   w->initial_scene_size = shadow->scene_size;
+
+   memcpy(&w->setup, setup, sizeof *setup);
+   w->setup.scene = shadow;
+   w->setup.bin_worker = true;
+   w->setup.bin_worker_failed = false;
+   w->num_binned = 0;
+   w->fpstate = util_fpstate_get();
+
+   return true;
+}
+
+
+static void
+bin_worker_free_data(struct lp_setup_bin_worker *w)
+{
+   struct data_block *block, *next;
+
+   for (block = w->scene.data.head; block != &w->scene.data.first;
+        block = next) {
+      next = block->next;
+      FREE(block);
+   }
+   w->scene.data.head = &w->scene.data.first;
+}
+
+
+/**
+ * Append a worker's command lists to the real scene's bins and hand its
+ * data blocks over to the scene.
+ */
+static void
+bin_worker_merge(struct lp_scene *scene, struct lp_setup_bin_worker *w)
+{
+   const unsigned num_bins = lp_scene_get_num_bins(scene);
+
+   for (unsigned i = 0; i < num_bins; i++) {
+      const struct cmd_bin *src = &w->scene.tiles[i];
+      struct cmd_bin *dst = &scene->tiles[i];
+
+      if (!src->head)
+         continue;
+
+      if (dst->tail)
+         dst->tail->next = src->head;
+      else
+         dst->head = src->head;
+      dst->tail = src->tail;
+      dst->last_state = src->last_state;
+      dst->num_cmds += src->num_cmds;
+   }
+
+   struct data_block *head = w->scene.data.head;
+   if (head != &w->scene.data.first) {
+      struct data_block *last = head;
+      while (last->next != &w->scene.data.first)
+         last = last->next;
+
+      /* Keep the scene's current block at the head of its list. */
+      last->next = scene->data.head->next;
+      scene->data.head->next = head;
+      w->scene.data.head = &w->scene.data.first;
+   }
+
+   scene->scene_size += w->scene.scene_size - w->initial_scene_size;
+}
+
+
+/**
+ * Bin the triangles [0, num_tris) of the batch on the cs thread pool.
+ * Returns the number of triangles which have been binned; the caller
+ * bins the remaining ones serially.
+ */
+static unsigned
+bin_batch_parallel(struct lp_setup_context *setup, unsigned num_tris)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(setup->pipe->screen);
+   struct lp_setup_tri_batch *batch = &setup->tri_batch;
+   struct lp_scene *scene = setup->scene;
+
+   unsigned num_chunks = MIN2(setup->num_threads,
+                              num_tris / LP_TRI_BATCH_MIN_CHUNK_TRIS);
+   if (num_chunks < 2)
+      return 0;
+
+   /* Split what's left of the scene's memory budget between the
+    * workers.  If it is too tight, bin serially and let the regular
+    * flush-and-restart logic deal with it.
+    */
+   const unsigned budget = (LP_SCENE_MAX_SIZE - scene->scene_size) / num_chunks;
+   if (budget < 4 * DATA_BLOCK_SIZE)
+      return 0;
+
+   if (!batch->workers) {
+      batch->workers = align_calloc(setup->num_threads *
+                                    sizeof(struct lp_setup_bin_worker), 16);
+      if (!batch->workers)
+         return 0;
+      batch->num_workers = setup->num_threads;
+   }
+
+   const unsigned per_chunk = num_tris / num_chunks;
+   for (unsigned i = 0; i < num_chunks; i++) {
+      struct lp_setup_bin_worker *w = &batch->workers[i];
+
+      w->first_tri = i * per_chunk;
+      w->num_tris = i == num_chunks - 1 ? num_tris - w->first_tri : per_chunk;
+      if (!bin_worker_begin(setup, w, budget))
+         return 0;
+   }
+
+   struct lp_cs_tpool_task *task;
+   mtx_lock(&screen->cs_mutex);
+   task = lp_cs_tpool_queue_task(screen->cs_tpool, bin_worker_fn,
+                                 setup, num_chunks);
+   mtx_unlock(&screen->cs_mutex);
+   lp_cs_tpool_wait_for_task(screen->cs_tpool, &task);
+
+   /* Merge in submission order.  Once a worker ran out of memory, the
+    * output of the following ones is thrown away: those triangles must
+    * not be rasterized before the ones which still need binning.
+    */
+   unsigned num_binned = 0;
+   bool failed = false;
+   for (unsigned i = 0; i < num_chunks; i++) {
+      struct lp_setup_bin_worker *w = &batch->workers[i];
+
+      if (failed) {
+         bin_worker_free_data(w);
+         continue;
+      }
+
+      bin_worker_merge(scene, w);
+      num_binned += w->num_binned;
+      failed = w->num_binned != w->num_tris;
+   }
+
+   LP_DBG(DEBUG_SETUP, "%s: %u tris in %u chunks, %u binned\n",
+          __func__, num_tris, num_chunks, num_binned);
+
+   return num_binned;
+}
+
+
+/**
+ * Bin all the recorded triangles into the current scene.
+ */
+void
+lp_setup_flush_tri_batch(struct lp_setup_context *setup)
+{
+   struct lp_setup_tri_batch *batch = &setup->tri_batch;
+   const unsigned num_tris = batch->num_tris;
+   unsigned first = 0;
+
+   batch->vbuf_offset = ~0u;
+
+   if (num_tris == 0)
+      return;
+
+   /* Detach the triangles first, binning may restart the scene which
+    * will call back into here.
+    */
+   batch->num_tris = 0;
+
+   assert(setup->state == SETUP_ACTIVE && setup->scene);
+
+   struct llvmpipe_context *lp = llvmpipe_context(setup->pipe);
+   if (num_tris >= LP_TRI_BATCH_MIN_PARALLEL_TRIS &&
+       !lp->active_statistics_queries)
+      first = bin_batch_parallel(setup, num_tris);
+
+   for (unsigned i = first; i < num_tris; i++) {
+      const uint32_t *tri = batch->tris[i];
+
+      batch->triangle(setup,
+                      batch_vert(batch, tri[0]),
+                      batch_vert(batch, tri[1]),
+                      batch_vert(batch, tri[2]));
+   }
+}
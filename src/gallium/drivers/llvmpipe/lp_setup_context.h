@@ -53,6 +53,8 @@
 #define LP_SETUP_NEW_SSBOS       0x20
 
 struct lp_setup_variant;
+struct lp_setup_bin_worker;
+struct lp_setup_context;
 
 
 /** Max number of scenes */
@@ -61,6 +63,37 @@ struct lp_setup_variant;
 
 
 
+typedef void (*lp_setup_triangle_func)(struct lp_setup_context *,
+                                       const float (*v0)[4],
+                                       const float (*v1)[4],
+                                       const float (*v2)[4]);
+
+
+/**
+ * Triangles recorded for deferred, multi-threaded binning.
+ * See lp_setup_bin.c.
+ */
+struct lp_setup_tri_batch
+{
+   bool enabled;
+
+   /** the triangle function picked by lp_setup_choose_triangle() */
+   lp_setup_triangle_func triangle;
+
+   uint8_t *verts;          /**< copies of the vbuf vertex data */
+   unsigned verts_size;
+   unsigned verts_used;
+   unsigned vbuf_offset;    /**< where the current vbuf was copied, or ~0 */
+
+   uint32_t (*tris)[3];     /**< vertex offsets into verts */
+   unsigned tris_size;
+   unsigned num_tris;
+
+   struct lp_setup_bin_worker *workers;
+   unsigned num_workers;
+};
+
+
 /**
  * Point/line/triangle setup context.
  * Note: "stored" below indicates data which is stored in the bins,
@@ -174,6 +207,14 @@ struct lp_setup_context
 
    unsigned dirty;   /**< bitmask of LP_SETUP_NEW_x bits */
 
+   struct lp_setup_tri_batch tri_batch;
+
+   /** Set on the private copies used by the parallel binning workers.
+    * Those must not flush the scene, failures are flagged instead.
+    */
+   bool bin_worker;
+   bool bin_worker_failed;
+
    void (*point)(struct lp_setup_context *,
                  const float (*v0)[4]);
 
@@ -181,10 +222,7 @@ struct lp_setup_context
                 const float (*v0)[4],
                 const float (*v1)[4]);
 
-   void (*triangle)(struct lp_setup_context *,
-                    const float (*v0)[4],
-                    const float (*v1)[4],
-                    const float (*v2)[4]);
+   lp_setup_triangle_func triangle;
 
    bool
    (*rect)(struct lp_setup_context *,
@@ -232,6 +270,15 @@ lp_setup_choose_rect(struct lp_setup_context *setup);
 void
 lp_setup_init_vbuf(struct lp_setup_context *setup);
 
+void
+lp_setup_init_tri_batch(struct lp_setup_context *setup);
+
+void
+lp_setup_destroy_tri_batch(struct lp_setup_context *setup);
+
+void
+lp_setup_tri_batch_install(struct lp_setup_context *setup);
+
 bool
 lp_setup_update_state(struct lp_setup_context *setup,
                       bool update_scene);
@@ -1018,6 +1018,11 @@ retry_triangle_ccw(struct lp_setup_context *setup,
    }
 
    if (!do_triangle_ccw(setup, position, v0, v1, v2, front)) {
+      if (setup->bin_worker) {
+         setup->bin_worker_failed = true;
+         return;
+      }
+
       if (!lp_setup_flush_and_restart(setup))
          return;
 
@@ -1271,6 +1276,8 @@ lp_setup_choose_triangle(struct lp_setup_context *setup)
       break;
    default:
       setup->triangle = triangle_noop;
-      break;
+      return;
    }
+
+   lp_setup_tri_batch_install(setup);
 }
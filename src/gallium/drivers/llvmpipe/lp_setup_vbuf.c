@@ -109,6 +109,9 @@ static void *
 lp_setup_map_vertices(struct vbuf_render *vbr)
 {
    struct lp_setup_context *setup = lp_setup_context(vbr);
+
+   /* new vertex data, a batched copy of the old one may be needed */
+   setup->tri_batch.vbuf_offset = ~0u;
    return setup->vertex_buffer;
 }
 
@@ -134,7 +137,12 @@ lp_setup_set_primitive(struct vbuf_render *vbr, enum mesa_prim prim)
 static void
 lp_setup_set_view_index(struct vbuf_render *vbr, unsigned view_index)
 {
-   lp_setup_context(vbr)->view_index = view_index;
+   struct lp_setup_context *setup = lp_setup_context(vbr);
+
+   if (setup->view_index != view_index) {
+      lp_setup_flush_tri_batch(setup);
+      setup->view_index = view_index;
+   }
 }
 
 
@@ -157,6 +165,9 @@ rect(struct lp_setup_context *setup,
      const float (*v4)[4],
      const float (*v5)[4])
 {
+   if (setup->permit_linear_rasterizer)
+      lp_setup_flush_tri_batch(setup);
+
    if (!setup->permit_linear_rasterizer ||
        !setup->rect(setup, v0, v1, v2, v3, v4, v5)) {
       setup->triangle(setup, v0, v1, v2);
@@ -185,6 +196,10 @@ lp_setup_draw_elements(struct vbuf_render *vbr, const uint16_t *indices, uint nr
    const bool uses_constant_interp =
       setup->setup.variant->key.uses_constant_interp;
 
+   /* Only triangles get batched, keep points and lines in order. */
+   if (u_reduced_prim(setup->prim) != MESA_PRIM_TRIANGLES)
+      lp_setup_flush_tri_batch(setup);
+
    switch (setup->prim) {
    case MESA_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
@@ -393,6 +408,10 @@ lp_setup_draw_arrays(struct vbuf_render *vbr, uint start, uint nr)
    const bool uses_constant_interp =
       setup->setup.variant->key.uses_constant_interp;
 
+   /* Only triangles get batched, keep points and lines in order. */
+   if (u_reduced_prim(setup->prim) != MESA_PRIM_TRIANGLES)
+      lp_setup_flush_tri_batch(setup);
+
    switch (setup->prim) {
    case MESA_PRIM_POINTS:
       for (i = 0; i < nr; i++) {
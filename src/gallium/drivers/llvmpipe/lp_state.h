@@ -211,6 +211,18 @@ void
 llvmpipe_cleanup_stage_sampling(struct llvmpipe_context *ctx,
                                 enum pipe_shader_type stage);
 
+void
+llvmpipe_static_texture_state(struct lp_static_texture_state *state,
+                              const struct pipe_sampler_view *view);
+
+void
+llvmpipe_static_texture_state_image(struct lp_static_texture_state *state,
+                                    const struct pipe_image_view *view);
+
+void
+llvmpipe_set_draw_tiled_textures(struct llvmpipe_context *lp,
+                                 enum pipe_shader_type shader);
+
 void
 llvmpipe_prepare_vertex_images(struct llvmpipe_context *lp,
                                unsigned num,
@@ -1043,12 +1043,13 @@ llvmpipe_get_compute_state_info(struct pipe_context *pipe, void *cs,
 
 /**
  * Remove shader variant from two lists: the shader's variant list
- * and the context's variant list.
+ * and the variant list of the context that compiled it.
  */
 static void
-llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
-                                  struct lp_compute_shader_variant *variant)
+llvmpipe_remove_cs_shader_variant(struct lp_compute_shader_variant *variant)
 {
+   struct llvmpipe_context *lp = variant->context;
+
    if ((LP_DEBUG & DEBUG_CS) || (gallivm_debug & GALLIVM_DEBUG_IR)) {
       debug_printf("llvmpipe: del cs #%u var %u v created %u v cached %u "
                    "v total cached %u inst %u total inst %u\n",
@@ -1075,13 +1076,31 @@ llvmpipe_remove_cs_shader_variant(struct llvmpipe_context *lp,
 }
 
 
+/**
+ * Delete all the variants of a shader.  Lavapipe dispatches a shader on
+ * several contexts, so the variants may be in other contexts' lists.
+ */
+static void
+llvmpipe_remove_cs_shader_variants(struct pipe_context *pipe,
+                                   struct lp_compute_shader *shader)
+{
+   struct llvmpipe_screen *screen = llvmpipe_screen(pipe->screen);
+   struct lp_cs_variant_list_item *li, *next;
+
+   mtx_lock(&screen->cs_variant_mutex);
+   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
+      llvmpipe_remove_cs_shader_variant(li->base);
+   }
+   mtx_unlock(&screen->cs_variant_mutex);
+}
+
+
 static void
 llvmpipe_delete_compute_state(struct pipe_context *pipe,
                               void *cs)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct lp_compute_shader *shader = cs;
-   struct lp_cs_variant_list_item *li, *next;
 
    if (llvmpipe->cs == cs)
       llvmpipe->cs = NULL;
@@ -1089,10 +1108,7 @@ llvmpipe_delete_compute_state(struct pipe_context *pipe,
       pipe_resource_reference(&shader->global_buffers[i], NULL);
    FREE(shader->global_buffers);
 
-   /* Delete all the variants */
-   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
-      llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
-   }
+   llvmpipe_remove_cs_shader_variants(pipe, shader);
    ralloc_free(shader->base.ir.nir);
    FREE(shader);
 }
@@ -1138,7 +1154,7 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if (BITSET_TEST(nir->info.textures_used, i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
+            llvmpipe_static_texture_state(&cs_sampler[i].texture_state,
                                             lp->sampler_views[sh_type][i]);
          }
       }
@@ -1146,7 +1162,7 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for (unsigned i = 0; i < key->nr_sampler_views; ++i) {
          if (BITSET_TEST(nir->info.samplers_used, i)) {
-            lp_sampler_static_texture_state(&cs_sampler[i].texture_state,
+            llvmpipe_static_texture_state(&cs_sampler[i].texture_state,
                                             lp->sampler_views[sh_type][i]);
          }
       }
@@ -1161,7 +1177,7 @@ make_variant_key(struct llvmpipe_context *lp,
              key->nr_images * sizeof *lp_image);
    for (unsigned i = 0; i < key->nr_images; ++i) {
       if (BITSET_TEST(nir->info.images_used, i)) {
-         lp_sampler_static_texture_state_image(&lp_image[i].image_state,
+         llvmpipe_static_texture_state_image(&lp_image[i].image_state,
                                                &lp->images[sh_type][i]);
       }
    }
@@ -1287,6 +1303,7 @@ generate_variant(struct llvmpipe_context *lp,
             shname, shader->no, shader->variants_created);
 
    variant->shader = shader;
+   variant->context = lp;
    memcpy(&variant->key, key, shader->variant_key_size);
 
    unsigned char ir_sha1_cache_key[20];
@@ -1367,10 +1384,16 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
       make_variant_key(lp, shader, sh_type, store);
    struct lp_compute_shader_variant *variant = NULL;
    struct lp_cs_variant_list_item *li;
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+
+   mtx_lock(&screen->cs_variant_mutex);
 
-   /* Search the variants for one which matches the key */
+   /* Search the variants for one which matches the key.  Only this
+    * context's variants are used, since each context evicts its own.
+    */
    LIST_FOR_EACH_ENTRY(li, &shader->variants.list, list) {
-      if (memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
+      if (li->base->context == lp &&
+          memcmp(&li->base->key, key, shader->variant_key_size) == 0) {
          variant = li->base;
          break;
       }
@@ -1425,7 +1448,7 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
                                    struct lp_cs_variant_list_item, list);
             assert(item);
             assert(item->base);
-            llvmpipe_remove_cs_shader_variant(lp, item->base);
+            llvmpipe_remove_cs_shader_variant(item->base);
          }
       }
 
@@ -1449,6 +1472,8 @@ llvmpipe_update_cs_variant(struct llvmpipe_context *lp,
          shader->variants_cached++;
       }
    }
+
+   mtx_unlock(&screen->cs_variant_mutex);
    return variant;
 }
 
@@ -1943,14 +1968,9 @@ llvmpipe_bind_ts_state(struct pipe_context *pipe, void *_task)
 static void
 llvmpipe_delete_ts_state(struct pipe_context *pipe, void *_task)
 {
-   struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct lp_compute_shader *shader = _task;
-   struct lp_cs_variant_list_item *li, *next;
 
-   /* Delete all the variants */
-   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
-      llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
-   }
+   llvmpipe_remove_cs_shader_variants(pipe, shader);
    ralloc_free(shader->base.ir.nir);
    FREE(shader);
 }
@@ -2025,12 +2045,8 @@ llvmpipe_delete_ms_state(struct pipe_context *pipe, void *_mesh)
 {
    struct llvmpipe_context *llvmpipe = llvmpipe_context(pipe);
    struct lp_compute_shader *shader = _mesh;
-   struct lp_cs_variant_list_item *li, *next;
 
-   /* Delete all the variants */
-   LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
-      llvmpipe_remove_cs_shader_variant(llvmpipe, li->base);
-   }
+   llvmpipe_remove_cs_shader_variants(pipe, shader);
 
    draw_delete_mesh_shader(llvmpipe->draw, shader->draw_mesh_data);
    ralloc_free(shader->base.ir.nir);
@@ -101,6 +101,11 @@ struct lp_compute_shader_variant
 
    struct lp_compute_shader *shader;
 
+   /* Context whose variant list holds this variant.  Lavapipe deletes
+    * shaders on another context than the one that compiled them.
+    */
+   struct llvmpipe_context *context;
+
    /* For debugging/profiling purposes */
    unsigned no;
 
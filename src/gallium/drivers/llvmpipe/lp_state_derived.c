@@ -275,6 +275,9 @@ llvmpipe_update_derived(struct llvmpipe_context *llvmpipe)
 {
    struct llvmpipe_screen *lp_screen = llvmpipe_screen(llvmpipe->pipe.screen);
 
+   /* Triangles still waiting to be binned were drawn with the old state. */
+   lp_setup_flush_tri_batch(llvmpipe->setup);
+
    /* Check for updated textures.
     */
    if (llvmpipe->tex_timestamp != lp_screen->timestamp) {
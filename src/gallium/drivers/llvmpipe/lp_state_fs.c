@@ -67,6 +67,7 @@
 #include "util/u_string.h"
 #include "util/u_dual_blend.h"
 #include "util/u_upload_mgr.h"
+#include "util/u_atomic.h"
 #include "util/os_time.h"
 #include "pipe/p_shader_tokens.h"
 #include "draw/draw_context.h"
@@ -1099,8 +1100,13 @@ generate_fs_loop(struct gallivm_state *gallivm,
    params.ssbo_ptr = ssbo_ptr;
    params.image = image;
 
-   /* Build the actual shader */
-   lp_build_nir_soa(gallivm, nir, &params, outputs);
+   /* Build the actual shader.  The SoA prepasses rewrite the NIR, so they
+    * run on a copy and the shader's NIR stays unchanged for variants being
+    * generated concurrently.
+    */
+   nir_shader *clone = nir_shader_clone(NULL, nir);
+   lp_build_nir_soa(gallivm, clone, &params, outputs);
+   ralloc_free(clone);
 
    /*
     * Must not count ps invocations if there's a null shader.
@@ -3762,11 +3768,14 @@ lp_fs_get_ir_cache_key(struct lp_fragment_shader_variant *variant,
 /**
  * Generate a new fragment shader variant from the shader code and
  * other state indicated by the key.
+ * May run on the fs_compile_queue thread, so it must not modify the shader
+ * or the context.
  */
 static struct lp_fragment_shader_variant *
 generate_variant(struct llvmpipe_context *lp,
                  struct lp_fragment_shader *shader,
-                 const struct lp_fragment_shader_variant_key *key)
+                 const struct lp_fragment_shader_variant_key *key,
+                 lp_context_ref *context)
 {
    struct nir_shader *nir = shader->base.ir.nir;
    struct lp_fragment_shader_variant *variant =
@@ -3793,10 +3802,12 @@ generate_variant(struct llvmpipe_context *lp,
          needs_caching = true;
    }
 
+   variant->no = p_atomic_inc_return(&shader->variants_created) - 1;
+
    char module_name[64];
    snprintf(module_name, sizeof(module_name), "fs%u_variant%u",
-            shader->no, shader->variants_created);
-   variant->gallivm = gallivm_create(module_name, &lp->context, &cached);
+            shader->no, variant->no);
+   variant->gallivm = gallivm_create(module_name, context, &cached);
    if (!variant->gallivm) {
       FREE(variant);
       return NULL;
@@ -3804,7 +3815,6 @@ generate_variant(struct llvmpipe_context *lp,
 
    variant->list_item_global.base = variant;
    variant->list_item_local.base = variant;
-   variant->no = shader->variants_created++;
 
    /*
     * Determine whether we are touching all channels in the color buffer.
@@ -3855,6 +3865,44 @@ generate_variant(struct llvmpipe_context *lp,
          shader->info.cbuf[0][3].file != TGSI_FILE_NULL
          ? true : false;
 
+   /* Coarse depth culling only handles depth tests which pass for smaller
+    * values, so that depth writes never increase the depth values.
+    */
+   const bool writes_depth =
+         nir->info.outputs_written & BITFIELD64_BIT(FRAG_RESULT_DEPTH);
+   const bool depth_less =
+         key->depth.func == PIPE_FUNC_LESS ||
+         key->depth.func == PIPE_FUNC_LEQUAL;
+
+   variant->hiz_cull =
+         key->depth.enabled &&
+         (depth_less || key->depth.func == PIPE_FUNC_EQUAL) &&
+         !key->stencil[0].enabled &&
+         !key->depth_clamp &&
+         !key->multisample &&
+         !writes_depth &&
+         !nir->info.writes_memory;
+
+   variant->hiz_update =
+         key->depth.enabled &&
+         key->depth.writemask &&
+         depth_less &&
+         !key->stencil[0].enabled &&
+         !key->alpha.enabled &&
+         !key->blend.alpha_to_coverage &&
+         !key->depth_clamp &&
+         !key->multisample &&
+         !writes_depth &&
+         !nir->info.fs.uses_discard &&
+         !(nir->info.outputs_written & BITFIELD64_BIT(FRAG_RESULT_SAMPLE_MASK));
+
+   variant->hiz_invalidate =
+         key->depth.enabled &&
+         key->depth.writemask &&
+         !depth_less &&
+         key->depth.func != PIPE_FUNC_EQUAL &&
+         key->depth.func != PIPE_FUNC_NEVER;
+
    /* We only care about opaque blits for now */
    if (variant->opaque &&
        (shader->kind == LP_FS_KIND_BLIT_RGBA ||
@@ -4010,6 +4058,178 @@ generate_variant(struct llvmpipe_context *lp,
 }
 
 
+static struct lp_fragment_shader_variant_key *
+make_variant_key(struct llvmpipe_context *lp,
+                 struct lp_fragment_shader *shader,
+                 char *store);
+
+static void
+llvmpipe_remove_shader_variant(struct llvmpipe_context *lp,
+                               struct lp_fragment_shader_variant *variant);
+
+
+/**
+ * A fragment shader variant compiled on the context's fs_compile_queue.
+ */
+struct lp_fs_async_job
+{
+   struct util_queue_fence fence;
+   struct llvmpipe_context *lp;
+   struct lp_fragment_shader *shader;
+   struct lp_fragment_shader_variant *variant;
+   const struct lp_fragment_shader_variant_key *key;
+   char store[LP_FS_MAX_VARIANT_KEY_SIZE];
+};
+
+
+static void
+lp_fs_async_execute(void *data, void *gdata, int thread_index)
+{
+   struct lp_fs_async_job *job = data;
+   struct lp_fragment_shader *shader = job->shader;
+
+   /* LLVM contexts can't be shared between threads, so the variant gets
+    * one of its own.
+    */
+   lp_context_ref context;
+   lp_context_create(&context);
+   if (!context.ref)
+      return;
+
+   job->variant = generate_variant(job->lp, shader, job->key, &context);
+
+   if (job->variant)
+      job->variant->context = context;
+   else
+      lp_context_destroy(&context);
+}
+
+
+/**
+ * Start compiling the variant for the current state in the background,
+ * on the guess that the shader will be drawn with that state.
+ */
+static void
+lp_fs_compile_async(struct llvmpipe_context *lp,
+                    struct lp_fragment_shader *shader)
+{
+   if (!util_queue_is_initialized(&lp->fs_compile_queue) ||
+       !lp->rasterizer || !lp->blend || !lp->depth_stencil)
+      return;
+
+   struct lp_fs_async_job *job = CALLOC_STRUCT(lp_fs_async_job);
+   if (!job)
+      return;
+
+   job->lp = lp;
+   job->shader = shader;
+   job->key = make_variant_key(lp, shader, job->store);
+   util_queue_fence_init(&job->fence);
+
+   shader->async_job = job;
+   util_queue_add_job(&lp->fs_compile_queue, job, &job->fence,
+                      lp_fs_async_execute, NULL, 0);
+}
+
+
+/**
+ * If we've exceeded the max number of shader variants, free 6.25% of them
+ * (the least recently used ones) before adding another.
+ */
+static void
+lp_fs_cull_variants(struct llvmpipe_context *lp,
+                    struct lp_fragment_shader *shader)
+{
+   const unsigned variants_to_cull =
+      lp->nr_fs_variants >= LP_MAX_SHADER_VARIANTS
+      ? LP_MAX_SHADER_VARIANTS / 16 : 0;
+
+   if (variants_to_cull ||
+       lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
+      if (gallivm_debug & GALLIVM_DEBUG_PERF) {
+         debug_printf("Evicting FS: %u fs variants,\t%u total variants,"
+                      "\t%u instrs,\t%u instrs/variant\n",
+                      shader->variants_cached,
+                      lp->nr_fs_variants, lp->nr_fs_instrs,
+                      lp->nr_fs_instrs / lp->nr_fs_variants);
+      }
+
+      /*
+       * We need to re-check lp->nr_fs_variants because an arbitrarily
+       * large number of shader variants (potentially all of them) could
+       * be pending for destruction on flush.
+       */
+
+      for (unsigned i = 0;
+           i < variants_to_cull ||
+              lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS;
+           i++) {
+         struct lp_fs_variant_list_item *item;
+         if (list_is_empty(&lp->fs_variants_list.list)) {
+            break;
+         }
+         item = list_last_entry(&lp->fs_variants_list.list,
+                                struct lp_fs_variant_list_item, list);
+         assert(item);
+         assert(item->base);
+         llvmpipe_remove_shader_variant(lp, item->base);
+         struct lp_fragment_shader_variant *variant = item->base;
+         lp_fs_variant_reference(lp, &variant, NULL);
+      }
+   }
+}
+
+
+static void
+lp_fs_add_variant(struct llvmpipe_context *lp,
+                  struct lp_fragment_shader *shader,
+                  struct lp_fragment_shader_variant *variant)
+{
+   list_add(&variant->list_item_local.list, &shader->variants.list);
+   list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
+   lp->nr_fs_variants++;
+   lp->nr_fs_instrs += variant->nr_instrs;
+   shader->variants_cached++;
+}
+
+
+/**
+ * Add the background compiled variant to the shader's variants once it
+ * is done.  Waits for it if it matches 'key', or if 'key' is NULL.
+ */
+static void
+lp_fs_finish_async(struct llvmpipe_context *lp,
+                   struct lp_fragment_shader *shader,
+                   const struct lp_fragment_shader_variant_key *key)
+{
+   struct lp_fs_async_job *job = shader->async_job;
+   if (!job)
+      return;
+
+   const bool wanted =
+      key && memcmp(job->key, key, shader->variant_key_size) == 0;
+
+   if (!util_queue_fence_is_signalled(&job->fence)) {
+      if (key && !wanted)
+         return;
+      if (wanted)
+         LP_COUNT(nr_fs_async_waits);
+      util_queue_fence_wait(&job->fence);
+   } else if (wanted && job->variant) {
+      LP_COUNT(nr_fs_async_hits);
+   }
+
+   if (job->variant) {
+      lp_fs_cull_variants(lp, shader);
+      lp_fs_add_variant(lp, shader, job->variant);
+   }
+
+   shader->async_job = NULL;
+   util_queue_fence_destroy(&job->fence);
+   FREE(job);
+}
+
+
 static void *
 llvmpipe_create_fs_state(struct pipe_context *pipe,
                          const struct pipe_shader_state *templ)
@@ -4109,6 +4329,8 @@ llvmpipe_create_fs_state(struct pipe_context *pipe,
 
    llvmpipe_fs_analyse_nir(shader);
 
+   lp_fs_compile_async(llvmpipe, shader);
+
    return shader;
 }
 
@@ -4165,6 +4387,7 @@ llvmpipe_destroy_shader_variant(struct llvmpipe_context *lp,
                                 struct lp_fragment_shader_variant *variant)
 {
    gallivm_destroy(variant->gallivm);
+   lp_context_destroy(&variant->context);
    lp_fs_reference(lp, &variant->shader, NULL);
    if (variant->function_name[RAST_EDGE_TEST])
       FREE(variant->function_name[RAST_EDGE_TEST]);
@@ -4196,6 +4419,8 @@ llvmpipe_delete_fs_state(struct pipe_context *pipe, void *fs)
    struct lp_fragment_shader *shader = fs;
    struct lp_fs_variant_list_item *li, *next;
 
+   lp_fs_finish_async(llvmpipe, shader, NULL);
+
    /* Delete all the variants */
    LIST_FOR_EACH_ENTRY_SAFE(li, next, &shader->variants.list, list) {
       struct lp_fragment_shader_variant *variant;
@@ -4365,6 +4590,7 @@ llvmpipe_set_shader_images(struct pipe_context *pipe,
    case PIPE_SHADER_TESS_EVAL:
       draw_set_images(llvmpipe->draw, shader, llvmpipe->images[shader],
                       start_slot + count);
+      llvmpipe_set_draw_tiled_textures(llvmpipe, shader);
       break;
    case PIPE_SHADER_COMPUTE:
       llvmpipe->cs_dirty |= LP_CSNEW_IMAGES;
@@ -4638,7 +4864,7 @@ make_variant_key(struct llvmpipe_context *lp,
           * used views may be included in the shader key.
           */
          if (BITSET_TEST(nir->info.textures_used, i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
+            llvmpipe_static_texture_state(&fs_sampler[i].texture_state,
                                   lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
@@ -4646,7 +4872,7 @@ make_variant_key(struct llvmpipe_context *lp,
       key->nr_sampler_views = key->nr_samplers;
       for (unsigned i = 0; i < key->nr_sampler_views; ++i) {
          if (BITSET_TEST(nir->info.samplers_used, i)) {
-            lp_sampler_static_texture_state(&fs_sampler[i].texture_state,
+            llvmpipe_static_texture_state(&fs_sampler[i].texture_state,
                                  lp->sampler_views[PIPE_SHADER_FRAGMENT][i]);
          }
       }
@@ -4659,7 +4885,7 @@ make_variant_key(struct llvmpipe_context *lp,
              key->nr_images * sizeof *lp_image);
    for (unsigned i = 0; i < key->nr_images; ++i) {
       if (BITSET_TEST(nir->info.images_used, i)) {
-         lp_sampler_static_texture_state_image(&lp_image[i].image_state,
+         llvmpipe_static_texture_state_image(&lp_image[i].image_state,
                                       &lp->images[PIPE_SHADER_FRAGMENT][i]);
       }
    }
@@ -4689,6 +4915,8 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
    const struct lp_fragment_shader_variant_key *key =
       make_variant_key(lp, shader, store);
 
+   lp_fs_finish_async(lp, shader, key);
+
    struct lp_fragment_shader_variant *variant = NULL;
    struct lp_fs_variant_list_item *li;
    /* Search the variants for one which matches the key */
@@ -4714,65 +4942,21 @@ llvmpipe_update_fs(struct llvmpipe_context *lp)
                       lp->nr_fs_variants ? lp->nr_fs_instrs / lp->nr_fs_variants : 0);
       }
 
-      /* First, check if we've exceeded the max number of shader variants.
-       * If so, free 6.25% of them (the least recently used ones).
-       */
-      const unsigned variants_to_cull =
-         lp->nr_fs_variants >= LP_MAX_SHADER_VARIANTS
-         ? LP_MAX_SHADER_VARIANTS / 16 : 0;
-
-      if (variants_to_cull ||
-          lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS) {
-         if (gallivm_debug & GALLIVM_DEBUG_PERF) {
-            debug_printf("Evicting FS: %u fs variants,\t%u total variants,"
-                         "\t%u instrs,\t%u instrs/variant\n",
-                         shader->variants_cached,
-                         lp->nr_fs_variants, lp->nr_fs_instrs,
-                         lp->nr_fs_instrs / lp->nr_fs_variants);
-         }
-
-         /*
-          * We need to re-check lp->nr_fs_variants because an arbitrarily
-          * large number of shader variants (potentially all of them) could
-          * be pending for destruction on flush.
-          */
-
-         for (unsigned i = 0;
-              i < variants_to_cull ||
-                 lp->nr_fs_instrs >= LP_MAX_SHADER_INSTRUCTIONS;
-              i++) {
-            struct lp_fs_variant_list_item *item;
-            if (list_is_empty(&lp->fs_variants_list.list)) {
-               break;
-            }
-            item = list_last_entry(&lp->fs_variants_list.list,
-                                   struct lp_fs_variant_list_item, list);
-            assert(item);
-            assert(item->base);
-            llvmpipe_remove_shader_variant(lp, item->base);
-            struct lp_fragment_shader_variant *variant = item->base;
-            lp_fs_variant_reference(lp, &variant, NULL);
-         }
-      }
+      lp_fs_cull_variants(lp, shader);
 
       /*
        * Generate the new variant.
        */
       int64_t t0 = os_time_get();
-      variant = generate_variant(lp, shader, key);
+      variant = generate_variant(lp, shader, key, &lp->context);
       int64_t t1 = os_time_get();
       int64_t dt = t1 - t0;
       LP_COUNT_ADD(llvm_compile_time, dt);
       LP_COUNT_ADD(nr_llvm_compiles, 2);  /* emit vs. omit in/out test */
 
       /* Put the new variant into the list */
-      if (variant) {
-         list_add(&variant->list_item_local.list, &shader->variants.list);
-         list_add(&variant->list_item_global.list, &lp->fs_variants_list.list);
-         lp->nr_fs_variants++;
-         lp->nr_fs_instrs += variant->nr_instrs;
-         shader->variants_cached++;
-      }
+      if (variant)
+         lp_fs_add_variant(lp, shader, variant);
    }
 
    /* Bind this variant */
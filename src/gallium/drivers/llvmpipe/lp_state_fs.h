@@ -41,6 +41,7 @@
 #include "lp_jit.h"
 
 struct lp_fragment_shader;
+struct lp_fs_async_job;
 
 
 /** Indexes into jit_function[] array */
@@ -150,6 +151,15 @@ struct lp_fragment_shader_variant
 
    unsigned opaque:1;
    unsigned blit:1;
+
+   /*
+    * Coarse depth (hiz) behaviour, see lp_rast_hiz_cull():
+    * blocks failing the depth test can be skipped, fully covered blocks
+    * bound the depth values, or writes may increase depth values.
+    */
+   unsigned hiz_cull:1;
+   unsigned hiz_update:1;
+   unsigned hiz_invalidate:1;
    unsigned linear_input_mask:16;
    struct pipe_reference reference;
 
@@ -190,6 +200,11 @@ struct lp_fragment_shader_variant
    struct lp_fs_variant_list_item list_item_global, list_item_local;
    struct lp_fragment_shader *shader;
 
+   /* LLVM context of variants compiled in the background, unowned
+    * otherwise.
+    */
+   lp_context_ref context;
+
    /* For debugging/profiling purposes */
    unsigned no;
 
@@ -213,6 +228,9 @@ struct lp_fragment_shader
 
    struct draw_fragment_shader *draw_data;
 
+   /* Variant being compiled in the background, see LP_ASYNC_COMPILE */
+   struct lp_fs_async_job *async_job;
+
    /* For debugging/profiling purposes */
    unsigned variant_key_size;
    unsigned no;
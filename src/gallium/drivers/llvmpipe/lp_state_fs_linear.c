@@ -39,11 +39,7 @@
 #include "lp_debug.h"
 #include "lp_state_fs.h"
 #include "lp_linear_priv.h"
-
-
-#if DETECT_ARCH_SSE
-
-#include <emmintrin.h>
+#include "lp_linear_span.h"
 
 
 struct nearest_sampler {
@@ -72,6 +68,7 @@ struct color_blend {
    uint8_t *color;
    int stride;
    int width;                   /* the exact width */
+   lp_linear_blend_span_func blend_span;
 };
 
 
@@ -82,7 +79,6 @@ struct shader {
    alignas(16) uint32_t out0[64];
    const uint32_t *src0;
    const uint32_t *src1;
-   __m128i const0;
    int width;                   /* rounded up to multiple of 4 */
 };
 
@@ -100,32 +96,8 @@ struct shader {
 static void
 blend_premul(struct color_blend *blend)
 {
-   const uint32_t *src = blend->src;  /* aligned */
-   uint32_t *dst = (uint32_t *)blend->color;      /* unaligned */
-   const int width = blend->width;
-   int i;
-   union { __m128i m128; uint ui[4]; } dstreg;
-
+   blend->blend_span((uint32_t *)blend->color, blend->src, blend->width);
    blend->color += blend->stride;
-
-   for (i = 0; i + 3 < width; i += 4) {
-      __m128i tmp;
-      tmp = _mm_loadu_si128((const __m128i *)&dst[i]);  /* UNALIGNED READ */
-      dstreg.m128 = util_sse2_blend_premul_4(*(const __m128i *)&src[i],
-                                             tmp);
-      _mm_storeu_si128((__m128i *)&dst[i], dstreg.m128); /* UNALIGNED WRITE */
-   }
-
-   if (i < width) {
-      int j;
-      for (j = 0; j < width - i ; j++) {
-         dstreg.ui[j] = dst[i+j];
-      }
-      dstreg.m128 = util_sse2_blend_premul_4(*(const __m128i *)&src[i],
-                                             dstreg.m128);
-      for (; i < width; i++)
-         dst[i] = dstreg.ui[i&3];
-   }
 }
 
 
@@ -146,6 +118,7 @@ init_blend(struct color_blend *blend,
    blend->color = color + x * 4 + y * stride;
    blend->stride = stride;
    blend->width = width;
+   blend->blend_span = lp_linear_get_blend_premul_span();
 }
 
 
@@ -174,13 +147,9 @@ fetch_row(struct nearest_sampler *samp)
       (const uint32_t *)((const uint8_t *)texture->base +
                          yy * texture->row_stride[0]);
    const int iscale_x = samp->fdsdx * 256;
-   const int width = samp->width;
-   int acc = samp->fsrc_x * 256 + 128;
+   const int acc = samp->fsrc_x * 256 + 128;
 
-   for (int i = 0; i < width; i++) {
-      row[i] = src_row[acc>>8];
-      acc += iscale_x;
-   }
+   lp_linear_fetch_nearest_span(row, src_row, acc, iscale_x, samp->width);
 
    return row;
 }
@@ -315,17 +284,7 @@ init_nearest_sampler(struct nearest_sampler *samp,
 static const uint32_t *
 shade_rgb1(struct shader *shader)
 {
-   const __m128i rgb1 = _mm_set1_epi32(0xff000000);
-   const uint32_t *src0 = shader->src0;
-   uint32_t *dst = shader->out0;
-   int width = shader->width;
-   int i;
-
-   for (i = 0; i + 3 < width; i += 4) {
-      __m128i s = *(const __m128i *)&src0[i];
-      *(__m128i *)&dst[i] = _mm_or_si128(s, rgb1);
-   }
-
+   lp_linear_rgb1_span(shader->out0, shader->src0, shader->width);
    return shader->out0;
 }
 
@@ -435,13 +394,7 @@ blit_rgb1_blit(const struct lp_rast_state *state,
       return false;
 
    for (y = 0; y < height; y++) {
-      const uint32_t *src_row = (const uint32_t *)src;
-      uint32_t *dst_row = (uint32_t *)color;
-
-      for (x = 0; x < width; x++) {
-         *dst_row++ = *src_row++ | 0xff000000;
-      }
-
+      lp_linear_rgb1_span((uint32_t *)color, (const uint32_t *)src, width);
       color += stride;
       src += src_stride;
    }
@@ -660,8 +613,7 @@ llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
       if (variant->opaque) {
          variant->jit_linear_blit = blit_rgba_blit;
          variant->jit_linear = blit_rgba;
-      } else if (is_one_inv_src_alpha_blend(variant) &&
-                 util_get_cpu_caps()->has_sse2) {
+      } else if (is_one_inv_src_alpha_blend(variant)) {
          variant->jit_linear = blit_rgba_blend_premul;
       }
       return;
@@ -682,11 +634,4 @@ llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
       return;
    }
 }
-#else
-void
-llvmpipe_fs_variant_linear_fastpath(struct lp_fragment_shader_variant *variant)
-{
-   /* don't bother if there is no SSE */
-}
-#endif
 
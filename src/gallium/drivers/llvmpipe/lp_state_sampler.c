@@ -188,6 +188,7 @@ llvmpipe_set_sampler_views(struct pipe_context *pipe,
                              shader,
                              llvmpipe->sampler_views[shader],
                              llvmpipe->num_sampler_views[shader]);
+      llvmpipe_set_draw_tiled_textures(llvmpipe, shader);
       break;
    case PIPE_SHADER_COMPUTE:
       llvmpipe->cs_dirty |= LP_CSNEW_SAMPLER_VIEW;
@@ -612,6 +613,59 @@ llvmpipe_cleanup_stage_images(struct llvmpipe_context *ctx,
 }
 
 
+/**
+ * lp_sampler_static_texture_state() for the textures llvmpipe may have
+ * laid out in sparse tiles.
+ */
+void
+llvmpipe_static_texture_state(struct lp_static_texture_state *state,
+                              const struct pipe_sampler_view *view)
+{
+   lp_sampler_static_texture_state(state, view);
+   if (view && view->texture && llvmpipe_resource_const(view->texture)->tiled)
+      lp_sampler_static_texture_state_tiled(state, view);
+}
+
+
+void
+llvmpipe_static_texture_state_image(struct lp_static_texture_state *state,
+                                    const struct pipe_image_view *view)
+{
+   lp_sampler_static_texture_state_image(state, view);
+   if (view && view->resource && llvmpipe_resource_const(view->resource)->tiled)
+      lp_sampler_static_texture_state_image_tiled(state, view);
+}
+
+
+/**
+ * Tell draw which of the textures of a draw module shader stage are tiled,
+ * it derives the rest of their static state from the views itself.
+ */
+void
+llvmpipe_set_draw_tiled_textures(struct llvmpipe_context *lp,
+                                 enum pipe_shader_type shader)
+{
+   bool sampler_views[PIPE_MAX_SHADER_SAMPLER_VIEWS];
+   bool images[PIPE_MAX_SHADER_IMAGES];
+   const unsigned num_sampler_views = lp->num_sampler_views[shader];
+   const unsigned num_images = lp->num_images[shader];
+
+   for (unsigned i = 0; i < num_sampler_views; i++) {
+      const struct pipe_sampler_view *view = lp->sampler_views[shader][i];
+      sampler_views[i] = view && view->texture &&
+                         llvmpipe_resource_const(view->texture)->tiled;
+   }
+
+   for (unsigned i = 0; i < num_images; i++) {
+      const struct pipe_resource *res = lp->images[shader][i].resource;
+      images[i] = res && llvmpipe_resource_const(res)->tiled;
+   }
+
+   draw_set_tiled_textures(lp->draw, shader, sampler_views, num_sampler_views,
+                           images, num_images);
+}
+
+
 void
 llvmpipe_init_sampler_funcs(struct llvmpipe_context *llvmpipe)
 {
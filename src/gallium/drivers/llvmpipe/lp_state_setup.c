@@ -29,6 +29,7 @@
 #include "util/u_math.h"
 #include "util/u_memory.h"
 #include "util/os_time.h"
+#include "util/mesa-sha1.h"
 #include "gallivm/lp_bld_arit.h"
 #include "gallivm/lp_bld_bitarit.h"
 #include "gallivm/lp_bld_const.h"
@@ -647,12 +648,33 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    variant->no = setup_no++;
 
-   char func_name[64];
-   snprintf(func_name, sizeof(func_name), "setup_variant_%u",
+   /* The setup code only depends on the key, so it can come straight
+    * from the disk cache.
+    */
+   struct llvmpipe_screen *screen = llvmpipe_screen(lp->pipe.screen);
+   struct lp_cached_code cached = { 0 };
+   unsigned char ir_sha1_cache_key[20];
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, "setup", 5);
+   _mesa_sha1_update(&ctx, key, key->size);
+   _mesa_sha1_final(&ctx, ir_sha1_cache_key);
+
+   lp_disk_cache_find_shader(screen, &cached, ir_sha1_cache_key);
+   const bool needs_caching = !cached.data_size;
+
+   char module_name[64];
+   snprintf(module_name, sizeof(module_name), "setup_variant_%u",
             variant->no);
 
+   /* Each module has its own symbol namespace, so the function name can
+    * stay the same for all variants, as the cached code requires.
+    */
+   const char *func_name = "setup_variant";
+
    struct gallivm_state *gallivm;
-   variant->gallivm = gallivm = gallivm_create(func_name, &lp->context, NULL);
+   variant->gallivm = gallivm = gallivm_create(module_name, &lp->context,
+                                               &cached);
    if (!variant->gallivm) {
       goto fail;
    }
@@ -697,41 +719,48 @@ generate_setup_variant(struct lp_setup_variant_key *key,
 
    lp_function_add_debug_info(gallivm, variant->function, func_type);
 
-   struct lp_setup_args args;
-   args.vec4f_type = vec4f_type;
-   args.v0       = LLVMGetParam(variant->function, 0);
-   args.v1       = LLVMGetParam(variant->function, 1);
-   args.v2       = LLVMGetParam(variant->function, 2);
-   args.facing   = LLVMGetParam(variant->function, 3);
-   args.a0       = LLVMGetParam(variant->function, 4);
-   args.dadx     = LLVMGetParam(variant->function, 5);
-   args.dady     = LLVMGetParam(variant->function, 6);
-   args.key      = LLVMGetParam(variant->function, 7);
-
-   lp_build_name(args.v0, "in_v0");
-   lp_build_name(args.v1, "in_v1");
-   lp_build_name(args.v2, "in_v2");
-   lp_build_name(args.facing, "in_facing");
-   lp_build_name(args.a0, "out_a0");
-   lp_build_name(args.dadx, "out_dadx");
-   lp_build_name(args.dady, "out_dady");
-   lp_build_name(args.key, "key");
-
-   /*
-    * Function body
+   /* On a cache hit the code comes from the cached object, so only the
+    * declaration is needed.
     */
-   LLVMBasicBlockRef block =
-      LLVMAppendBasicBlockInContext(gallivm->context,
-                                    variant->function, "entry");
-   LLVMPositionBuilderAtEnd(builder, block);
+   if (cached.data_size) {
+      gallivm_stub_func(gallivm, variant->function);
+   } else {
+      struct lp_setup_args args;
+      args.vec4f_type = vec4f_type;
+      args.v0       = LLVMGetParam(variant->function, 0);
+      args.v1       = LLVMGetParam(variant->function, 1);
+      args.v2       = LLVMGetParam(variant->function, 2);
+      args.facing   = LLVMGetParam(variant->function, 3);
+      args.a0       = LLVMGetParam(variant->function, 4);
+      args.dadx     = LLVMGetParam(variant->function, 5);
+      args.dady     = LLVMGetParam(variant->function, 6);
+      args.key      = LLVMGetParam(variant->function, 7);
+
+      lp_build_name(args.v0, "in_v0");
+      lp_build_name(args.v1, "in_v1");
+      lp_build_name(args.v2, "in_v2");
+      lp_build_name(args.facing, "in_facing");
+      lp_build_name(args.a0, "out_a0");
+      lp_build_name(args.dadx, "out_dadx");
+      lp_build_name(args.dady, "out_dady");
+      lp_build_name(args.key, "key");
 
-   set_noalias(builder, variant->function, arg_types, ARRAY_SIZE(arg_types));
-   init_args(gallivm, &variant->key, &args);
-   emit_tri_coef(gallivm, &variant->key, &args);
+      /*
+       * Function body
+       */
+      LLVMBasicBlockRef block =
+         LLVMAppendBasicBlockInContext(gallivm->context,
+                                       variant->function, "entry");
+      LLVMPositionBuilderAtEnd(builder, block);
 
-   LLVMBuildRetVoid(builder);
+      set_noalias(builder, variant->function, arg_types, ARRAY_SIZE(arg_types));
+      init_args(gallivm, &variant->key, &args);
+      emit_tri_coef(gallivm, &variant->key, &args);
 
-   gallivm_verify_function(gallivm, variant->function);
+      LLVMBuildRetVoid(builder);
+
+      gallivm_verify_function(gallivm, variant->function);
+   }
 
    gallivm_compile_module(gallivm);
 
@@ -740,6 +769,9 @@ generate_setup_variant(struct lp_setup_variant_key *key,
    if (!variant->jit_function)
       goto fail;
 
+   if (needs_caching)
+      lp_disk_cache_insert_shader(screen, &cached, ir_sha1_cache_key);
+
    gallivm_free_ir(variant->gallivm);
 
    /*
@@ -0,0 +1,305 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+
+/**
+ * @file
+ * Unit tests and benchmark for the span kernels of the linear
+ * rasterizer fastpaths (lp_linear_span.c).
+ *
+ * Every implementation supported by the host CPU is checked against the
+ * C reference, and timed on full tile-wide spans.  Pass -o <file> to get
+ * the cycle counts as TSV.
+ */
+
+#include <string.h>
+
+#include "util/u_cpu_detect.h"
+#include "util/u_memory.h"
+
+#include "lp_linear_span.h"
+#include "lp_test.h"
+
+
+#define SPAN_WIDTH 64  /* TILE_SIZE */
+#define SPAN_REPEAT 64
+
+
+enum span_kind {
+   SPAN_BLEND,
+   SPAN_RGB1,
+   SPAN_FETCH,
+};
+
+
+struct span_kernel {
+   const char *name;
+   enum span_kind kind;
+   lp_linear_blend_span_func blend;
+   int step;                    /**< 24.8 texel step of fetch kernels */
+   bool (*supported)(void);
+};
+
+
+static bool
+always(void)
+{
+   return true;
+}
+
+
+#if DETECT_ARCH_SSE
+static bool
+has_sse2(void)
+{
+   return util_get_cpu_caps()->has_sse2;
+}
+#endif
+
+
+#if LP_LINEAR_SPAN_AVX
+static bool
+has_avx2(void)
+{
+   return util_get_cpu_caps()->has_avx2;
+}
+
+
+static bool
+has_avx512(void)
+{
+   return util_get_cpu_caps()->has_avx512f &&
+          util_get_cpu_caps()->has_avx512bw;
+}
+#endif
+
+
+#if LP_LINEAR_SPAN_NEON
+static bool
+has_neon(void)
+{
+   return DETECT_ARCH_AARCH64 || util_get_cpu_caps()->has_neon;
+}
+#endif
+
+
+static const struct span_kernel span_kernels[] = {
+   { "blend_premul_c", SPAN_BLEND, lp_linear_blend_premul_span_c, 0, always },
+#if DETECT_ARCH_SSE
+   { "blend_premul_sse2", SPAN_BLEND, lp_linear_blend_premul_span_sse2, 0,
+     has_sse2 },
+#endif
+#if LP_LINEAR_SPAN_AVX
+   { "blend_premul_avx2", SPAN_BLEND, lp_linear_blend_premul_span_avx2, 0,
+     has_avx2 },
+   { "blend_premul_avx512", SPAN_BLEND, lp_linear_blend_premul_span_avx512, 0,
+     has_avx512 },
+#endif
+#if LP_LINEAR_SPAN_NEON
+   { "blend_premul_neon", SPAN_BLEND, lp_linear_blend_premul_span_neon, 0,
+     has_neon },
+#endif
+   { "rgb1", SPAN_RGB1, NULL, 0, always },
+   { "fetch_nearest_1x", SPAN_FETCH, NULL, 256, always },
+   { "fetch_nearest_0.75x", SPAN_FETCH, NULL, 341, always },
+   { "fetch_nearest_2x", SPAN_FETCH, NULL, 128, always },
+};
+
+
+void
+write_tsv_header(FILE *fp)
+{
+   fprintf(fp,
+           "result\t"
+           "cycles_per_pixel\t"
+           "kernel\n");
+
+   fflush(fp);
+}
+
+
+static void
+write_tsv_row(FILE *fp,
+              const struct span_kernel *kernel,
+              double cycles,
+              bool success)
+{
+   fprintf(fp, "%s\t", success ? "pass" : "fail");
+   fprintf(fp, "%.2f\t", cycles);
+   fprintf(fp, "%s\n", kernel->name);
+
+   fflush(fp);
+}
+
+
+static uint32_t
+random_pixel(void)
+{
+   uint32_t pixel = 0;
+
+   for (unsigned c = 0; c < 4; c++)
+      pixel |= (uint32_t)(rand() & 0xff) << (c * 8);
+
+   /* Exercise the fully transparent and fully opaque paths too. */
+   switch (rand() % 8) {
+   case 0:
+      pixel &= 0x00ffffff;
+      break;
+   case 1:
+      pixel |= 0xff000000;
+      break;
+   }
+
+   return pixel;
+}
+
+
+static void
+run_kernel(const struct span_kernel *kernel,
+           uint32_t *dst, const uint32_t *src, unsigned width)
+{
+   switch (kernel->kind) {
+   case SPAN_BLEND:
+      kernel->blend(dst, src, width);
+      break;
+   case SPAN_RGB1:
+      lp_linear_rgb1_span(dst, src, width);
+      break;
+   case SPAN_FETCH:
+      lp_linear_fetch_nearest_span(dst, src, 128, kernel->step, width);
+      break;
+   }
+}
+
+
+static void
+run_reference(const struct span_kernel *kernel,
+              uint32_t *dst, const uint32_t *src, unsigned width)
+{
+   switch (kernel->kind) {
+   case SPAN_BLEND:
+      lp_linear_blend_premul_span_c(dst, src, width);
+      break;
+   case SPAN_RGB1:
+      for (unsigned i = 0; i < width; i++)
+         dst[i] = src[i] | 0xff000000;
+      break;
+   case SPAN_FETCH:
+      for (unsigned i = 0; i < width; i++)
+         dst[i] = src[(128 + i * kernel->step) >> 8];
+      break;
+   }
+}
+
+
+static bool
+test_kernel(unsigned verbose, FILE *fp, const struct span_kernel *kernel)
+{
+   /* Fetch kernels read up to 2x the span width of source texels. */
+   alignas(64) uint32_t src[2 * SPAN_WIDTH + 16];
+   alignas(64) uint32_t dst[SPAN_WIDTH + 16];
+   alignas(64) uint32_t ref[SPAN_WIDTH + 16];
+   int64_t cycles[LP_TEST_NUM_SAMPLES];
+   bool success = true;
+
+   if (verbose >= 1)
+      printf("Testing %s ...\n", kernel->name);
+
+   /* Check all widths, and unaligned destinations. */
+   for (unsigned width = 1; width <= SPAN_WIDTH && success; width++) {
+      for (unsigned offset = 0; offset < 4 && success; offset++) {
+         for (unsigned i = 0; i < ARRAY_SIZE(src); i++)
+            src[i] = random_pixel();
+         for (unsigned i = 0; i < ARRAY_SIZE(dst); i++)
+            dst[i] = ref[i] = random_pixel();
+
+         run_kernel(kernel, dst + offset, src, width);
+         run_reference(kernel, ref + offset, src, width);
+
+         for (unsigned i = 0; i < ARRAY_SIZE(dst); i++) {
+            if (dst[i] != ref[i]) {
+               printf("%s: width %u offset %u pixel %u: "
+                      "got 0x%08x, expected 0x%08x\n",
+                      kernel->name, width, offset, i, dst[i], ref[i]);
+               success = false;
+               break;
+            }
+         }
+      }
+   }
+
+   for (unsigned i = 0; i < LP_TEST_NUM_SAMPLES; i++) {
+      int64_t start_counter = rdtsc();
+      for (unsigned j = 0; j < SPAN_REPEAT; j++)
+         run_kernel(kernel, dst, src, SPAN_WIDTH);
+      int64_t end_counter = rdtsc();
+      cycles[i] = end_counter - start_counter;
+   }
+
+   /* Keep the best sample, the others mostly measure noise. */
+   int64_t best = cycles[0];
+   for (unsigned i = 1; i < LP_TEST_NUM_SAMPLES; i++)
+      best = MIN2(best, cycles[i]);
+
+   const double cycles_per_pixel =
+      (double)best / (SPAN_REPEAT * SPAN_WIDTH);
+
+   if (verbose >= 1)
+      printf("  %s, %.2f cycles/pixel\n",
+             success ? "pass" : "FAIL", cycles_per_pixel);
+
+   if (fp)
+      write_tsv_row(fp, kernel, cycles_per_pixel, success);
+
+   return success;
+}
+
+
+bool
+test_all(unsigned verbose, FILE *fp)
+{
+   bool success = true;
+
+   for (unsigned i = 0; i < ARRAY_SIZE(span_kernels); i++) {
+      const struct span_kernel *kernel = &span_kernels[i];
+
+      if (!kernel->supported()) {
+         if (verbose >= 1)
+            printf("Skipping %s, not supported by this CPU\n", kernel->name);
+         continue;
+      }
+
+      if (!test_kernel(verbose, fp, kernel))
+         success = false;
+   }
+
+   /* The dispatcher must return one of the kernels checked above. */
+   if (verbose >= 1) {
+      lp_linear_blend_span_func best = lp_linear_get_blend_premul_span();
+      for (unsigned i = 0; i < ARRAY_SIZE(span_kernels); i++) {
+         if (span_kernels[i].blend == best)
+            printf("Selected %s\n", span_kernels[i].name);
+      }
+   }
+
+   return success;
+}
+
+
+bool
+test_some(unsigned verbose, FILE *fp,
+          unsigned long n)
+{
+   return test_all(verbose, fp);
+}
+
+
+bool
+test_single(unsigned verbose, FILE *fp)
+{
+   printf("no test_single()");
+   return true;
+}
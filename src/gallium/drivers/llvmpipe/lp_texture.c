@@ -57,6 +57,8 @@
 #include "lp_state.h"
 #include "lp_rast.h"
 
+#include "gallivm/lp_bld_sample.h"
+
 #include "frontend/sw_winsys.h"
 #include "git_sha1.h"
 
@@ -85,6 +87,34 @@ static const char *driver_id = "llvmpipe" MESA_GIT_SHA1;
 
 #endif
 
+/**
+ * Size in blocks of the 64KiB tiles of sparse and tiled textures.
+ */
+static void
+llvmpipe_get_tile_size(const struct pipe_resource *pt, uint32_t tile_size[3])
+{
+   uint32_t dimensions = 1;
+   switch (pt->target) {
+   case PIPE_TEXTURE_2D:
+   case PIPE_TEXTURE_CUBE:
+   case PIPE_TEXTURE_RECT:
+   case PIPE_TEXTURE_2D_ARRAY:
+   case PIPE_TEXTURE_CUBE_ARRAY:
+      dimensions = 2;
+      break;
+   case PIPE_TEXTURE_3D:
+      dimensions = 3;
+      break;
+   default:
+      break;
+   }
+
+   for (unsigned i = 0; i < 3; i++)
+      tile_size[i] = util_format_get_tilesize(pt->format, dimensions,
+                                              pt->nr_samples, i);
+}
+
+
 /**
  * Conventional allocation path for non-display textures:
  * Compute strides and allocate data (unless asked not to).
@@ -117,7 +147,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
     * for the virgl driver when host uses llvmpipe, causing Qemu and crosvm to
     * bail out on the KVM error.
     */
-   if (lpr->base.flags & PIPE_RESOURCE_FLAG_SPARSE)
+   if (llvmpipe_resource_is_tiled(&lpr->base))
       mip_align = 64 * 1024;
    else if (lpr->base.flags & PIPE_RESOURCE_FLAG_MAP_PERSISTENT)
       os_get_page_size(&mip_align);
@@ -125,26 +155,8 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
    assert(LP_MAX_TEXTURE_2D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
    assert(LP_MAX_TEXTURE_3D_LEVELS <= LP_MAX_TEXTURE_LEVELS);
 
-   uint32_t dimensions = 1;
-   switch (pt->target) {
-   case PIPE_TEXTURE_2D:
-   case PIPE_TEXTURE_CUBE:
-   case PIPE_TEXTURE_RECT:
-   case PIPE_TEXTURE_2D_ARRAY:
-      dimensions = 2;
-      break;
-   case PIPE_TEXTURE_3D:
-      dimensions = 3;
-      break;
-   default:
-      break;
-   }
-
-   uint32_t sparse_tile_size[3] = {
-      util_format_get_tilesize(pt->format, dimensions, pt->nr_samples, 0),
-      util_format_get_tilesize(pt->format, dimensions, pt->nr_samples, 1),
-      util_format_get_tilesize(pt->format, dimensions, pt->nr_samples, 2),
-   };
+   uint32_t sparse_tile_size[3];
+   llvmpipe_get_tile_size(pt, sparse_tile_size);
 
    for (unsigned level = 0; level <= pt->last_level; level++) {
       uint64_t mipsize;
@@ -177,7 +189,7 @@ llvmpipe_texture_layout(struct llvmpipe_screen *screen,
                                           align(height, align_y));
       block_size = util_format_get_blocksize(pt->format);
 
-      if (pt->flags & PIPE_RESOURCE_FLAG_SPARSE) {
+      if (llvmpipe_resource_is_tiled(pt)) {
          nblocksx = align(nblocksx, sparse_tile_size[0]);
          nblocksy = align(nblocksy, sparse_tile_size[1]);
          align_z = MAX2(align_z, sparse_tile_size[2]);
@@ -263,6 +275,60 @@ llvmpipe_can_create_resource(struct pipe_screen *screen,
 }
 
 
+/**
+ * Whether to store a texture in the 64KiB tiles of sparse textures rather
+ * than in rows, so that texels sampled together share cache lines and
+ * pages even when minified, rotated or 3D.  Only the samplers and
+ * transfers know about that layout, so this is limited to textures which
+ * are never rendered to nor shared, and is not worth the padding of small
+ * textures.
+ */
+static bool
+llvmpipe_texture_use_tiled(struct llvmpipe_screen *screen,
+                           const struct pipe_resource *templat)
+{
+   if (!screen->tiled_textures)
+      return false;
+
+   if (!(templat->bind & PIPE_BIND_SAMPLER_VIEW) ||
+       (templat->bind & ~(PIPE_BIND_SAMPLER_VIEW | PIPE_BIND_SHADER_IMAGE)))
+      return false;
+
+   /* Persistent mappings can't go through a staging copy. */
+   if (templat->flags & ~(PIPE_RESOURCE_FLAG_TEXTURING_MORE_LIKELY |
+                          PIPE_RESOURCE_FLAG_SINGLE_THREAD_USE |
+                          PIPE_RESOURCE_FLAG_DONT_OVER_ALLOCATE))
+      return false;
+
+   if (llvmpipe_resource_is_1d(templat) || templat->nr_samples > 1)
+      return false;
+
+   const struct util_format_description *desc =
+      util_format_description(templat->format);
+   if (!desc ||
+       util_format_is_depth_or_stencil(templat->format) ||
+       (desc->layout != UTIL_FORMAT_LAYOUT_PLAIN &&
+        !util_format_is_compressed(templat->format)) ||
+       !util_is_power_of_two_nonzero(desc->block.bits / 8))
+      return false;
+
+   struct llvmpipe_resource linear;
+   memset(&linear, 0, sizeof(linear));
+   linear.base = *templat;
+   if (!llvmpipe_texture_layout(screen, &linear, false))
+      return false;
+
+   struct llvmpipe_resource tiled;
+   memset(&tiled, 0, sizeof(tiled));
+   tiled.base = *templat;
+   tiled.tiled = true;
+   if (!llvmpipe_texture_layout(screen, &tiled, false))
+      return false;
+
+   return tiled.size_required <= linear.size_required + linear.size_required / 4;
+}
+
+
 static bool
 llvmpipe_displaytarget_layout(struct llvmpipe_screen *screen,
                               struct llvmpipe_resource *lpr,
@@ -319,6 +385,9 @@ llvmpipe_resource_create_all(struct pipe_screen *_screen,
             goto fail;
       } else {
          /* texture map */
+         if (alloc_backing && llvmpipe_texture_use_tiled(screen, &lpr->base))
+            lpr->tiled = true;
+
          if (!llvmpipe_texture_layout(screen, lpr, alloc_backing))
             goto fail;
 
@@ -896,6 +965,46 @@ fail:
 }
 
 
+/**
+ * Copy the blocks of a transfer of a tiled texture between the texture
+ * and the linear staging memory of the transfer, a run of blocks within
+ * a tile at a time.
+ */
+static void
+llvmpipe_tiled_copy_box(struct llvmpipe_transfer *lpt, uint8_t *tex_data,
+                        bool to_texture)
+{
+   struct pipe_resource *resource = lpt->base.resource;
+   const struct pipe_box *box = &lpt->block_box;
+   const uint32_t block_stride = util_format_get_blocksize(resource->format);
+   uint8_t *staging = lpt->map;
+
+   uint32_t tile_size[3];
+   llvmpipe_get_tile_size(resource, tile_size);
+
+   for (uint32_t z = 0; z < box->depth; z++) {
+      for (uint32_t y = 0; y < box->height; y++) {
+         for (uint32_t x = 0; x < box->width;) {
+            const uint32_t tx = box->x + x;
+            const uint32_t count = MIN2(tile_size[0] - tx % tile_size[0],
+                                        box->width - x);
+            uint8_t *texel = tex_data +
+               llvmpipe_get_texel_offset(resource, lpt->base.level,
+                                         tx, box->y + y, box->z + z);
+
+            if (to_texture)
+               memcpy(texel, staging, count * block_stride);
+            else
+               memcpy(staging, texel, count * block_stride);
+
+            staging += count * block_stride;
+            x += count;
+         }
+      }
+   }
+}
+
+
 void *
 llvmpipe_transfer_map_ms(struct pipe_context *pipe,
                          struct pipe_resource *resource,
@@ -988,7 +1097,7 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
 
    format = lpr->base.format;
 
-   if (llvmpipe_resource_is_texture(resource) && (resource->flags & PIPE_RESOURCE_FLAG_SPARSE)) {
+   if (llvmpipe_resource_is_texture(resource) && llvmpipe_resource_is_tiled(resource)) {
       map = llvmpipe_resource_map(resource, 0, 0, tex_usage);
       if (!map)
          return NULL;
@@ -1010,24 +1119,16 @@ llvmpipe_transfer_map_ms(struct pipe_context *pipe,
       pt->stride = lpt->block_box.width * block_stride;
       pt->layer_stride = pt->stride * lpt->block_box.height;
 
-      uint8_t *staging_map = malloc(pt->layer_stride * lpt->block_box.depth);
-      lpt->map = staging_map;
-
-      if (usage & PIPE_MAP_READ) {
-         for (uint32_t z = 0; z < lpt->block_box.depth; z++) {
-            for (uint32_t y = 0; y < lpt->block_box.height; y++) {
-               for (uint32_t x = 0; x < lpt->block_box.width; x++) {
-                  memcpy(staging_map,
-                         map + llvmpipe_get_texel_offset(resource, level,
-                                                         lpt->block_box.x + x,
-                                                         lpt->block_box.y + y,
-                                                         lpt->block_box.z + z),
-                         block_stride);
-                  staging_map += block_stride;
-               }
-            }
-         }
-      }
+      lpt->map = malloc(pt->layer_stride * lpt->block_box.depth);
+
+      /* Writes which don't discard the range may leave some of it as is. */
+      if ((usage & PIPE_MAP_READ) ||
+          !(usage & (PIPE_MAP_DISCARD_RANGE |
+                     PIPE_MAP_DISCARD_WHOLE_RESOURCE)))
+         llvmpipe_tiled_copy_box(lpt, map, false);
+
+      if (usage & PIPE_MAP_WRITE)
+         screen->timestamp++;
 
       return lpt->map;
    }
@@ -1066,26 +1167,8 @@ llvmpipe_get_texel_offset(struct pipe_resource *resource,
       z = 0;
    }
 
-   uint32_t dimensions = 1;
-   switch (resource->target) {
-   case PIPE_TEXTURE_2D:
-   case PIPE_TEXTURE_CUBE:
-   case PIPE_TEXTURE_RECT:
-   case PIPE_TEXTURE_2D_ARRAY:
-      dimensions = 2;
-      break;
-   case PIPE_TEXTURE_3D:
-      dimensions = 3;
-      break;
-   default:
-      break;
-   }
-
-   uint32_t sparse_tile_size[3] = {
-      util_format_get_tilesize(resource->format, dimensions, resource->nr_samples, 0),
-      util_format_get_tilesize(resource->format, dimensions, resource->nr_samples, 1),
-      util_format_get_tilesize(resource->format, dimensions, resource->nr_samples, 2),
-   };
+   uint32_t sparse_tile_size[3];
+   llvmpipe_get_tile_size(resource, sparse_tile_size);
 
    uint32_t num_tiles_x = DIV_ROUND_UP(u_minify(resource->width0, level),
                                        sparse_tile_size[0] * util_format_get_blockwidth(resource->format));
@@ -1131,26 +1214,9 @@ llvmpipe_transfer_unmap(struct pipe_context *pipe,
 
    assert(resource);
 
-   if (llvmpipe_resource_is_texture(resource) && (resource->flags & PIPE_RESOURCE_FLAG_SPARSE) &&
-       (transfer->usage & PIPE_MAP_WRITE)) {
-      uint32_t block_stride = util_format_get_blocksize(resource->format);
-
-      const uint8_t *src = lpt->map;
-      uint8_t *dst = lpr->tex_data;
-
-      for (uint32_t z = 0; z < lpt->block_box.depth; z++) {
-         for (uint32_t y = 0; y < lpt->block_box.height; y++) {
-            for (uint32_t x = 0; x < lpt->block_box.width; x++) {
-               memcpy(dst + llvmpipe_get_texel_offset(resource, transfer->level,
-                                                      lpt->block_box.x + x,
-                                                      lpt->block_box.y + y,
-                                                      lpt->block_box.z + z),
-                      src, block_stride);
-               src += block_stride;
-            }
-         }
-      }
-   }
+   if (llvmpipe_resource_is_texture(resource) && llvmpipe_resource_is_tiled(resource) &&
+       (transfer->usage & PIPE_MAP_WRITE))
+      llvmpipe_tiled_copy_box(lpt, lpr->tex_data, true);
 
    llvmpipe_resource_unmap(resource,
                            transfer->level,
@@ -102,6 +102,11 @@ struct llvmpipe_resource
    void *data;
 
    bool user_ptr;  /** Is this a user-space buffer? */
+   /**
+    * Texture laid out in the 64KiB tiles of sparse resources without being
+    * sparse itself, see lp_build_tiled_sample_offset().
+    */
+   bool tiled;
    unsigned timestamp;
 
    unsigned id;  /**< temporary, for debugging */
@@ -226,6 +231,17 @@ llvmpipe_resource_is_1d(const struct pipe_resource *resource)
 }
 
 
+/**
+ * Is the texture laid out in the tiles of sparse resources?
+ */
+static inline bool
+llvmpipe_resource_is_tiled(const struct pipe_resource *resource)
+{
+   return (resource->flags & PIPE_RESOURCE_FLAG_SPARSE) ||
+          llvmpipe_resource_const(resource)->tiled;
+}
+
+
 static inline unsigned
 llvmpipe_layer_stride(struct pipe_resource *resource,
                       unsigned level)
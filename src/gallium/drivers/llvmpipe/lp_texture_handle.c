@@ -24,6 +24,7 @@
 #include "lp_context.h"
 #include "lp_texture_handle.h"
 #include "lp_screen.h"
+#include "lp_state.h"
 
 #include "gallivm/lp_bld_const.h"
 #include "gallivm/lp_bld_debug.h"
@@ -57,7 +58,7 @@ llvmpipe_create_texture_handle(struct pipe_context *pctx, struct pipe_sampler_vi
 
    if (view) {
       struct lp_static_texture_state state;
-      lp_sampler_static_texture_state(&state, view);
+      llvmpipe_static_texture_state(&state, view);
 
       /* Trade a bit of performance for potentially less sampler/texture combinations. */
       state.pot_width = false;
@@ -112,7 +113,7 @@ llvmpipe_create_image_handle(struct pipe_context *pctx, const struct pipe_image_
    struct lp_texture_handle *handle = calloc(1, sizeof(struct lp_texture_handle));
 
    struct lp_static_texture_state state;
-   lp_sampler_static_texture_state_image(&state, view);
+   llvmpipe_static_texture_state_image(&state, view);
 
    /* Trade a bit of performance for potentially less sampler/texture combinations. */
    state.pot_width = false;
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "util/u_cpu_detect.h"
+#include "util/u_math.h"
+#include "lp_limits.h"
+#include "lp_debug.h"
+#include "lp_thread.h"
+
+
+/**
+ * Number of L3 cache domains the worker threads get spread over.
+ * One means no topology information, or a single domain.
+ */
+unsigned
+lp_thread_num_groups(unsigned num_threads)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+
+   if (!(LP_PERF & PERF_THREAD_PIN))
+      return 1;
+
+   if (caps->num_L3_caches < 2 || !caps->L3_affinity_mask)
+      return 1;
+
+   return MAX2(1, MIN3(caps->num_L3_caches, num_threads,
+                       LP_MAX_THREAD_GROUPS));
+}
+
+
+/**
+ * Group of a worker thread.  Threads are dealt out in contiguous blocks
+ * so that every group gets the same number of threads, give or take one.
+ */
+unsigned
+lp_thread_group(unsigned thread_index, unsigned num_threads)
+{
+   const unsigned num_groups = lp_thread_num_groups(num_threads);
+
+   assert(thread_index < MAX2(1, num_threads));
+   return thread_index * num_groups / MAX2(1, num_threads);
+}
+
+
+/**
+ * Restrict a worker thread to the CPUs sharing its group's L3 cache.
+ * Only done when asked for with LP_PERF=thread_pin, and never widens the
+ * affinity the thread inherited from the process.  Failure is not an
+ * error, the thread just keeps floating.
+ */
+void
+lp_thread_pin(thrd_t thread, unsigned thread_index, unsigned num_threads)
+{
+   const struct util_cpu_caps_t *caps = util_get_cpu_caps();
+   const unsigned num_groups = lp_thread_num_groups(num_threads);
+
+   if (num_groups < 2)
+      return;
+
+   /* With fewer groups than L3 caches, spread the groups evenly. */
+   const unsigned group = lp_thread_group(thread_index, num_threads);
+   const unsigned L3 = group * caps->num_L3_caches / num_groups;
+   const unsigned num_words = DIV_ROUND_UP(caps->num_cpu_mask_bits, 32);
+   util_affinity_mask old_mask = {0};
+   util_affinity_mask mask;
+   bool inherited = false, any = false;
+
+   /* There is no affinity getter, so read the inherited mask back while
+    * setting the L3 one.  The set itself may fail when the process is not
+    * allowed on any CPU of that L3, the old mask is still returned then.
+    */
+   util_set_thread_affinity(thread, caps->L3_affinity_mask[L3], old_mask,
+                            caps->num_cpu_mask_bits);
+
+   for (unsigned i = 0; i < num_words; i++) {
+      mask[i] = caps->L3_affinity_mask[L3][i] & old_mask[i];
+      inherited |= old_mask[i] != 0;
+      any |= mask[i] != 0;
+   }
+
+   if (!inherited)
+      return;
+
+   /* Keep the inherited mask if it shares no CPU with this L3. */
+   util_set_thread_affinity(thread, any ? mask : old_mask, NULL,
+                            caps->num_cpu_mask_bits);
+}
@@ -0,0 +1,34 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/**
+ * Placement of the rasterizer and compute worker threads on the CPU
+ * topology.
+ *
+ * With LP_PERF=thread_pin, the worker threads are split in contiguous
+ * groups, one per L3 cache domain (at most LP_MAX_THREAD_GROUPS of them).
+ * Threads of a group are pinned to the CPUs sharing that L3, and the
+ * rasterizer hands each group the bins of its own band of framebuffer
+ * rows first.  Otherwise there is a single group and nothing is pinned.
+ */
+
+#ifndef LP_THREAD_H
+#define LP_THREAD_H
+
+#include "util/u_thread.h"
+
+
+unsigned
+lp_thread_num_groups(unsigned num_threads);
+
+unsigned
+lp_thread_group(unsigned thread_index, unsigned num_threads);
+
+void
+lp_thread_pin(thrd_t thread, unsigned thread_index, unsigned num_threads);
+
+
+#endif /* LP_THREAD_H */
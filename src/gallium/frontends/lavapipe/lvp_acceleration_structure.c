@@ -6,182 +6,10 @@
 #include "lvp_acceleration_structure.h"
 #include "lvp_entrypoints.h"
 
-#include "radix_sort/radix_sort_u64.h"
 #include "bvh/vk_bvh.h"
-
-struct radix_sort_vk_target_config lvp_radix_sort_config = {
-   .keyval_dwords = 2,
-   .init = {
-      .workgroup_size_log2 = 4,
-   },
-   .fill = {
-      .workgroup_size_log2 = 4,
-      .block_rows = 4,
-   },
-   .histogram = {
-      .workgroup_size_log2 = 7,
-      .subgroup_size_log2 = 3,
-      .block_rows = 16,
-   },
-   .prefix = {
-      .workgroup_size_log2 = 8,
-      .subgroup_size_log2 = 3,
-   },
-   .scatter = {
-      .workgroup_size_log2 = 7,
-      .subgroup_size_log2 = 3,
-      .block_rows = 8,
-   },
-   .nonsequential_dispatch = true,
-};
-
-static void
-lvp_init_radix_sort(struct lvp_device *device)
-{
-   simple_mtx_lock(&device->radix_sort_lock);
-   if (device->radix_sort) {
-      simple_mtx_unlock(&device->radix_sort_lock);
-      return;
-   }
-
-   device->radix_sort =
-      vk_create_radix_sort_u64(lvp_device_to_handle(device),
-                               &device->vk.alloc, VK_NULL_HANDLE,
-                               lvp_radix_sort_config);
-
-   device->accel_struct_args.radix_sort = device->radix_sort;
-
-   simple_mtx_unlock(&device->radix_sort_lock);
-}
-
-static void
-lvp_write_buffer_cp(VkCommandBuffer cmdbuf, VkDeviceAddress addr,
-                    void *data, uint32_t size)
-{
-   VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, cmdbuf);
-
-   struct vk_cmd_queue_entry *entry =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct vk_cmd_queue_entry),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry)
-      return;
-
-   entry->type = LVP_CMD_WRITE_BUFFER_CP;
-
-   struct lvp_cmd_write_buffer_cp *cmd =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct lvp_cmd_write_buffer_cp) + size,
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry) {
-      vk_free(cmd_buffer->vk.cmd_queue.alloc, entry);
-      return;
-   }
-
-   cmd->addr = addr;
-   cmd->data = cmd + 1;
-   cmd->size = size;
-
-   memcpy(cmd->data, data, size);
-
-   entry->driver_data = cmd;
-
-   list_addtail(&entry->cmd_link, &cmd_buffer->vk.cmd_queue.cmds);
-}
-
-static void
-lvp_flush_buffer_write_cp(VkCommandBuffer cmdbuf)
-{
-}
-
-static void
-lvp_cmd_dispatch_unaligned(VkCommandBuffer cmdbuf, uint32_t invocations_x,
-                           uint32_t invocations_y, uint32_t invocations_z)
-{
-   VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, cmdbuf);
-
-   struct vk_cmd_queue_entry *entry =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct vk_cmd_queue_entry),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry)
-      return;
-
-   entry->type = LVP_CMD_DISPATCH_UNALIGNED;
-
-   entry->u.dispatch.group_count_x = invocations_x;
-   entry->u.dispatch.group_count_y = invocations_y;
-   entry->u.dispatch.group_count_z = invocations_z;
-
-   list_addtail(&entry->cmd_link, &cmd_buffer->vk.cmd_queue.cmds);
-}
-
-static void
-lvp_cmd_fill_buffer_addr(VkCommandBuffer cmdbuf, VkDeviceAddress addr,
-                         VkDeviceSize size, uint32_t data)
-{
-   VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, cmdbuf);
-
-   struct vk_cmd_queue_entry *entry =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct vk_cmd_queue_entry),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry)
-      return;
-
-   entry->type = LVP_CMD_FILL_BUFFER_ADDR;
-
-   struct lvp_cmd_fill_buffer_addr *cmd =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct lvp_cmd_write_buffer_cp),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry) {
-      vk_free(cmd_buffer->vk.cmd_queue.alloc, entry);
-      return;
-   }
-
-   cmd->addr = addr;
-   cmd->size = size;
-   cmd->data = data;
-
-   entry->driver_data = cmd;
-
-   list_addtail(&entry->cmd_link, &cmd_buffer->vk.cmd_queue.cmds);
-}
-
-static void
-lvp_enqueue_encode_as(VkCommandBuffer commandBuffer,
-                      const VkAccelerationStructureBuildGeometryInfoKHR *build_info,
-                      const VkAccelerationStructureBuildRangeInfoKHR *build_range_infos,
-                      VkDeviceAddress intermediate_as_addr,
-                      VkDeviceAddress intermediate_header_addr,
-                      uint32_t leaf_count,
-                      uint32_t key,
-                      struct vk_acceleration_structure *dst)
-{
-   VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
-
-   struct vk_cmd_queue_entry *entry =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct vk_cmd_queue_entry),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry)
-      return;
-
-   entry->type = LVP_CMD_ENCODE_AS;
-
-   struct lvp_cmd_encode_as *cmd =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct lvp_cmd_encode_as),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry) {
-      vk_free(cmd_buffer->vk.cmd_queue.alloc, entry);
-      return;
-   }
-
-   cmd->dst = dst;
-   cmd->intermediate_as_addr = intermediate_as_addr;
-   cmd->intermediate_header_addr = intermediate_header_addr;
-   cmd->leaf_count = leaf_count;
-   cmd->geometry_type = vk_get_as_geometry_type(build_info);
-
-   entry->driver_data = cmd;
-
-   list_addtail(&entry->cmd_link, &cmd_buffer->vk.cmd_queue.cmds);
-}
+#include "util/format/u_format.h"
+#include "util/u_cpu_detect.h"
+#include "util/u_debug.h"
 
 static uint32_t
 ir_id_to_offset(uint32_t id)
@@ -204,13 +32,22 @@ lvp_pack_sbt_offset_and_flags(uint32_t sbt_offset, VkGeometryInstanceFlagsKHR fl
    return ret;
 }
 
+/* The binary tree the IR is converted to before flattening it and
+ * collapsing it into box nodes.  Internal children are offsets into the
+ * binary tree, leaf children are already offsets into the output.
+ */
+struct lvp_bvh_binary_node {
+   vk_aabb bounds[2];
+   uint32_t children[2];
+};
+
 static void
 lvp_select_subtrees_to_flatten(const struct vk_ir_header *header, const struct vk_ir_box_node *ir_box_nodes,
                                const uint32_t *node_depth, const uint32_t *child_counts, uint32_t root_offset,
                                uint32_t index, struct util_dynarray *subtrees, uint32_t *max_subtree_size)
 {
    uint32_t depth = node_depth[header->ir_internal_node_count - index - 1];
-   uint32_t available_depth = 23 - depth;
+   uint32_t available_depth = LVP_BVH_MAX_BINARY_DEPTH - 1 - depth;
    uint32_t allowed_child_count = 1 << available_depth;
    uint32_t child_count = child_counts[index];
    bool flatten = child_count > allowed_child_count;
@@ -247,7 +84,7 @@ lvp_gather_subtree(const uint8_t *output, uint32_t offset, uint32_t *leaf_nodes,
                    vk_aabb *leaf_bounds, uint32_t *leaf_node_count, uint32_t *internal_nodes,
                    uint32_t *internal_node_count)
 {
-   const struct lvp_bvh_box_node *node = (void *)(output + offset);
+   const struct lvp_bvh_binary_node *node = (void *)(output + offset);
 
    for (uint32_t child_index = 0; child_index < 2; child_index++) {
       if (node->children[child_index] == VK_BVH_INVALID_NODE)
@@ -292,14 +129,14 @@ lvp_rebuild_subtree(const uint8_t *output, uint32_t *leaf_nodes, vk_aabb *leaf_b
    child_nodes[1] = lvp_rebuild_subtree(output, leaf_nodes + split_index, leaf_bounds + split_index, internal_nodes,
                                         leaf_node_count - split_index, internal_node_index);
 
-   struct lvp_bvh_box_node *node = (void *)(output + ir_id_to_offset(node_id));
+   struct lvp_bvh_binary_node *node = (void *)(output + ir_id_to_offset(node_id));
 
    for (uint32_t i = 0; i < 2; i++) {
       node->children[i] = child_nodes[i];
 
       uint32_t type = child_nodes[i] & 3;
       if (type == lvp_bvh_node_internal) {
-         const struct lvp_bvh_box_node *child_node =
+         const struct lvp_bvh_binary_node *child_node =
             (void *)(output + ir_id_to_offset(child_nodes[i]));
          node->bounds[i].min.x = MIN2(child_node->bounds[0].min.x, child_node->bounds[1].min.x);
          node->bounds[i].min.y = MIN2(child_node->bounds[0].min.y, child_node->bounds[1].min.y);
@@ -365,7 +202,7 @@ lvp_flatten_as(const struct vk_ir_header *header, const struct vk_ir_box_node *i
 
    util_dynarray_foreach(&subtrees, uint32_t, root_index) {
       uint32_t offset = sizeof(struct lvp_bvh_header) +
-         (header->ir_internal_node_count - 1 - *root_index) * sizeof(struct lvp_bvh_box_node);
+         (header->ir_internal_node_count - 1 - *root_index) * sizeof(struct lvp_bvh_binary_node);
 
       internal_nodes[0] = offset | lvp_bvh_node_internal;
 
@@ -385,6 +222,69 @@ ret:
    free(internal_nodes);
 }
 
+/* Write the box node for a binary node, pulling the children of its
+ * internal children up so that every box node covers two levels of the
+ * binary tree.
+ */
+static uint32_t
+lvp_encode_box_node(const uint8_t *binary, uint32_t binary_id, uint8_t *output,
+                    uint32_t *box_node_count)
+{
+   const struct lvp_bvh_binary_node *node = (const void *)(binary + ir_id_to_offset(binary_id));
+
+   uint32_t offset = sizeof(struct lvp_bvh_header) +
+                     (*box_node_count)++ * sizeof(struct lvp_bvh_box_node);
+   struct lvp_bvh_box_node *box = (void *)(output + offset);
+
+   uint32_t children[LVP_BVH_BOX_WIDTH];
+   vk_aabb bounds[LVP_BVH_BOX_WIDTH];
+   uint32_t child_count = 0;
+
+   for (uint32_t i = 0; i < 2; i++) {
+      if (node->children[i] == VK_BVH_INVALID_NODE)
+         continue;
+
+      if ((node->children[i] & 3) != lvp_bvh_node_internal) {
+         children[child_count] = node->children[i];
+         bounds[child_count++] = node->bounds[i];
+         continue;
+      }
+
+      const struct lvp_bvh_binary_node *child =
+         (const void *)(binary + ir_id_to_offset(node->children[i]));
+      for (uint32_t j = 0; j < 2; j++) {
+         if (child->children[j] == VK_BVH_INVALID_NODE)
+            continue;
+
+         children[child_count] = child->children[j];
+         bounds[child_count++] = child->bounds[j];
+      }
+   }
+
+   for (uint32_t i = 0; i < LVP_BVH_BOX_WIDTH; i++) {
+      if (i >= child_count) {
+         box->min_x[i] = box->min_y[i] = box->min_z[i] = NAN;
+         box->max_x[i] = box->max_y[i] = box->max_z[i] = NAN;
+         box->children[i] = LVP_BVH_INVALID_NODE;
+         continue;
+      }
+
+      box->min_x[i] = bounds[i].min.x;
+      box->min_y[i] = bounds[i].min.y;
+      box->min_z[i] = bounds[i].min.z;
+      box->max_x[i] = bounds[i].max.x;
+      box->max_y[i] = bounds[i].max.y;
+      box->max_z[i] = bounds[i].max.z;
+
+      if ((children[i] & 3) == lvp_bvh_node_internal)
+         box->children[i] = lvp_encode_box_node(binary, children[i], output, box_node_count);
+      else
+         box->children[i] = children[i];
+   }
+
+   return offset | lvp_bvh_node_internal;
+}
+
 static void
 lvp_get_leaf_node_size(VkGeometryTypeKHR geometry_type, uint32_t *ir_leaf_node_size,
                        uint32_t *output_leaf_node_size)
@@ -407,7 +307,7 @@ lvp_get_leaf_node_size(VkGeometryTypeKHR geometry_type, uint32_t *ir_leaf_node_s
    }
 }
 
-void
+static void
 lvp_encode_as(struct vk_acceleration_structure *dst, VkDeviceAddress intermediate_as_addr,
               VkDeviceAddress intermediate_header_addr, uint32_t leaf_count,
               VkGeometryTypeKHR geometry_type)
@@ -483,16 +383,21 @@ lvp_encode_as(struct vk_acceleration_structure *dst, VkDeviceAddress intermediat
       }
    }
 
+   /* The binary nodes use the same layout as the output, so that node ids
+    * can be turned into offsets the same way.
+    */
+   uint8_t *binary = malloc(sizeof(struct lvp_bvh_header) +
+                            header->ir_internal_node_count * sizeof(struct lvp_bvh_binary_node));
    uint32_t *node_depth = calloc(header->ir_internal_node_count, sizeof(uint32_t));
-   if (!node_depth)
-      return;
+   if (!binary || !node_depth)
+      goto fail;
 
    uint32_t max_node_depth = 0;
 
    for (uint32_t i = 0; i < header->ir_internal_node_count; i++) {
       const struct vk_ir_box_node *ir_box = ir_box_nodes + (header->ir_internal_node_count - i - 1);
-      struct lvp_bvh_box_node *output_box =
-         (void *)(output + sizeof(struct lvp_bvh_header) + i * sizeof(struct lvp_bvh_box_node));
+      struct lvp_bvh_binary_node *output_box =
+         (void *)(binary + sizeof(struct lvp_bvh_header) + i * sizeof(struct lvp_bvh_binary_node));
 
       for (uint32_t child_index = 0; child_index < 2; child_index++) {
          if (ir_box->children[child_index] == VK_BVH_INVALID_NODE) {
@@ -533,7 +438,7 @@ lvp_encode_as(struct vk_acceleration_structure *dst, VkDeviceAddress intermediat
             uint32_t src_index = (ir_child_offset - root_offset) / sizeof(struct vk_ir_box_node);
             uint32_t dst_index = header->ir_internal_node_count - src_index - 1;
             output_box->children[child_index] =
-               sizeof(struct lvp_bvh_header) + dst_index * sizeof(struct lvp_bvh_box_node);
+               sizeof(struct lvp_bvh_header) + dst_index * sizeof(struct lvp_bvh_binary_node);
             output_box->children[child_index] |= lvp_bvh_node_internal;
 
             node_depth[dst_index] = node_depth[i] + 1;
@@ -545,9 +450,14 @@ lvp_encode_as(struct vk_acceleration_structure *dst, VkDeviceAddress intermediat
    /* The BVH exceeds the maximum depth supported by the traversal stack, 
     * flatten the offending parts of the tree.
     */
-   if (max_node_depth >= 24)
-      lvp_flatten_as(header, ir_box_nodes, root_offset, node_depth, output);
+   if (max_node_depth >= LVP_BVH_MAX_BINARY_DEPTH)
+      lvp_flatten_as(header, ir_box_nodes, root_offset, node_depth, binary);
+
+   uint32_t box_node_count = 0;
+   lvp_encode_box_node(binary, LVP_BVH_ROOT_NODE, output, &box_node_count);
 
+fail:
+   free(binary);
    free(node_depth);
 }
 
@@ -556,18 +466,98 @@ static_assert(sizeof(struct lvp_bvh_aabb_node) % 8 == 0, "lvp_bvh_aabb_node is n
 static_assert(sizeof(struct lvp_bvh_instance_node) % 8 == 0, "lvp_bvh_instance_node is not padded");
 static_assert(sizeof(struct lvp_bvh_box_node) % 8 == 0, "lvp_bvh_box_node is not padded");
 
+/* Builds don't use the scratch buffer, this is only to give applications a
+ * valid buffer size.
+ */
+#define LVP_BVH_SCRATCH_SIZE 64
+
+static VkDeviceSize
+lvp_get_as_size(const VkAccelerationStructureBuildGeometryInfoKHR *build_info,
+                uint32_t leaf_count)
+{
+   uint32_t internal_node_count = MAX2(leaf_count, 2) - 1;
+   uint32_t nodes_size = internal_node_count * sizeof(struct lvp_bvh_box_node);
+
+   uint32_t ir_leaf_node_size = 0;
+   uint32_t output_leaf_node_size = 0;
+   lvp_get_leaf_node_size(vk_get_as_geometry_type(build_info), &ir_leaf_node_size, &output_leaf_node_size);
+
+   nodes_size += leaf_count * output_leaf_node_size;
+
+   nodes_size = util_align_npot(nodes_size, LVP_BVH_NODE_PREFETCH_SIZE);
+
+   return sizeof(struct lvp_bvh_header) + nodes_size;
+}
+
 VKAPI_ATTR void VKAPI_CALL
 lvp_GetAccelerationStructureBuildSizesKHR(
    VkDevice _device, VkAccelerationStructureBuildTypeKHR buildType,
    const VkAccelerationStructureBuildGeometryInfoKHR *pBuildInfo,
    const uint32_t *pMaxPrimitiveCounts, VkAccelerationStructureBuildSizesInfoKHR *pSizeInfo)
 {
-   VK_FROM_HANDLE(lvp_device, device, _device);
+   uint32_t leaf_count = 0;
+   for (uint32_t i = 0; i < pBuildInfo->geometryCount; i++)
+      leaf_count += pMaxPrimitiveCounts[i];
+
+   pSizeInfo->accelerationStructureSize = lvp_get_as_size(pBuildInfo, leaf_count);
+
+   /* Builds and updates run on the CPU with their own memory, but the
+    * scratch buffer still has to be created.
+    */
+   pSizeInfo->updateScratchSize = LVP_BVH_SCRATCH_SIZE;
+   pSizeInfo->buildScratchSize = LVP_BVH_SCRATCH_SIZE;
+}
+
+void
+lvp_copy_accel_struct_to_memory(struct vk_acceleration_structure *accel_struct, void *dst)
+{
+   struct lvp_bvh_header *header = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+   struct lvp_accel_struct_serialization_header *serialized = dst;
+
+   lvp_device_get_cache_uuid(serialized->driver_uuid);
+   lvp_device_get_cache_uuid(serialized->accel_struct_compat);
+   serialized->serialization_size = header->serialization_size;
+   serialized->compacted_size = accel_struct->size;
+   serialized->instance_count = header->instance_count;
+
+   const struct lvp_bvh_instance_node *instances =
+      (const void *)((const uint8_t *)header + header->leaf_nodes_offset);
+   for (uint32_t i = 0; i < header->instance_count; i++)
+      serialized->instances[i] = instances[i].bvh_ptr;
+
+   memcpy(&serialized->instances[serialized->instance_count], header, accel_struct->size);
+}
+
+void
+lvp_copy_memory_to_accel_struct(const void *src, struct vk_acceleration_structure *accel_struct)
+{
+   struct lvp_bvh_header *header = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+   const struct lvp_accel_struct_serialization_header *serialized = src;
 
-   lvp_init_radix_sort(device);
+   memcpy(header, &serialized->instances[serialized->instance_count], serialized->compacted_size);
 
-   vk_get_as_build_sizes(_device, buildType, pBuildInfo, pMaxPrimitiveCounts,
-                         pSizeInfo, &device->accel_struct_args);
+   struct lvp_bvh_instance_node *instances =
+      (void *)((uint8_t *)header + header->leaf_nodes_offset);
+   for (uint32_t i = 0; i < serialized->instance_count; i++)
+      instances[i].bvh_ptr = serialized->instances[i];
+}
+
+uint64_t
+lvp_get_accel_struct_property(struct vk_acceleration_structure *accel_struct, VkQueryType query_type)
+{
+   const struct lvp_bvh_header *header = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
+
+   switch (query_type) {
+   case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR:
+   case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SIZE_KHR:
+      return accel_struct->size;
+   case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR:
+      return header->serialization_size;
+   case VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_BOTTOM_LEVEL_POINTERS_KHR:
+      return header->instance_count;
+   default:
+      unreachable("Unsupported query type");
+   }
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL
@@ -576,151 +566,762 @@ lvp_WriteAccelerationStructuresPropertiesKHR(
    const VkAccelerationStructureKHR *pAccelerationStructures, VkQueryType queryType,
    size_t dataSize, void *pData, size_t stride)
 {
-   unreachable("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   for (uint32_t i = 0; i < accelerationStructureCount; i++) {
+      VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, pAccelerationStructures[i]);
+
+      uint64_t *dst = (void *)((uint8_t *)pData + i * stride);
+      *dst = lvp_get_accel_struct_property(accel_struct, queryType);
+   }
+
+   return VK_SUCCESS;
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL
-lvp_BuildAccelerationStructuresKHR(
-   VkDevice _device, VkDeferredOperationKHR deferredOperation, uint32_t infoCount,
-   const VkAccelerationStructureBuildGeometryInfoKHR *pInfos,
-   const VkAccelerationStructureBuildRangeInfoKHR *const *ppBuildRangeInfos)
+/* Both the host commands and the ones recorded in command buffers build
+ * the tree on the CPU with a binned SAH into the intermediate representation
+ * of the common BVH code, which is then encoded by lvp_encode_as.
+ */
+#define LVP_HOST_BUILD_BINS 16
+
+/* Past this depth, splits are made at the median so that degenerate inputs
+ * can't recurse without bounds.
+ */
+#define LVP_HOST_BUILD_MAX_SAH_DEPTH 64
+
+/* Subtrees with fewer leaves than this are not worth a job of their own. */
+#define LVP_HOST_BUILD_MIN_TASK_LEAVES 4096
+
+/* Upper bound for the subtrees below the top-level splits which are built
+ * in parallel, 1 << LVP_HOST_BUILD_MAX_TASK_DEPTH.
+ */
+#define LVP_HOST_BUILD_MAX_TASK_DEPTH 6
+#define LVP_HOST_BUILD_MAX_TASKS (1 << LVP_HOST_BUILD_MAX_TASK_DEPTH)
+
+struct lvp_host_build {
+   uint8_t *ir;
+   uint32_t leaf_size;
+   uint32_t leaf_type;
+   uint32_t leaf_count;
+   uint32_t box_node_count;
+   float (*centroids)[3];
+   /* Device builds reference BLASes by address, host builds by handle. */
+   bool blas_by_address;
+};
+
+static void
+aabb_extend(vk_aabb *aabb, const vk_aabb *other)
 {
-   unreachable("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   aabb->min.x = MIN2(aabb->min.x, other->min.x);
+   aabb->min.y = MIN2(aabb->min.y, other->min.y);
+   aabb->min.z = MIN2(aabb->min.z, other->min.z);
+   aabb->max.x = MAX2(aabb->max.x, other->max.x);
+   aabb->max.y = MAX2(aabb->max.y, other->max.y);
+   aabb->max.z = MAX2(aabb->max.z, other->max.z);
 }
 
-VKAPI_ATTR void VKAPI_CALL
-lvp_GetDeviceAccelerationStructureCompatibilityKHR(
-   VkDevice _device, const VkAccelerationStructureVersionInfoKHR *pVersionInfo,
-   VkAccelerationStructureCompatibilityKHR *pCompatibility)
+static float
+aabb_half_area(const vk_aabb *aabb)
 {
-   uint8_t uuid[VK_UUID_SIZE];
-   lvp_device_get_cache_uuid(uuid);
-   bool compat = memcmp(pVersionInfo->pVersionData, uuid, VK_UUID_SIZE) == 0;
-   *pCompatibility = compat ? VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR
-                            : VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+   float dx = aabb->max.x - aabb->min.x;
+   float dy = aabb->max.y - aabb->min.y;
+   float dz = aabb->max.z - aabb->min.z;
+   if (dx < 0.0f || dy < 0.0f || dz < 0.0f)
+      return 0.0f;
+   return dx * dy + dy * dz + dz * dx;
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL
-lvp_CopyAccelerationStructureKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
-                                 const VkCopyAccelerationStructureInfoKHR *pInfo)
+static const vk_aabb empty_aabb = {
+   .min = { INFINITY, INFINITY, INFINITY },
+   .max = { -INFINITY, -INFINITY, -INFINITY },
+};
+
+static vk_ir_node *
+lvp_host_build_leaf(struct lvp_host_build *build, uint32_t index)
 {
-   unreachable("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   return (void *)(build->ir + index * build->leaf_size);
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL
-lvp_CopyMemoryToAccelerationStructureKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
-                                         const VkCopyMemoryToAccelerationStructureInfoKHR *pInfo)
+static struct vk_ir_box_node *
+lvp_host_build_box(struct lvp_host_build *build, uint32_t index)
 {
-   unreachable("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   return (void *)(build->ir + build->leaf_count * build->leaf_size +
+                   index * sizeof(struct vk_ir_box_node));
 }
 
-VKAPI_ATTR VkResult VKAPI_CALL
-lvp_CopyAccelerationStructureToMemoryKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
-                                         const VkCopyAccelerationStructureToMemoryInfoKHR *pInfo)
+/* Reorder refs so that the first half has the smaller centroids along axis. */
+static void
+lvp_host_build_select_median(uint32_t *refs, uint32_t count, const float (*centroids)[3],
+                             unsigned axis)
 {
-   unreachable("Unimplemented");
-   return VK_ERROR_FEATURE_NOT_PRESENT;
+   int32_t lo = 0, hi = count - 1, k = count / 2;
+
+   while (lo < hi) {
+      float pivot = centroids[refs[(lo + hi) / 2]][axis];
+      int32_t i = lo, j = hi;
+
+      while (i <= j) {
+         while (centroids[refs[i]][axis] < pivot)
+            i++;
+         while (centroids[refs[j]][axis] > pivot)
+            j--;
+         if (i <= j) {
+            uint32_t tmp = refs[i];
+            refs[i++] = refs[j];
+            refs[j--] = tmp;
+         }
+      }
+
+      if (k <= j)
+         hi = j;
+      else if (k >= i)
+         lo = i;
+      else
+         break;
+   }
 }
 
-static VkDeviceSize
-lvp_get_as_size(VkDevice device,
-                const VkAccelerationStructureBuildGeometryInfoKHR *build_info,
-                uint32_t leaf_count)
+/* Split the leaves in refs into two non-empty sets, returning the size of
+ * the first one.
+ */
+static uint32_t
+lvp_host_build_split(struct lvp_host_build *build, uint32_t *refs, uint32_t count,
+                     uint32_t depth)
 {
-   uint32_t internal_node_count = MAX2(leaf_count, 2) - 1;
-   uint32_t nodes_size = internal_node_count * sizeof(struct lvp_bvh_box_node);
+   float centroid_min[3] = { INFINITY, INFINITY, INFINITY };
+   float centroid_max[3] = { -INFINITY, -INFINITY, -INFINITY };
+   for (uint32_t i = 0; i < count; i++) {
+      for (unsigned c = 0; c < 3; c++) {
+         centroid_min[c] = MIN2(centroid_min[c], build->centroids[refs[i]][c]);
+         centroid_max[c] = MAX2(centroid_max[c], build->centroids[refs[i]][c]);
+      }
+   }
 
-   uint32_t ir_leaf_node_size = 0;
-   uint32_t output_leaf_node_size = 0;
-   lvp_get_leaf_node_size(vk_get_as_geometry_type(build_info), &ir_leaf_node_size, &output_leaf_node_size);
+   unsigned axis = 0;
+   for (unsigned c = 1; c < 3; c++) {
+      if (centroid_max[c] - centroid_min[c] > centroid_max[axis] - centroid_min[axis])
+         axis = c;
+   }
 
-   nodes_size += leaf_count * output_leaf_node_size;
+   float extent = centroid_max[axis] - centroid_min[axis];
+   if (!(extent > 0.0f))
+      return count / 2;
 
-   nodes_size = util_align_npot(nodes_size, LVP_BVH_NODE_PREFETCH_SIZE);
+   if (depth >= LVP_HOST_BUILD_MAX_SAH_DEPTH) {
+      lvp_host_build_select_median(refs, count, (const void *)build->centroids, axis);
+      return count / 2;
+   }
 
-   return sizeof(struct lvp_bvh_header) + nodes_size;
+   uint32_t bin_counts[LVP_HOST_BUILD_BINS] = { 0 };
+   vk_aabb bin_bounds[LVP_HOST_BUILD_BINS];
+   for (unsigned i = 0; i < LVP_HOST_BUILD_BINS; i++)
+      bin_bounds[i] = empty_aabb;
+
+   float scale = LVP_HOST_BUILD_BINS / extent;
+#define BIN_INDEX(ref) \
+   MIN2((unsigned)((build->centroids[ref][axis] - centroid_min[axis]) * scale), \
+        LVP_HOST_BUILD_BINS - 1)
+
+   for (uint32_t i = 0; i < count; i++) {
+      unsigned bin = BIN_INDEX(refs[i]);
+      bin_counts[bin]++;
+      aabb_extend(&bin_bounds[bin], &lvp_host_build_leaf(build, refs[i])->aabb);
+   }
+
+   /* Sweep from the right to get the cost of everything above each plane,
+    * then from the left to find the cheapest one.
+    */
+   float right_cost[LVP_HOST_BUILD_BINS];
+   vk_aabb bounds = empty_aabb;
+   uint32_t right_count = 0;
+   for (unsigned i = LVP_HOST_BUILD_BINS - 1; i > 0; i--) {
+      aabb_extend(&bounds, &bin_bounds[i]);
+      right_count += bin_counts[i];
+      right_cost[i] = aabb_half_area(&bounds) * right_count;
+   }
+
+   float best_cost = INFINITY;
+   unsigned best_plane = 0;
+   bounds = empty_aabb;
+   uint32_t left_count = 0;
+   for (unsigned i = 1; i < LVP_HOST_BUILD_BINS; i++) {
+      aabb_extend(&bounds, &bin_bounds[i - 1]);
+      left_count += bin_counts[i - 1];
+      if (!left_count || left_count == count)
+         continue;
+
+      float cost = aabb_half_area(&bounds) * left_count + right_cost[i];
+      if (cost < best_cost) {
+         best_cost = cost;
+         best_plane = i;
+      }
+   }
+
+   if (!best_plane)
+      return count / 2;
+
+   uint32_t first = 0, last = count;
+   while (first < last) {
+      if (BIN_INDEX(refs[first]) < best_plane) {
+         first++;
+      } else {
+         last--;
+         uint32_t tmp = refs[first];
+         refs[first] = refs[last];
+         refs[last] = tmp;
+      }
+   }
+#undef BIN_INDEX
+
+   return first;
 }
 
 static uint32_t
-lvp_get_encode_key(struct vk_device *device, VkAccelerationStructureTypeKHR type,
-                   VkBuildAccelerationStructureFlagBitsKHR flags)
+lvp_host_build_box_id(struct lvp_host_build *build, uint32_t index)
 {
-   return 0;
+   return (build->leaf_count * build->leaf_size + index * sizeof(struct vk_ir_box_node)) |
+          vk_ir_node_internal;
 }
 
-static VkResult
-lvp_encode_bind_pipeline(VkCommandBuffer cmd_buffer,
-                         uint32_t key)
+/* A subtree over count leaves has count - 1 box nodes, so the range of box
+ * nodes of every subtree is known before it is built.
+ */
+static uint32_t
+lvp_host_build_subtree_id(struct lvp_host_build *build, const uint32_t *refs, uint32_t count,
+                          uint32_t first_box)
 {
-   return VK_SUCCESS;
+   if (count == 1)
+      return (refs[0] * build->leaf_size) | build->leaf_type;
+
+   return lvp_host_build_box_id(build, first_box + count - 2);
+}
+
+static struct vk_ir_box_node *
+lvp_host_build_init_box(struct lvp_host_build *build, uint32_t index, const uint32_t children[2])
+{
+   struct vk_ir_box_node *node = lvp_host_build_box(build, index);
+   node->children[0] = children[0];
+   node->children[1] = children[1];
+   node->bvh_offset = VK_UNKNOWN_BVH_OFFSET;
+   return node;
+}
+
+static void
+lvp_host_build_update_bounds(struct lvp_host_build *build, struct vk_ir_box_node *node)
+{
+   const vk_ir_node *children[2] = {
+      (const void *)(build->ir + ir_id_to_offset(node->children[0])),
+      (const void *)(build->ir + ir_id_to_offset(node->children[1])),
+   };
+   node->base.aabb = children[0]->aabb;
+   aabb_extend(&node->base.aabb, &children[1]->aabb);
 }
 
-const struct vk_acceleration_structure_build_ops accel_struct_ops = {
-   .get_as_size = lvp_get_as_size,
-   .get_encode_key[0] = lvp_get_encode_key,
-   .encode_bind_pipeline[0] = lvp_encode_bind_pipeline,
-   .encode_as[0] = lvp_enqueue_encode_as,
+/* Build the subtree over refs into the box nodes starting at first_box,
+ * numbered in post-order so that children come before their parents like
+ * the encoder expects.
+ */
+static uint32_t
+lvp_host_build_node(struct lvp_host_build *build, uint32_t *refs, uint32_t count,
+                    uint32_t depth, uint32_t first_box)
+{
+   if (count == 1)
+      return lvp_host_build_subtree_id(build, refs, count, first_box);
+
+   uint32_t split = lvp_host_build_split(build, refs, count, depth);
+
+   uint32_t children[2] = {
+      lvp_host_build_node(build, refs, split, depth + 1, first_box),
+      lvp_host_build_node(build, refs + split, count - split, depth + 1, first_box + split - 1),
+   };
+
+   uint32_t index = first_box + count - 2;
+   lvp_host_build_update_bounds(build, lvp_host_build_init_box(build, index, children));
+
+   return lvp_host_build_box_id(build, index);
+}
+
+struct lvp_host_build_task {
+   struct lvp_host_build *build;
+   uint32_t *refs;
+   uint32_t count;
+   uint32_t depth;
+   uint32_t first_box;
+   struct util_queue_fence fence;
 };
 
-VkResult
-lvp_device_init_accel_struct_state(struct lvp_device *device)
+struct lvp_host_build_tasks {
+   struct util_queue *queue;
+   uint32_t max_depth;
+   uint32_t task_count;
+   struct lvp_host_build_task tasks[LVP_HOST_BUILD_MAX_TASKS];
+   /* box nodes above the tasks, in post-order */
+   uint32_t top_count;
+   uint32_t top[LVP_HOST_BUILD_MAX_TASKS];
+};
+
+static void
+lvp_host_build_task_execute(void *data, void *gdata, int thread_index)
 {
-   device->accel_struct_args.subgroup_size = lp_native_vector_width / 32;
+   struct lvp_host_build_task *task = data;
+   lvp_host_build_node(task->build, task->refs, task->count, task->depth, task->first_box);
+}
 
-   device->vk.as_build_ops = &accel_struct_ops;
-   device->vk.write_buffer_cp = lvp_write_buffer_cp;
-   device->vk.flush_buffer_write_cp = lvp_flush_buffer_write_cp;
-   device->vk.cmd_dispatch_unaligned = lvp_cmd_dispatch_unaligned;
-   device->vk.cmd_fill_buffer_addr = lvp_cmd_fill_buffer_addr;
+/* Make the top-level splits on the calling thread and queue the subtrees
+ * below them.  Their box node ranges don't overlap, so the tree is the same
+ * as the one lvp_host_build_node builds, and the bounds of the top nodes
+ * are filled in once the subtrees are done.
+ */
+static uint32_t
+lvp_host_build_top(struct lvp_host_build *build, struct lvp_host_build_tasks *tasks,
+                   uint32_t *refs, uint32_t count, uint32_t depth, uint32_t first_box)
+{
+   if (depth == tasks->max_depth || count < LVP_HOST_BUILD_MIN_TASK_LEAVES) {
+      struct lvp_host_build_task *task = &tasks->tasks[tasks->task_count++];
+      task->build = build;
+      task->refs = refs;
+      task->count = count;
+      task->depth = depth;
+      task->first_box = first_box;
+      util_queue_fence_init(&task->fence);
+      util_queue_add_job(tasks->queue, task, &task->fence, lvp_host_build_task_execute, NULL, 0);
+
+      return lvp_host_build_subtree_id(build, refs, count, first_box);
+   }
 
-   simple_mtx_init(&device->radix_sort_lock, mtx_plain);
+   uint32_t split = lvp_host_build_split(build, refs, count, depth);
 
-   return VK_SUCCESS;
+   uint32_t children[2] = {
+      lvp_host_build_top(build, tasks, refs, split, depth + 1, first_box),
+      lvp_host_build_top(build, tasks, refs + split, count - split, depth + 1, first_box + split - 1),
+   };
+
+   uint32_t index = first_box + count - 2;
+   lvp_host_build_init_box(build, index, children);
+   tasks->top[tasks->top_count++] = index;
+
+   return lvp_host_build_box_id(build, index);
 }
 
-void
-lvp_device_finish_accel_struct_state(struct lvp_device *device)
+static struct util_queue *
+lvp_host_build_get_queue(struct lvp_device *device)
 {
-   simple_mtx_destroy(&device->radix_sort_lock);
+   if (device->bvh_thread_count < 2)
+      return NULL;
+
+   simple_mtx_lock(&device->bvh_queue_lock);
+   if (!util_queue_is_initialized(&device->bvh_queue)) {
+      util_queue_init(&device->bvh_queue, "lvp_bvh", LVP_HOST_BUILD_MAX_TASKS,
+                      device->bvh_thread_count, UTIL_QUEUE_INIT_RESIZE_IF_FULL, NULL);
+   }
+   simple_mtx_unlock(&device->bvh_queue_lock);
 
-   if (device->radix_sort)
-      radix_sort_vk_destroy(device->radix_sort, lvp_device_to_handle(device), &device->vk.alloc);
+   return util_queue_is_initialized(&device->bvh_queue) ? &device->bvh_queue : NULL;
 }
 
 static void
-lvp_enqueue_save_state(VkCommandBuffer cmdbuf)
+lvp_host_build_tree(struct lvp_device *device, struct lvp_host_build *build, uint32_t *refs)
 {
-   VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, cmdbuf);
+   struct util_queue *queue = NULL;
+   if (build->leaf_count >= 2 * LVP_HOST_BUILD_MIN_TASK_LEAVES)
+      queue = lvp_host_build_get_queue(device);
 
-   struct vk_cmd_queue_entry *entry =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct vk_cmd_queue_entry),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry)
+   if (!queue) {
+      lvp_host_build_node(build, refs, build->leaf_count, 0, 0);
       return;
+   }
+
+   struct lvp_host_build_tasks *tasks = malloc(sizeof(*tasks));
+   if (!tasks) {
+      lvp_host_build_node(build, refs, build->leaf_count, 0, 0);
+      return;
+   }
 
-   entry->type = LVP_CMD_SAVE_STATE;
+   tasks->queue = queue;
+   tasks->max_depth = MIN2(util_logbase2_ceil(device->bvh_thread_count) + 2,
+                           LVP_HOST_BUILD_MAX_TASK_DEPTH);
+   tasks->task_count = 0;
+   tasks->top_count = 0;
+
+   lvp_host_build_top(build, tasks, refs, build->leaf_count, 0, 0);
+
+   for (uint32_t i = 0; i < tasks->task_count; i++) {
+      util_queue_fence_wait(&tasks->tasks[i].fence);
+      util_queue_fence_destroy(&tasks->tasks[i].fence);
+   }
+
+   for (uint32_t i = 0; i < tasks->top_count; i++)
+      lvp_host_build_update_bounds(build, lvp_host_build_box(build, tasks->top[i]));
+
+   free(tasks);
+}
 
-   list_addtail(&entry->cmd_link, &cmd_buffer->vk.cmd_queue.cmds);
+static void
+transform_point(const VkTransformMatrixKHR *transform, const float in[3], float out[3])
+{
+   for (unsigned r = 0; r < 3; r++) {
+      out[r] = transform->matrix[r][0] * in[0] + transform->matrix[r][1] * in[1] +
+               transform->matrix[r][2] * in[2] + transform->matrix[r][3];
+   }
 }
 
 static void
-lvp_enqueue_restore_state(VkCommandBuffer cmdbuf)
+aabb_from_points(vk_aabb *aabb, const float (*points)[3], unsigned count)
 {
-   VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, cmdbuf);
+   *aabb = empty_aabb;
+   for (unsigned i = 0; i < count; i++) {
+      aabb->min.x = MIN2(aabb->min.x, points[i][0]);
+      aabb->min.y = MIN2(aabb->min.y, points[i][1]);
+      aabb->min.z = MIN2(aabb->min.z, points[i][2]);
+      aabb->max.x = MAX2(aabb->max.x, points[i][0]);
+      aabb->max.y = MAX2(aabb->max.y, points[i][1]);
+      aabb->max.z = MAX2(aabb->max.z, points[i][2]);
+   }
+}
 
-   struct vk_cmd_queue_entry *entry =
-      vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct vk_cmd_queue_entry),
-                8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
-   if (!entry)
-      return;
+static uint32_t
+lvp_host_fetch_index(const VkAccelerationStructureGeometryTrianglesDataKHR *triangles,
+                     const uint8_t *indices, uint32_t index)
+{
+   switch (triangles->indexType) {
+   case VK_INDEX_TYPE_UINT8_KHR:
+      return indices[index];
+   case VK_INDEX_TYPE_UINT16:
+      return ((const uint16_t *)indices)[index];
+   case VK_INDEX_TYPE_UINT32:
+      return ((const uint32_t *)indices)[index];
+   default:
+      return index;
+   }
+}
+
+static uint32_t
+lvp_host_write_triangles(struct lvp_host_build *build, uint32_t geometry_index,
+                         const VkAccelerationStructureGeometryKHR *geometry,
+                         const VkAccelerationStructureBuildRangeInfoKHR *range)
+{
+   const VkAccelerationStructureGeometryTrianglesDataKHR *triangles = &geometry->geometry.triangles;
+   enum pipe_format format = lvp_vk_format_to_pipe_format(triangles->vertexFormat);
+
+   const uint8_t *vertices = triangles->vertexData.hostAddress;
+   const uint8_t *indices = NULL;
+   if (triangles->indexType == VK_INDEX_TYPE_NONE_KHR)
+      vertices += range->primitiveOffset;
+   else
+      indices = (const uint8_t *)triangles->indexData.hostAddress + range->primitiveOffset;
+
+   const VkTransformMatrixKHR *transform = NULL;
+   if (triangles->transformData.hostAddress)
+      transform = (const void *)((const uint8_t *)triangles->transformData.hostAddress + range->transformOffset);
+
+   uint32_t geometry_id_and_flags = geometry_index;
+   if (geometry->flags & VK_GEOMETRY_OPAQUE_BIT_KHR)
+      geometry_id_and_flags |= VK_GEOMETRY_OPAQUE;
+
+   uint32_t count = 0;
+   for (uint32_t p = 0; p < range->primitiveCount; p++) {
+      float coords[3][3];
+      bool active = true;
+
+      for (unsigned v = 0; v < 3; v++) {
+         uint32_t vertex = range->firstVertex + lvp_host_fetch_index(triangles, indices, p * 3 + v);
+
+         float rgba[4];
+         util_format_unpack_rgba(format, rgba, vertices + vertex * triangles->vertexStride, 1);
+
+         if (transform)
+            transform_point(transform, rgba, coords[v]);
+         else
+            memcpy(coords[v], rgba, sizeof(coords[v]));
+
+         /* A NaN x component makes the triangle inactive. */
+         active &= !isnan(coords[v][0]);
+      }
+
+      if (!active)
+         continue;
+
+      struct vk_ir_triangle_node *node = (void *)lvp_host_build_leaf(build, build->leaf_count + count++);
+      memcpy(node->coords, coords, sizeof(coords));
+      aabb_from_points(&node->base.aabb, (const void *)coords, 3);
+      node->triangle_id = p;
+      node->id = 0;
+      node->geometry_id_and_flags = geometry_id_and_flags;
+   }
+
+   return count;
+}
+
+static uint32_t
+lvp_host_write_aabbs(struct lvp_host_build *build, uint32_t geometry_index,
+                     const VkAccelerationStructureGeometryKHR *geometry,
+                     const VkAccelerationStructureBuildRangeInfoKHR *range)
+{
+   const VkAccelerationStructureGeometryAabbsDataKHR *aabbs = &geometry->geometry.aabbs;
+   const uint8_t *data = (const uint8_t *)aabbs->data.hostAddress + range->primitiveOffset;
+
+   uint32_t geometry_id_and_flags = geometry_index;
+   if (geometry->flags & VK_GEOMETRY_OPAQUE_BIT_KHR)
+      geometry_id_and_flags |= VK_GEOMETRY_OPAQUE;
+
+   uint32_t count = 0;
+   for (uint32_t p = 0; p < range->primitiveCount; p++) {
+      const VkAabbPositionsKHR *aabb = (const void *)(data + p * aabbs->stride);
+      if (isnan(aabb->minX))
+         continue;
+
+      struct vk_ir_aabb_node *node = (void *)lvp_host_build_leaf(build, build->leaf_count + count++);
+      node->base.aabb = (vk_aabb){
+         .min = { aabb->minX, aabb->minY, aabb->minZ },
+         .max = { aabb->maxX, aabb->maxY, aabb->maxZ },
+      };
+      node->primitive_id = p;
+      node->geometry_id_and_flags = geometry_id_and_flags;
+   }
+
+   return count;
+}
+
+static uint32_t
+lvp_host_write_instances(struct lvp_host_build *build,
+                         const VkAccelerationStructureGeometryKHR *geometry,
+                         const VkAccelerationStructureBuildRangeInfoKHR *range)
+{
+   const VkAccelerationStructureGeometryInstancesDataKHR *instances = &geometry->geometry.instances;
+   const uint8_t *data = (const uint8_t *)instances->data.hostAddress + range->primitiveOffset;
+
+   uint32_t count = 0;
+   for (uint32_t p = 0; p < range->primitiveCount; p++) {
+      const VkAccelerationStructureInstanceKHR *instance;
+      if (instances->arrayOfPointers)
+         instance = ((const VkAccelerationStructureInstanceKHR *const *)data)[p];
+      else
+         instance = (const VkAccelerationStructureInstanceKHR *)data + p;
+
+      uint64_t blas_va = instance->accelerationStructureReference;
+      if (!build->blas_by_address) {
+         VK_FROM_HANDLE(vk_acceleration_structure, blas,
+                        (VkAccelerationStructureKHR)(uintptr_t)instance->accelerationStructureReference);
+         blas_va = blas ? vk_acceleration_structure_get_va(blas) : 0;
+      }
+      if (!blas_va)
+         continue;
+
+      const struct lvp_bvh_header *blas_header = (const void *)(uintptr_t)blas_va;
+      if (isnan(blas_header->bounds.min.x))
+         continue;
+
+      float corners[8][3];
+      for (unsigned c = 0; c < 8; c++) {
+         const float corner[3] = {
+            c & 1 ? blas_header->bounds.max.x : blas_header->bounds.min.x,
+            c & 2 ? blas_header->bounds.max.y : blas_header->bounds.min.y,
+            c & 4 ? blas_header->bounds.max.z : blas_header->bounds.min.z,
+         };
+         transform_point(&instance->transform, corner, corners[c]);
+      }
+
+      struct vk_ir_instance_node *node = (void *)lvp_host_build_leaf(build, build->leaf_count + count++);
+      aabb_from_points(&node->base.aabb, (const void *)corners, 8);
+      node->base_ptr = blas_va;
+      node->custom_instance_and_mask = instance->instanceCustomIndex | (instance->mask << 24);
+      node->sbt_offset_and_flags = instance->instanceShaderBindingTableRecordOffset |
+                                   (instance->flags << 24);
+      memcpy(node->otw_matrix.values, instance->transform.matrix, sizeof(node->otw_matrix.values));
+      node->instance_id = p;
+   }
+
+   return count;
+}
+
+/* Device addresses are host pointers, so the geometry data of device builds
+ * is read the same way, only instances reference BLASes differently.
+ */
+VkResult
+lvp_build_accel_struct(struct lvp_device *device,
+                       const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                       const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+                       bool host)
+{
+   VK_FROM_HANDLE(vk_acceleration_structure, dst, info->dstAccelerationStructure);
+   VkGeometryTypeKHR geometry_type = vk_get_as_geometry_type(info);
+
+   struct lvp_host_build build = { 0 };
+   build.blas_by_address = !host;
+   uint32_t output_leaf_size;
+   lvp_get_leaf_node_size(geometry_type, &build.leaf_size, &output_leaf_size);
+
+   switch (geometry_type) {
+   case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+      build.leaf_type = vk_ir_node_triangle;
+      break;
+   case VK_GEOMETRY_TYPE_AABBS_KHR:
+      build.leaf_type = vk_ir_node_aabb;
+      break;
+   default:
+      build.leaf_type = vk_ir_node_instance;
+      break;
+   }
+
+   uint32_t max_leaf_count = 0;
+   for (uint32_t i = 0; i < info->geometryCount; i++)
+      max_leaf_count += ranges[i].primitiveCount;
+
+   /* The box nodes are placed after the active leaves once their count is
+    * known, so leave room for both.
+    */
+   build.ir = malloc((size_t)max_leaf_count * build.leaf_size +
+                     MAX2(max_leaf_count, 2) * sizeof(struct vk_ir_box_node));
+   build.centroids = malloc(MAX2(max_leaf_count, 1) * sizeof(*build.centroids));
+   uint32_t *refs = malloc(MAX2(max_leaf_count, 1) * sizeof(uint32_t));
+   if (!build.ir || !build.centroids || !refs) {
+      free(build.ir);
+      free(build.centroids);
+      free(refs);
+      return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+   }
+
+   for (uint32_t i = 0; i < info->geometryCount; i++) {
+      const VkAccelerationStructureGeometryKHR *geometry =
+         info->pGeometries ? &info->pGeometries[i] : info->ppGeometries[i];
+
+      switch (geometry_type) {
+      case VK_GEOMETRY_TYPE_TRIANGLES_KHR:
+         build.leaf_count += lvp_host_write_triangles(&build, i, geometry, &ranges[i]);
+         break;
+      case VK_GEOMETRY_TYPE_AABBS_KHR:
+         build.leaf_count += lvp_host_write_aabbs(&build, i, geometry, &ranges[i]);
+         break;
+      default:
+         build.leaf_count += lvp_host_write_instances(&build, geometry, &ranges[i]);
+         break;
+      }
+   }
+
+   for (uint32_t i = 0; i < build.leaf_count; i++) {
+      const vk_aabb *aabb = &lvp_host_build_leaf(&build, i)->aabb;
+      build.centroids[i][0] = (aabb->min.x + aabb->max.x) * 0.5f;
+      build.centroids[i][1] = (aabb->min.y + aabb->max.y) * 0.5f;
+      build.centroids[i][2] = (aabb->min.z + aabb->max.z) * 0.5f;
+      refs[i] = i;
+   }
+
+   if (build.leaf_count >= 2) {
+      build.box_node_count = build.leaf_count - 1;
+      lvp_host_build_tree(device, &build, refs);
+   } else {
+      /* The encoder always starts from a box node. */
+      struct vk_ir_box_node *root = lvp_host_build_box(&build, build.box_node_count++);
+      root->children[0] = VK_BVH_INVALID_NODE;
+      root->children[1] = VK_BVH_INVALID_NODE;
+      root->bvh_offset = VK_UNKNOWN_BVH_OFFSET;
+      root->base.aabb = (vk_aabb){
+         .min = { NAN, NAN, NAN },
+         .max = { NAN, NAN, NAN },
+      };
+
+      if (build.leaf_count) {
+         root->children[0] = build.leaf_type;
+         root->base.aabb = lvp_host_build_leaf(&build, 0)->aabb;
+      }
+   }
+
+   struct vk_ir_header header = {
+      .active_leaf_count = build.leaf_count,
+      .ir_internal_node_count = build.box_node_count,
+   };
+
+   lvp_encode_as(dst, (uintptr_t)build.ir, (uintptr_t)&header, build.leaf_count, geometry_type);
+
+   free(build.ir);
+   free(build.centroids);
+   free(refs);
+
+   return VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+lvp_BuildAccelerationStructuresKHR(
+   VkDevice _device, VkDeferredOperationKHR deferredOperation, uint32_t infoCount,
+   const VkAccelerationStructureBuildGeometryInfoKHR *pInfos,
+   const VkAccelerationStructureBuildRangeInfoKHR *const *ppBuildRangeInfos)
+{
+   VK_FROM_HANDLE(lvp_device, device, _device);
+
+   /* Updates are rebuilt from scratch, the result is the same size. */
+   for (uint32_t i = 0; i < infoCount; i++) {
+      VkResult result = lvp_build_accel_struct(device, &pInfos[i], ppBuildRangeInfos[i], true);
+      if (result != VK_SUCCESS)
+         return result;
+   }
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
+}
+
+VKAPI_ATTR void VKAPI_CALL
+lvp_GetDeviceAccelerationStructureCompatibilityKHR(
+   VkDevice _device, const VkAccelerationStructureVersionInfoKHR *pVersionInfo,
+   VkAccelerationStructureCompatibilityKHR *pCompatibility)
+{
+   uint8_t uuid[VK_UUID_SIZE];
+   lvp_device_get_cache_uuid(uuid);
+   bool compat = memcmp(pVersionInfo->pVersionData, uuid, VK_UUID_SIZE) == 0;
+   *pCompatibility = compat ? VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR
+                            : VK_ACCELERATION_STRUCTURE_COMPATIBILITY_INCOMPATIBLE_KHR;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+lvp_CopyAccelerationStructureKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
+                                 const VkCopyAccelerationStructureInfoKHR *pInfo)
+{
+   VK_FROM_HANDLE(vk_acceleration_structure, src, pInfo->src);
+   VK_FROM_HANDLE(vk_acceleration_structure, dst, pInfo->dst);
+
+   memcpy((void *)(uintptr_t)vk_acceleration_structure_get_va(dst),
+          (const void *)(uintptr_t)vk_acceleration_structure_get_va(src),
+          MIN2(src->size, dst->size));
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+lvp_CopyMemoryToAccelerationStructureKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
+                                         const VkCopyMemoryToAccelerationStructureInfoKHR *pInfo)
+{
+   VK_FROM_HANDLE(vk_acceleration_structure, dst, pInfo->dst);
+
+   lvp_copy_memory_to_accel_struct(pInfo->src.hostAddress, dst);
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
+}
+
+VKAPI_ATTR VkResult VKAPI_CALL
+lvp_CopyAccelerationStructureToMemoryKHR(VkDevice _device, VkDeferredOperationKHR deferredOperation,
+                                         const VkCopyAccelerationStructureToMemoryInfoKHR *pInfo)
+{
+   VK_FROM_HANDLE(vk_acceleration_structure, src, pInfo->src);
+
+   lvp_copy_accel_struct_to_memory(src, pInfo->dst.hostAddress);
+
+   return deferredOperation ? VK_OPERATION_NOT_DEFERRED_KHR : VK_SUCCESS;
+}
+
+VkResult
+lvp_device_init_accel_struct_state(struct lvp_device *device)
+{
+   unsigned num_threads = util_get_cpu_caps()->nr_cpus > 1 ? util_get_cpu_caps()->nr_cpus : 0;
+   device->bvh_thread_count = debug_get_num_option("LP_NUM_THREADS", num_threads);
 
-   entry->type = LVP_CMD_RESTORE_STATE;
+   simple_mtx_init(&device->bvh_queue_lock, mtx_plain);
 
-   list_addtail(&entry->cmd_link, &cmd_buffer->vk.cmd_queue.cmds);
+   return VK_SUCCESS;
+}
+
+void
+lvp_device_finish_accel_struct_state(struct lvp_device *device)
+{
+   simple_mtx_destroy(&device->bvh_queue_lock);
+
+   if (util_queue_is_initialized(&device->bvh_queue))
+      util_queue_destroy(&device->bvh_queue);
 }
 
 VKAPI_ATTR void VKAPI_CALL
@@ -730,12 +1331,50 @@ lvp_CmdBuildAccelerationStructuresKHR(VkCommandBuffer commandBuffer, uint32_t in
 {
    VK_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
-   lvp_init_radix_sort(cmd_buffer->device);
+   /* Builds are run on the CPU by the same builder as the host commands, so
+    * only a copy of the build parameters is recorded.
+    */
+   for (uint32_t i = 0; i < infoCount; i++) {
+      const VkAccelerationStructureBuildGeometryInfoKHR *info = &pInfos[i];
+
+      struct vk_cmd_queue_entry *entry =
+         vk_zalloc(cmd_buffer->vk.cmd_queue.alloc, sizeof(struct vk_cmd_queue_entry),
+                   8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (!entry)
+         return;
+
+      entry->type = LVP_CMD_BUILD_AS;
+
+      struct lvp_cmd_build_as *cmd =
+         vk_zalloc(cmd_buffer->vk.cmd_queue.alloc,
+                   sizeof(struct lvp_cmd_build_as) +
+                   info->geometryCount * (sizeof(VkAccelerationStructureGeometryKHR) +
+                                          sizeof(VkAccelerationStructureBuildRangeInfoKHR)),
+                   8, VK_SYSTEM_ALLOCATION_SCOPE_OBJECT);
+      if (!cmd) {
+         vk_free(cmd_buffer->vk.cmd_queue.alloc, entry);
+         return;
+      }
+
+      VkAccelerationStructureGeometryKHR *geometries = (void *)(cmd + 1);
+      VkAccelerationStructureBuildRangeInfoKHR *ranges = (void *)(geometries + info->geometryCount);
 
-   lvp_enqueue_save_state(commandBuffer);
+      for (uint32_t j = 0; j < info->geometryCount; j++) {
+         geometries[j] = info->pGeometries ? info->pGeometries[j] : *info->ppGeometries[j];
+         geometries[j].pNext = NULL;
+         if (geometries[j].geometryType == VK_GEOMETRY_TYPE_TRIANGLES_KHR)
+            geometries[j].geometry.triangles.pNext = NULL;
+      }
+      memcpy(ranges, ppBuildRangeInfos[i], info->geometryCount * sizeof(*ranges));
+
+      cmd->info = *info;
+      cmd->info.pNext = NULL;
+      cmd->info.pGeometries = geometries;
+      cmd->info.ppGeometries = NULL;
+      cmd->ranges = ranges;
 
-   vk_cmd_build_acceleration_structures(commandBuffer, &cmd_buffer->device->vk, &cmd_buffer->device->meta,
-                                        infoCount, pInfos, ppBuildRangeInfos, &cmd_buffer->device->accel_struct_args);
+      entry->driver_data = cmd;
 
-   lvp_enqueue_restore_state(commandBuffer);
+      list_addtail(&entry->cmd_link, &cmd_buffer->vk.cmd_queue.cmds);
+   }
 }
@@ -61,12 +61,34 @@ struct lvp_bvh_instance_node {
    mat3x4 otw_matrix;
 };
 
-/* 56 bytes */
+/* Children per box node. */
+#define LVP_BVH_BOX_WIDTH 4
+
+/* 112 bytes, the bounds are stored per axis so that the traversal can
+ * test all children against the ray with vec4 operations.  Unused
+ * children have NaN bounds and an invalid node id.
+ */
 struct lvp_bvh_box_node {
-   vk_aabb bounds[2];
-   uint32_t children[2];
+   float min_x[LVP_BVH_BOX_WIDTH];
+   float min_y[LVP_BVH_BOX_WIDTH];
+   float min_z[LVP_BVH_BOX_WIDTH];
+   float max_x[LVP_BVH_BOX_WIDTH];
+   float max_y[LVP_BVH_BOX_WIDTH];
+   float max_z[LVP_BVH_BOX_WIDTH];
+   uint32_t children[LVP_BVH_BOX_WIDTH];
 };
 
+/* Binary BVHs are limited to this depth before being collapsed into box
+ * nodes, which halves it.
+ */
+#define LVP_BVH_MAX_BINARY_DEPTH 24
+
+/* Every box node pushes all but its nearest child, for both the TLAS and
+ * a BLAS.
+ */
+#define LVP_BVH_STACK_SIZE \
+   ((LVP_BVH_BOX_WIDTH - 1) * (LVP_BVH_MAX_BINARY_DEPTH / 2) * 2)
+
 #define LVP_BVH_NODE_PREFETCH_SIZE 56
 
 struct lvp_bvh_header {
@@ -96,7 +118,22 @@ struct lvp_accel_struct_serialization_header {
 VkResult
 lvp_device_init_accel_struct_state(struct lvp_device *device);
 
+void
+lvp_copy_accel_struct_to_memory(struct vk_acceleration_structure *accel_struct, void *dst);
+
+void
+lvp_copy_memory_to_accel_struct(const void *src, struct vk_acceleration_structure *accel_struct);
+
+uint64_t
+lvp_get_accel_struct_property(struct vk_acceleration_structure *accel_struct, VkQueryType query_type);
+
 void
 lvp_device_finish_accel_struct_state(struct lvp_device *device);
 
+VkResult
+lvp_build_accel_struct(struct lvp_device *device,
+                       const VkAccelerationStructureBuildGeometryInfoKHR *info,
+                       const VkAccelerationStructureBuildRangeInfoKHR *ranges,
+                       bool host);
+
 #endif
@@ -22,6 +22,7 @@
  */
 
 #include "lvp_private.h"
+#include "lvp_cmd_prune.h"
 #include "pipe/p_context.h"
 #include "vk_util.h"
 
@@ -30,6 +31,7 @@
 static void
 lvp_cmd_buffer_destroy(struct vk_command_buffer *cmd_buffer)
 {
+   lvp_cmd_buffer_free_stream(container_of(cmd_buffer, struct lvp_cmd_buffer, vk));
    vk_command_buffer_finish(cmd_buffer);
    vk_free(&cmd_buffer->pool->alloc, cmd_buffer);
 }
@@ -56,6 +58,8 @@ lvp_create_cmd_buffer(struct vk_command_pool *pool,
    }
 
    cmd_buffer->device = device;
+   cmd_buffer->usage_flags = 0;
+   cmd_buffer->stream = NULL;
 
    *cmd_buffer_out = &cmd_buffer->vk;
 
@@ -66,6 +70,7 @@ static void
 lvp_reset_cmd_buffer(struct vk_command_buffer *vk_cmd_buffer,
                      UNUSED VkCommandBufferResetFlags flags)
 {
+   lvp_cmd_buffer_free_stream(container_of(vk_cmd_buffer, struct lvp_cmd_buffer, vk));
    vk_command_buffer_reset(vk_cmd_buffer);
 }
 
@@ -82,6 +87,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_BeginCommandBuffer(
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
    vk_command_buffer_begin(&cmd_buffer->vk, pBeginInfo);
+   cmd_buffer->usage_flags = pBeginInfo->flags;
 
    return VK_SUCCESS;
 }
@@ -91,5 +97,15 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_EndCommandBuffer(
 {
    LVP_FROM_HANDLE(lvp_cmd_buffer, cmd_buffer, commandBuffer);
 
+   if (vk_command_buffer_get_record_result(&cmd_buffer->vk) == VK_SUCCESS) {
+      lvp_cmd_queue_prune_state(&cmd_buffer->vk.cmd_queue);
+
+      /* One-time-submit command buffers would only pay for the translation
+       * twice, everything else is replayed from the compiled stream.
+       */
+      if (!(cmd_buffer->usage_flags & VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT))
+         lvp_cmd_buffer_compile(cmd_buffer);
+   }
+
    return vk_command_buffer_end(&cmd_buffer->vk);
 }
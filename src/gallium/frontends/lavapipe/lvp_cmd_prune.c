@@ -0,0 +1,221 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include "lvp_cmd_prune.h"
+
+#include <string.h>
+
+/* Dynamic state which is only ever overwritten by its setters, grouped by
+ * the rendering state the setters write.
+ */
+enum lvp_dyn_group {
+   LVP_DYN_VIEWPORT,
+   LVP_DYN_SCISSOR,
+   LVP_DYN_LINE_WIDTH,
+   LVP_DYN_DEPTH_BIAS,
+   LVP_DYN_BLEND_CONSTANTS,
+   LVP_DYN_DEPTH_BOUNDS,
+   LVP_DYN_STENCIL_COMPARE_MASK,
+   LVP_DYN_STENCIL_WRITE_MASK,
+   LVP_DYN_STENCIL_REFERENCE,
+   LVP_DYN_CULL_MODE,
+   LVP_DYN_FRONT_FACE,
+   LVP_DYN_PRIMITIVE_TOPOLOGY,
+   LVP_DYN_DEPTH_TEST_ENABLE,
+   LVP_DYN_DEPTH_WRITE_ENABLE,
+   LVP_DYN_DEPTH_COMPARE_OP,
+   LVP_DYN_DEPTH_BOUNDS_TEST_ENABLE,
+   LVP_DYN_STENCIL_TEST_ENABLE,
+   LVP_DYN_COUNT,
+};
+
+static int
+dyn_state_group(enum vk_cmd_type type)
+{
+   switch (type) {
+   case VK_CMD_SET_VIEWPORT:
+   case VK_CMD_SET_VIEWPORT_WITH_COUNT:
+      return LVP_DYN_VIEWPORT;
+   case VK_CMD_SET_SCISSOR:
+   case VK_CMD_SET_SCISSOR_WITH_COUNT:
+      return LVP_DYN_SCISSOR;
+   case VK_CMD_SET_LINE_WIDTH:
+      return LVP_DYN_LINE_WIDTH;
+   case VK_CMD_SET_DEPTH_BIAS:
+      return LVP_DYN_DEPTH_BIAS;
+   case VK_CMD_SET_BLEND_CONSTANTS:
+      return LVP_DYN_BLEND_CONSTANTS;
+   case VK_CMD_SET_DEPTH_BOUNDS:
+      return LVP_DYN_DEPTH_BOUNDS;
+   case VK_CMD_SET_STENCIL_COMPARE_MASK:
+      return LVP_DYN_STENCIL_COMPARE_MASK;
+   case VK_CMD_SET_STENCIL_WRITE_MASK:
+      return LVP_DYN_STENCIL_WRITE_MASK;
+   case VK_CMD_SET_STENCIL_REFERENCE:
+      return LVP_DYN_STENCIL_REFERENCE;
+   case VK_CMD_SET_CULL_MODE:
+      return LVP_DYN_CULL_MODE;
+   case VK_CMD_SET_FRONT_FACE:
+      return LVP_DYN_FRONT_FACE;
+   case VK_CMD_SET_PRIMITIVE_TOPOLOGY:
+      return LVP_DYN_PRIMITIVE_TOPOLOGY;
+   case VK_CMD_SET_DEPTH_TEST_ENABLE:
+      return LVP_DYN_DEPTH_TEST_ENABLE;
+   case VK_CMD_SET_DEPTH_WRITE_ENABLE:
+      return LVP_DYN_DEPTH_WRITE_ENABLE;
+   case VK_CMD_SET_DEPTH_COMPARE_OP:
+      return LVP_DYN_DEPTH_COMPARE_OP;
+   case VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE:
+      return LVP_DYN_DEPTH_BOUNDS_TEST_ENABLE;
+   case VK_CMD_SET_STENCIL_TEST_ENABLE:
+      return LVP_DYN_STENCIL_TEST_ENABLE;
+   default:
+      return -1;
+   }
+}
+
+/* Commands which neither read nor write any of the state above, so a setter
+ * on either side of them sees the same state.
+ */
+static bool
+dyn_state_neutral(enum vk_cmd_type type)
+{
+   switch (type) {
+   case VK_CMD_BIND_DESCRIPTOR_SETS:
+   case VK_CMD_BIND_DESCRIPTOR_SETS2:
+   case VK_CMD_BIND_INDEX_BUFFER:
+   case VK_CMD_BIND_INDEX_BUFFER2:
+   case VK_CMD_BIND_VERTEX_BUFFERS:
+   case VK_CMD_BIND_VERTEX_BUFFERS2:
+   case VK_CMD_PUSH_CONSTANTS:
+   case VK_CMD_PUSH_CONSTANTS2:
+   case VK_CMD_DRAW:
+   case VK_CMD_DRAW_INDEXED:
+   case VK_CMD_DRAW_MULTI_EXT:
+   case VK_CMD_DRAW_MULTI_INDEXED_EXT:
+   case VK_CMD_DRAW_INDIRECT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT:
+   case VK_CMD_DRAW_INDIRECT_COUNT:
+   case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
+   case VK_CMD_PIPELINE_BARRIER2:
+      return true;
+   default:
+      return false;
+   }
+}
+
+static bool
+dyn_state_equal(const struct vk_cmd_queue_entry *a,
+                const struct vk_cmd_queue_entry *b)
+{
+   if (a->type != b->type)
+      return false;
+
+   switch (a->type) {
+   case VK_CMD_SET_VIEWPORT:
+      return a->u.set_viewport.first_viewport == b->u.set_viewport.first_viewport &&
+             a->u.set_viewport.viewport_count == b->u.set_viewport.viewport_count &&
+             !memcmp(a->u.set_viewport.viewports, b->u.set_viewport.viewports,
+                     a->u.set_viewport.viewport_count * sizeof(VkViewport));
+   case VK_CMD_SET_VIEWPORT_WITH_COUNT:
+      return a->u.set_viewport_with_count.viewport_count == b->u.set_viewport_with_count.viewport_count &&
+             !memcmp(a->u.set_viewport_with_count.viewports, b->u.set_viewport_with_count.viewports,
+                     a->u.set_viewport_with_count.viewport_count * sizeof(VkViewport));
+   case VK_CMD_SET_SCISSOR:
+      return a->u.set_scissor.first_scissor == b->u.set_scissor.first_scissor &&
+             a->u.set_scissor.scissor_count == b->u.set_scissor.scissor_count &&
+             !memcmp(a->u.set_scissor.scissors, b->u.set_scissor.scissors,
+                     a->u.set_scissor.scissor_count * sizeof(VkRect2D));
+   case VK_CMD_SET_SCISSOR_WITH_COUNT:
+      return a->u.set_scissor_with_count.scissor_count == b->u.set_scissor_with_count.scissor_count &&
+             !memcmp(a->u.set_scissor_with_count.scissors, b->u.set_scissor_with_count.scissors,
+                     a->u.set_scissor_with_count.scissor_count * sizeof(VkRect2D));
+   case VK_CMD_SET_LINE_WIDTH:
+      return !memcmp(&a->u.set_line_width, &b->u.set_line_width,
+                     sizeof(a->u.set_line_width));
+   case VK_CMD_SET_DEPTH_BIAS:
+      return !memcmp(&a->u.set_depth_bias, &b->u.set_depth_bias,
+                     sizeof(a->u.set_depth_bias));
+   case VK_CMD_SET_BLEND_CONSTANTS:
+      return !memcmp(&a->u.set_blend_constants, &b->u.set_blend_constants,
+                     sizeof(a->u.set_blend_constants));
+   case VK_CMD_SET_DEPTH_BOUNDS:
+      return !memcmp(&a->u.set_depth_bounds, &b->u.set_depth_bounds,
+                     sizeof(a->u.set_depth_bounds));
+   case VK_CMD_SET_STENCIL_COMPARE_MASK:
+      return !memcmp(&a->u.set_stencil_compare_mask, &b->u.set_stencil_compare_mask,
+                     sizeof(a->u.set_stencil_compare_mask));
+   case VK_CMD_SET_STENCIL_WRITE_MASK:
+      return !memcmp(&a->u.set_stencil_write_mask, &b->u.set_stencil_write_mask,
+                     sizeof(a->u.set_stencil_write_mask));
+   case VK_CMD_SET_STENCIL_REFERENCE:
+      return !memcmp(&a->u.set_stencil_reference, &b->u.set_stencil_reference,
+                     sizeof(a->u.set_stencil_reference));
+   case VK_CMD_SET_CULL_MODE:
+      return a->u.set_cull_mode.cull_mode == b->u.set_cull_mode.cull_mode;
+   case VK_CMD_SET_FRONT_FACE:
+      return a->u.set_front_face.front_face == b->u.set_front_face.front_face;
+   case VK_CMD_SET_PRIMITIVE_TOPOLOGY:
+      return a->u.set_primitive_topology.primitive_topology ==
+             b->u.set_primitive_topology.primitive_topology;
+   case VK_CMD_SET_DEPTH_TEST_ENABLE:
+      return a->u.set_depth_test_enable.depth_test_enable ==
+             b->u.set_depth_test_enable.depth_test_enable;
+   case VK_CMD_SET_DEPTH_WRITE_ENABLE:
+      return a->u.set_depth_write_enable.depth_write_enable ==
+             b->u.set_depth_write_enable.depth_write_enable;
+   case VK_CMD_SET_DEPTH_COMPARE_OP:
+      return a->u.set_depth_compare_op.depth_compare_op ==
+             b->u.set_depth_compare_op.depth_compare_op;
+   case VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE:
+      return a->u.set_depth_bounds_test_enable.depth_bounds_test_enable ==
+             b->u.set_depth_bounds_test_enable.depth_bounds_test_enable;
+   case VK_CMD_SET_STENCIL_TEST_ENABLE:
+      return a->u.set_stencil_test_enable.stencil_test_enable ==
+             b->u.set_stencil_test_enable.stencil_test_enable;
+   default:
+      return false;
+   }
+}
+
+/* Drop dynamic state setters which repeat the last setter of the same state,
+ * with only draws and binds in between.  Applications (and layers) commonly
+ * re-set viewports, scissors and the like before every draw, and doing this
+ * once at end of recording saves walking those commands on every submit.
+ *
+ * The face masks of the stencil setters are part of the comparison, so a
+ * setter is only dropped when it writes exactly what its predecessor wrote.
+ */
+void
+lvp_cmd_queue_prune_state(struct vk_cmd_queue *queue)
+{
+   struct vk_cmd_queue_entry *last[LVP_DYN_COUNT] = { NULL };
+   struct vk_cmd_queue pruned = { .alloc = queue->alloc };
+
+   list_inithead(&pruned.cmds);
+
+   list_for_each_entry_safe(struct vk_cmd_queue_entry, cmd, &queue->cmds, cmd_link) {
+      int group = dyn_state_group(cmd->type);
+
+      if (group < 0) {
+         /* Pipeline binds, render pass boundaries, secondaries and driver
+          * internal commands may all change the state behind our back.
+          */
+         if (!dyn_state_neutral(cmd->type))
+            memset(last, 0, sizeof(last));
+         continue;
+      }
+
+      if (last[group] && dyn_state_equal(last[group], cmd)) {
+         list_del(&cmd->cmd_link);
+         list_addtail(&cmd->cmd_link, &pruned.cmds);
+      } else {
+         last[group] = cmd;
+      }
+   }
+
+   vk_cmd_queue_finish(&pruned);
+}
@@ -0,0 +1,23 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef LVP_CMD_PRUNE_H
+#define LVP_CMD_PRUNE_H
+
+#include "vk_cmd_queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void
+lvp_cmd_queue_prune_state(struct vk_cmd_queue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* LVP_CMD_PRUNE_H */
@@ -55,6 +55,44 @@ lvp_descriptor_set_layout_destroy(struct vk_device *_device, struct vk_descripto
    vk_descriptor_set_layout_destroy(_device, _layout);
 }
 
+/* Hash what lowering a shader against the layout depends on, so that the
+ * pipeline cache can tell layouts apart.
+ */
+static void
+lvp_descriptor_set_layout_hash(struct lvp_descriptor_set_layout *set_layout)
+{
+   struct mesa_blake3 ctx;
+   _mesa_blake3_init(&ctx);
+   _mesa_blake3_update(&ctx, &set_layout->vk.flags, sizeof(set_layout->vk.flags));
+   _mesa_blake3_update(&ctx, &set_layout->binding_count, sizeof(set_layout->binding_count));
+   _mesa_blake3_update(&ctx, &set_layout->size, sizeof(set_layout->size));
+
+   for (uint32_t b = 0; b < set_layout->binding_count; b++) {
+      const struct lvp_descriptor_set_binding_layout *binding = &set_layout->binding[b];
+
+      _mesa_blake3_update(&ctx, &binding->valid, sizeof(binding->valid));
+      _mesa_blake3_update(&ctx, &binding->type, sizeof(binding->type));
+      _mesa_blake3_update(&ctx, &binding->descriptor_index, sizeof(binding->descriptor_index));
+      _mesa_blake3_update(&ctx, &binding->stride, sizeof(binding->stride));
+      _mesa_blake3_update(&ctx, &binding->array_size, sizeof(binding->array_size));
+      _mesa_blake3_update(&ctx, &binding->dynamic_index, sizeof(binding->dynamic_index));
+      _mesa_blake3_update(&ctx, &binding->uniform_block_offset, sizeof(binding->uniform_block_offset));
+      _mesa_blake3_update(&ctx, &binding->uniform_block_size, sizeof(binding->uniform_block_size));
+
+      if (!binding->immutable_samplers)
+         continue;
+
+      for (uint32_t i = 0; i < binding->array_size; i++) {
+         const struct vk_ycbcr_conversion *conversion =
+            binding->immutable_samplers[i]->vk.ycbcr_conversion;
+         if (conversion)
+            _mesa_blake3_update(&ctx, &conversion->state, sizeof(conversion->state));
+      }
+   }
+
+   _mesa_blake3_final(&ctx, set_layout->vk.blake3);
+}
+
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDescriptorSetLayout(
     VkDevice                                    _device,
     const VkDescriptorSetLayoutCreateInfo*      pCreateInfo,
@@ -186,6 +224,8 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDescriptorSetLayout(
 
    set_layout->dynamic_offset_count = dynamic_offset_count;
 
+   lvp_descriptor_set_layout_hash(set_layout);
+
    if (set_layout->binding_count == set_layout->immutable_sampler_count) {
       /* create a bindable set with all the immutable samplers */
       lvp_descriptor_set_create(device, set_layout, &set_layout->immutable_set);
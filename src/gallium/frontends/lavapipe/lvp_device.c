@@ -503,7 +503,7 @@ lvp_get_features(const struct lvp_physical_device *pdevice,
       .accelerationStructure = true,
       .accelerationStructureCaptureReplay = false,
       .accelerationStructureIndirectBuild = false,
-      .accelerationStructureHostCommands = false,
+      .accelerationStructureHostCommands = true,
       .descriptorBindingAccelerationStructureUpdateAfterBind = true,
 
       /* VK_EXT_descriptor_buffer */
@@ -1507,17 +1507,8 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
 {
    VK_OUTARRAY_MAKE_TYPED(VkQueueFamilyProperties2, out, pQueueFamilyProperties, pCount);
 
-   VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(pQueueFamilyProperties, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
-   if (prio) {
-      prio->priorityCount = 4;
-      prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
-      prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
-      prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
-      prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
-   }
-
-   vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
-      p->queueFamilyProperties = (VkQueueFamilyProperties) {
+   const VkQueueFamilyProperties families[] = {
+      {
          .queueFlags = VK_QUEUE_GRAPHICS_BIT |
          VK_QUEUE_COMPUTE_BIT |
          VK_QUEUE_TRANSFER_BIT |
@@ -1525,7 +1516,29 @@ VKAPI_ATTR void VKAPI_CALL lvp_GetPhysicalDeviceQueueFamilyProperties2(
          .queueCount = 1,
          .timestampValidBits = 64,
          .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
-      };
+      },
+      {
+         .queueFlags = VK_QUEUE_COMPUTE_BIT |
+         VK_QUEUE_TRANSFER_BIT,
+         .queueCount = LVP_MAX_COMPUTE_QUEUES,
+         .timestampValidBits = 64,
+         .minImageTransferGranularity = (VkExtent3D) { 1, 1, 1 },
+      },
+   };
+
+   for (unsigned i = 0; i < ARRAY_SIZE(families); i++) {
+      vk_outarray_append_typed(VkQueueFamilyProperties2, &out, p) {
+         p->queueFamilyProperties = families[i];
+
+         VkQueueFamilyGlobalPriorityPropertiesKHR *prio = vk_find_struct(p, QUEUE_FAMILY_GLOBAL_PRIORITY_PROPERTIES_KHR);
+         if (prio) {
+            prio->priorityCount = 4;
+            prio->priorities[0] = VK_QUEUE_GLOBAL_PRIORITY_LOW_KHR;
+            prio->priorities[1] = VK_QUEUE_GLOBAL_PRIORITY_MEDIUM_KHR;
+            prio->priorities[2] = VK_QUEUE_GLOBAL_PRIORITY_HIGH_KHR;
+            prio->priorities[3] = VK_QUEUE_GLOBAL_PRIORITY_REALTIME_KHR;
+         }
+      }
    }
 }
 
@@ -1676,7 +1689,11 @@ lvp_queue_submit(struct vk_queue *vk_queue,
          vk_sync_as_lvp_pipe_sync(submit->signals[i].sync);
       lvp_pipe_sync_signal_with_fence(queue->device, sync, queue->last_fence);
    }
-   destroy_pipelines(queue);
+   /* Destroyed pipelines are only queued on the graphics queue, and
+    * released on its thread since they use its context.
+    */
+   if (queue == &queue->device->queue)
+      destroy_pipelines(queue);
 
    return VK_SUCCESS;
 }
@@ -1699,6 +1716,16 @@ lvp_queue_init(struct lvp_device *device, struct lvp_queue *queue,
 
    queue->device = device;
 
+   /* The graphics queue's state is allocated along with the device. */
+   if (!queue->state) {
+      queue->state = vk_zalloc(&device->vk.alloc, lvp_get_rendering_state_size(), 8,
+                               VK_SYSTEM_ALLOCATION_SCOPE_DEVICE);
+      if (!queue->state) {
+         vk_queue_finish(&queue->vk);
+         return vk_error(device, VK_ERROR_OUT_OF_HOST_MEMORY);
+      }
+   }
+
    queue->ctx = device->pscreen->context_create(device->pscreen, NULL, PIPE_CONTEXT_ROBUST_BUFFER_ACCESS);
    queue->cso = cso_create_context(queue->ctx, CSO_NO_VBUF);
    queue->uploader = u_upload_create(queue->ctx, 1024 * 1024, PIPE_BIND_CONSTANT_BUFFER, PIPE_USAGE_STREAM, 0);
@@ -1723,6 +1750,11 @@ lvp_queue_finish(struct lvp_queue *queue)
    u_upload_destroy(queue->uploader);
    cso_destroy_context(queue->cso);
    queue->ctx->destroy(queue->ctx);
+
+   if (queue->last_fence)
+      queue->device->pscreen->fence_reference(queue->device->pscreen, &queue->last_fence, NULL);
+   if (queue != &queue->device->queue)
+      vk_free(&queue->device->vk.alloc, queue->state);
 }
 
 VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
@@ -1771,10 +1803,27 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    device->pscreen = physical_device->pscreen;
 
-   assert(pCreateInfo->queueCreateInfoCount == 1);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueFamilyIndex == 0);
-   assert(pCreateInfo->pQueueCreateInfos[0].queueCount == 1);
-   result = lvp_queue_init(device, &device->queue, pCreateInfo->pQueueCreateInfos, 0);
+   /* The graphics queue always exists, its context is the device's. */
+   const VkDeviceQueueCreateInfo default_queue_info = {
+      .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+      .queueFamilyIndex = 0,
+      .queueCount = 1,
+   };
+   const VkDeviceQueueCreateInfo *graphics_queue_info = &default_queue_info;
+   const VkDeviceQueueCreateInfo *compute_queue_info = NULL;
+   for (uint32_t i = 0; i < pCreateInfo->queueCreateInfoCount; i++) {
+      const VkDeviceQueueCreateInfo *queue_info = &pCreateInfo->pQueueCreateInfos[i];
+      if (queue_info->queueFamilyIndex == 0) {
+         assert(queue_info->queueCount == 1);
+         graphics_queue_info = queue_info;
+      } else {
+         assert(queue_info->queueFamilyIndex == 1);
+         assert(queue_info->queueCount <= LVP_MAX_COMPUTE_QUEUES);
+         compute_queue_info = queue_info;
+      }
+   }
+
+   result = lvp_queue_init(device, &device->queue, graphics_queue_info, 0);
    if (result != VK_SUCCESS) {
       vk_free(&device->vk.alloc, device);
       return result;
@@ -1809,6 +1858,15 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateDevice(
 
    lvp_device_init_accel_struct_state(device);
 
+   for (uint32_t i = 0; compute_queue_info && i < compute_queue_info->queueCount; i++) {
+      result = lvp_queue_init(device, &device->compute_queues[i], compute_queue_info, i);
+      if (result != VK_SUCCESS) {
+         lvp_DestroyDevice(lvp_device_to_handle(device), pAllocator);
+         return result;
+      }
+      device->num_compute_queues++;
+   }
+
    *pDevice = lvp_device_to_handle(device);
 
    return VK_SUCCESS;
@@ -1840,13 +1898,19 @@ VKAPI_ATTR void VKAPI_CALL lvp_DestroyDevice(
 
    device->queue.ctx->delete_fs_state(device->queue.ctx, device->noop_fs);
 
-   if (device->queue.last_fence)
-      device->pscreen->fence_reference(device->pscreen, &device->queue.last_fence, NULL);
    ralloc_free(device->bda.table);
    simple_mtx_destroy(&device->bda_lock);
    pipe_resource_reference(&device->zero_buffer, NULL);
 
    lvp_queue_finish(&device->queue);
+
+   /* Compute shader variants live in the context of the queue whose
+    * dispatch compiled them, so these go after the graphics queue has
+    * released the last pipelines.
+    */
+   for (uint32_t i = 0; i < device->num_compute_queues; i++)
+      lvp_queue_finish(&device->compute_queues[i]);
+
    vk_device_finish(&device->vk);
    vk_free(&device->vk.alloc, device);
 }
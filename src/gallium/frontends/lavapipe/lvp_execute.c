@@ -95,7 +95,8 @@ struct rendering_state {
    bool blend_color_dirty;
    bool ve_dirty;
    bool vb_dirty;
-   bool constbuf_dirty[LVP_SHADER_STAGES];
+   /* descriptor set slots to rebind, per stage */
+   uint32_t constbuf_dirty[LVP_SHADER_STAGES];
    bool pcbuf_dirty[LVP_SHADER_STAGES];
    bool has_pcbuf[LVP_SHADER_STAGES];
    bool vp_dirty;
@@ -165,6 +166,21 @@ struct rendering_state {
 
    void *velems_cso;
 
+   /* Last CSOs handed to the cso context.  Dynamic state is often set to
+    * the value it already has, so compare against these before paying
+    * for the cso hash lookup.
+    */
+   struct {
+      bool blend_valid;
+      bool rs_valid;
+      bool dsa_valid;
+      bool velem_valid;
+      struct pipe_blend_state blend;
+      struct pipe_rasterizer_state rs;
+      struct pipe_depth_stencil_alpha_state dsa;
+      struct cso_velems_state velem;
+   } emitted;
+
    uint8_t push_constants[128 * 4];
    uint16_t push_size[LVP_PIPELINE_TYPE_COUNT];
    uint16_t gfx_push_sizes[LVP_SHADER_STAGES];
@@ -204,11 +220,6 @@ struct rendering_state {
    struct util_dynarray internal_buffers;
 
    struct lvp_pipeline *exec_graph;
-
-   struct {
-      struct lvp_shader *compute_shader;
-      uint8_t push_constants[128 * 4];
-   } saved;
 };
 
 static struct pipe_resource *
@@ -305,12 +316,12 @@ static void emit_compute_state(struct rendering_state *state)
    if (state->pcbuf_dirty[MESA_SHADER_COMPUTE])
       update_pcbuf(state, MESA_SHADER_COMPUTE, MESA_SHADER_COMPUTE);
 
-   if (state->constbuf_dirty[MESA_SHADER_COMPUTE]) {
-      for (unsigned i = 0; i < state->num_const_bufs[MESA_SHADER_COMPUTE]; i++)
-         state->pctx->set_constant_buffer(state->pctx, MESA_SHADER_COMPUTE,
-                                          i + 1, false, &state->const_buffer[MESA_SHADER_COMPUTE][i]);
-      state->constbuf_dirty[MESA_SHADER_COMPUTE] = false;
+   u_foreach_bit(i, state->constbuf_dirty[MESA_SHADER_COMPUTE] &
+                    BITFIELD_MASK(state->num_const_bufs[MESA_SHADER_COMPUTE])) {
+      state->pctx->set_constant_buffer(state->pctx, MESA_SHADER_COMPUTE,
+                                       i + 1, false, &state->const_buffer[MESA_SHADER_COMPUTE][i]);
    }
+   state->constbuf_dirty[MESA_SHADER_COMPUTE] = 0;
 
    if (state->compute_shader_dirty)
       state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_COMPUTE]->shader_cso);
@@ -318,7 +329,7 @@ static void emit_compute_state(struct rendering_state *state)
    state->compute_shader_dirty = false;
 
    state->pcbuf_dirty[MESA_SHADER_RAYGEN] = true;
-   state->constbuf_dirty[MESA_SHADER_RAYGEN] = true;
+   state->constbuf_dirty[MESA_SHADER_RAYGEN] = UINT32_MAX;
 }
 
 static void
@@ -362,6 +373,59 @@ static void update_vertex_elements_buffer_index(struct rendering_state *state)
       state->velem.velems[i].vertex_buffer_index = state->vertex_buffer_index[i] - state->start_vb;
 }
 
+static void
+set_blend(struct rendering_state *state, const struct pipe_blend_state *blend)
+{
+   if (state->emitted.blend_valid &&
+       !memcmp(&state->emitted.blend, blend, sizeof(*blend)))
+      return;
+
+   cso_set_blend(state->cso, blend);
+   state->emitted.blend = *blend;
+   state->emitted.blend_valid = true;
+}
+
+static void
+set_rasterizer(struct rendering_state *state)
+{
+   if (state->emitted.rs_valid &&
+       !memcmp(&state->emitted.rs, &state->rs_state, sizeof(state->rs_state)))
+      return;
+
+   cso_set_rasterizer(state->cso, &state->rs_state);
+   state->emitted.rs = state->rs_state;
+   state->emitted.rs_valid = true;
+}
+
+static void
+set_depth_stencil_alpha(struct rendering_state *state)
+{
+   if (state->emitted.dsa_valid &&
+       !memcmp(&state->emitted.dsa, &state->dsa_state, sizeof(state->dsa_state)))
+      return;
+
+   cso_set_depth_stencil_alpha(state->cso, &state->dsa_state);
+   state->emitted.dsa = state->dsa_state;
+   state->emitted.dsa_valid = true;
+}
+
+static void
+set_vertex_elements(struct rendering_state *state)
+{
+   const unsigned count = state->velem.count;
+
+   if (state->emitted.velem_valid && state->emitted.velem.count == count &&
+       !memcmp(state->emitted.velem.velems, state->velem.velems,
+               count * sizeof(state->velem.velems[0])))
+      return;
+
+   cso_set_vertex_elements(state->cso, &state->velem);
+   state->emitted.velem.count = count;
+   memcpy(state->emitted.velem.velems, state->velem.velems,
+          count * sizeof(state->velem.velems[0]));
+   state->emitted.velem_valid = true;
+}
+
 static void emit_state(struct rendering_state *state)
 {
    if (!state->shaders[MESA_SHADER_FRAGMENT] && !state->noop_fs_bound) {
@@ -384,9 +448,9 @@ static void emit_state(struct rendering_state *state)
                blend.rt[state->fb_map[i]] = state->blend_state.rt[i];
             }
          }
-         cso_set_blend(state->cso, &blend);
+         set_blend(state, &blend);
       } else {
-         cso_set_blend(state->cso, &state->blend_state);
+         set_blend(state, &state->blend_state);
       }
       /* reset colormasks using saved bitmask */
       if (state->color_write_disables) {
@@ -420,7 +484,7 @@ static void emit_state(struct rendering_state *state)
          state->rs_state.offset_line = false;
          state->rs_state.offset_point = false;
       }
-      cso_set_rasterizer(state->cso, &state->rs_state);
+      set_rasterizer(state);
       state->rs_dirty = false;
       state->rs_state.multisample = ms;
    }
@@ -432,7 +496,7 @@ static void emit_state(struct rendering_state *state)
          state->dsa_state.stencil[0].enabled = false;
          state->dsa_state.stencil[1].enabled = false;
       }
-      cso_set_depth_stencil_alpha(state->cso, &state->dsa_state);
+      set_depth_stencil_alpha(state);
       state->dsa_dirty = false;
       state->dsa_state.stencil[0].enabled = s0_enabled;
       state->dsa_state.stencil[1].enabled = s1_enabled;
@@ -470,7 +534,7 @@ static void emit_state(struct rendering_state *state)
    }
 
    if (state->ve_dirty) {
-      cso_set_vertex_elements(state->cso, &state->velem);
+      set_vertex_elements(state);
       state->ve_dirty = false;
    }
 
@@ -480,12 +544,11 @@ static void emit_state(struct rendering_state *state)
    }
 
    lvp_forall_gfx_stage(sh) {
-      if (state->constbuf_dirty[sh]) {
-         for (unsigned idx = 0; idx < state->num_const_bufs[sh]; idx++)
-            state->pctx->set_constant_buffer(state->pctx, sh,
-                                             idx + 1, false, &state->const_buffer[sh][idx]);
+      u_foreach_bit(idx, state->constbuf_dirty[sh] & BITFIELD_MASK(state->num_const_bufs[sh])) {
+         state->pctx->set_constant_buffer(state->pctx, sh,
+                                          idx + 1, false, &state->const_buffer[sh][idx]);
       }
-      state->constbuf_dirty[sh] = false;
+      state->constbuf_dirty[sh] = 0;
    }
 
    lvp_forall_gfx_stage(sh) {
@@ -1079,12 +1142,20 @@ handle_set_stage_buffer(struct rendering_state *state,
                         gl_shader_stage stage,
                         uint32_t index)
 {
-   state->const_buffer[stage][index].buffer = bo;
-   state->const_buffer[stage][index].buffer_offset = offset;
-   state->const_buffer[stage][index].buffer_size = bo->width0;
-   state->const_buffer[stage][index].user_buffer = NULL;
+   struct pipe_constant_buffer *cbuf = &state->const_buffer[stage][index];
+
+   /* Sets are already laid out the way the JIT reads them, so rebinding
+    * the same one is a no-op.
+    */
+   if (cbuf->buffer != bo || cbuf->buffer_offset != offset ||
+       cbuf->buffer_size != bo->width0) {
+      cbuf->buffer = bo;
+      cbuf->buffer_offset = offset;
+      cbuf->buffer_size = bo->width0;
+      cbuf->user_buffer = NULL;
 
-   state->constbuf_dirty[stage] = true;
+      state->constbuf_dirty[stage] |= BITFIELD_BIT(index);
+   }
 
    if (state->num_const_bufs[stage] <= index)
       state->num_const_bufs[stage] = index + 1;
@@ -1100,19 +1171,32 @@ static void handle_set_stage(struct rendering_state *state,
    handle_set_stage_buffer(state, set->bo, 0, stage, index);
 }
 
+/* Copies made for dynamic offsets are appended to owned_sets, which is either
+ * the per-submit state or the compiled stream of a reusable command buffer.
+ */
 static void
-apply_dynamic_offsets(struct lvp_descriptor_set **out_set, const uint32_t *offsets, uint32_t offset_count,
-                      struct rendering_state *state)
+apply_dynamic_offsets(struct lvp_device *device, struct util_dynarray *owned_sets,
+                      struct lvp_descriptor_set **out_set, const uint32_t *offsets, uint32_t offset_count)
 {
    if (!offset_count)
       return;
 
    struct lvp_descriptor_set *in_set = *out_set;
 
+   /* Zero offsets leave the set as is, so it can be bound directly instead
+    * of being copied.
+    */
+   uint32_t count = MIN2(offset_count, in_set->layout->dynamic_offset_count);
+   bool has_offset = false;
+   for (uint32_t i = 0; i < count; i++)
+      has_offset |= offsets[i] != 0;
+   if (!has_offset)
+      return;
+
    struct lvp_descriptor_set *set;
-   lvp_descriptor_set_create(state->device, in_set->layout, &set);
+   lvp_descriptor_set_create(device, in_set->layout, &set);
 
-   util_dynarray_append(&state->push_desc_sets, struct lvp_descriptor_set *, set);
+   util_dynarray_append(owned_sets, struct lvp_descriptor_set *, set);
 
    memcpy(set->map, in_set->map, in_set->bo->width0);
 
@@ -1150,14 +1234,14 @@ handle_descriptor_sets(VkBindDescriptorSetsInfoKHR *bds, struct rendering_state
             /* always unset descriptor buffers when binding sets */
             if (pipeline_type == LVP_PIPELINE_COMPUTE) {
                   bool changed = state->const_buffer[MESA_SHADER_COMPUTE][bds->firstSet + i].buffer == state->desc_buffers[bds->firstSet + i];
-                  state->constbuf_dirty[MESA_SHADER_COMPUTE] |= changed;
+                  state->constbuf_dirty[MESA_SHADER_COMPUTE] |= (uint32_t)changed << (bds->firstSet + i);
             } else if (pipeline_type == LVP_PIPELINE_RAY_TRACING) {
                   bool changed = state->const_buffer[MESA_SHADER_RAYGEN][bds->firstSet + i].buffer == state->desc_buffers[bds->firstSet + i];
-                  state->constbuf_dirty[MESA_SHADER_RAYGEN] |= changed;
+                  state->constbuf_dirty[MESA_SHADER_RAYGEN] |= (uint32_t)changed << (bds->firstSet + i);
             } else {
                lvp_forall_gfx_stage(j) {
                   bool changed = state->const_buffer[j][bds->firstSet + i].buffer == state->desc_buffers[bds->firstSet + i];
-                  state->constbuf_dirty[j] |= changed;
+                  state->constbuf_dirty[j] |= (uint32_t)changed << (bds->firstSet + i);
                }
             }
          }
@@ -1168,8 +1252,11 @@ handle_descriptor_sets(VkBindDescriptorSetsInfoKHR *bds, struct rendering_state
          if (!set)
             continue;
 
-         apply_dynamic_offsets(&set, bds->pDynamicOffsets + dynamic_offset_index,
-                              bds->dynamicOffsetCount - dynamic_offset_index, state);
+         if (dynamic_offset_index < bds->dynamicOffsetCount) {
+            apply_dynamic_offsets(state->device, &state->push_desc_sets, &set,
+                                  bds->pDynamicOffsets + dynamic_offset_index,
+                                  bds->dynamicOffsetCount - dynamic_offset_index);
+         }
 
          dynamic_offset_index += set->layout->dynamic_offset_count;
 
@@ -1870,12 +1957,20 @@ static void handle_draw(struct vk_cmd_queue_entry *cmd,
    state->pctx->draw_vbo(state->pctx, &state->info, 0, NULL, &draw, 1);
 }
 
-static void handle_draw_multi(struct vk_cmd_queue_entry *cmd,
-                              struct rendering_state *state)
+static void
+fill_draw_multi(struct vk_cmd_queue_entry *cmd, struct pipe_draw_start_count_bias *draws)
 {
-   struct pipe_draw_start_count_bias *draws = calloc(cmd->u.draw_multi_ext.draw_count,
-                                                     sizeof(*draws));
+   for (unsigned i = 0; i < cmd->u.draw_multi_ext.draw_count; i++) {
+      draws[i].start = cmd->u.draw_multi_ext.vertex_info[i].firstVertex;
+      draws[i].count = cmd->u.draw_multi_ext.vertex_info[i].vertexCount;
+      draws[i].index_bias = 0;
+   }
+}
 
+static void
+draw_multi(struct vk_cmd_queue_entry *cmd, const struct pipe_draw_start_count_bias *draws,
+           struct rendering_state *state)
+{
    state->info.index_size = 0;
    state->info.index.resource = NULL;
    state->info.start_instance = cmd->u.draw_multi_ext.first_instance;
@@ -1883,14 +1978,18 @@ static void handle_draw_multi(struct vk_cmd_queue_entry *cmd,
    if (cmd->u.draw_multi_ext.draw_count > 1)
       state->info.increment_draw_id = true;
 
-   for (unsigned i = 0; i < cmd->u.draw_multi_ext.draw_count; i++) {
-      draws[i].start = cmd->u.draw_multi_ext.vertex_info[i].firstVertex;
-      draws[i].count = cmd->u.draw_multi_ext.vertex_info[i].vertexCount;
-      draws[i].index_bias = 0;
-   }
-
    if (cmd->u.draw_multi_indexed_ext.draw_count)
       state->pctx->draw_vbo(state->pctx, &state->info, 0, NULL, draws, cmd->u.draw_multi_ext.draw_count);
+}
+
+static void handle_draw_multi(struct vk_cmd_queue_entry *cmd,
+                              struct rendering_state *state)
+{
+   struct pipe_draw_start_count_bias *draws = calloc(cmd->u.draw_multi_ext.draw_count,
+                                                     sizeof(*draws));
+
+   fill_draw_multi(cmd, draws);
+   draw_multi(cmd, draws, state);
 
    free(draws);
 }
@@ -2772,13 +2871,18 @@ static void handle_push_constants(struct vk_cmd_queue_entry *cmd,
 
 static void lvp_execute_cmd_buffer(struct list_head *cmds,
                                    struct rendering_state *state, bool print_cmds);
+static void lvp_execute_cmd_stream(const struct lvp_cmd_stream *stream,
+                                   struct rendering_state *state, bool print_cmds);
 
 static void handle_execute_commands(struct vk_cmd_queue_entry *cmd,
                                     struct rendering_state *state, bool print_cmds)
 {
    for (unsigned i = 0; i < cmd->u.execute_commands.command_buffer_count; i++) {
       LVP_FROM_HANDLE(lvp_cmd_buffer, secondary_buf, cmd->u.execute_commands.command_buffers[i]);
-      lvp_execute_cmd_buffer(&secondary_buf->vk.cmd_queue.cmds, state, print_cmds);
+      if (secondary_buf->stream)
+         lvp_execute_cmd_stream(secondary_buf->stream, state, print_cmds);
+      else
+         lvp_execute_cmd_buffer(&secondary_buf->vk.cmd_queue.cmds, state, print_cmds);
    }
 }
 
@@ -2822,10 +2926,47 @@ static void handle_wait_events2(struct vk_cmd_queue_entry *cmd,
    }
 }
 
-static void handle_pipeline_barrier(struct vk_cmd_queue_entry *cmd,
+/* Stages which only run inside llvmpipe's rasterizer.  Scenes are rasterized
+ * in submission order, so nothing consumed in these stages can observe the
+ * results of an earlier scene before it has completed.
+ */
+#define LVP_RASTERIZER_STAGES (VK_PIPELINE_STAGE_2_TOP_OF_PIPE_BIT | \
+                               VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | \
+                               VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT | \
+                               VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT)
+
+static bool
+barrier_needs_stall(const VkDependencyInfo *dep)
+{
+   VkPipelineStageFlags2 dst_stage_mask = 0;
+
+   for (uint32_t i = 0; i < dep->memoryBarrierCount; i++)
+      dst_stage_mask |= dep->pMemoryBarriers[i].dstStageMask;
+   for (uint32_t i = 0; i < dep->bufferMemoryBarrierCount; i++)
+      dst_stage_mask |= dep->pBufferMemoryBarriers[i].dstStageMask;
+   for (uint32_t i = 0; i < dep->imageMemoryBarrierCount; i++)
+      dst_stage_mask |= dep->pImageMemoryBarriers[i].dstStageMask;
+
+   /* Shader reads go through descriptors llvmpipe doesn't track, and vertex,
+    * index and indirect data is read on the CPU while recording the scene,
+    * so those still need everything in flight to land first.
+    */
+   return dst_stage_mask & ~LVP_RASTERIZER_STAGES;
+}
+
+static bool handle_pipeline_barrier(struct vk_cmd_queue_entry *cmd,
                                     struct rendering_state *state)
 {
+   /* Barriers between passes which only hand attachments over to the
+    * attachment stages of later passes (layout transitions of independent
+    * render targets being the common case) leave the earlier scenes in
+    * flight, so the next pass is set up and binned while they rasterize.
+    */
+   if (!barrier_needs_stall(cmd->u.pipeline_barrier2.dependency_info))
+      return false;
+
    finish_fence(state);
+   return true;
 }
 
 static void handle_begin_query(struct vk_cmd_queue_entry *cmd,
@@ -4261,7 +4402,7 @@ bind_db_samplers(struct rendering_state *state, enum lvp_pipeline_type pipeline_
       }
    }
    u_foreach_bit(stage, did_update)
-      state->constbuf_dirty[stage] = true;
+      state->constbuf_dirty[stage] |= BITFIELD_BIT(set);
 }
 
 static void
@@ -4456,17 +4597,7 @@ handle_copy_memory_to_acceleration_structure(struct vk_cmd_queue_entry *cmd, str
 
    VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, copy->info->dst);
 
-   struct lvp_bvh_header *dst = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
-   const struct lvp_accel_struct_serialization_header *src = copy->info->src.hostAddress;
-
-   memcpy(dst, &src->instances[src->instance_count], src->compacted_size);
-
-   for (uint32_t i = 0; i < src->instance_count; i++) {
-      uint8_t *leaf_nodes = (uint8_t *)dst;
-      leaf_nodes += dst->leaf_nodes_offset;
-      struct lvp_bvh_instance_node *node = (struct lvp_bvh_instance_node *)leaf_nodes;
-      node[i].bvh_ptr = src->instances[i];
-   }
+   lvp_copy_memory_to_accel_struct(copy->info->src.hostAddress, accel_struct);
 }
 
 static void
@@ -4476,23 +4607,7 @@ handle_copy_acceleration_structure_to_memory(struct vk_cmd_queue_entry *cmd, str
 
    VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, copy->info->src);
 
-   struct lvp_bvh_header *src = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
-   struct lvp_accel_struct_serialization_header *dst = copy->info->dst.hostAddress;
-
-   lvp_device_get_cache_uuid(dst->driver_uuid);
-   lvp_device_get_cache_uuid(dst->accel_struct_compat);
-   dst->serialization_size = src->serialization_size;
-   dst->compacted_size = accel_struct->size;
-   dst->instance_count = src->instance_count;
-
-   for (uint32_t i = 0; i < src->instance_count; i++) {
-      uint8_t *leaf_nodes = (uint8_t *)src;
-      leaf_nodes += src->leaf_nodes_offset;
-      struct lvp_bvh_instance_node *node = (struct lvp_bvh_instance_node *)leaf_nodes;
-      dst->instances[i] = node[i].bvh_ptr;
-   }
-
-   memcpy(&dst->instances[dst->instance_count], src, accel_struct->size);
+   lvp_copy_accel_struct_to_memory(accel_struct, copy->info->dst.hostAddress);
 }
 
 static void
@@ -4508,26 +4623,7 @@ handle_write_acceleration_structures_properties(struct vk_cmd_queue_entry *cmd,
    for (uint32_t i = 0; i < write->acceleration_structure_count; i++) {
       VK_FROM_HANDLE(vk_acceleration_structure, accel_struct, write->acceleration_structures[i]);
 
-      switch ((uint32_t)pool->base_type) {
-      case LVP_QUERY_ACCELERATION_STRUCTURE_COMPACTED_SIZE:
-         dst[i] = accel_struct->size;
-         break;
-      case LVP_QUERY_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE: {
-         struct lvp_bvh_header *header = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
-         dst[i] = header->serialization_size;
-         break;
-      }
-      case LVP_QUERY_ACCELERATION_STRUCTURE_SIZE:
-         dst[i] = accel_struct->size;
-         break;
-      case LVP_QUERY_ACCELERATION_STRUCTURE_INSTANCE_COUNT: {
-         struct lvp_bvh_header *header = (void *)(uintptr_t)vk_acceleration_structure_get_va(accel_struct);
-         dst[i] = header->instance_count;
-         break;
-      }
-      default:
-         unreachable("Unsupported query type");
-      }
+      dst[i] = lvp_get_accel_struct_property(accel_struct, pool->type);
    }
 }
 
@@ -4537,17 +4633,17 @@ static void emit_ray_tracing_state(struct rendering_state *state)
    if (pcbuf_dirty)
       update_pcbuf(state, MESA_SHADER_COMPUTE, MESA_SHADER_RAYGEN);
 
-   if (state->constbuf_dirty[MESA_SHADER_RAYGEN]) {
-      for (unsigned i = 0; i < state->num_const_bufs[MESA_SHADER_RAYGEN]; i++)
-         state->pctx->set_constant_buffer(state->pctx, MESA_SHADER_COMPUTE,
-                                          i + 1, false, &state->const_buffer[MESA_SHADER_RAYGEN][i]);
-      state->constbuf_dirty[MESA_SHADER_RAYGEN] = false;
+   u_foreach_bit(i, state->constbuf_dirty[MESA_SHADER_RAYGEN] &
+                    BITFIELD_MASK(state->num_const_bufs[MESA_SHADER_RAYGEN])) {
+      state->pctx->set_constant_buffer(state->pctx, MESA_SHADER_COMPUTE,
+                                       i + 1, false, &state->const_buffer[MESA_SHADER_RAYGEN][i]);
    }
+   state->constbuf_dirty[MESA_SHADER_RAYGEN] = 0;
 
    state->pctx->bind_compute_state(state->pctx, state->shaders[MESA_SHADER_RAYGEN]->shader_cso);
 
    state->pcbuf_dirty[MESA_SHADER_COMPUTE] = true;
-   state->constbuf_dirty[MESA_SHADER_COMPUTE] = true;
+   state->constbuf_dirty[MESA_SHADER_COMPUTE] = UINT32_MAX;
    state->compute_shader_dirty = true;
 }
 
@@ -4660,81 +4756,14 @@ handle_trace_rays_indirect2(struct vk_cmd_queue_entry *cmd, struct rendering_sta
 }
 
 static void
-handle_write_buffer_cp(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
-{
-   struct lvp_cmd_write_buffer_cp *write = cmd->driver_data;
-
-   finish_fence(state);
-
-   memcpy((void *)(uintptr_t)write->addr, write->data, write->size);
-}
-
-static void
-handle_dispatch_unaligned(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
-{
-   assert(cmd->u.dispatch.group_count_y == 1);
-   assert(cmd->u.dispatch.group_count_z == 1);
-
-   uint32_t last_block_size = state->dispatch_info.block[0];
-
-   state->dispatch_info.grid[0] = cmd->u.dispatch.group_count_x / last_block_size;
-   state->dispatch_info.grid[1] = 1;
-   state->dispatch_info.grid[2] = 1;
-   state->dispatch_info.grid_base[0] = 0;
-   state->dispatch_info.grid_base[1] = 0;
-   state->dispatch_info.grid_base[2] = 0;
-   state->dispatch_info.indirect = NULL;
-   state->pctx->launch_grid(state->pctx, &state->dispatch_info);
-
-   if (cmd->u.dispatch.group_count_x % last_block_size) {
-      state->dispatch_info.block[0] = cmd->u.dispatch.group_count_x % last_block_size;
-      state->dispatch_info.grid[0] = 1;
-      state->dispatch_info.grid_base[0] = cmd->u.dispatch.group_count_x / last_block_size;
-      state->pctx->launch_grid(state->pctx, &state->dispatch_info);
-      state->dispatch_info.block[0] = last_block_size;
-   }
-}
-
-static void
-handle_fill_buffer_addr(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
-{
-   struct lvp_cmd_fill_buffer_addr *fill = cmd->driver_data;
-
-   finish_fence(state);
-
-   uint32_t *dst = (void *)(uintptr_t)fill->addr;
-   for (uint32_t i = 0; i < fill->size / 4; i++) {
-      dst[i] = fill->data;
-   }
-}
-
-static void
-handle_encode_as(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+handle_build_acceleration_structure(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
 {
-   struct lvp_cmd_encode_as *encode = cmd->driver_data;
+   struct lvp_cmd_build_as *build = cmd->driver_data;
 
+   /* The inputs are read on the CPU. */
    finish_fence(state);
 
-   lvp_encode_as(encode->dst, encode->intermediate_as_addr,
-                 encode->intermediate_header_addr, encode->leaf_count,
-                 encode->geometry_type);
-}
-
-static void
-handle_save_state(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
-{
-   state->saved.compute_shader = state->shaders[MESA_SHADER_COMPUTE];
-   memcpy(state->saved.push_constants, state->push_constants, sizeof(state->push_constants));
-}
-
-static void
-handle_restore_state(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
-{
-   if (state->saved.compute_shader)
-      handle_compute_shader(state, state->saved.compute_shader);
-
-   memcpy(state->push_constants, state->saved.push_constants, sizeof(state->push_constants));
-   state->pcbuf_dirty[MESA_SHADER_COMPUTE] = true;
+   lvp_build_accel_struct(state->device, &build->info, build->ranges, false);
 }
 
 void lvp_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp)
@@ -4896,6 +4925,393 @@ void lvp_add_enqueue_cmd_entrypoints(struct vk_device_dispatch_table *disp)
 #undef ENQUEUE_CMD
 }
 
+static void
+execute_internal_cmd(struct vk_cmd_queue_entry *cmd, struct rendering_state *state)
+{
+   uint32_t type = cmd->type;
+   if (type == LVP_CMD_BUILD_AS)
+      handle_build_acceleration_structure(cmd, state);
+}
+
+static void
+execute_cmd(struct vk_cmd_queue_entry *cmd, struct rendering_state *state, bool print_cmds)
+{
+   switch ((unsigned)cmd->type) {
+   case VK_CMD_BIND_PIPELINE:
+      handle_pipeline(cmd, state);
+      break;
+   case VK_CMD_SET_VIEWPORT:
+      handle_set_viewport(cmd, state);
+      break;
+   case VK_CMD_SET_VIEWPORT_WITH_COUNT:
+      handle_set_viewport_with_count(cmd, state);
+      break;
+   case VK_CMD_SET_SCISSOR:
+      handle_set_scissor(cmd, state);
+      break;
+   case VK_CMD_SET_SCISSOR_WITH_COUNT:
+      handle_set_scissor_with_count(cmd, state);
+      break;
+   case VK_CMD_SET_LINE_WIDTH:
+      handle_set_line_width(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_BIAS:
+      handle_set_depth_bias(cmd, state);
+      break;
+   case VK_CMD_SET_BLEND_CONSTANTS:
+      handle_set_blend_constants(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_BOUNDS:
+      handle_set_depth_bounds(cmd, state);
+      break;
+   case VK_CMD_SET_STENCIL_COMPARE_MASK:
+      handle_set_stencil_compare_mask(cmd, state);
+      break;
+   case VK_CMD_SET_STENCIL_WRITE_MASK:
+      handle_set_stencil_write_mask(cmd, state);
+      break;
+   case VK_CMD_SET_STENCIL_REFERENCE:
+      handle_set_stencil_reference(cmd, state);
+      break;
+   case VK_CMD_BIND_DESCRIPTOR_SETS2:
+      handle_descriptor_sets_cmd(cmd, state);
+      break;
+   case VK_CMD_BIND_INDEX_BUFFER:
+      handle_index_buffer(cmd, state);
+      break;
+   case VK_CMD_BIND_INDEX_BUFFER2:
+      handle_index_buffer2(cmd, state);
+      break;
+   case VK_CMD_BIND_VERTEX_BUFFERS2:
+      handle_vertex_buffers2(cmd, state);
+      break;
+   case VK_CMD_DRAW:
+      emit_state(state);
+      handle_draw(cmd, state);
+      break;
+   case VK_CMD_DRAW_MULTI_EXT:
+      emit_state(state);
+      handle_draw_multi(cmd, state);
+      break;
+   case VK_CMD_DRAW_INDEXED:
+      emit_state(state);
+      handle_draw_indexed(cmd, state);
+      break;
+   case VK_CMD_DRAW_INDIRECT:
+      emit_state(state);
+      handle_draw_indirect(cmd, state, false);
+      break;
+   case VK_CMD_DRAW_INDEXED_INDIRECT:
+      emit_state(state);
+      handle_draw_indirect(cmd, state, true);
+      break;
+   case VK_CMD_DRAW_MULTI_INDEXED_EXT:
+      emit_state(state);
+      handle_draw_multi_indexed(cmd, state);
+      break;
+   case VK_CMD_DISPATCH:
+      emit_compute_state(state);
+      handle_dispatch(cmd, state);
+      break;
+   case VK_CMD_DISPATCH_BASE:
+      emit_compute_state(state);
+      handle_dispatch_base(cmd, state);
+      break;
+   case VK_CMD_DISPATCH_INDIRECT:
+      emit_compute_state(state);
+      handle_dispatch_indirect(cmd, state);
+      break;
+   case VK_CMD_COPY_BUFFER2:
+      handle_copy_buffer(cmd, state);
+      break;
+   case VK_CMD_COPY_IMAGE2:
+      handle_copy_image(cmd, state);
+      break;
+   case VK_CMD_BLIT_IMAGE2:
+      handle_blit_image(cmd, state);
+      break;
+   case VK_CMD_COPY_BUFFER_TO_IMAGE2:
+      handle_copy_buffer_to_image(cmd, state);
+      break;
+   case VK_CMD_COPY_IMAGE_TO_BUFFER2:
+      handle_copy_image_to_buffer2(cmd, state);
+      break;
+   case VK_CMD_UPDATE_BUFFER:
+      handle_update_buffer(cmd, state);
+      break;
+   case VK_CMD_FILL_BUFFER:
+      handle_fill_buffer(cmd, state);
+      break;
+   case VK_CMD_CLEAR_COLOR_IMAGE:
+      handle_clear_color_image(cmd, state);
+      break;
+   case VK_CMD_CLEAR_DEPTH_STENCIL_IMAGE:
+      handle_clear_ds_image(cmd, state);
+      break;
+   case VK_CMD_CLEAR_ATTACHMENTS:
+      handle_clear_attachments(cmd, state);
+      break;
+   case VK_CMD_RESOLVE_IMAGE2:
+      handle_resolve_image(cmd, state);
+      break;
+   case VK_CMD_BEGIN_QUERY_INDEXED_EXT:
+      handle_begin_query_indexed_ext(cmd, state);
+      break;
+   case VK_CMD_END_QUERY_INDEXED_EXT:
+      handle_end_query_indexed_ext(cmd, state);
+      break;
+   case VK_CMD_BEGIN_QUERY:
+      handle_begin_query(cmd, state);
+      break;
+   case VK_CMD_END_QUERY:
+      handle_end_query(cmd, state);
+      break;
+   case VK_CMD_RESET_QUERY_POOL:
+      handle_reset_query_pool(cmd, state);
+      break;
+   case VK_CMD_COPY_QUERY_POOL_RESULTS:
+      handle_copy_query_pool_results(cmd, state);
+      break;
+   case VK_CMD_PUSH_CONSTANTS2:
+      handle_push_constants(cmd, state);
+      break;
+   case VK_CMD_EXECUTE_COMMANDS:
+      handle_execute_commands(cmd, state, print_cmds);
+      break;
+   case VK_CMD_DRAW_INDIRECT_COUNT:
+      emit_state(state);
+      handle_draw_indirect_count(cmd, state, false);
+      break;
+   case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
+      emit_state(state);
+      handle_draw_indirect_count(cmd, state, true);
+      break;
+   case VK_CMD_PUSH_DESCRIPTOR_SET2:
+      handle_push_descriptor_set(cmd, state);
+      break;
+   case VK_CMD_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE2:
+      handle_push_descriptor_set_with_template(cmd, state);
+      break;
+   case VK_CMD_BIND_TRANSFORM_FEEDBACK_BUFFERS_EXT:
+      handle_bind_transform_feedback_buffers(cmd, state);
+      break;
+   case VK_CMD_BEGIN_TRANSFORM_FEEDBACK_EXT:
+      handle_begin_transform_feedback(cmd, state);
+      break;
+   case VK_CMD_END_TRANSFORM_FEEDBACK_EXT:
+      handle_end_transform_feedback(cmd, state);
+      break;
+   case VK_CMD_DRAW_INDIRECT_BYTE_COUNT_EXT:
+      emit_state(state);
+      handle_draw_indirect_byte_count(cmd, state);
+      break;
+   case VK_CMD_BEGIN_CONDITIONAL_RENDERING_EXT:
+      handle_begin_conditional_rendering(cmd, state);
+      break;
+   case VK_CMD_END_CONDITIONAL_RENDERING_EXT:
+      handle_end_conditional_rendering(state);
+      break;
+   case VK_CMD_SET_VERTEX_INPUT_EXT:
+      handle_set_vertex_input(cmd, state);
+      break;
+   case VK_CMD_SET_CULL_MODE:
+      handle_set_cull_mode(cmd, state);
+      break;
+   case VK_CMD_SET_FRONT_FACE:
+      handle_set_front_face(cmd, state);
+      break;
+   case VK_CMD_SET_PRIMITIVE_TOPOLOGY:
+      handle_set_primitive_topology(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_TEST_ENABLE:
+      handle_set_depth_test_enable(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_WRITE_ENABLE:
+      handle_set_depth_write_enable(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_COMPARE_OP:
+      handle_set_depth_compare_op(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE:
+      handle_set_depth_bounds_test_enable(cmd, state);
+      break;
+   case VK_CMD_SET_STENCIL_TEST_ENABLE:
+      handle_set_stencil_test_enable(cmd, state);
+      break;
+   case VK_CMD_SET_STENCIL_OP:
+      handle_set_stencil_op(cmd, state);
+      break;
+   case VK_CMD_SET_LINE_STIPPLE:
+      handle_set_line_stipple(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_BIAS_ENABLE:
+      handle_set_depth_bias_enable(cmd, state);
+      break;
+   case VK_CMD_SET_LOGIC_OP_EXT:
+      handle_set_logic_op(cmd, state);
+      break;
+   case VK_CMD_SET_PATCH_CONTROL_POINTS_EXT:
+      handle_set_patch_control_points(cmd, state);
+      break;
+   case VK_CMD_SET_PRIMITIVE_RESTART_ENABLE:
+      handle_set_primitive_restart_enable(cmd, state);
+      break;
+   case VK_CMD_SET_RASTERIZER_DISCARD_ENABLE:
+      handle_set_rasterizer_discard_enable(cmd, state);
+      break;
+   case VK_CMD_SET_COLOR_WRITE_ENABLE_EXT:
+      handle_set_color_write_enable(cmd, state);
+      break;
+   case VK_CMD_BEGIN_RENDERING:
+      handle_begin_rendering(cmd, state);
+      break;
+   case VK_CMD_END_RENDERING:
+      handle_end_rendering(cmd, state);
+      break;
+   case VK_CMD_SET_DEVICE_MASK:
+      /* no-op */
+      break;
+   case VK_CMD_RESET_EVENT2:
+      handle_event_reset2(cmd, state);
+      break;
+   case VK_CMD_SET_EVENT2:
+      handle_event_set2(cmd, state);
+      break;
+   case VK_CMD_WAIT_EVENTS2:
+      handle_wait_events2(cmd, state);
+      break;
+   case VK_CMD_WRITE_TIMESTAMP2:
+      handle_write_timestamp2(cmd, state);
+      break;
+   case VK_CMD_SET_POLYGON_MODE_EXT:
+      handle_set_polygon_mode(cmd, state);
+      break;
+   case VK_CMD_SET_TESSELLATION_DOMAIN_ORIGIN_EXT:
+      handle_set_tessellation_domain_origin(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_CLAMP_ENABLE_EXT:
+      handle_set_depth_clamp_enable(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_CLIP_ENABLE_EXT:
+      handle_set_depth_clip_enable(cmd, state);
+      break;
+   case VK_CMD_SET_LOGIC_OP_ENABLE_EXT:
+      handle_set_logic_op_enable(cmd, state);
+      break;
+   case VK_CMD_SET_SAMPLE_MASK_EXT:
+      handle_set_sample_mask(cmd, state);
+      break;
+   case VK_CMD_SET_RASTERIZATION_SAMPLES_EXT:
+      handle_set_samples(cmd, state);
+      break;
+   case VK_CMD_SET_ALPHA_TO_COVERAGE_ENABLE_EXT:
+      handle_set_alpha_to_coverage(cmd, state);
+      break;
+   case VK_CMD_SET_ALPHA_TO_ONE_ENABLE_EXT:
+      handle_set_alpha_to_one(cmd, state);
+      break;
+   case VK_CMD_SET_DEPTH_CLIP_NEGATIVE_ONE_TO_ONE_EXT:
+      handle_set_halfz(cmd, state);
+      break;
+   case VK_CMD_SET_LINE_RASTERIZATION_MODE_EXT:
+      handle_set_line_rasterization_mode(cmd, state);
+      break;
+   case VK_CMD_SET_LINE_STIPPLE_ENABLE_EXT:
+      handle_set_line_stipple_enable(cmd, state);
+      break;
+   case VK_CMD_SET_PROVOKING_VERTEX_MODE_EXT:
+      handle_set_provoking_vertex_mode(cmd, state);
+      break;
+   case VK_CMD_SET_COLOR_BLEND_ENABLE_EXT:
+      handle_set_color_blend_enable(cmd, state);
+      break;
+   case VK_CMD_SET_COLOR_WRITE_MASK_EXT:
+      handle_set_color_write_mask(cmd, state);
+      break;
+   case VK_CMD_SET_COLOR_BLEND_EQUATION_EXT:
+      handle_set_color_blend_equation(cmd, state);
+      break;
+   case VK_CMD_BIND_SHADERS_EXT:
+      handle_shaders(cmd, state);
+      break;
+   case VK_CMD_SET_ATTACHMENT_FEEDBACK_LOOP_ENABLE_EXT:
+      break;
+   case VK_CMD_DRAW_MESH_TASKS_EXT:
+      emit_state(state);
+      handle_draw_mesh_tasks(cmd, state);
+      break;
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_EXT:
+      emit_state(state);
+      handle_draw_mesh_tasks_indirect(cmd, state);
+      break;
+   case VK_CMD_DRAW_MESH_TASKS_INDIRECT_COUNT_EXT:
+      emit_state(state);
+      handle_draw_mesh_tasks_indirect_count(cmd, state);
+      break;
+   case VK_CMD_PREPROCESS_GENERATED_COMMANDS_EXT:
+      handle_preprocess_generated_commands_ext(cmd, state, print_cmds);
+      break;
+   case VK_CMD_EXECUTE_GENERATED_COMMANDS_EXT:
+      handle_execute_generated_commands_ext(cmd, state, print_cmds);
+      break;
+   case VK_CMD_BIND_DESCRIPTOR_BUFFERS_EXT:
+      handle_descriptor_buffers(cmd, state);
+      break;
+   case VK_CMD_SET_DESCRIPTOR_BUFFER_OFFSETS2_EXT:
+      handle_descriptor_buffer_offsets(cmd, state);
+      break;
+   case VK_CMD_BIND_DESCRIPTOR_BUFFER_EMBEDDED_SAMPLERS2_EXT:
+      handle_descriptor_buffer_embedded_samplers(cmd, state);
+      break;
+#ifdef VK_ENABLE_BETA_EXTENSIONS
+   case VK_CMD_INITIALIZE_GRAPH_SCRATCH_MEMORY_AMDX:
+      break;
+   case VK_CMD_DISPATCH_GRAPH_INDIRECT_COUNT_AMDX:
+      break;
+   case VK_CMD_DISPATCH_GRAPH_INDIRECT_AMDX:
+      break;
+   case VK_CMD_DISPATCH_GRAPH_AMDX:
+      handle_dispatch_graph(cmd, state);
+      break;
+#endif
+   case VK_CMD_SET_RENDERING_ATTACHMENT_LOCATIONS:
+      handle_rendering_attachment_locations(cmd, state);
+      break;
+   case VK_CMD_SET_RENDERING_INPUT_ATTACHMENT_INDICES:
+      handle_rendering_input_attachment_indices(cmd, state);
+      break;
+   case VK_CMD_COPY_ACCELERATION_STRUCTURE_KHR:
+      handle_copy_acceleration_structure(cmd, state);
+      break;
+   case VK_CMD_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_KHR:
+      handle_copy_memory_to_acceleration_structure(cmd, state);
+      break;
+   case VK_CMD_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_KHR:
+      handle_copy_acceleration_structure_to_memory(cmd, state);
+      break;
+   case VK_CMD_BUILD_ACCELERATION_STRUCTURES_INDIRECT_KHR:
+      break;
+   case VK_CMD_WRITE_ACCELERATION_STRUCTURES_PROPERTIES_KHR:
+      handle_write_acceleration_structures_properties(cmd, state);
+      break;
+   case VK_CMD_SET_RAY_TRACING_PIPELINE_STACK_SIZE_KHR:
+      break;
+   case VK_CMD_TRACE_RAYS_INDIRECT2_KHR:
+      handle_trace_rays_indirect2(cmd, state);
+      break;
+   case VK_CMD_TRACE_RAYS_INDIRECT_KHR:
+      handle_trace_rays_indirect(cmd, state);
+      break;
+   case VK_CMD_TRACE_RAYS_KHR:
+      handle_trace_rays(cmd, state);
+      break;
+   default:
+      fprintf(stderr, "Unsupported command %s\n", vk_cmd_queue_type_names[cmd->type]);
+      unreachable("Unsupported command");
+      break;
+   }
+}
+
 static void lvp_execute_cmd_buffer(struct list_head *cmds,
                                    struct rendering_state *state, bool print_cmds)
 {
@@ -4904,410 +5320,216 @@ static void lvp_execute_cmd_buffer(struct list_head *cmds,
 
    LIST_FOR_EACH_ENTRY(cmd, cmds, cmd_link) {
       if (cmd->type >= VK_CMD_TYPE_COUNT) {
-         uint32_t type = cmd->type;
-         if (type == LVP_CMD_WRITE_BUFFER_CP) {
-            handle_write_buffer_cp(cmd, state);
-         } else if (type == LVP_CMD_DISPATCH_UNALIGNED) {
-            emit_compute_state(state);
-            handle_dispatch_unaligned(cmd, state);
-         } else if (type == LVP_CMD_FILL_BUFFER_ADDR) {
-            handle_fill_buffer_addr(cmd, state);
-         } else if (type == LVP_CMD_ENCODE_AS) {
-            handle_encode_as(cmd, state);
-         } else if (type == LVP_CMD_SAVE_STATE) {
-            handle_save_state(cmd, state);
-         } else if (type == LVP_CMD_RESTORE_STATE) {
-            handle_restore_state(cmd, state);
-         }
+         execute_internal_cmd(cmd, state);
          continue;
       }
 
       if (print_cmds)
          fprintf(stderr, "%s\n", vk_cmd_queue_type_names[cmd->type]);
-      switch ((unsigned)cmd->type) {
-      case VK_CMD_BIND_PIPELINE:
-         handle_pipeline(cmd, state);
-         break;
-      case VK_CMD_SET_VIEWPORT:
-         handle_set_viewport(cmd, state);
-         break;
-      case VK_CMD_SET_VIEWPORT_WITH_COUNT:
-         handle_set_viewport_with_count(cmd, state);
-         break;
-      case VK_CMD_SET_SCISSOR:
-         handle_set_scissor(cmd, state);
-         break;
-      case VK_CMD_SET_SCISSOR_WITH_COUNT:
-         handle_set_scissor_with_count(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_WIDTH:
-         handle_set_line_width(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BIAS:
-         handle_set_depth_bias(cmd, state);
-         break;
-      case VK_CMD_SET_BLEND_CONSTANTS:
-         handle_set_blend_constants(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BOUNDS:
-         handle_set_depth_bounds(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_COMPARE_MASK:
-         handle_set_stencil_compare_mask(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_WRITE_MASK:
-         handle_set_stencil_write_mask(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_REFERENCE:
-         handle_set_stencil_reference(cmd, state);
-         break;
-      case VK_CMD_BIND_DESCRIPTOR_SETS2:
-         handle_descriptor_sets_cmd(cmd, state);
-         break;
-      case VK_CMD_BIND_INDEX_BUFFER:
-         handle_index_buffer(cmd, state);
-         break;
-      case VK_CMD_BIND_INDEX_BUFFER2:
-         handle_index_buffer2(cmd, state);
-         break;
-      case VK_CMD_BIND_VERTEX_BUFFERS2:
-         handle_vertex_buffers2(cmd, state);
-         break;
-      case VK_CMD_DRAW:
-         emit_state(state);
-         handle_draw(cmd, state);
-         break;
-      case VK_CMD_DRAW_MULTI_EXT:
-         emit_state(state);
-         handle_draw_multi(cmd, state);
-         break;
-      case VK_CMD_DRAW_INDEXED:
-         emit_state(state);
-         handle_draw_indexed(cmd, state);
-         break;
-      case VK_CMD_DRAW_INDIRECT:
-         emit_state(state);
-         handle_draw_indirect(cmd, state, false);
-         break;
-      case VK_CMD_DRAW_INDEXED_INDIRECT:
-         emit_state(state);
-         handle_draw_indirect(cmd, state, true);
-         break;
-      case VK_CMD_DRAW_MULTI_INDEXED_EXT:
-         emit_state(state);
-         handle_draw_multi_indexed(cmd, state);
-         break;
-      case VK_CMD_DISPATCH:
-         emit_compute_state(state);
-         handle_dispatch(cmd, state);
-         break;
-      case VK_CMD_DISPATCH_BASE:
-         emit_compute_state(state);
-         handle_dispatch_base(cmd, state);
-         break;
-      case VK_CMD_DISPATCH_INDIRECT:
-         emit_compute_state(state);
-         handle_dispatch_indirect(cmd, state);
-         break;
-      case VK_CMD_COPY_BUFFER2:
-         handle_copy_buffer(cmd, state);
-         break;
-      case VK_CMD_COPY_IMAGE2:
-         handle_copy_image(cmd, state);
-         break;
-      case VK_CMD_BLIT_IMAGE2:
-         handle_blit_image(cmd, state);
-         break;
-      case VK_CMD_COPY_BUFFER_TO_IMAGE2:
-         handle_copy_buffer_to_image(cmd, state);
-         break;
-      case VK_CMD_COPY_IMAGE_TO_BUFFER2:
-         handle_copy_image_to_buffer2(cmd, state);
-         break;
-      case VK_CMD_UPDATE_BUFFER:
-         handle_update_buffer(cmd, state);
-         break;
-      case VK_CMD_FILL_BUFFER:
-         handle_fill_buffer(cmd, state);
-         break;
-      case VK_CMD_CLEAR_COLOR_IMAGE:
-         handle_clear_color_image(cmd, state);
-         break;
-      case VK_CMD_CLEAR_DEPTH_STENCIL_IMAGE:
-         handle_clear_ds_image(cmd, state);
-         break;
-      case VK_CMD_CLEAR_ATTACHMENTS:
-         handle_clear_attachments(cmd, state);
-         break;
-      case VK_CMD_RESOLVE_IMAGE2:
-         handle_resolve_image(cmd, state);
+      if (cmd->type == VK_CMD_PIPELINE_BARRIER2) {
+         /* flushes are actually stalls, so multiple flushes are redundant */
+         if (!did_flush)
+            did_flush = handle_pipeline_barrier(cmd, state);
+         continue;
+      }
+
+      execute_cmd(cmd, state, print_cmds);
+      did_flush = false;
+      if (!cmd->cmd_link.next)
          break;
+   }
+}
+
+enum lvp_cmd_op_type {
+   /* run the recorded command through execute_cmd()/execute_internal_cmd() */
+   LVP_CMD_OP_EXECUTE,
+   /* a pipeline barrier which needs everything in flight to land */
+   LVP_CMD_OP_STALL,
+   /* vkCmdBindDescriptorSets2 with the dynamic offsets already applied */
+   LVP_CMD_OP_BIND_DESCRIPTOR_SETS,
+   /* vkCmdDrawMultiEXT with the draws already converted */
+   LVP_CMD_OP_DRAW_MULTI,
+};
+
+struct lvp_cmd_op {
+   enum lvp_cmd_op_type type;
+   struct vk_cmd_queue_entry *cmd;
+   union {
+      VkBindDescriptorSetsInfoKHR *bind_sets;
+      struct pipe_draw_start_count_bias *draws;
+   };
+};
+
+/* The commands of a reusable command buffer, translated once at
+ * vkEndCommandBuffer.  Everything which only depends on the recorded
+ * commands is resolved here instead of on every submit: barriers are
+ * reduced to the stalls they cause, no-op commands are dropped and
+ * dynamic offsets and multi-draw arrays are applied ahead of time.
+ * Anything that depends on the state at execution time (push descriptors,
+ * indirect parameters, the bound pipeline) is still handled by the
+ * executor.
+ */
+struct lvp_cmd_stream {
+   struct util_dynarray ops;
+   /* descriptor set copies with dynamic offsets applied */
+   struct util_dynarray sets;
+};
+
+static struct lvp_cmd_op *
+stream_add_op(struct lvp_cmd_stream *stream, enum lvp_cmd_op_type type,
+              struct vk_cmd_queue_entry *cmd)
+{
+   struct lvp_cmd_op *op = util_dynarray_grow(&stream->ops, struct lvp_cmd_op, 1);
+   op->type = type;
+   op->cmd = cmd;
+   op->bind_sets = NULL;
+   return op;
+}
+
+static bool
+compile_descriptor_sets(struct lvp_device *device, struct lvp_cmd_stream *stream,
+                        struct vk_cmd_queue_entry *cmd)
+{
+   VkBindDescriptorSetsInfoKHR *bds = cmd->u.bind_descriptor_sets2.bind_descriptor_sets_info;
+   LVP_FROM_HANDLE(lvp_pipeline_layout, layout, bds->layout);
+
+   if (!bds->dynamicOffsetCount)
+      return false;
+
+   /* Sets from update-after-bind pools can still change after recording. */
+   for (uint32_t i = 0; i < bds->descriptorSetCount; i++) {
+      struct lvp_descriptor_set *set = lvp_descriptor_set_from_handle(bds->pDescriptorSets[i]);
+      if (set && (set->layout->vk.flags & VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT))
+         return false;
+   }
+
+   VkBindDescriptorSetsInfoKHR *resolved = ralloc(stream, VkBindDescriptorSetsInfoKHR);
+   VkDescriptorSet *sets = ralloc_array(stream, VkDescriptorSet, bds->descriptorSetCount);
+   *resolved = *bds;
+   resolved->pDescriptorSets = sets;
+   resolved->dynamicOffsetCount = 0;
+   resolved->pDynamicOffsets = NULL;
+
+   uint32_t dynamic_offset_index = 0;
+   for (uint32_t i = 0; i < bds->descriptorSetCount; i++) {
+      sets[i] = bds->pDescriptorSets[i];
+      if (!layout->vk.set_layouts[bds->firstSet + i])
+         continue;
+
+      struct lvp_descriptor_set *set = lvp_descriptor_set_from_handle(bds->pDescriptorSets[i]);
+      if (!set)
+         continue;
+
+      if (dynamic_offset_index < bds->dynamicOffsetCount) {
+         apply_dynamic_offsets(device, &stream->sets, &set,
+                               bds->pDynamicOffsets + dynamic_offset_index,
+                               bds->dynamicOffsetCount - dynamic_offset_index);
+      }
+      sets[i] = lvp_descriptor_set_to_handle(set);
+
+      dynamic_offset_index += set->layout->dynamic_offset_count;
+   }
+
+   stream_add_op(stream, LVP_CMD_OP_BIND_DESCRIPTOR_SETS, cmd)->bind_sets = resolved;
+   return true;
+}
+
+void
+lvp_cmd_buffer_compile(struct lvp_cmd_buffer *cmd_buffer)
+{
+   struct lvp_cmd_stream *stream = rzalloc(NULL, struct lvp_cmd_stream);
+   if (!stream)
+      return;
+
+   util_dynarray_init(&stream->ops, stream);
+   util_dynarray_init(&stream->sets, stream);
+
+   struct vk_cmd_queue_entry *cmd;
+   bool did_flush = false;
+
+   LIST_FOR_EACH_ENTRY(cmd, &cmd_buffer->vk.cmd_queue.cmds, cmd_link) {
+      if (cmd->type >= VK_CMD_TYPE_COUNT) {
+         stream_add_op(stream, LVP_CMD_OP_EXECUTE, cmd);
+         continue;
+      }
+
+      switch ((unsigned)cmd->type) {
       case VK_CMD_PIPELINE_BARRIER2:
-         /* flushes are actually stalls, so multiple flushes are redundant */
+         /* same as lvp_execute_cmd_buffer(), only decided once */
          if (did_flush)
             continue;
-         handle_pipeline_barrier(cmd, state);
-         did_flush = true;
+         did_flush = barrier_needs_stall(cmd->u.pipeline_barrier2.dependency_info);
+         if (did_flush)
+            stream_add_op(stream, LVP_CMD_OP_STALL, cmd);
          continue;
-      case VK_CMD_BEGIN_QUERY_INDEXED_EXT:
-         handle_begin_query_indexed_ext(cmd, state);
-         break;
-      case VK_CMD_END_QUERY_INDEXED_EXT:
-         handle_end_query_indexed_ext(cmd, state);
-         break;
-      case VK_CMD_BEGIN_QUERY:
-         handle_begin_query(cmd, state);
-         break;
-      case VK_CMD_END_QUERY:
-         handle_end_query(cmd, state);
-         break;
-      case VK_CMD_RESET_QUERY_POOL:
-         handle_reset_query_pool(cmd, state);
-         break;
-      case VK_CMD_COPY_QUERY_POOL_RESULTS:
-         handle_copy_query_pool_results(cmd, state);
-         break;
-      case VK_CMD_PUSH_CONSTANTS2:
-         handle_push_constants(cmd, state);
-         break;
-      case VK_CMD_EXECUTE_COMMANDS:
-         handle_execute_commands(cmd, state, print_cmds);
-         break;
-      case VK_CMD_DRAW_INDIRECT_COUNT:
-         emit_state(state);
-         handle_draw_indirect_count(cmd, state, false);
-         break;
-      case VK_CMD_DRAW_INDEXED_INDIRECT_COUNT:
-         emit_state(state);
-         handle_draw_indirect_count(cmd, state, true);
-         break;
-      case VK_CMD_PUSH_DESCRIPTOR_SET2:
-         handle_push_descriptor_set(cmd, state);
-         break;
-      case VK_CMD_PUSH_DESCRIPTOR_SET_WITH_TEMPLATE2:
-         handle_push_descriptor_set_with_template(cmd, state);
-         break;
-      case VK_CMD_BIND_TRANSFORM_FEEDBACK_BUFFERS_EXT:
-         handle_bind_transform_feedback_buffers(cmd, state);
-         break;
-      case VK_CMD_BEGIN_TRANSFORM_FEEDBACK_EXT:
-         handle_begin_transform_feedback(cmd, state);
-         break;
-      case VK_CMD_END_TRANSFORM_FEEDBACK_EXT:
-         handle_end_transform_feedback(cmd, state);
-         break;
-      case VK_CMD_DRAW_INDIRECT_BYTE_COUNT_EXT:
-         emit_state(state);
-         handle_draw_indirect_byte_count(cmd, state);
-         break;
-      case VK_CMD_BEGIN_CONDITIONAL_RENDERING_EXT:
-         handle_begin_conditional_rendering(cmd, state);
-         break;
-      case VK_CMD_END_CONDITIONAL_RENDERING_EXT:
-         handle_end_conditional_rendering(state);
-         break;
-      case VK_CMD_SET_VERTEX_INPUT_EXT:
-         handle_set_vertex_input(cmd, state);
-         break;
-      case VK_CMD_SET_CULL_MODE:
-         handle_set_cull_mode(cmd, state);
-         break;
-      case VK_CMD_SET_FRONT_FACE:
-         handle_set_front_face(cmd, state);
-         break;
-      case VK_CMD_SET_PRIMITIVE_TOPOLOGY:
-         handle_set_primitive_topology(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_TEST_ENABLE:
-         handle_set_depth_test_enable(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_WRITE_ENABLE:
-         handle_set_depth_write_enable(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_COMPARE_OP:
-         handle_set_depth_compare_op(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BOUNDS_TEST_ENABLE:
-         handle_set_depth_bounds_test_enable(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_TEST_ENABLE:
-         handle_set_stencil_test_enable(cmd, state);
-         break;
-      case VK_CMD_SET_STENCIL_OP:
-         handle_set_stencil_op(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_STIPPLE:
-         handle_set_line_stipple(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_BIAS_ENABLE:
-         handle_set_depth_bias_enable(cmd, state);
-         break;
-      case VK_CMD_SET_LOGIC_OP_EXT:
-         handle_set_logic_op(cmd, state);
-         break;
-      case VK_CMD_SET_PATCH_CONTROL_POINTS_EXT:
-         handle_set_patch_control_points(cmd, state);
-         break;
-      case VK_CMD_SET_PRIMITIVE_RESTART_ENABLE:
-         handle_set_primitive_restart_enable(cmd, state);
-         break;
-      case VK_CMD_SET_RASTERIZER_DISCARD_ENABLE:
-         handle_set_rasterizer_discard_enable(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_WRITE_ENABLE_EXT:
-         handle_set_color_write_enable(cmd, state);
-         break;
-      case VK_CMD_BEGIN_RENDERING:
-         handle_begin_rendering(cmd, state);
-         break;
-      case VK_CMD_END_RENDERING:
-         handle_end_rendering(cmd, state);
-         break;
       case VK_CMD_SET_DEVICE_MASK:
-         /* no-op */
-         break;
-      case VK_CMD_RESET_EVENT2:
-         handle_event_reset2(cmd, state);
-         break;
-      case VK_CMD_SET_EVENT2:
-         handle_event_set2(cmd, state);
-         break;
-      case VK_CMD_WAIT_EVENTS2:
-         handle_wait_events2(cmd, state);
-         break;
-      case VK_CMD_WRITE_TIMESTAMP2:
-         handle_write_timestamp2(cmd, state);
-         break;
-      case VK_CMD_SET_POLYGON_MODE_EXT:
-         handle_set_polygon_mode(cmd, state);
-         break;
-      case VK_CMD_SET_TESSELLATION_DOMAIN_ORIGIN_EXT:
-         handle_set_tessellation_domain_origin(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_CLAMP_ENABLE_EXT:
-         handle_set_depth_clamp_enable(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_CLIP_ENABLE_EXT:
-         handle_set_depth_clip_enable(cmd, state);
-         break;
-      case VK_CMD_SET_LOGIC_OP_ENABLE_EXT:
-         handle_set_logic_op_enable(cmd, state);
-         break;
-      case VK_CMD_SET_SAMPLE_MASK_EXT:
-         handle_set_sample_mask(cmd, state);
-         break;
-      case VK_CMD_SET_RASTERIZATION_SAMPLES_EXT:
-         handle_set_samples(cmd, state);
-         break;
-      case VK_CMD_SET_ALPHA_TO_COVERAGE_ENABLE_EXT:
-         handle_set_alpha_to_coverage(cmd, state);
-         break;
-      case VK_CMD_SET_ALPHA_TO_ONE_ENABLE_EXT:
-         handle_set_alpha_to_one(cmd, state);
-         break;
-      case VK_CMD_SET_DEPTH_CLIP_NEGATIVE_ONE_TO_ONE_EXT:
-         handle_set_halfz(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_RASTERIZATION_MODE_EXT:
-         handle_set_line_rasterization_mode(cmd, state);
-         break;
-      case VK_CMD_SET_LINE_STIPPLE_ENABLE_EXT:
-         handle_set_line_stipple_enable(cmd, state);
-         break;
-      case VK_CMD_SET_PROVOKING_VERTEX_MODE_EXT:
-         handle_set_provoking_vertex_mode(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_BLEND_ENABLE_EXT:
-         handle_set_color_blend_enable(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_WRITE_MASK_EXT:
-         handle_set_color_write_mask(cmd, state);
-         break;
-      case VK_CMD_SET_COLOR_BLEND_EQUATION_EXT:
-         handle_set_color_blend_equation(cmd, state);
-         break;
-      case VK_CMD_BIND_SHADERS_EXT:
-         handle_shaders(cmd, state);
-         break;
       case VK_CMD_SET_ATTACHMENT_FEEDBACK_LOOP_ENABLE_EXT:
-         break;
-      case VK_CMD_DRAW_MESH_TASKS_EXT:
-         emit_state(state);
-         handle_draw_mesh_tasks(cmd, state);
-         break;
-      case VK_CMD_DRAW_MESH_TASKS_INDIRECT_EXT:
-         emit_state(state);
-         handle_draw_mesh_tasks_indirect(cmd, state);
-         break;
-      case VK_CMD_DRAW_MESH_TASKS_INDIRECT_COUNT_EXT:
-         emit_state(state);
-         handle_draw_mesh_tasks_indirect_count(cmd, state);
-         break;
-      case VK_CMD_PREPROCESS_GENERATED_COMMANDS_EXT:
-         handle_preprocess_generated_commands_ext(cmd, state, print_cmds);
-         break;
-      case VK_CMD_EXECUTE_GENERATED_COMMANDS_EXT:
-         handle_execute_generated_commands_ext(cmd, state, print_cmds);
-         break;
-      case VK_CMD_BIND_DESCRIPTOR_BUFFERS_EXT:
-         handle_descriptor_buffers(cmd, state);
-         break;
-      case VK_CMD_SET_DESCRIPTOR_BUFFER_OFFSETS2_EXT:
-         handle_descriptor_buffer_offsets(cmd, state);
-         break;
-      case VK_CMD_BIND_DESCRIPTOR_BUFFER_EMBEDDED_SAMPLERS2_EXT:
-         handle_descriptor_buffer_embedded_samplers(cmd, state);
-         break;
-#ifdef VK_ENABLE_BETA_EXTENSIONS
-      case VK_CMD_INITIALIZE_GRAPH_SCRATCH_MEMORY_AMDX:
-         break;
-      case VK_CMD_DISPATCH_GRAPH_INDIRECT_COUNT_AMDX:
-         break;
-      case VK_CMD_DISPATCH_GRAPH_INDIRECT_AMDX:
-         break;
-      case VK_CMD_DISPATCH_GRAPH_AMDX:
-         handle_dispatch_graph(cmd, state);
-         break;
-#endif
-      case VK_CMD_SET_RENDERING_ATTACHMENT_LOCATIONS:
-         handle_rendering_attachment_locations(cmd, state);
-         break;
-      case VK_CMD_SET_RENDERING_INPUT_ATTACHMENT_INDICES:
-         handle_rendering_input_attachment_indices(cmd, state);
-         break;
-      case VK_CMD_COPY_ACCELERATION_STRUCTURE_KHR:
-         handle_copy_acceleration_structure(cmd, state);
-         break;
-      case VK_CMD_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_KHR:
-         handle_copy_memory_to_acceleration_structure(cmd, state);
-         break;
-      case VK_CMD_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_KHR:
-         handle_copy_acceleration_structure_to_memory(cmd, state);
-         break;
       case VK_CMD_BUILD_ACCELERATION_STRUCTURES_INDIRECT_KHR:
-         break;
-      case VK_CMD_WRITE_ACCELERATION_STRUCTURES_PROPERTIES_KHR:
-         handle_write_acceleration_structures_properties(cmd, state);
-         break;
       case VK_CMD_SET_RAY_TRACING_PIPELINE_STACK_SIZE_KHR:
+         /* nothing is submitted, so a stall before is still in effect */
+         continue;
+      case VK_CMD_BIND_DESCRIPTOR_SETS2:
+         if (!compile_descriptor_sets(cmd_buffer->device, stream, cmd))
+            stream_add_op(stream, LVP_CMD_OP_EXECUTE, cmd);
          break;
-      case VK_CMD_TRACE_RAYS_INDIRECT2_KHR:
-         handle_trace_rays_indirect2(cmd, state);
-         break;
-      case VK_CMD_TRACE_RAYS_INDIRECT_KHR:
-         handle_trace_rays_indirect(cmd, state);
-         break;
-      case VK_CMD_TRACE_RAYS_KHR:
-         handle_trace_rays(cmd, state);
+      case VK_CMD_DRAW_MULTI_EXT: {
+         struct pipe_draw_start_count_bias *draws =
+            ralloc_array(stream, struct pipe_draw_start_count_bias,
+                         MAX2(cmd->u.draw_multi_ext.draw_count, 1));
+         fill_draw_multi(cmd, draws);
+         stream_add_op(stream, LVP_CMD_OP_DRAW_MULTI, cmd)->draws = draws;
          break;
+      }
       default:
-         fprintf(stderr, "Unsupported command %s\n", vk_cmd_queue_type_names[cmd->type]);
-         unreachable("Unsupported command");
+         stream_add_op(stream, LVP_CMD_OP_EXECUTE, cmd);
          break;
       }
       did_flush = false;
-      if (!cmd->cmd_link.next)
+   }
+
+   cmd_buffer->stream = stream;
+}
+
+void
+lvp_cmd_buffer_free_stream(struct lvp_cmd_buffer *cmd_buffer)
+{
+   struct lvp_cmd_stream *stream = cmd_buffer->stream;
+   if (!stream)
+      return;
+
+   util_dynarray_foreach (&stream->sets, struct lvp_descriptor_set *, set)
+      lvp_descriptor_set_destroy(cmd_buffer->device, *set);
+
+   ralloc_free(stream);
+   cmd_buffer->stream = NULL;
+}
+
+static void lvp_execute_cmd_stream(const struct lvp_cmd_stream *stream,
+                                   struct rendering_state *state, bool print_cmds)
+{
+   util_dynarray_foreach (&stream->ops, struct lvp_cmd_op, op) {
+      if (op->cmd->type >= VK_CMD_TYPE_COUNT) {
+         execute_internal_cmd(op->cmd, state);
+         continue;
+      }
+
+      if (print_cmds)
+         fprintf(stderr, "%s\n", vk_cmd_queue_type_names[op->cmd->type]);
+      switch (op->type) {
+      case LVP_CMD_OP_EXECUTE:
+         execute_cmd(op->cmd, state, print_cmds);
+         break;
+      case LVP_CMD_OP_STALL:
+         finish_fence(state);
          break;
+      case LVP_CMD_OP_BIND_DESCRIPTOR_SETS:
+         handle_descriptor_sets(op->bind_sets, state);
+         break;
+      case LVP_CMD_OP_DRAW_MULTI:
+         emit_state(state);
+         draw_multi(op->cmd, op->draws, state);
+         break;
+      }
    }
 }
 
@@ -5354,7 +5576,10 @@ VkResult lvp_execute_cmds(struct lvp_device *device,
    state->index_buffer = state->device->zero_buffer;
 
    /* create a gallium context */
-   lvp_execute_cmd_buffer(&cmd_buffer->vk.cmd_queue.cmds, state, device->print_cmds);
+   if (cmd_buffer->stream)
+      lvp_execute_cmd_stream(cmd_buffer->stream, state, device->print_cmds);
+   else
+      lvp_execute_cmd_buffer(&cmd_buffer->vk.cmd_queue.cmds, state, device->print_cmds);
 
    state->start_vb = -1;
    state->num_vb = 0;
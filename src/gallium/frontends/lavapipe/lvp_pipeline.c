@@ -24,6 +24,7 @@
 #include "lvp_private.h"
 #include "vk_nir_convert_ycbcr.h"
 #include "vk_pipeline.h"
+#include "vk_pipeline_cache.h"
 #include "vk_render_pass.h"
 #include "vk_util.h"
 #include "glsl_types.h"
@@ -215,66 +216,109 @@ lvp_nir_fixup_indirect_tex(nir_shader *shader)
    return nir_shader_lower_instructions(shader, find_tex, fixup_tex_instr, NULL);
 }
 
+#define INSTRS nir_opt_changes_instrs
+#define DEAD nir_opt_changes_dead
+#define CF nir_opt_changes_cf
+#define VARS nir_opt_changes_vars
+#define ALL nir_opt_changes_all
+
 static void
 optimize(nir_shader *nir)
 {
-   bool progress = false;
-   do {
-      progress = false;
-
-      NIR_PASS(progress, nir, nir_lower_flrp, 32|64, true);
-      NIR_PASS(progress, nir, nir_split_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_shrink_vec_array_vars, nir_var_function_temp);
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_vars_to_ssa);
+   nir_opt_schedule sched;
+   nir_opt_schedule_init(&sched);
 
-      NIR_PASS(progress, nir, nir_opt_copy_prop_vars);
-
-      NIR_PASS(progress, nir, nir_copy_prop);
-      NIR_PASS(progress, nir, nir_opt_dce);
+   bool progress = false;
+   while (nir_opt_schedule_iterate(&sched)) {
+      NIR_SCHED_PASS(progress, &sched, INSTRS, INSTRS | DEAD,
+                     nir, nir_lower_flrp, 32|64, true);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | VARS | DEAD, VARS | INSTRS | DEAD,
+                     nir, nir_split_array_vars, nir_var_function_temp);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | VARS | DEAD, VARS | INSTRS | DEAD,
+                     nir, nir_shrink_vec_array_vars, nir_var_function_temp);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | VARS, VARS | INSTRS | DEAD,
+                     nir, nir_opt_deref);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | VARS | DEAD | CF, ALL,
+                     nir, nir_lower_vars_to_ssa);
+
+      NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, &sched, INSTRS | VARS | DEAD | CF,
+                                    VARS | INSTRS | DEAD,
+                                    nir, nir_opt_copy_prop_vars);
+
+      NIR_SCHED_PASS(progress, &sched, INSTRS | CF, INSTRS | DEAD,
+                     nir, nir_copy_prop);
+      NIR_SCHED_PASS(progress, &sched, DEAD, DEAD | CF,
+                     nir, nir_opt_dce);
 
       nir_opt_peephole_select_options peephole_select_options = {
          .limit = 8,
          .indirect_load_ok = true,
          .expensive_alu_ok = true,
       };
-      NIR_PASS(progress, nir, nir_opt_peephole_select, &peephole_select_options);
-
-      NIR_PASS(progress, nir, nir_opt_algebraic);
-      NIR_PASS(progress, nir, nir_opt_constant_folding);
-
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
+      NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, &sched, INSTRS | DEAD | CF,
+                                    INSTRS | DEAD | CF,
+                                    nir, nir_opt_peephole_select,
+                                    &peephole_select_options);
+
+      NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, &sched, INSTRS | DEAD, INSTRS | DEAD,
+                                    nir, nir_opt_algebraic);
+      NIR_SCHED_PASS(progress, &sched, INSTRS, INSTRS | VARS | DEAD,
+                     nir, nir_opt_constant_folding);
+
+      NIR_SCHED_PASS(progress, &sched, INSTRS | CF, INSTRS | DEAD | CF,
+                     nir, nir_opt_remove_phis);
       bool loop = false;
-      NIR_PASS(loop, nir, nir_opt_loop);
+      NIR_SCHED_PASS(loop, &sched, INSTRS | CF, ALL,
+                     nir, nir_opt_loop);
       progress |= loop;
       if (loop) {
          /* If nir_opt_loop makes progress, then we need to clean
           * things up if we want any hope of nir_opt_if or nir_opt_loop_unroll
           * to make progress.
           */
-         NIR_PASS(progress, nir, nir_copy_prop);
-         NIR_PASS(progress, nir, nir_opt_dce);
-         NIR_PASS(progress, nir, nir_opt_remove_phis);
+         NIR_SCHED_PASS(progress, &sched, INSTRS | CF, INSTRS | DEAD,
+                        nir, nir_copy_prop);
+         NIR_SCHED_PASS(progress, &sched, DEAD, DEAD | CF,
+                        nir, nir_opt_dce);
+         NIR_SCHED_PASS(progress, &sched, INSTRS | CF, INSTRS | DEAD | CF,
+                        nir, nir_opt_remove_phis);
       }
-      NIR_PASS(progress, nir, nir_opt_if, nir_opt_if_optimize_phi_true_false);
-      NIR_PASS(progress, nir, nir_opt_dead_cf);
+      NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, &sched, INSTRS | CF, ALL,
+                                    nir, nir_opt_if,
+                                    nir_opt_if_optimize_phi_true_false);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | DEAD | CF, ALL,
+                     nir, nir_opt_dead_cf);
 
       nir_opt_peephole_select_options peephole_discard_options = {
          .limit = 0,
          .discard_ok = true,
       };
-      NIR_PASS(progress, nir, nir_opt_peephole_select, &peephole_discard_options);
-      NIR_PASS(progress, nir, nir_opt_remove_phis);
-      NIR_PASS(progress, nir, nir_opt_cse);
-      NIR_PASS(progress, nir, nir_opt_undef);
-
-      NIR_PASS(progress, nir, nir_opt_deref);
-      NIR_PASS(progress, nir, nir_lower_alu_to_scalar, NULL, NULL);
-      NIR_PASS(progress, nir, nir_opt_loop_unroll);
-      NIR_PASS(progress, nir, lvp_nir_fixup_indirect_tex);
-   } while (progress);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | DEAD | CF, INSTRS | DEAD | CF,
+                     nir, nir_opt_peephole_select, &peephole_discard_options);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | CF, INSTRS | DEAD | CF,
+                     nir, nir_opt_remove_phis);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | CF, INSTRS | DEAD,
+                     nir, nir_opt_cse);
+      NIR_SCHED_PASS(progress, &sched, INSTRS | CF, INSTRS | DEAD,
+                     nir, nir_opt_undef);
+
+      NIR_SCHED_PASS(progress, &sched, INSTRS | VARS, VARS | INSTRS | DEAD,
+                     nir, nir_opt_deref);
+      NIR_SCHED_PASS(progress, &sched, INSTRS, INSTRS | DEAD,
+                     nir, nir_lower_alu_to_scalar, NULL, NULL);
+      NIR_SCHED_PASS_NOT_IDEMPOTENT(progress, &sched, INSTRS | CF, ALL,
+                                    nir, nir_opt_loop_unroll);
+      NIR_SCHED_PASS(progress, &sched, INSTRS, INSTRS | DEAD,
+                     nir, lvp_nir_fixup_indirect_tex);
+   }
 }
 
+#undef INSTRS
+#undef DEAD
+#undef CF
+#undef VARS
+#undef ALL
+
 void
 lvp_shader_optimize(nir_shader *nir)
 {
@@ -493,14 +537,77 @@ lvp_shader_init(struct lvp_shader *shader, nir_shader *nir)
    shader->pipeline_nir = lvp_create_pipeline_nir(nir);
 }
 
+/* Key of the lowered NIR of a stage in the pipeline cache: everything
+ * lvp_spirv_to_nir() depends on besides the device.
+ */
+static void
+lvp_hash_shader_stage(struct lvp_pipeline *pipeline, const void *pipeline_pNext,
+                      const VkPipelineShaderStageCreateInfo *sinfo,
+                      unsigned char sha1[SHA1_DIGEST_LENGTH])
+{
+   struct vk_pipeline_robustness_state robustness;
+   vk_pipeline_robustness_state_fill(&pipeline->device->vk, &robustness, pipeline_pNext, sinfo->pNext);
+
+   unsigned char stage_sha1[SHA1_DIGEST_LENGTH];
+   vk_pipeline_hash_shader_stage(pipeline->flags, sinfo, &robustness, stage_sha1);
+
+   struct mesa_sha1 ctx;
+   _mesa_sha1_init(&ctx);
+   _mesa_sha1_update(&ctx, stage_sha1, sizeof(stage_sha1));
+   _mesa_sha1_update(&ctx, &pipeline->type, sizeof(pipeline->type));
+
+   const bool debug_info = gallivm_debug & GALLIVM_DEBUG_SYMBOLS;
+   _mesa_sha1_update(&ctx, &debug_info, sizeof(debug_info));
+
+#ifdef VK_ENABLE_BETA_EXTENSIONS
+   const VkPipelineShaderStageNodeCreateInfoAMDX *node_info = vk_find_struct_const(
+      sinfo->pNext, PIPELINE_SHADER_STAGE_NODE_CREATE_INFO_AMDX);
+   const uint32_t node_index = node_info ? node_info->index : 0;
+   _mesa_sha1_update(&ctx, &node_index, sizeof(node_index));
+#endif
+
+   /* The descriptor offsets and ycbcr conversions of the layout are baked
+    * into the lowered shader.
+    */
+   const struct lvp_pipeline_layout *layout = pipeline->layout;
+   _mesa_sha1_update(&ctx, &layout->vk.set_count, sizeof(layout->vk.set_count));
+   for (uint32_t i = 0; i < layout->vk.set_count; i++) {
+      static const blake3_hash no_set;
+      const struct vk_descriptor_set_layout *set_layout = layout->vk.set_layouts[i];
+      _mesa_sha1_update(&ctx, set_layout ? set_layout->blake3 : no_set, sizeof(blake3_hash));
+   }
+   _mesa_sha1_update(&ctx, &layout->push_constant_size, sizeof(layout->push_constant_size));
+
+   _mesa_sha1_final(&ctx, sha1);
+}
+
 static VkResult
-lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline, const void *pipeline_pNext,
+lvp_shader_compile_to_ir(struct lvp_pipeline *pipeline, struct vk_pipeline_cache *cache,
+                         const void *pipeline_pNext,
                          const VkPipelineShaderStageCreateInfo *sinfo)
 {
    gl_shader_stage stage = vk_to_mesa_shader_stage(sinfo->stage);
    assert(stage <= LVP_SHADER_STAGES && stage != MESA_SHADER_NONE);
-   nir_shader *nir;
-   VkResult result = lvp_spirv_to_nir(pipeline, pipeline_pNext, sinfo, &nir);
+   nir_shader *nir = NULL;
+   VkResult result = VK_SUCCESS;
+
+   /* Only the NIR is cached here, llvmpipe's own shader cache supplies the
+    * JIT code for it.
+    */
+   unsigned char sha1[SHA1_DIGEST_LENGTH];
+   if (cache) {
+      lvp_hash_shader_stage(pipeline, pipeline_pNext, sinfo, sha1);
+      nir = vk_pipeline_cache_lookup_nir(cache, sha1, sizeof(sha1),
+                                         pipeline->device->physical_device->drv_options[stage],
+                                         NULL, NULL);
+   }
+
+   if (!nir) {
+      result = lvp_spirv_to_nir(pipeline, pipeline_pNext, sinfo, &nir);
+      if (result == VK_SUCCESS && cache)
+         vk_pipeline_cache_add_nir(cache, sha1, sizeof(sha1), nir);
+   }
+
    if (result == VK_SUCCESS) {
       struct lvp_shader *shader = &pipeline->shaders[stage];
       lvp_shader_init(shader, nir);
@@ -765,7 +872,7 @@ copy_shader_sanitized(struct lvp_shader *dst, const struct lvp_shader *src)
 static VkResult
 lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
                            struct lvp_device *device,
-                           struct lvp_pipeline_cache *cache,
+                           struct vk_pipeline_cache *cache,
                            const VkGraphicsPipelineCreateInfo *pCreateInfo,
                            VkPipelineCreateFlagBits2KHR flags)
 {
@@ -863,7 +970,7 @@ lvp_graphics_pipeline_init(struct lvp_pipeline *pipeline,
          if (!(pipeline->stages & VK_GRAPHICS_PIPELINE_LIBRARY_PRE_RASTERIZATION_SHADERS_BIT_EXT))
             continue;
       }
-      result = lvp_shader_compile_to_ir(pipeline, pCreateInfo->pNext, sinfo);
+      result = lvp_shader_compile_to_ir(pipeline, cache, pCreateInfo->pNext, sinfo);
       if (result != VK_SUCCESS)
          goto fail;
 
@@ -962,7 +1069,7 @@ lvp_graphics_pipeline_create(
    bool group)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -1034,7 +1141,7 @@ VKAPI_ATTR VkResult VKAPI_CALL lvp_CreateGraphicsPipelines(
 static VkResult
 lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
                           struct lvp_device *device,
-                          struct lvp_pipeline_cache *cache,
+                          struct vk_pipeline_cache *cache,
                           const VkComputePipelineCreateInfo *pCreateInfo,
                           VkPipelineCreateFlagBits2KHR flags)
 {
@@ -1046,7 +1153,7 @@ lvp_compute_pipeline_init(struct lvp_pipeline *pipeline,
 
    pipeline->type = LVP_PIPELINE_COMPUTE;
 
-   VkResult result = lvp_shader_compile_to_ir(pipeline, pCreateInfo->pNext, &pCreateInfo->stage);
+   VkResult result = lvp_shader_compile_to_ir(pipeline, cache, pCreateInfo->pNext, &pCreateInfo->stage);
    if (result != VK_SUCCESS)
       return result;
 
@@ -1067,7 +1174,7 @@ lvp_compute_pipeline_create(
    VkPipeline *pPipeline)
 {
    LVP_FROM_HANDLE(lvp_device, device, _device);
-   LVP_FROM_HANDLE(lvp_pipeline_cache, cache, _cache);
+   VK_FROM_HANDLE(vk_pipeline_cache, cache, _cache);
    struct lvp_pipeline *pipeline;
    VkResult result;
 
@@ -109,6 +109,9 @@ extern "C" {
 /* Currently lavapipe does not support more than 1 image plane */
 #define LVP_MAX_PLANE_COUNT 1
 
+/* Queues of the compute/transfer-only family, each with its own context. */
+#define LVP_MAX_COMPUTE_QUEUES 4
+
 #ifdef _WIN32
 #define lvp_printflike(a, b)
 #else
@@ -198,16 +201,15 @@ struct lvp_queue {
    simple_mtx_t lock;
 };
 
-struct lvp_pipeline_cache {
-   struct vk_object_base                        base;
-   struct lvp_device *                          device;
-   VkAllocationCallbacks                        alloc;
-};
-
 struct lvp_device {
    struct vk_device vk;
 
+   /* The graphics queue, its context also creates the device's shaders
+    * and handles.
+    */
    struct lvp_queue queue;
+   struct lvp_queue compute_queues[LVP_MAX_COMPUTE_QUEUES];
+   uint32_t num_compute_queues;
    struct lvp_instance *                       instance;
    struct lvp_physical_device *physical_device;
    struct pipe_screen *pscreen;
@@ -226,9 +228,13 @@ struct lvp_device {
    uint32_t group_handle_alloc;
 
    struct vk_meta_device meta;
-   radix_sort_vk_t *radix_sort;
-   simple_mtx_t radix_sort_lock;
-   struct vk_acceleration_structure_build_args accel_struct_args;
+
+   /* Runs the subtrees of large acceleration structure builds, created on
+    * first use.
+    */
+   struct util_queue bvh_queue;
+   simple_mtx_t bvh_queue_lock;
+   unsigned bvh_thread_count;
 };
 
 void lvp_device_get_cache_uuid(void *uuid);
@@ -608,12 +614,21 @@ struct lvp_query_pool {
    struct pipe_query *queries[0];
 };
 
+struct lvp_cmd_stream;
+
 struct lvp_cmd_buffer {
    struct vk_command_buffer vk;
 
    struct lvp_device *                          device;
 
    uint8_t push_constants[MAX_PUSH_CONSTANTS_SIZE];
+
+   VkCommandBufferUsageFlags usage_flags;
+
+   /* Pre-resolved commands replayed on submit, built at vkEndCommandBuffer
+    * unless the command buffer is one-time-submit.
+    */
+   struct lvp_cmd_stream *stream;
 };
 
 struct lvp_indirect_command_layout_nv {
@@ -692,8 +707,6 @@ VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_event, base, VkEvent, VK_OBJECT_TYPE_EVENT)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image, vk.base, VkImage, VK_OBJECT_TYPE_IMAGE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_image_view, vk.base, VkImageView,
                                VK_OBJECT_TYPE_IMAGE_VIEW);
-VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline_cache, base, VkPipelineCache,
-                               VK_OBJECT_TYPE_PIPELINE_CACHE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_pipeline, base, VkPipeline,
                                VK_OBJECT_TYPE_PIPELINE)
 VK_DEFINE_NONDISP_HANDLE_CASTS(lvp_shader, base, VkShaderEXT,
@@ -726,6 +739,10 @@ VkResult lvp_image_bind_sparse(struct lvp_device *device,
 VkResult lvp_execute_cmds(struct lvp_device *device,
                           struct lvp_queue *queue,
                           struct lvp_cmd_buffer *cmd_buffer);
+void
+lvp_cmd_buffer_compile(struct lvp_cmd_buffer *cmd_buffer);
+void
+lvp_cmd_buffer_free_stream(struct lvp_cmd_buffer *cmd_buffer);
 size_t
 lvp_get_rendering_state_size(void);
 struct lvp_image *lvp_swapchain_get_image(VkSwapchainKHR swapchain,
@@ -820,38 +837,13 @@ lvp_ext_dgc_token_to_cmd_type(const struct lvp_indirect_command_layout_ext *elay
 size_t
 lvp_ext_dgc_token_size(const struct lvp_indirect_command_layout_ext *elayout, const VkIndirectCommandsLayoutTokenEXT *token);
 
-struct lvp_cmd_write_buffer_cp {
-   VkDeviceAddress addr;
-   void *data;
-   uint32_t size;
-};
-
-struct lvp_cmd_fill_buffer_addr {
-   VkDeviceAddress addr;
-   VkDeviceSize size;
-   uint32_t data;
-};
-
-void
-lvp_encode_as(struct vk_acceleration_structure *dst, VkDeviceAddress intermediate_as_addr,
-              VkDeviceAddress intermediate_header_addr, uint32_t leaf_count,
-              VkGeometryTypeKHR geometry_type);
-
-struct lvp_cmd_encode_as {
-   struct vk_acceleration_structure *dst;
-   VkDeviceAddress intermediate_as_addr;
-   VkDeviceAddress intermediate_header_addr;
-   uint32_t leaf_count;
-   VkGeometryTypeKHR geometry_type;
+struct lvp_cmd_build_as {
+   VkAccelerationStructureBuildGeometryInfoKHR info;
+   VkAccelerationStructureBuildRangeInfoKHR *ranges;
 };
 
 enum {
-   LVP_CMD_WRITE_BUFFER_CP = VK_CMD_TYPE_COUNT,
-   LVP_CMD_DISPATCH_UNALIGNED,
-   LVP_CMD_FILL_BUFFER_ADDR,
-   LVP_CMD_ENCODE_AS,
-   LVP_CMD_SAVE_STATE,
-   LVP_CMD_RESTORE_STATE,
+   LVP_CMD_BUILD_AS = VK_CMD_TYPE_COUNT,
 };
 
 #ifdef __cplusplus
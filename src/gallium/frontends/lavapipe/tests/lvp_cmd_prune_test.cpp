@@ -0,0 +1,112 @@
+/*
+ * Copyright 2025 Mesa contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "lvp_cmd_prune.h"
+#include "vk_alloc.h"
+
+class lvp_cmd_prune_test : public ::testing::Test {
+protected:
+   lvp_cmd_prune_test()
+   {
+      vk_cmd_queue_init(&queue, (VkAllocationCallbacks *)vk_default_allocator());
+   }
+
+   ~lvp_cmd_prune_test()
+   {
+      vk_cmd_queue_finish(&queue);
+   }
+
+   std::vector<enum vk_cmd_type> types()
+   {
+      std::vector<enum vk_cmd_type> types;
+      list_for_each_entry(struct vk_cmd_queue_entry, cmd, &queue.cmds, cmd_link)
+         types.push_back(cmd->type);
+      return types;
+   }
+
+   void draw()
+   {
+      vk_enqueue_cmd_draw(&queue, 3, 1, 0, 0);
+   }
+
+   struct vk_cmd_queue queue;
+};
+
+TEST_F(lvp_cmd_prune_test, repeated_setters)
+{
+   const VkViewport viewport = { 0, 0, 64, 64, 0, 1 };
+   const VkViewport other = { 0, 0, 32, 32, 0, 1 };
+
+   vk_enqueue_cmd_set_viewport(&queue, 0, 1, &viewport);
+   vk_enqueue_cmd_set_line_width(&queue, 1.0f);
+   draw();
+   vk_enqueue_cmd_set_viewport(&queue, 0, 1, &viewport);
+   vk_enqueue_cmd_set_line_width(&queue, 1.0f);
+   draw();
+   vk_enqueue_cmd_set_viewport(&queue, 0, 1, &other);
+   draw();
+
+   lvp_cmd_queue_prune_state(&queue);
+
+   const std::vector<enum vk_cmd_type> expected = {
+      VK_CMD_SET_VIEWPORT,
+      VK_CMD_SET_LINE_WIDTH,
+      VK_CMD_DRAW,
+      VK_CMD_DRAW,
+      VK_CMD_SET_VIEWPORT,
+      VK_CMD_DRAW,
+   };
+   EXPECT_EQ(types(), expected);
+
+   const struct vk_cmd_queue_entry *last =
+      list_last_entry(&queue.cmds, struct vk_cmd_queue_entry, cmd_link);
+   last = list_entry(last->cmd_link.prev, struct vk_cmd_queue_entry, cmd_link);
+   EXPECT_EQ(last->u.set_viewport.viewports[0].width, 32.0f);
+}
+
+TEST_F(lvp_cmd_prune_test, pipeline_bind_resets)
+{
+   vk_enqueue_cmd_set_line_width(&queue, 1.0f);
+   draw();
+   vk_enqueue_cmd_bind_pipeline(&queue, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                VK_NULL_HANDLE);
+   vk_enqueue_cmd_set_line_width(&queue, 1.0f);
+   draw();
+
+   lvp_cmd_queue_prune_state(&queue);
+
+   const std::vector<enum vk_cmd_type> expected = {
+      VK_CMD_SET_LINE_WIDTH,
+      VK_CMD_DRAW,
+      VK_CMD_BIND_PIPELINE,
+      VK_CMD_SET_LINE_WIDTH,
+      VK_CMD_DRAW,
+   };
+   EXPECT_EQ(types(), expected);
+}
+
+TEST_F(lvp_cmd_prune_test, stencil_faces)
+{
+   vk_enqueue_cmd_set_stencil_reference(&queue, VK_STENCIL_FACE_FRONT_BIT, 1);
+   vk_enqueue_cmd_set_stencil_reference(&queue, VK_STENCIL_FACE_BACK_BIT, 1);
+   draw();
+   vk_enqueue_cmd_set_stencil_reference(&queue, VK_STENCIL_FACE_BACK_BIT, 1);
+   draw();
+
+   lvp_cmd_queue_prune_state(&queue);
+
+   /* Only the last setter repeats its predecessor exactly. */
+   const std::vector<enum vk_cmd_type> expected = {
+      VK_CMD_SET_STENCIL_REFERENCE,
+      VK_CMD_SET_STENCIL_REFERENCE,
+      VK_CMD_DRAW,
+      VK_CMD_DRAW,
+   };
+   EXPECT_EQ(types(), expected);
+}
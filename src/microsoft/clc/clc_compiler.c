@@ -32,6 +32,8 @@
 #include "../compiler/dxil_nir_lower_int_samplers.h"
 #include "../compiler/nir_to_dxil.h"
 
+#include "util/set.h"
+#include "util/simple_mtx.h"
 #include "util/u_debug.h"
 #include "util/u_printf.h"
 #include <util/u_math.h>
@@ -607,6 +609,15 @@ static bool shader_has_double(nir_shader *nir)
 
 struct clc_libclc {
    const nir_shader *libclc_nir;
+
+   /* For deserialized libraries, the serialized data and the shader whose
+    * function impls are read from it as kernels start calling them.  The
+    * lock serializes loading impls and linking them into kernels.
+    */
+   const void *serialized;
+   size_t serialized_size;
+   nir_lazy_shader *lazy;
+   simple_mtx_t lock;
 };
 
 struct clc_libclc *
@@ -656,6 +667,8 @@ clc_libclc_new(const struct clc_logger *logger, const struct clc_libclc_options
 
 void clc_free_libclc(struct clc_libclc *ctx)
 {
+   if (ctx->lazy)
+      simple_mtx_destroy(&ctx->lock);
    ralloc_free(ctx);
    glsl_type_singleton_decref();
 }
@@ -671,7 +684,14 @@ void clc_libclc_serialize(struct clc_libclc *context,
 {
    struct blob tmp;
    blob_init(&tmp);
-   nir_serialize(&tmp, context->libclc_nir, true);
+
+   /* The impls of a deserialized library may not all be loaded yet, so hand
+    * back the data it was created from.
+    */
+   if (context->lazy)
+      blob_write_bytes(&tmp, context->serialized, context->serialized_size);
+   else
+      nir_serialize(&tmp, context->libclc_nir, true);
 
    blob_finish_get_buffer(&tmp, serialized, serialized_size);
 }
@@ -691,21 +711,47 @@ clc_libclc_deserialize(const void *serialized, size_t serialized_size)
 
    glsl_type_singleton_init_or_ref();
 
-   struct blob_reader tmp;
-   blob_reader_init(&tmp, serialized, serialized_size);
-
-   nir_shader *s = nir_deserialize(NULL, NULL, &tmp);
-   if (!s) {
+   /* Kernels only call a handful of the library functions, so only read
+    * the impls they need, see clc_libclc_load_functions().
+    */
+   ctx->serialized = ralloc_memdup(ctx, serialized, serialized_size);
+   ctx->serialized_size = serialized_size;
+   ctx->lazy = nir_deserialize_lazy(ctx, NULL, ctx->serialized,
+                                    ctx->serialized_size);
+   if (!ctx->lazy) {
       ralloc_free(ctx);
+      glsl_type_singleton_decref();
       return NULL;
    }
 
-   ralloc_steal(ctx, s);
-   ctx->libclc_nir = s;
+   simple_mtx_init(&ctx->lock, mtx_plain);
+   ctx->libclc_nir = nir_lazy_shader_get_shader(ctx->lazy);
 
    return ctx;
 }
 
+static bool
+is_called_function(const nir_function *fxn, void *data)
+{
+   return _mesa_set_search(data, fxn->name) != NULL;
+}
+
+/* Reads the impls of the library functions which nir calls. */
+static void
+clc_libclc_load_functions(struct clc_libclc *lib, const nir_shader *nir)
+{
+   struct set *names = _mesa_set_create(NULL, _mesa_hash_string,
+                                        _mesa_key_string_equal);
+   nir_foreach_function(fxn, nir) {
+      if (!fxn->impl && fxn->name)
+         _mesa_set_add(names, fxn->name);
+   }
+
+   nir_lazy_shader_load_functions(lib->lazy, is_called_function, names);
+
+   _mesa_set_destroy(names, NULL);
+}
+
 struct clc_libclc *
 clc_libclc_new_dxil(const struct clc_logger *logger,
                     const struct clc_libclc_dxil_options *options)
@@ -830,7 +876,14 @@ clc_spirv_to_dxil(struct clc_libclc *lib,
    // according to the comment on nir_inline_functions
    NIR_PASS_V(nir, nir_lower_variable_initializers, nir_var_function_temp);
    NIR_PASS_V(nir, nir_lower_returns);
-   NIR_PASS_V(nir, nir_link_shader_functions, clc_libclc_get_clc_shader(lib));
+   if (lib->lazy) {
+      simple_mtx_lock(&lib->lock);
+      clc_libclc_load_functions(lib, nir);
+      NIR_PASS_V(nir, nir_link_shader_functions, clc_libclc_get_clc_shader(lib));
+      simple_mtx_unlock(&lib->lock);
+   } else {
+      NIR_PASS_V(nir, nir_link_shader_functions, clc_libclc_get_clc_shader(lib));
+   }
    NIR_PASS_V(nir, nir_inline_functions);
 
    // Pick off the single entrypoint that we want.
@@ -942,6 +942,13 @@ gc_mark_live(gc_ctx *ctx, const void *mem)
       ralloc_steal(ctx, header);
 }
 
+static int
+gc_slab_compare_num_free(const void *a, const void *b)
+{
+   const gc_slab *sa = *(const gc_slab **)a, *sb = *(const gc_slab **)b;
+   return (int)sa->num_free - (int)sb->num_free;
+}
+
 void
 gc_sweep_end(gc_ctx *ctx)
 {
@@ -949,34 +956,88 @@ gc_sweep_end(gc_ctx *ctx)
 
    for (unsigned i = 0; i < NUM_FREELIST_BUCKETS; i++) {
       unsigned obj_size = gc_bucket_obj_size(i);
+      unsigned num_objs = gc_bucket_num_objs(i);
+      unsigned num_partial = 0;
+
+      /* Every slab is walked anyway, so rebuild the freelists from scratch
+       * rather than freeing dead objects one at a time, which would resort
+       * the free slabs for each of them.
+       */
+      list_for_each_entry_safe(gc_slab, slab, &ctx->slabs[i].free_slabs, free_link)
+         list_del(&slab->free_link);
+
       list_for_each_entry_safe(gc_slab, slab, &ctx->slabs[i].slabs, link) {
-         if (!slab->num_allocated) {
-            free_slab(slab);
-            continue;
-         }
+         gc_block_header *freelist = NULL, *prev = NULL, *last_before_live = NULL;
+         char *end = (char *)(slab + 1);
+         unsigned num_live = 0;
 
-         for (char *ptr = (char*)(slab + 1); ptr != slab->next_available; ptr += obj_size) {
+         for (char *ptr = (char *)(slab + 1); ptr != slab->next_available; ptr += obj_size) {
             gc_block_header *header = (gc_block_header *)ptr;
-            if (!(header->flags & IS_USED))
-               continue;
-            if ((header->flags & CURRENT_GENERATION) == ctx->current_gen)
+            if ((header->flags & IS_USED) &&
+                (header->flags & CURRENT_GENERATION) == ctx->current_gen) {
+               num_live++;
+               end = ptr + obj_size;
+               last_before_live = prev;
                continue;
+            }
 
-            bool last = slab->num_allocated == 1;
-
+            /* Chain free objects in address order, so that new objects are
+             * allocated close to each other.
+             */
             header->flags &= ~IS_USED;
-            free_from_slab(header, false);
+            if (prev)
+               set_gc_freelist_next(prev, header);
+            else
+               freelist = header;
+            prev = header;
+         }
 
-            if (last)
-               break;
+         if (!num_live) {
+            list_del(&slab->link);
+            ralloc_free(slab);
+            continue;
          }
+
+         /* Free objects past the last live one go back to the linear
+          * allocator instead.
+          */
+         if (last_before_live)
+            set_gc_freelist_next(last_before_live, NULL);
+         else
+            freelist = NULL;
+
+         slab->freelist = freelist;
+         slab->next_available = end;
+         slab->num_allocated = num_live;
+         slab->num_free = num_objs - num_live;
+         if (slab->num_free)
+            num_partial++;
+
+         ralloc_steal(ctx, slab);
       }
-   }
 
-   for (unsigned i = 0; i < NUM_FREELIST_BUCKETS; i++) {
+      if (!num_partial)
+         continue;
+
+      /* Keep the free slabs sorted by the number of free objects, see
+       * free_from_slab().
+       */
+      gc_slab **partial = malloc(num_partial * sizeof(*partial));
+      unsigned n = 0;
       list_for_each_entry(gc_slab, slab, &ctx->slabs[i].slabs, link) {
-         assert(slab->num_allocated > 0); /* free_from_slab() should free it otherwise */
-         ralloc_steal(ctx, slab);
+         if (!slab->num_free)
+            continue;
+         if (likely(partial))
+            partial[n++] = slab;
+         else
+            list_addtail(&slab->free_link, &ctx->slabs[i].free_slabs);
+      }
+
+      if (likely(partial)) {
+         qsort(partial, n, sizeof(*partial), gc_slab_compare_num_free);
+         for (unsigned j = 0; j < n; j++)
+            list_addtail(&partial[j]->free_link, &ctx->slabs[i].free_slabs);
+         free(partial);
       }
    }
 
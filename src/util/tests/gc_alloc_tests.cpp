@@ -23,6 +23,8 @@
  */
 
 #include <gtest/gtest.h>
+#include "util/macros.h"
+#include "util/os_time.h"
 #include "util/ralloc.h"
 
 #if defined(__LP64__) || defined(_WIN64)
@@ -46,3 +48,86 @@ TEST(gc_alloc, align)
       }
    }
 }
+
+TEST(gc_alloc, sweep)
+{
+   gc_ctx *ctx = gc_context(NULL);
+   uint32_t *objs[256];
+
+   for (unsigned i = 0; i < ARRAY_SIZE(objs); i++) {
+      objs[i] = (uint32_t *)gc_alloc_size(ctx, 64, 8);
+      *objs[i] = i;
+   }
+
+   /* Keep every other object. */
+   gc_sweep_start(ctx);
+   for (unsigned i = 0; i < ARRAY_SIZE(objs); i += 2)
+      gc_mark_live(ctx, objs[i]);
+   gc_sweep_end(ctx);
+
+   for (unsigned i = 0; i < ARRAY_SIZE(objs); i += 2)
+      EXPECT_EQ(*objs[i], i);
+
+   /* The dead objects are reused, lowest addresses first. */
+   uintptr_t last = 0;
+   for (unsigned i = 1; i < ARRAY_SIZE(objs); i += 2) {
+      uint32_t *obj = (uint32_t *)gc_alloc_size(ctx, 64, 8);
+      EXPECT_GT((uintptr_t)obj, last);
+      last = (uintptr_t)obj;
+
+      bool reused = false;
+      for (unsigned j = 1; j < ARRAY_SIZE(objs); j += 2)
+         reused |= obj == objs[j];
+      EXPECT_TRUE(reused);
+   }
+
+   ralloc_free(ctx);
+}
+
+/* Not a test: times sweeping a large heap, the way nir_sweep() uses it.
+ * Run with --gtest_also_run_disabled_tests --gtest_filter=*sweep_benchmark.
+ */
+TEST(gc_alloc, DISABLED_sweep_benchmark)
+{
+   const unsigned num_objs = 1000000, num_rounds = 10;
+   gc_ctx *ctx = gc_context(NULL);
+   void **objs = (void **)malloc(num_objs * sizeof(*objs));
+   ASSERT_NE(objs, nullptr);
+
+   for (unsigned i = 0; i < num_objs; i++)
+      objs[i] = gc_alloc_size(ctx, 72 + (i % 3) * 32, 8);
+
+   /* Each round drops about a quarter of the objects and replaces them. */
+   uint32_t seed = 1;
+   int64_t mark_ns = 0, sweep_ns = 0, alloc_ns = 0;
+   for (unsigned r = 0; r < num_rounds; r++) {
+      int64_t t0 = os_time_get_nano();
+      gc_sweep_start(ctx);
+      for (unsigned i = 0; i < num_objs; i++) {
+         seed = seed * 1103515245u + 12345u;
+         if ((seed >> 16) & 3)
+            gc_mark_live(ctx, objs[i]);
+         else
+            objs[i] = NULL;
+      }
+      int64_t t1 = os_time_get_nano();
+      gc_sweep_end(ctx);
+      int64_t t2 = os_time_get_nano();
+      for (unsigned i = 0; i < num_objs; i++) {
+         if (!objs[i])
+            objs[i] = gc_alloc_size(ctx, 72 + (i % 3) * 32, 8);
+      }
+      int64_t t3 = os_time_get_nano();
+
+      mark_ns += t1 - t0;
+      sweep_ns += t2 - t1;
+      alloc_ns += t3 - t2;
+   }
+
+   printf("%u rounds over %u objects: mark %.1f ms, gc_sweep_end %.1f ms, "
+          "realloc %.1f ms\n", num_rounds, num_objs,
+          mark_ns / 1e6, sweep_ns / 1e6, alloc_ns / 1e6);
+
+   free(objs);
+   ralloc_free(ctx);
+}